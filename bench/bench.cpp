@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sched.h>
+
+#include "bench.h"
+
+static uint64_t timeBody(const function<void(uint64_t)>& body, uint64_t ops) {
+    auto start = std::chrono::steady_clock::now();
+    body(ops);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+BenchRunner::BenchRunner(const string& filter, unsigned int samples) {
+    this->filter = filter;
+    this->samples = samples ? samples : 1;
+    cpu = -1;
+}
+
+bool BenchRunner::pin(int cpu) {
+    if (cpu < 0)
+        cpu = sched_getcpu();
+    if (cpu < 0)
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        return false;
+    this->cpu = cpu;
+    return true;
+}
+
+int BenchRunner::pinnedCPU() const {
+    return cpu;
+}
+
+bool BenchRunner::wanted(const string& name) const {
+    return filter.empty() || name.find(filter) != string::npos;
+}
+
+void BenchRunner::run(const string& name, const function<void(uint64_t ops)>& body) {
+    if (!wanted(name))
+        return;
+
+    // Grow the batch until a sample is long enough that the clock's resolution doesn't matter
+    uint64_t ops = 1;
+    uint64_t ns = timeBody(body, ops);
+    while (ns < BENCH_SAMPLE_NS / 4) {
+        ops = ns ? std::max(ops * 2, ops * BENCH_SAMPLE_NS / ns) : ops * 16;
+        ns = timeBody(body, ops);
+    }
+
+    for (int i = 0; i < BENCH_WARMUP_SAMPLES; i++)
+        timeBody(body, ops);
+    vector<double> perOp;
+    for (unsigned int i = 0; i < samples; i++)
+        perOp.push_back((double) timeBody(body, ops) / ops);
+    std::sort(perOp.begin(), perOp.end());
+
+    BenchResult result;
+    result.name = name;
+    result.median = perOp[perOp.size() / 2];
+    result.p99 = perOp[(size_t) (0.99 * (perOp.size() - 1))];
+    result.samples = samples;
+    result.opsPerSample = ops;
+    done.push_back(result);
+
+    std::cout << std::left << std::setw(36) << name << std::right << std::fixed << std::setprecision(1)
+              << " median " << std::setw(12) << result.median << " ns  p99 " << std::setw(12) << result.p99 << " ns"
+              << std::endl;
+}
+
+const vector<BenchResult>& BenchRunner::results() const {
+    return done;
+}
+
+bool BenchRunner::writeJSON(const char* path) const {
+    std::ofstream file;
+    bool toStdout = string(path) == "-";
+    if (!toStdout) {
+        file.open(path);
+        if (!file.is_open())
+            return false;
+    }
+    std::ostream& out = toStdout ? std::cout : file;
+
+    // One benchmark per line keeps the file easy to diff and to read back in compare()
+    out << "{" << std::endl << "  \"cpu\": " << cpu << "," << std::endl << "  \"benchmarks\": [" << std::endl;
+    out << std::setprecision(2) << std::fixed;
+    for (size_t i = 0; i < done.size(); i++) {
+        const BenchResult& result = done[i];
+        out << "    {\"name\": \"" << result.name << "\", \"median_ns\": " << result.median << ", \"p99_ns\": "
+            << result.p99 << ", \"samples\": " << result.samples << ", \"ops_per_sample\": " << result.opsPerSample
+            << "}" << (i + 1 < done.size() ? "," : "") << std::endl;
+    }
+    out << "  ]" << std::endl << "}" << std::endl;
+    return out.good();
+}
+
+bool BenchRunner::compare(const char* baselinePath) const {
+    map<string, double> baseline = readMedians(baselinePath);
+    if (baseline.empty())
+        return false;
+
+    std::cout << std::endl << "Against " << baselinePath << " (median, negative is faster):" << std::endl;
+    for (const BenchResult& result : done) {
+        auto before = baseline.find(result.name);
+        if (before == baseline.end() || before->second <= 0.0)
+            continue;
+        double change = (result.median - before->second) / before->second * 100.0;
+        std::cout << std::left << std::setw(36) << result.name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << before->second << " -> " << std::setw(12) << result.median << " ns "
+                  << std::showpos << std::setw(7) << change << std::noshowpos << "%" << std::endl;
+    }
+    return true;
+}
+
+map<string, double> BenchRunner::readMedians(const char* path) {
+    map<string, double> medians;
+    std::ifstream file(path);
+    string line;
+    while (std::getline(file, line)) {
+        size_t name = line.find("\"name\": \"");
+        size_t median = line.find("\"median_ns\": ");
+        if (name == string::npos || median == string::npos)
+            continue;
+        name += 9;
+        size_t nameEnd = line.find('"', name);
+        medians[line.substr(name, nameEnd - name)] = std::stod(line.substr(median + 13));
+    }
+    return medians;
+}
@@ -0,0 +1,55 @@
+/*
+ * Small harness for repeatable microbenchmarks. Each benchmark is a body that performs a given
+ * number of operations; the runner grows that number until one sample takes long enough to time
+ * reliably, runs warmup samples, then records the time per operation of every sample and reports
+ * the median and 99th percentile. The process can be pinned to one CPU so samples aren't spread
+ * over cores with different clocks and caches.
+ *
+ * Results can be written as JSON, one benchmark per line, and a previous run's JSON given as a
+ * baseline prints the change for every benchmark both runs have.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+#define BENCH_SAMPLE_NS 2000000                         // Aim for samples of about 2ms
+#define BENCH_WARMUP_SAMPLES 3
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+using std::function;
+using std::map;
+using std::string;
+using std::vector;
+
+struct BenchResult {
+    string name;
+    double median;                                      // Nanoseconds per operation
+    double p99;
+    uint64_t samples;
+    uint64_t opsPerSample;
+};
+
+class BenchRunner {
+    public:
+        BenchRunner(const string& filter, unsigned int samples);
+        bool pin(int cpu);                              // Pin to cpu, or the current one if negative
+        int pinnedCPU() const;
+        bool wanted(const string& name) const;          // Name matches the filter
+        void run(const string& name, const function<void(uint64_t ops)>& body);
+        const vector<BenchResult>& results() const;
+        bool writeJSON(const char* path) const;         // - for stdout
+        bool compare(const char* baselinePath) const;   // Print change against an earlier writeJSON()
+
+    private:
+        string filter;
+        unsigned int samples;
+        int cpu;
+        vector<BenchResult> done;
+
+        static map<string, double> readMedians(const char* path);
+};
+#endif
@@ -0,0 +1,66 @@
+/*
+ * Input latency through the InputQueue. The ROM runs on an EmulationThread paced to 60Hz while
+ * this thread pushes button changes at random moments, and the NES records for each one how long
+ * it took from the push until a CPU read of $4016/$4017 first saw it. Applying input at the start
+ * of the frame instead would add the wait for that frame to start, up to a whole frame.
+ *
+ * Only games that poll the pads every frame give meaningful figures.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "emulation_thread.h"
+#include "nes.h"
+#include "triple_buffer.h"
+
+const unsigned int DEFAULT_EVENTS = 120u;
+const unsigned int MAX_GAP_MS = 40u;                    // Pushes are 1-40ms apart
+
+static double percentile(std::vector<uint64_t>& samples, double p) {
+    std::sort(samples.begin(), samples.end());
+    return samples[(size_t) (p * (samples.size() - 1))] / 1000.0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cout << "Usage: input_bench ROM [events]" << std::endl;
+        return -1;
+    }
+    unsigned int events = argc > 2 ? std::stoul(argv[2]) : DEFAULT_EVENTS;
+
+    NES nes(argv[1]);
+    if (!nes.isLoaded())
+        return -1;
+    TripleBuffer frames;
+    EmulationThread emulation(&nes, &frames);
+    emulation.start(true);
+
+    std::mt19937 random(1);
+    std::uniform_int_distribution<unsigned int> gap(1, MAX_GAP_MS);
+    unsigned int dropped = 0;
+    for (unsigned int i = 0; i < events; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(gap(random)));
+        if (!emulation.setInput(0, i & 0x1 ? 0x01 : 0x00))
+            dropped++;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    emulation.stop();
+
+    std::vector<uint64_t> latencies = emulation.inputQueue().latencies();
+    std::cout << "Pushed " << events << " events, " << latencies.size() << " seen by the game, " << dropped
+              << " dropped with the queue full" << std::endl;
+    if (latencies.empty()) {
+        std::cout << "The game never read the pads" << std::endl;
+        return 1;
+    }
+    double median = percentile(latencies, 0.5);
+    std::cout << "push to first read  median " << median << "us  p99 " << percentile(latencies, 0.99)
+              << "us  max " << latencies.back() / 1000.0 << "us" << std::endl;
+    return 0;
+}
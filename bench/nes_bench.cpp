@@ -0,0 +1,592 @@
+/*
+ * Microbenchmarks for the emulation core, run through BenchRunner (see bench.h) so every figure
+ * is a median and p99 over pinned, warmed up samples that can be saved as JSON and compared with
+ * a run from another commit.
+ *
+ *   cpu/<OP>_<mode>     one instruction, for each of the 151 official opcodes, on a synthetic cart
+ *                       whose PRG ROM is that instruction over and over
+ *   bus/...             a CPU bus read or write of RAM, PRG ROM, PRG RAM and I/O registers, PRG
+ *                       ROM reads with one cheat and with a cheat on every byte of the page, and
+ *                       RAM reads with a debugger watching their page and watching another page
+ *   ppu/scanline        one visible scanline (341 dots) rendered, and again with composition skipped
+ *   ppu/sprite_eval     sprite evaluation for one scanline, with the in-range masks cached and not
+ *   state/save, load    a whole save state
+ *   nes/fork            fork and discard, and a fork's first write to a RAM page it still shares
+ *   frame/<rom>/...     one frame of each ROM, composed, composed with a cheat on every PRG page
+ *                       (each giving a byte the value it already has), skipped, and skipped with
+ *                       the opcode pairs its own profile picked fused, run through <rom>_native.so
+ *                       from nes_recompile where the build made one, and composed on the accurate
+ *                       core
+ *
+ * The ROMs are the ones given on the command line, or every .nes file under the bundled tests
+ * directory. Those the core can't run are skipped. Before anything is timed, each ROM is run
+ * with and without composition and with and without fusion and the last frames compared, and a
+ * fork and its parent (and a fork of the fork) are run side by side, so a benchmark never times
+ * a broken core.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "debugger.h"
+#include "instance_pool.h"
+#include "nes.h"
+
+const uint64_t WARMUP_FRAMES = 60u;
+const uint64_t CHECK_FRAMES = 120u;                     // Frames each ROM runs before composed and skipped are compared
+const uint64_t DIVERGE_FRAMES = 30u;                    // Frames the parent runs before its fork catches up
+const unsigned int POOL_INSTANCES = 4u;
+const unsigned int DEFAULT_SAMPLES = 30u;
+const uint16_t OPERAND_ZP = 0x10u;                      // Zero page operand of the synthetic carts
+const uint16_t OPERAND_ABS = 0x0200u;                   // Absolute operand, and where zero page pointers point
+const uint16_t PRG_START = 0x8000u;
+
+static volatile uint8_t sink;                           // Keeps timed reads from being optimised away
+
+static FusionTable profiledFusion(const char* romFile);
+
+// Where nes_add_recompiled() in CMakeLists.txt leaves the code for a bundled ROM
+static string nativeLibrary(const char* romFile) {
+    return string(NES_NATIVE_DIR) + "/" + std::filesystem::path(romFile).stem().string() + "_native.so";
+}
+
+class NESBench {
+    public:
+        static void opcodes(BenchRunner& runner);
+        static void bus(BenchRunner& runner);
+        static void ppu(BenchRunner& runner, const char* romFile);
+        static void state(BenchRunner& runner, const char* romFile);
+        static void forks(BenchRunner& runner, const char* romFile);
+        static void frames(BenchRunner& runner, const char* romFile, const string& name);
+
+    private:
+        static const char* modeName(uint8_t (MOS6502::*mode)());
+        static unsigned int operandBytes(uint8_t (MOS6502::*mode)());
+        static vector<uint8_t> instructionCart(uint8_t opcode);
+        static void showSprites(NES& nes);
+};
+
+const char* NESBench::modeName(uint8_t (MOS6502::*mode)()) {
+    if (mode == &MOS6502::IMM) return "imm";
+    if (mode == &MOS6502::ZP0) return "zp";
+    if (mode == &MOS6502::ZPX) return "zpx";
+    if (mode == &MOS6502::ZPY) return "zpy";
+    if (mode == &MOS6502::REL) return "rel";
+    if (mode == &MOS6502::ABS) return "abs";
+    if (mode == &MOS6502::ABX) return "abx";
+    if (mode == &MOS6502::ABY) return "aby";
+    if (mode == &MOS6502::IND) return "ind";
+    if (mode == &MOS6502::IZX) return "izx";
+    if (mode == &MOS6502::IZY) return "izy";
+    return "imp";
+}
+
+unsigned int NESBench::operandBytes(uint8_t (MOS6502::*mode)()) {
+    if (mode == &MOS6502::IMP)
+        return 0;
+    if (mode == &MOS6502::ABS || mode == &MOS6502::ABX || mode == &MOS6502::ABY || mode == &MOS6502::IND)
+        return 2;
+    return 1;
+}
+
+// NROM image whose PRG ROM repeats one instruction, then jumps back to the start. Every vector
+// points at the start too, so BRK, RTI and RTS (with a stack full of $80) stay in the loop.
+vector<uint8_t> NESBench::instructionCart(uint8_t opcode) {
+    vector<uint8_t> rom(HEADER_SIZE + 32768 + 8192, 0x0u);
+    std::memcpy(rom.data(), "NES\x1A", 4);
+    rom[4] = 2;                                         // 32KB PRG
+    rom[5] = 1;                                         // 8KB CHR
+    uint8_t* prg = rom.data() + HEADER_SIZE;
+
+    const MOS6502::INSTRUCTION& inst = MOS6502::oplist[opcode];
+    unsigned int length = 1 + operandBytes(inst.addrmode);
+    uint16_t operand = length == 3 ? OPERAND_ABS : OPERAND_ZP;
+    if (inst.addrmode == &MOS6502::REL)
+        operand = 0x0u;                                 // Taken or not, carry on with the next one
+    else if (inst.addrmode == &MOS6502::ABS && (inst.execute == &MOS6502::JMP || inst.execute == &MOS6502::JSR))
+        operand = PRG_START;
+
+    unsigned int end = 0x7FF0u - 3;                     // Room for the jump back, clear of the vectors
+    unsigned int i = 0;
+    for (; i + length <= end; i += length) {
+        prg[i] = opcode;
+        if (length > 1) prg[i + 1] = operand & 0xFF;
+        if (length > 2) prg[i + 2] = operand >> 8;
+    }
+    prg[i] = 0x4C;                                      // JMP $8000
+    prg[i + 1] = PRG_START & 0xFF;
+    prg[i + 2] = PRG_START >> 8;
+    for (unsigned int vector = 0x7FFA; vector < 0x8000; vector += 2) {
+        prg[vector] = PRG_START & 0xFF;
+        prg[vector + 1] = PRG_START >> 8;
+    }
+    return rom;
+}
+
+void NESBench::opcodes(BenchRunner& runner) {
+    for (unsigned int opcode = 0; opcode < 256; opcode++) {
+        const MOS6502::INSTRUCTION& inst = MOS6502::oplist[opcode];
+        // 0xDA and 0xFA are unofficial NOPs the table spells out
+        if (std::strcmp(inst.name, "ILL") == 0 || opcode == 0xDA || opcode == 0xFA)
+            continue;
+        string name = string("cpu/") + inst.name + "_" + modeName(inst.addrmode);
+        if (!runner.wanted(name))
+            continue;
+
+        vector<uint8_t> rom = instructionCart(opcode);
+        NES nes(rom.data(), rom.size());
+        MOS6502* cpu = nes.cpu;
+        // Every zero page pointer leads to $0202, returns pulled off the stack land in PRG ROM and
+        // $0200 holds the JMP ($0200) target
+        for (uint16_t addr = 0; addr < 0x100; addr++)
+            nes.writeMem(addr, OPERAND_ABS >> 8);
+        for (uint16_t addr = 0x100; addr < 0x200; addr++)
+            nes.writeMem(addr, PRG_START >> 8);
+        nes.writeMem(OPERAND_ABS, PRG_START & 0xFF);
+        nes.writeMem(OPERAND_ABS + 1, PRG_START >> 8);
+        while (cpu->cyclesRemaining)
+            cpu->cycle();
+
+        runner.run(name, [cpu](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; i++) {
+                do
+                    cpu->cycle();
+                while (cpu->cyclesRemaining);
+            }
+        });
+    }
+}
+
+void NESBench::bus(BenchRunner& runner) {
+    vector<uint8_t> rom = instructionCart(0xEA);
+    NES nes(rom.data(), rom.size());
+    auto reads = [&](const string& name, uint16_t addr) {
+        runner.run(name, [&nes, addr](uint64_t ops) {
+            uint8_t acc = 0x0u;
+            for (uint64_t i = 0; i < ops; i++)
+                acc ^= nes.readMem(addr);
+            sink = acc;
+        });
+    };
+    auto writes = [&](const string& name, uint16_t addr) {
+        runner.run(name, [&nes, addr](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; i++)
+                nes.writeMem(addr, (uint8_t) i);
+        });
+    };
+
+    reads("bus/read_ram", 0x0200u);
+    reads("bus/read_rom", 0xC000u);
+    reads("bus/read_prg_ram", 0x6000u);
+    reads("bus/read_ppustatus", 0x2002u);
+    reads("bus/read_apu_status", 0x4015u);
+    writes("bus/write_ram", 0x0200u);
+    writes("bus/write_prg_ram", 0x6000u);
+    writes("bus/write_ppudata", 0x2007u);
+    writes("bus/write_apu", 0x4000u);
+
+    // Cheats put patched copies of pages in the table PRG ROM is read through, so a read should
+    // cost the same with no cheats, one, or one for every byte of the page
+    nes.addCheat("C000:EA");
+    reads("bus/read_rom_cheat", 0xC000u);
+    for (unsigned int offset = 1; offset < PRG_PAGE_SIZE; offset++) {
+        char code[8];
+        std::snprintf(code, sizeof(code), "%04X:EA", 0xC000u + offset);
+        nes.addCheat(code);
+    }
+    reads("bus/read_rom_cheats_page", 0xC000u);
+    nes.clearCheats();
+
+    // Only the pages a watchpoint covers go through the debugger, the rest cost what they did
+    Debugger debugger(&nes);
+    debugger.addWatchpoint(Watchpoint{ 0x0300u, 0x0300u, false, true });
+    reads("bus/read_ram_watched_page", 0x0300u);
+    reads("bus/read_ram_other_page", 0x0200u);
+}
+
+// Spread all 64 sprites down the screen, several per line, and turn rendering on
+void NESBench::showSprites(NES& nes) {
+    PPU* ppu = nes.ppu;
+    ppu->oamAddr = 0;
+    for (int n = 0; n < 64; n++) {
+        ppu->writeOAM((uint8_t) (n * 29 % 232));        // Y
+        ppu->writeOAM((uint8_t) n);                     // Tile
+        ppu->writeOAM((uint8_t) (n & 0xC3));            // Attributes, some flipped
+        ppu->writeOAM((uint8_t) (n * 37));              // X
+    }
+    ppu->writeReg(0x2001, 0x1E);
+}
+
+void NESBench::ppu(BenchRunner& runner, const char* romFile) {
+    NES nes(romFile);
+    for (uint64_t i = 0; i < WARMUP_FRAMES; i++)
+        nes.runFrame();
+    showSprites(nes);
+    PPU* ppu = nes.ppu;
+
+    // Go back to the top of the picture rather than run the idle and vblank lines
+    auto scanlines = [ppu](uint64_t ops) {
+        for (uint64_t i = 0; i < ops; i++) {
+            for (int dot = 0; dot < 341; dot++)
+                ppu->cycle();
+            if (ppu->scanline >= SCREEN_HEIGHT) {
+                ppu->scanline = 0;
+                ppu->dot = 0;
+                ppu->vramAddr = ppu->tempAddr;
+            }
+        }
+    };
+    ppu->scanline = 0;
+    ppu->dot = 0;
+    ppu->setSkipComposition(false);
+    runner.run("ppu/scanline", scanlines);
+    ppu->setSkipComposition(true);
+    runner.run("ppu/scanline_skip", scanlines);
+
+    runner.run("ppu/sprite_eval", [ppu](uint64_t ops) {
+        for (uint64_t i = 0; i < ops; i++) {
+            ppu->scanline = i % SCREEN_HEIGHT;
+            ppu->evaluateSprites();
+        }
+    });
+    runner.run("ppu/sprite_eval_uncached", [ppu](uint64_t ops) {
+        for (uint64_t i = 0; i < ops; i++) {
+            ppu->scanline = i % SCREEN_HEIGHT;
+            ppu->oamGeneration++;
+            ppu->evaluateSprites();
+        }
+    });
+}
+
+void NESBench::state(BenchRunner& runner, const char* romFile) {
+    NES nes(romFile);
+    for (uint64_t i = 0; i < WARMUP_FRAMES; i++)
+        nes.runFrame();
+    vector<uint8_t> saved(nes.stateSize());
+    nes.saveState(saved.data(), saved.size());
+
+    runner.run("state/save", [&nes, &saved](uint64_t ops) {
+        for (uint64_t i = 0; i < ops; i++)
+            nes.saveState(saved.data(), saved.size());
+    });
+    runner.run("state/load", [&nes, &saved](uint64_t ops) {
+        for (uint64_t i = 0; i < ops; i++)
+            nes.loadState(saved.data(), saved.size());
+    });
+}
+
+void NESBench::forks(BenchRunner& runner, const char* romFile) {
+    // Declared first so it outlives the instance forked from
+    InstancePool pool(POOL_INSTANCES);
+    NES parent(romFile);
+    for (uint64_t i = 0; i < WARMUP_FRAMES; i++)
+        parent.runFrame();
+
+    runner.run("nes/fork", [&parent, &pool](uint64_t ops) {
+        for (uint64_t i = 0; i < ops; i++)
+            pool.release(parent.fork(pool));
+    });
+    // The copy on write fault: each write copies the page from the snapshot, then the page is
+    // handed back to the snapshot (a few pointer stores) so the next write faults again
+    runner.run("nes/fork_first_write", [&parent, &pool](uint64_t ops) {
+        NES* fork = parent.fork(pool);
+        for (uint64_t i = 0; i < ops; i++) {
+            fork->writeMem(0x0000, (uint8_t) i);
+            fork->state->wram.share(fork->snapshot->wram);
+        }
+        pool.release(fork);
+    });
+}
+
+void NESBench::frames(BenchRunner& runner, const char* romFile, const string& name) {
+    NES nes(romFile);
+    for (uint64_t i = 0; i < WARMUP_FRAMES; i++)
+        nes.runFrame();
+    auto run = [&nes](uint64_t ops) {
+        for (uint64_t i = 0; i < ops; i++)
+            nes.runFrame();
+    };
+    runner.run("frame/" + name + "/composed", run);
+    nes.setAudioThread(true);
+    runner.run("frame/" + name + "/audio_thread", run);
+    nes.setAudioThread(false);
+    for (unsigned int page = 0; page < PRG_PAGES; page++) {
+        uint16_t addr = 0x8000u + page * PRG_PAGE_SIZE;
+        char code[8];
+        std::snprintf(code, sizeof(code), "%04X:%02X", addr, nes.readMem(addr));
+        nes.addCheat(code);
+    }
+    runner.run("frame/" + name + "/cheats", run);
+    nes.clearCheats();
+    nes.setFrameSkip(true);
+    runner.run("frame/" + name + "/skipped", run);
+    FusionTable fusion = profiledFusion(romFile);
+    nes.setFusionTable(&fusion);
+    runner.run("frame/" + name + "/fused", run);
+    nes.setFusionTable(nullptr);
+    if (nes.loadCompiled(nativeLibrary(romFile).c_str()))
+        runner.run("frame/" + name + "/native", run);
+
+    // The cycle-interleaved core against the catch-up one above, composed as it has to be chosen
+    // before the first frame and warmed up the same way
+    NES accurate(romFile);
+    if (!accurate.setAccurate(true))
+        return;
+    for (uint64_t i = 0; i < WARMUP_FRAMES; i++)
+        accurate.runFrame();
+    runner.run("frame/" + name + "/accurate", [&accurate](uint64_t ops) {
+        for (uint64_t i = 0; i < ops; i++)
+            accurate.runFrame();
+    });
+}
+
+// Fusion table from the opcode pairs of the ROM's first frames
+static FusionTable profiledFusion(const char* romFile) {
+    OpcodeProfile profile;
+    NES nes(romFile);
+    nes.setOpcodeProfile(&profile);
+    for (uint64_t i = 0; i < CHECK_FRAMES; i++)
+        nes.runFrame();
+    return FusionTable::fromProfile(profile);
+}
+
+static bool sameFrame(const NES& a, const NES& b) {
+    return std::memcmp(a.frameBuffer(), b.frameBuffer(), SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(uint16_t)) == 0;
+}
+
+// Skip composition on all but the last frame and compare that with a run composing every frame
+static bool skipMatches(const char* romFile) {
+    NES composed(romFile);
+    NES skipped(romFile);
+    skipped.setFrameSkip(true);
+    for (uint64_t i = 0; i < CHECK_FRAMES - 1; i++) {
+        composed.runFrame();
+        skipped.runFrame();
+    }
+    skipped.setFrameSkip(false);
+    composed.runFrame();
+    skipped.runFrame();
+    return sameFrame(composed, skipped);
+}
+
+// Fused instructions must leave the same picture, audio and RAM as running each alone
+static bool fusionMatches(const char* romFile) {
+    FusionTable fusion = profiledFusion(romFile);
+    NES plain(romFile);
+    NES fused(romFile);
+    fused.setFusionTable(&fusion);
+    bool matches = true;
+    for (uint64_t i = 0; i < CHECK_FRAMES && matches; i++) {
+        plain.runFrame();
+        fused.runFrame();
+        size_t plainCount, fusedCount;
+        const int16_t* plainSamples = plain.audioSamples(plainCount);
+        const int16_t* fusedSamples = fused.audioSamples(fusedCount);
+        matches = plainCount == fusedCount && std::memcmp(plainSamples, fusedSamples, plainCount * sizeof(int16_t)) == 0;
+    }
+    uint8_t plainRAM[CPU_MEM_SIZE];
+    uint8_t fusedRAM[CPU_MEM_SIZE];
+    plain.readRAM(plainRAM);
+    fused.readRAM(fusedRAM);
+    return matches && sameFrame(plain, fused) && std::memcmp(plainRAM, fusedRAM, sizeof(plainRAM)) == 0;
+}
+
+// Recompiled code must do the same too, true if there is none for the ROM
+static bool nativeMatches(const char* romFile) {
+    string library = nativeLibrary(romFile);
+    if (!std::filesystem::exists(library))
+        return true;
+    NES plain(romFile);
+    NES native(romFile);
+    if (!native.loadCompiled(library.c_str()))
+        return false;
+    bool matches = true;
+    for (uint64_t i = 0; i < CHECK_FRAMES && matches; i++) {
+        plain.runFrame();
+        native.runFrame();
+        size_t plainCount, nativeCount;
+        const int16_t* plainSamples = plain.audioSamples(plainCount);
+        const int16_t* nativeSamples = native.audioSamples(nativeCount);
+        matches = plainCount == nativeCount && std::memcmp(plainSamples, nativeSamples, plainCount * sizeof(int16_t)) == 0;
+    }
+    uint8_t plainRAM[CPU_MEM_SIZE];
+    uint8_t nativeRAM[CPU_MEM_SIZE];
+    plain.readRAM(plainRAM);
+    native.readRAM(nativeRAM);
+    return matches && sameFrame(plain, native) && std::memcmp(plainRAM, nativeRAM, sizeof(plainRAM)) == 0;
+}
+
+// Audio synthesized on a worker comes out a frame late, but must be the same samples
+static bool audioThreadMatches(const char* romFile) {
+    NES plain(romFile);
+    NES threaded(romFile);
+    threaded.setAudioThread(true);
+    threaded.runFrame();
+    bool matches = true;
+    for (uint64_t i = 0; i < CHECK_FRAMES && matches; i++) {
+        plain.runFrame();
+        threaded.runFrame();
+        size_t plainCount, threadedCount;
+        const int16_t* plainSamples = plain.audioSamples(plainCount);
+        const int16_t* threadedSamples = threaded.audioSamples(threadedCount);
+        matches = plainCount == threadedCount && std::memcmp(plainSamples, threadedSamples, plainCount * sizeof(int16_t)) == 0;
+    }
+    return matches;
+}
+
+// The lockstep core spreads each instruction over its cycles, the default one has to land its
+// register accesses on the same dots
+static bool accurateMatches(const char* romFile) {
+    NES fast(romFile);
+    NES accurate(romFile);
+    if (!accurate.setAccurate(true))
+        return false;
+    bool matches = true;
+    for (uint64_t i = 0; i < CHECK_FRAMES && matches; i++) {
+        fast.runFrame();
+        accurate.runFrame();
+        matches = sameFrame(fast, accurate);
+    }
+    return matches;
+}
+
+// Run the parent ahead first so it writes pages the fork still shares, then the fork, and compare
+static bool forkMatches(const char* romFile) {
+    InstancePool pool(POOL_INSTANCES);
+    NES parent(romFile);
+    for (uint64_t i = 0; i < WARMUP_FRAMES; i++)
+        parent.runFrame();
+
+    NES* fork = parent.fork(pool);
+    if (!fork)
+        return false;
+    for (uint64_t i = 0; i < DIVERGE_FRAMES; i++)
+        parent.runFrame();
+    for (uint64_t i = 0; i < DIVERGE_FRAMES; i++)
+        fork->runFrame();
+    bool matches = sameFrame(parent, *fork) && parent.frameCount() == fork->frameCount();
+
+    // The fork has written its own pages by now, fork it in turn
+    NES* grandchild = fork->fork(pool);
+    if (!grandchild) {
+        pool.release(fork);
+        return false;
+    }
+    for (uint64_t i = 0; i < DIVERGE_FRAMES; i++)
+        fork->runFrame();
+    for (uint64_t i = 0; i < DIVERGE_FRAMES; i++)
+        grandchild->runFrame();
+    matches = matches && sameFrame(*fork, *grandchild);
+
+    pool.release(grandchild);
+    pool.release(fork);
+    return matches;
+}
+
+static vector<string> bundledROMs() {
+    vector<string> roms;
+    std::error_code error;
+    for (auto it = std::filesystem::recursive_directory_iterator(NES_TEST_ROM_DIR, error);
+         !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+        if (it->path().extension() == ".nes")
+            roms.push_back(it->path().string());
+    }
+    std::sort(roms.begin(), roms.end());
+    return roms;
+}
+
+int main(int argc, char* argv[]) {
+    const char* jsonFile = nullptr;
+    const char* baselineFile = nullptr;
+    string filter;
+    unsigned int samples = DEFAULT_SAMPLES;
+    int cpu = -1;
+    vector<string> romFiles;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baselineFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            samples = std::stoul(argv[++i]);
+        } else if (std::strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) {
+            cpu = std::stoi(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            std::cout << "Usage: nes_bench [--json FILE|-] [--baseline FILE] [--filter TEXT] [--samples N] [--cpu N] [ROM...]" << std::endl;
+            return -1;
+        } else {
+            romFiles.push_back(argv[i]);
+        }
+    }
+    if (romFiles.empty())
+        romFiles = bundledROMs();
+
+    // Only ROMs the core runs, each checked before anything is timed on it
+    vector<string> roms;
+    for (const string& romFile : romFiles) {
+        if (!NES(romFile.c_str()).isLoaded()) {
+            std::cout << "Skipping " << romFile << std::endl;
+            continue;
+        }
+        if (!skipMatches(romFile.c_str())) {
+            std::cout << romFile << ": final frames differ, skipping changed emulation state" << std::endl;
+            return 1;
+        }
+        if (!fusionMatches(romFile.c_str())) {
+            std::cout << romFile << ": fused instructions changed emulation state" << std::endl;
+            return 1;
+        }
+        if (!nativeMatches(romFile.c_str())) {
+            std::cout << romFile << ": recompiled code changed emulation state" << std::endl;
+            return 1;
+        }
+        if (!accurateMatches(romFile.c_str())) {
+            std::cout << romFile << ": the accurate core drew different frames" << std::endl;
+            return 1;
+        }
+        if (!audioThreadMatches(romFile.c_str())) {
+            std::cout << romFile << ": audio from the audio thread differs" << std::endl;
+            return 1;
+        }
+        if (!forkMatches(romFile.c_str())) {
+            std::cout << romFile << ": a fork and its parent diverged" << std::endl;
+            return 1;
+        }
+        roms.push_back(romFile);
+    }
+
+    BenchRunner runner(filter, samples);
+    if (!runner.pin(cpu))
+        std::cout << "Couldn't pin to a CPU, samples may move between cores" << std::endl;
+
+    NESBench::opcodes(runner);
+    NESBench::bus(runner);
+    if (!roms.empty()) {
+        NESBench::ppu(runner, roms[0].c_str());
+        NESBench::state(runner, roms[0].c_str());
+        NESBench::forks(runner, roms[0].c_str());
+    } else {
+        std::cout << "No ROM runs, skipping PPU, state, fork and frame benchmarks" << std::endl;
+    }
+    for (const string& romFile : roms)
+        NESBench::frames(runner, romFile.c_str(), std::filesystem::path(romFile).stem().string());
+
+    if (jsonFile && !runner.writeJSON(jsonFile)) {
+        std::cerr << "Couldn't write " << jsonFile << std::endl;
+        return -1;
+    }
+    if (baselineFile && !runner.compare(baselineFile)) {
+        std::cerr << "Couldn't read baseline " << baselineFile << std::endl;
+        return -1;
+    }
+    return 0;
+}
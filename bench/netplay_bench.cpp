@@ -0,0 +1,125 @@
+/*
+ * Loopback test of rollback netplay. Two sessions run the ROM on their own threads, paced to
+ * 60Hz, and talk over UDP on localhost through the transport's latency and loss shim. Each
+ * player's pad follows its own seeded random walk, so the other side keeps mispredicting. Once
+ * both have run the frames and heard all of each other's input, their RAM is compared with a
+ * single NES given both players' input directly, then rollback frequency and re-simulation cost
+ * are reported for each side.
+ */
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nes.h"
+#include "netplay.h"
+#include "udp_transport.h"
+
+const uint64_t DEFAULT_FRAMES = 600u;
+const unsigned int DEFAULT_LATENCY_MS = 30u;
+const double DEFAULT_LOSS = 0.05;
+const std::chrono::nanoseconds FRAME_PERIOD(16639267);
+const unsigned int SETTLE_TRIES = 1000u;                // 1ms apart
+
+// Buttons held for a few frames at a time, as a player would
+static std::vector<uint8_t> playerInput(uint32_t seed, uint64_t frames) {
+    std::mt19937 random(seed);
+    std::vector<uint8_t> input(frames);
+    uint8_t buttons = 0;
+    for (uint64_t i = 0; i < frames; i++) {
+        if (random() % 8 == 0)
+            buttons = random() & 0xFF;
+        input[i] = buttons;
+    }
+    return input;
+}
+
+static void play(NetplaySession* session, const std::vector<uint8_t>* input, uint64_t frames) {
+    auto deadline = std::chrono::steady_clock::now();
+    while (session->frame() < frames) {
+        session->advance((*input)[session->frame()]);
+        deadline += FRAME_PERIOD;
+        std::this_thread::sleep_until(deadline);
+    }
+}
+
+static void report(const char* name, const NetplaySession& session, const UdpTransport& transport) {
+    const NetplayStats& stats = session.stats();
+    std::cout << name << ": " << stats.rollbacks << " rollbacks in " << stats.frames << " frames ("
+              << 100.0 * stats.rollbacks / stats.frames << "%), " << stats.resimulatedFrames << " frames re-run, "
+              << stats.stalls << " stalls" << std::endl;
+    if (stats.rollbacks) {
+        std::cout << "  re-simulation " << stats.resimulationNs / 1000.0 / stats.rollbacks << "us per rollback, "
+                  << stats.resimulationNs / 1000.0 / stats.resimulatedFrames << "us per frame re-run, max "
+                  << stats.maxResimulationNs / 1000.0 << "us" << std::endl;
+    }
+    std::cout << "  " << transport.sent() << " packets sent, " << transport.dropped() << " dropped by the shim" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cout << "Usage: netplay_bench ROM [frames] [latency ms] [loss]" << std::endl;
+        return -1;
+    }
+    uint64_t frames = argc > 2 ? std::stoull(argv[2]) : DEFAULT_FRAMES;
+    unsigned int latency = argc > 3 ? std::stoul(argv[3]) : DEFAULT_LATENCY_MS;
+    double loss = argc > 4 ? std::stod(argv[4]) : DEFAULT_LOSS;
+
+    NES first(argv[1]);
+    NES second(argv[1]);
+    NES reference(argv[1]);
+    if (!first.isLoaded() || !second.isLoaded() || !reference.isLoaded())
+        return -1;
+
+    UdpTransport firstLink(0);
+    UdpTransport secondLink(0);
+    if (!firstLink.isOpen() || !secondLink.isOpen() || !firstLink.setPeer("127.0.0.1", secondLink.localPort())
+            || !secondLink.setPeer("127.0.0.1", firstLink.localPort()))
+        return -1;
+    firstLink.setShim(latency, loss, 1);
+    secondLink.setShim(latency, loss, 2);
+
+    std::vector<uint8_t> firstInput = playerInput(1, frames);
+    std::vector<uint8_t> secondInput = playerInput(2, frames);
+    NetplaySession firstSession(&first, &firstLink, 0);
+    NetplaySession secondSession(&second, &secondLink, 1);
+    std::thread other(play, &secondSession, &secondInput, frames);
+    play(&firstSession, &firstInput, frames);
+    other.join();
+
+    // The last packets may have been dropped, so keep resending until each side has the rest
+    for (unsigned int i = 0; i < SETTLE_TRIES; i++) {
+        firstSession.poll();
+        secondSession.poll();
+        if (firstSession.confirmedFrame() == frames && secondSession.confirmedFrame() == frames)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (firstSession.confirmedFrame() != frames || secondSession.confirmedFrame() != frames) {
+        std::cout << "Sessions never heard all of each other's input" << std::endl;
+        return 1;
+    }
+
+    for (uint64_t i = 0; i < frames; i++) {
+        reference.setInput(0, firstInput[i]);
+        reference.setInput(1, secondInput[i]);
+        reference.runFrame();
+    }
+    uint8_t referenceRAM[CPU_MEM_SIZE], firstRAM[CPU_MEM_SIZE], secondRAM[CPU_MEM_SIZE];
+    reference.readRAM(referenceRAM);
+    first.readRAM(firstRAM);
+    second.readRAM(secondRAM);
+    bool matches = first.frameCount() == frames && second.frameCount() == frames
+        && std::memcmp(firstRAM, referenceRAM, CPU_MEM_SIZE) == 0 && std::memcmp(secondRAM, referenceRAM, CPU_MEM_SIZE) == 0;
+
+    std::cout << frames << " frames at " << latency << "ms latency, " << 100.0 * loss << "% loss" << std::endl;
+    report("player 1", firstSession, firstLink);
+    report("player 2", secondSession, secondLink);
+    std::cout << (matches ? "Both sides match a local run with the same input" : "Sides diverged from a local run")
+              << std::endl;
+    return matches ? 0 : 1;
+}
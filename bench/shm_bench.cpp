@@ -0,0 +1,131 @@
+/*
+ * Latency and throughput of step requests through the shared memory server. A server process
+ * is forked off with the ROM; this process attaches as a client and times requests that only
+ * apply input (the round trip alone) and requests that run one frame, against the same frames
+ * run in process. The served frame and RAM are then compared with an in-process run of the same
+ * number of frames.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "nes.h"
+#include "shm_client.h"
+#include "shm_server.h"
+
+const uint64_t WARMUP_FRAMES = 60u;
+const unsigned int ATTACH_TRIES = 5000u;                // 1ms apart
+
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double percentile(std::vector<uint64_t>& samples, double p) {
+    std::sort(samples.begin(), samples.end());
+    return samples[(size_t) (p * (samples.size() - 1))] / 1000.0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cout << "Usage: shm_bench ROM [requests]" << std::endl;
+        return -1;
+    }
+    const char* romFile = argv[1];
+    uint64_t requests = argc > 2 ? std::stoull(argv[2]) : 600u;
+    if (requests < 1) {
+        std::cout << "Need at least 1 request" << std::endl;
+        return -1;
+    }
+    std::string name = "/nes_bench_" + std::to_string(getpid());
+
+    pid_t server = fork();
+    if (server == 0) {
+        // Scoped so the region is unlinked before exiting
+        bool served = false;
+        {
+            NES nes(romFile);
+            ShmServer shm(&nes, name.c_str());
+            if (nes.isLoaded() && shm.isOpen()) {
+                shm.run();
+                served = true;
+            }
+        }
+        _exit(served ? 0 : 1);
+    }
+
+    ShmClient* client = nullptr;
+    for (unsigned int i = 0; i < ATTACH_TRIES && !(client && client->isOpen()); i++) {
+        delete client;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        client = new ShmClient(name.c_str());
+    }
+    if (!client->isOpen()) {
+        std::cout << "Server didn't come up" << std::endl;
+        delete client;
+        waitpid(server, nullptr, 0);
+        return -1;
+    }
+
+    // Inputs change every request so applying them is part of what's timed
+    uint64_t frames = 0;
+    for (uint64_t i = 0; i < WARMUP_FRAMES; i++)
+        client->step(0x0u, 0x0u, 1);
+    frames += WARMUP_FRAMES;
+
+    std::vector<uint64_t> roundTrips;
+    for (uint64_t i = 0; i < requests; i++) {
+        uint64_t start = nowNs();
+        client->step((uint8_t) i, 0x0u, 0);
+        roundTrips.push_back(nowNs() - start);
+    }
+
+    std::vector<uint64_t> steps;
+    uint64_t stepStart = nowNs();
+    for (uint64_t i = 0; i < requests; i++) {
+        uint64_t start = nowNs();
+        client->step((uint8_t) i, 0x0u, 1);
+        steps.push_back(nowNs() - start);
+    }
+    double stepSeconds = (nowNs() - stepStart) / 1e9;
+    frames += requests;
+
+    // The same frames in process, with the inputs each served frame ran with
+    NES local(romFile);
+    for (uint64_t i = 0; i < WARMUP_FRAMES; i++)
+        local.runFrame();
+    uint64_t localStart = nowNs();
+    for (uint64_t i = 0; i < requests; i++) {
+        local.setInput(0, (uint8_t) i);
+        local.runFrame();
+    }
+    double localSeconds = (nowNs() - localStart) / 1e9;
+
+    uint8_t ram[CPU_MEM_SIZE];
+    local.readRAM(ram);
+    bool matches = client->frameCount() == frames && local.frameCount() == frames
+        && std::memcmp(client->frame(), local.frameBuffer(), SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(uint16_t)) == 0
+        && std::memcmp(client->ram(), ram, sizeof(ram)) == 0;
+
+    std::cout << "round trip:  median " << percentile(roundTrips, 0.5) << " us, p99 " << percentile(roundTrips, 0.99) << " us" << std::endl
+              << "step 1 frame: median " << percentile(steps, 0.5) << " us, p99 " << percentile(steps, 0.99) << " us, "
+              << requests / stepSeconds << " steps/s" << std::endl
+              << "in process:   " << requests / localSeconds << " frames/s" << std::endl;
+
+    client->shutdown();
+    delete client;
+    waitpid(server, nullptr, 0);
+
+    if (!matches) {
+        std::cout << "Served frames differ from an in-process run" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * What it costs to get a ROM loaded, through BenchRunner (see bench.h). For each archive:
+ *
+ *   startup/<rom>/raw           NES constructed from the plain .nes file next to the archive
+ *   startup/<rom>/<zip|gz>/cold the cache is emptied before every load, so each one inflates the
+ *                               archive and writes the cache (the emptying is timed too)
+ *   startup/<rom>/<zip|gz>/warm the image is mapped from the cache
+ *   startup/<rom>/<zip|gz>/none no cache at all, only inflating
+ *
+ * The archives are the ones given on the command line, or every .zip and .gz under the bundled
+ * tests directory. Before anything is timed, every way of loading an archive must give the same
+ * SHA-1 as its .nes file, and the cold load must leave the image in the cache.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "bench.h"
+#include "nes.h"
+
+const unsigned int DEFAULT_SAMPLES = 30u;
+
+static vector<string> bundledArchives() {
+    vector<string> archives;
+    std::error_code error;
+    for (auto it = std::filesystem::recursive_directory_iterator(NES_TEST_ROM_DIR, error);
+         !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+        if (it->path().extension() == ".zip" || it->path().extension() == ".gz")
+            archives.push_back(it->path().string());
+    }
+    std::sort(archives.begin(), archives.end());
+    return archives;
+}
+
+// game.zip and game.nes.gz both go with game.nes
+static std::filesystem::path rawROM(std::filesystem::path archive) {
+    archive.replace_extension();
+    if (archive.extension() != ".nes")
+        archive += ".nes";
+    return archive;
+}
+
+static bool cacheEmpty(const string& cacheDir) {
+    std::error_code error;
+    return std::filesystem::is_empty(cacheDir, error) || error;
+}
+
+int main(int argc, char* argv[]) {
+    const char* jsonFile = nullptr;
+    const char* baselineFile = nullptr;
+    string filter;
+    unsigned int samples = DEFAULT_SAMPLES;
+    vector<string> archives;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baselineFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            samples = std::stoul(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            std::cout << "Usage: startup_bench [--json FILE|-] [--baseline FILE] [--filter TEXT] [--samples N] [ARCHIVE...]" << std::endl;
+            return -1;
+        } else {
+            archives.push_back(argv[i]);
+        }
+    }
+    if (archives.empty())
+        archives = bundledArchives();
+
+    string cacheDir = (std::filesystem::temp_directory_path() / ("startup_bench." + std::to_string(getpid()))).string();
+    BenchRunner runner(filter, samples);
+    if (!runner.pin(-1))
+        std::cout << "Couldn't pin to a CPU, samples may move between cores" << std::endl;
+
+    for (const string& archive : archives) {
+        std::filesystem::path raw = rawROM(archive);
+        string name = raw.stem().string();
+        string kind = std::filesystem::path(archive).extension() == ".gz" ? "gz" : "zip";
+        NES plain(raw.c_str());
+        if (!plain.isLoaded()) {
+            std::cout << "Skipping " << archive << ", " << raw.string() << " doesn't run" << std::endl;
+            continue;
+        }
+
+        // Cold, warm and uncached loads all have to match the plain ROM
+        std::error_code error;
+        std::filesystem::remove_all(cacheDir, error);
+        NES cold(archive.c_str(), nullptr, cacheDir.c_str());
+        bool cached = !cacheEmpty(cacheDir);
+        NES warm(archive.c_str(), nullptr, cacheDir.c_str());
+        NES uncached(archive.c_str());
+        for (NES* loaded : { &cold, &warm, &uncached }) {
+            if (!loaded->isLoaded() || loaded->romSHA1() != plain.romSHA1()) {
+                std::cout << archive << ": doesn't load the same ROM as " << raw.string() << std::endl;
+                return 1;
+            }
+        }
+        if (!cached) {
+            std::cout << archive << ": nothing was cached" << std::endl;
+            return 1;
+        }
+
+        string prefix = "startup/" + name + "/";
+        runner.run(prefix + "raw", [&raw](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; i++)
+                NES nes(raw.c_str());
+        });
+        runner.run(prefix + kind + "/cold", [&archive, &cacheDir](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; i++) {
+                std::error_code error;
+                std::filesystem::remove_all(cacheDir, error);
+                NES nes(archive.c_str(), nullptr, cacheDir.c_str());
+            }
+        });
+        runner.run(prefix + kind + "/warm", [&archive, &cacheDir](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; i++)
+                NES nes(archive.c_str(), nullptr, cacheDir.c_str());
+        });
+        runner.run(prefix + kind + "/none", [&archive](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; i++)
+                NES nes(archive.c_str());
+        });
+    }
+    std::error_code error;
+    std::filesystem::remove_all(cacheDir, error);
+
+    if (jsonFile && !runner.writeJSON(jsonFile)) {
+        std::cerr << "Couldn't write " << jsonFile << std::endl;
+        return -1;
+    }
+    if (baselineFile && !runner.compare(baselineFile)) {
+        std::cerr << "Couldn't read baseline " << baselineFile << std::endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * The APU (Audio Processing Unit) shares the 2A03 die with the CPU and is clocked alongside it. It
+ * has five channels: two pulse waves, a triangle wave, a pseudo-random noise generator, and the
+ * delta modulation channel (DMC) which plays back 1-bit delta encoded samples from CPU memory. A
+ * frame counter clocks the envelopes, sweeps, and length counters at roughly 240Hz.
+ *
+ * Output is resampled to APU_SAMPLE_RATE by averaging the mixer over the CPU cycles that fall in
+ * each output sample. Past building the mixer tables everything is integer arithmetic, so a given
+ * ROM and input always produce the same samples.
+ *
+ * The channels can also be synthesized on another thread (see audio_thread.h). The APU the CPU
+ * talks to then only keeps time: it runs the frame counter, length counters and DMC reader, which
+ * is all $4015 and the interrupts depend on, and logs every register write and DMC byte with the
+ * cycle it happened on. A second APU replays that log to produce the same samples.
+ */
+
+#ifndef APU_H
+#define APU_H
+#define APU_SAMPLE_RATE 44100
+#define APU_SAMPLE_BUFFER_SIZE 4096
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+using std::vector;
+
+const unsigned int CPU_CLOCK_RATE = 1789773u;          // NTSC CPU clock in Hz
+
+class NES;
+
+// A register write, or a byte the DMC read from memory, as it went into the log
+struct APUEvent {
+    uint32_t cycle;                                     // CPU cycles into the log it happened before
+    uint16_t addr;                                      // Register, or APU_DMC_FETCH
+    uint8_t value;
+};
+
+const uint16_t APU_DMC_FETCH = 0x0000u;                 // Event is a DMC sample byte
+
+class APU {
+    friend class NES;
+    friend class AudioThread;
+
+    public:
+        APU();
+        void cycle();                                   // Perform one CPU cycle worth of work
+        void reset();                                   // Reset APU
+        uint8_t readStatus();                           // Read $4015 (clears frame interrupt)
+        void writeReg(uint16_t addr, uint8_t val);      // Write $4000-$4013, $4015 or $4017
+        bool irq();                                     // Frame counter or DMC interrupt pending
+        unsigned int cyclesUntilIRQ() const;            // Cycles irq() stays false for at least (0 if it may not)
+
+        const int16_t* samples() const;                 // Samples produced since last clear
+        size_t sampleCount() const;                     // Number of samples produced since last clear
+        void clearSamples();                            // Drop samples once they are consumed
+        void replay(uint32_t until);                    // Run the log from logCycle up to until, applying its writes
+        void takeChannels(const APU& synth);            // All but the logging, output and frame interrupt from synth
+
+    private:
+        NES* nes;                                       // The NES which this APU is part of (for DMC reads)
+
+        struct Envelope {
+            bool start;                                 // Restart decay on next quarter frame
+            bool loop;                                  // Loop decay (also halts length counter)
+            bool constant;                              // Output volume directly
+            uint8_t volume;                             // Constant volume / divider period
+            uint8_t divider;
+            uint8_t decay;
+        };
+
+        struct Pulse {
+            bool enabled;
+            bool onesComplement;                        // Pulse 1 negates with ones' complement
+            uint8_t duty;
+            uint8_t dutyPos;
+            uint16_t timerPeriod;
+            uint16_t timer;
+            uint8_t lengthCounter;
+            Envelope envelope;
+            bool sweepEnabled;
+            bool sweepNegate;
+            bool sweepReload;
+            uint8_t sweepPeriod;
+            uint8_t sweepDivider;
+            uint8_t sweepShift;
+        };
+
+        struct Triangle {
+            bool enabled;
+            bool control;                               // Halts length counter, holds linear reload
+            bool linearReload;
+            uint8_t linearReloadValue;
+            uint8_t linearCounter;
+            uint8_t lengthCounter;
+            uint16_t timerPeriod;
+            uint16_t timer;
+            uint8_t seqPos;
+        };
+
+        struct Noise {
+            bool enabled;
+            bool mode;                                  // Short (93 step) sequence
+            uint16_t shiftReg;
+            uint16_t timerPeriod;
+            uint16_t timer;
+            uint8_t lengthCounter;
+            Envelope envelope;
+        };
+
+        struct DMC {
+            bool irqEnabled;
+            bool loop;
+            bool irq;
+            uint16_t rate;
+            uint16_t timer;
+            uint8_t output;
+            uint16_t sampleAddress;
+            uint16_t sampleLength;
+            uint16_t currentAddress;
+            uint16_t bytesRemaining;
+            uint8_t sampleBuffer;
+            bool sampleBufferEmpty;
+            uint8_t shiftReg;
+            uint8_t bitsRemaining;
+            bool silence;
+        };
+
+        Pulse pulse1;
+        Pulse pulse2;
+        Triangle triangle;
+        Noise noise;
+        DMC dmc;
+
+        bool fiveStep;                                  // Frame counter mode
+        bool irqInhibit;
+        bool frameIrq;
+        unsigned int frameCycle;                        // CPU cycles into the frame counter sequence
+        bool oddCycle;                                  // Pulse timers tick every other cycle
+
+        int64_t mixSum;                                 // Mixer output accumulated for next sample
+        unsigned int mixCount;
+        unsigned int sampleClock;                       // Fractional sample position (in Hz units)
+        int16_t* sampleBuffer;                          // APU_SAMPLE_BUFFER_SIZE samples, owned by the NES
+        size_t numSamples;
+
+        bool synthesize;                                // Run the channels, false to only keep time and log
+        vector<APUEvent>* log;                          // Logged to when only keeping time, replayed from otherwise
+        size_t logNext;                                 // Next event replay() takes
+        uint32_t logCycle;                              // CPU cycles run since the log was started
+
+        void quarterFrame();                            // Envelopes and triangle linear counter
+        void halfFrame();                               // Length counters and sweeps
+        void clockEnvelope(Envelope& env);
+        void clockSweep(Pulse& pulse);
+        void clockDMC();
+        uint8_t fetchSample(uint16_t addr);             // DMC read from memory, or from the log
+        uint16_t sweepTarget(const Pulse& pulse);
+        uint8_t pulseOutput(const Pulse& pulse);
+        uint8_t envelopeOutput(const Envelope& env);
+        int32_t mix();
+};
+#endif
@@ -0,0 +1,34 @@
+/*
+ * Bump allocator over one contiguous region. Emulator instances take their state block from an
+ * arena rather than the heap, so many instances can be packed into memory the caller controls
+ * (a big preallocated buffer, a shared mapping, ...) and released all at once. Allocations are
+ * never freed individually; reset() forgets all of them.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+#define ARENA_ALIGNMENT 64
+
+#include <cstddef>
+#include <cstdint>
+
+class Arena {
+    public:
+        Arena(size_t capacity);                         // Allocate capacity bytes, cache line aligned
+        Arena(void* memory, size_t capacity);           // Use caller owned memory
+        ~Arena();
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        void* allocate(size_t size, size_t alignment);  // nullptr once the arena is full
+        void reset();                                   // Drop every allocation
+        size_t used() const;
+        size_t capacity() const;
+
+    private:
+        uint8_t* base;
+        size_t size;
+        size_t offset;
+        bool owned;                                     // base was allocated here
+};
+#endif
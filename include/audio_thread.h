@@ -0,0 +1,57 @@
+/*
+ * Synthesizes the APU's channels on a worker thread, a frame behind the emulation. While it runs
+ * the NES's own APU only keeps time (see apu.h) and logs each register write and DMC byte with
+ * the cycle it happened on. At the end of a frame the log is handed to the worker, which replays
+ * it into its own APU while the next frame is emulated, and the emulation thread gets back the
+ * samples of the frame before. Replay applies every write on the cycle it was made, so the
+ * samples are the same ones the APU would have produced by itself.
+ *
+ * Two logs are used in turn, so neither thread ever waits on the other unless the worker takes
+ * longer over a frame's audio than the emulation takes over the next frame.
+ */
+
+#ifndef AUDIO_THREAD_H
+#define AUDIO_THREAD_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "apu.h"
+
+class AudioThread {
+    public:
+        AudioThread(APU* apu, size_t carried);          // Take apu's channels over, its first carried samples are this frame's
+        ~AudioThread();
+        size_t endFrame(int16_t* out);                  // Hand the frame over, out gets the previous frame's samples
+        const APU& sync();                              // Channels as they are now, synthesized on this thread
+        const int16_t* finish(size_t& count);           // Give apu its channels back, returns the previous frame's samples
+
+    private:
+        struct Job {
+            vector<APUEvent> events;
+            int16_t samples[APU_SAMPLE_BUFFER_SIZE];
+            size_t sampleCount;
+            size_t nextEvent;                           // Where replay has got to
+            uint32_t replayed;                          // Cycles already synthesized
+            uint32_t cycles;                            // Cycles in the frame once it is handed over
+        };
+
+        APU* apu;                                       // The timing model the emulation thread runs
+        APU synth;                                      // Only touched by the worker while a job is handed over
+        Job jobs[2];
+        Job* logging;                                   // Job the emulation thread is logging to
+        Job* handedOver;                                // Job with samples not yet returned, nullptr for none
+        std::thread worker;
+        std::mutex lock;
+        std::condition_variable wake;
+        std::condition_variable done;
+        Job* work;                                      // Job the worker is synthesizing, nullptr while idle
+        bool quit;
+
+        void loop();                                    // Worker thread body
+        void waitIdle();
+        void synthesize(Job& job, uint32_t until);
+        void startLog(Job& job);
+};
+#endif
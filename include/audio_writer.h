@@ -0,0 +1,77 @@
+/*
+ * Streams emulated audio to a WAV or raw PCM file without putting file I/O on the emulation
+ * thread. Samples are copied into blocks taken from a pool allocated up front; full blocks are
+ * handed to a background thread which writes each one with a single large sequential write and
+ * then returns it to the pool.
+ *
+ * Nothing is ever dropped, so the file is a pure function of the ROM and its input and can be
+ * hashed in regression tests. If the writer falls a whole pool behind, the emulation thread
+ * waits for a block instead and the wait is counted in poolStalls().
+ */
+
+#ifndef AUDIO_WRITER_H
+#define AUDIO_WRITER_H
+#define AUDIO_POOL_BLOCKS 8
+#define AUDIO_BLOCK_SAMPLES 32768
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+using std::ofstream;
+
+// Container written around the 16-bit mono samples
+enum AUDIOFORMAT {
+    WAV_PCM16,      // RIFF/WAVE header, sizes patched on close when the output is seekable
+    RAW_PCM16,      // Headerless signed 16-bit little endian
+};
+
+class AudioWriter {
+    public:
+        AudioWriter(const char* fileName, AUDIOFORMAT format, unsigned int sampleRate);
+        ~AudioWriter();
+        bool isOpen() const;                            // Output file opened successfully
+        void write(const int16_t* samples, size_t count);   // Queue samples (emulation thread only)
+        void close();                                   // Flush remaining samples and finish the file
+
+        uint64_t samplesWritten() const;                // Samples queued so far
+        uint64_t poolStalls() const;                    // Times write() had to wait for a free block
+
+    private:
+        struct Block {
+            int16_t* data;
+            size_t count;
+        };
+
+        ofstream file;
+        AUDIOFORMAT format;
+        unsigned int sampleRate;
+
+        Block pool[AUDIO_POOL_BLOCKS];                  // Blocks are allocated once, never resized
+        int16_t* poolMemory;
+        unsigned int fullQueue[AUDIO_POOL_BLOCKS];      // Ring of blocks waiting to be written
+        unsigned int fullHead;
+        unsigned int fullCount;
+        unsigned int freeStack[AUDIO_POOL_BLOCKS];      // Blocks available to the emulation thread
+        unsigned int freeCount;
+        int current;                                    // Block being filled, -1 if none
+
+        std::mutex lock;                                // Guards the queues only, never held for I/O
+        std::condition_variable blockFilled;
+        std::condition_variable blockFreed;
+        std::thread writer;
+        bool closing;
+        bool closed;
+
+        uint64_t totalSamples;
+        std::atomic<uint64_t> stalls;
+
+        void writerLoop();                              // Background thread body
+        void submitCurrent();                           // Hand the current block to the writer
+        void writeHeader(uint32_t dataBytes);
+};
+#endif
@@ -0,0 +1,42 @@
+/*
+ * Battery backed cartridge RAM kept in a file. The file is mapped shared and the bus reads and
+ * writes the mapping directly through PRG RAM's page pointers, so a write costs exactly what it
+ * did before. Nothing is tracked per write: flush() compares the mapping with a copy taken at the
+ * last flush and only calls msync when they differ, so the NES can flush on a timer and thousands
+ * of instances whose games aren't saving don't touch the disk at all.
+ *
+ * Only the instance that attached the file writes to it. Forks copy pages out of it on their first
+ * write like any other shared page.
+ */
+
+#ifndef BATTERY_RAM_H
+#define BATTERY_RAM_H
+#define BATTERY_FLUSH_FRAMES 300u                       // Flush at most every 5 seconds of emulation
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+class BatteryRAM {
+    public:
+        BatteryRAM(const char* path, size_t size, const uint8_t* initial);  // A new file starts as initial
+        ~BatteryRAM();                                  // Flushes and unmaps
+        BatteryRAM(const BatteryRAM&) = delete;
+        BatteryRAM& operator=(const BatteryRAM&) = delete;
+        bool isOpen() const;
+        uint8_t* memory();
+        bool flush();                                   // msync if written since the last flush
+        uint64_t flushes() const;                       // msync calls made
+
+    private:
+        string path;
+        size_t size;
+        uint8_t* mapping;
+        vector<uint8_t> flushed;                        // Contents as of the last flush
+        uint64_t flushCount;
+};
+#endif
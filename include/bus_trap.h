@@ -0,0 +1,19 @@
+/*
+ * Somewhere other than the NES's memory for the CPU's reads and writes to go. The NES reaches
+ * each 256 byte page through a table and sends only the pages a trap is installed on to it (see
+ * NES::trapPage()), so a debugger watching memory costs nothing on the other pages, or once it's
+ * gone. A trap reaches the memory underneath through NES::readUntrapped()/writeUntrapped().
+ */
+
+#ifndef BUS_TRAP_H
+#define BUS_TRAP_H
+
+#include <cstdint>
+
+class BusTrap {
+    public:
+        virtual ~BusTrap() {}
+        virtual uint8_t read(uint16_t addr) = 0;
+        virtual void write(uint16_t addr, uint8_t val) = 0;
+};
+#endif
@@ -0,0 +1,25 @@
+/*
+ * Cheat codes that patch PRG ROM as the CPU sees it: Game Genie codes (6 letters for address and
+ * value, 8 with a compare value) and raw codes written AAAA:VV or AAAA?CC:VV, in hex. A code with
+ * a compare value only applies while the ROM byte mapped at its address is that value, which is
+ * how Game Genie codes aim at one bank of a bank-switched cart.
+ *
+ * Codes aren't checked on reads. The NES reads PRG ROM through a table of page pointers, and a
+ * page with an active cheat points at a patched copy of itself instead (see NES::mapPRG()).
+ */
+
+#ifndef CHEATS_H
+#define CHEATS_H
+
+#include <cstdint>
+
+struct Cheat {
+    uint16_t addr;                                      // $8000-$FFFF
+    uint8_t value;
+    uint8_t compare;
+    bool compared;                                      // Only applies while the ROM byte is compare
+};
+
+bool decodeGameGenie(const char* code, Cheat& cheat);   // False if it isn't a 6 or 8 letter code
+bool parseCheat(const char* code, Cheat& cheat);        // Game Genie or raw, false if it's neither
+#endif
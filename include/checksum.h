@@ -0,0 +1,41 @@
+/*
+ * Incremental CRC-32 (the zip/gzip polynomial) and SHA-1, fed a piece at a time so a ROM can be
+ * hashed as it is read or inflated rather than in a second pass over the whole image.
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+#define SHA1_SIZE 20u
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using std::string;
+
+class CRC32 {
+    public:
+        CRC32();
+        void update(const uint8_t* data, size_t size);
+        uint32_t value() const;
+
+    private:
+        uint32_t crc;                                   // Inverted while running
+};
+
+class SHA1 {
+    public:
+        SHA1();
+        void update(const uint8_t* data, size_t size);
+        void finish(uint8_t digest[SHA1_SIZE]);         // No more updates after this
+        static string hex(const uint8_t digest[SHA1_SIZE]);
+
+    private:
+        uint32_t h[5];
+        uint8_t block[64];
+        size_t blockUsed;
+        uint64_t length;                                // Bytes hashed so far
+
+        void compress(const uint8_t* data);
+};
+#endif
@@ -0,0 +1,27 @@
+/*
+ * Standard controller on one of the ports at $4016/$4017. The pad holds an 8-bit shift register
+ * that is loaded from the buttons while the strobe (bit 0 of a $4016 write, shared by both ports)
+ * is high and shifted out one bit per read once it goes low, in the order A, B, Select, Start,
+ * Up, Down, Left, Right. Reads past the eighth return 1, as an official pad does. The upper bits
+ * of a read are open bus, which on the NES is the $40 of the address just fetched.
+ */
+
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+#define CONTROLLER_OPEN_BUS 0x40u
+
+#include <cstdint>
+
+class ControllerPort {
+    public:
+        void reset();
+        void setButtons(uint8_t buttons);               // Host state, seen by the next load of the register
+        void strobe(uint8_t val);                       // $4016 write
+        uint8_t read();                                 // $4016/$4017 read, shifts while the strobe is low
+
+    private:
+        uint8_t buttons;
+        uint8_t shift;                                  // Next bit to report in bit 0
+        bool strobeHigh;
+};
+#endif
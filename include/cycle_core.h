@@ -0,0 +1,78 @@
+/*
+ * Experimental cycle-interleaved core, NES::setAccurate(). Instead of letting the CPU run ahead
+ * and catching the PPU up when it is touched, the CPU, PPU and APU are each a C++20 coroutine
+ * that does one clock's work and then co_awaits the next, and a master clock scheduler resumes
+ * the PPU every dot and the CPU and APU every third. Nothing ever runs ahead of anything else.
+ *
+ * The CPU coroutine spreads an instruction over its cycles rather than doing everything on the
+ * first one: the opcode is fetched on the first cycle, the operands on the second, and the read
+ * or write the instruction exists for lands on its last base cycle, so register accesses see the
+ * PPU as it is on that cycle. Page crossing and branch penalties, OAM DMA and interrupt entry are
+ * waited out afterwards. Instruction behaviour itself is the interpreter's (MOS6502 members).
+ *
+ * Coroutine frames come from a small arena owned by the core rather than the heap. The frames
+ * hold where each component is within its work, which can't be copied, so an instance in this
+ * mode can't be forked or saved.
+ */
+
+#ifndef CYCLE_CORE_H
+#define CYCLE_CORE_H
+#define CYCLE_CORE_ARENA_SIZE 4096                      // Room for the three coroutine frames
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+
+#include "arena.h"
+
+class NES;
+
+// One component's run, suspended between clocks
+class CycleTask {
+    public:
+        struct promise_type {
+            CycleTask get_return_object() { return CycleTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            static CycleTask get_return_object_on_allocation_failure() { return CycleTask(nullptr); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+
+            // The coroutine's own arguments pick the arena, its memory goes when the arena does
+            static void* operator new(size_t size, Arena& arena, NES*) noexcept { return arena.allocate(size, alignof(std::max_align_t)); }
+            static void operator delete(void*, size_t) {}
+        };
+
+        CycleTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+        CycleTask(CycleTask&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+        ~CycleTask() { if (handle) handle.destroy(); }
+        CycleTask(const CycleTask&) = delete;
+        CycleTask& operator=(const CycleTask&) = delete;
+        bool isValid() const { return (bool) handle; }
+        void resume() { handle.resume(); }              // Run one clock
+
+    private:
+        std::coroutine_handle<promise_type> handle;
+};
+
+// What a component awaits at the end of each clock
+typedef std::suspend_always BusCycle;
+
+class CycleCore {
+    public:
+        CycleCore(NES* nes);
+        bool isValid() const;                           // Every frame fit in the arena
+        void runFrame();                                // Clock everything until the PPU enters vblank
+
+    private:
+        NES* nes;
+        Arena arena;                                    // Declared before the tasks so it outlives their frames
+        CycleTask cpu;
+        CycleTask ppu;
+        CycleTask apu;
+
+        static CycleTask runCPU(Arena& arena, NES* nes);
+        static CycleTask runPPU(Arena& arena, NES* nes);
+        static CycleTask runAPU(Arena& arena, NES* nes);
+};
+#endif
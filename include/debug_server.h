@@ -0,0 +1,65 @@
+/*
+ * A Debugger (see debugger.h) served over TCP on 127.0.0.1, one client at a time, with a line
+ * based text protocol a person can type at with nc. Numbers are hex, with or without a $ or 0x.
+ * Every command gets one reply line starting "ok" or "error", except listings, which are one line
+ * per item followed by "ok". Commands that run the NES reply with where it stopped, and any line
+ * the client sends while one runs interrupts it between frames before being handled itself:
+ *
+ *   ok stopped <breakpoint|watchpoint|step|frames|limit|interrupted> pc=C000 frame=12 [read|write=ADDR value=VV by=PC]
+ *
+ *   break ADDR / delete ADDR       PC breakpoint on or off
+ *   breaks                         list breakpoints
+ *   watch FIRST[-LAST] [r|w|rw]    stop after a read and/or write in the range (default rw)
+ *   unwatch FIRST[-LAST]           remove a watchpoint
+ *   watches                        list watchpoints
+ *   step [N]                       run N instructions (default 1)
+ *   continue                       run until stopped or the frame limit
+ *   stop                           does nothing, send it to interrupt a run
+ *   frame [N]                      run to the end of the Nth frame from now (default 1)
+ *   regs                           a x y p sp pc, cycles left of the current instruction, frame, clock
+ *   read ADDR [LEN]                LEN bytes (default 1, at most 256) without side effects
+ *   write ADDR BYTE...             poke RAM or PRG RAM
+ *   heatmap on|off|clear           count CPU accesses per page
+ *   heatmap                        list pages touched since the last clear, as PAGE reads writes
+ *   quit                           close the connection
+ *   shutdown                       close the connection and stop serving
+ */
+
+#ifndef DEBUG_SERVER_H
+#define DEBUG_SERVER_H
+#define DEBUG_MAX_LINE 1024                             // Longer command lines are refused
+
+#include <cstdint>
+#include <string>
+
+#include "debugger.h"
+#include "nes.h"
+
+using std::string;
+
+class DebugServer {
+    public:
+        DebugServer(NES* nes, uint16_t port);           // 0 picks a free port
+        ~DebugServer();
+        DebugServer(const DebugServer&) = delete;
+        DebugServer& operator=(const DebugServer&) = delete;
+        bool isOpen() const;
+        uint16_t localPort() const;
+        void run();                                     // Serve clients until one sends shutdown
+        uint64_t commandsServed() const;
+
+    private:
+        Debugger debugger;
+        int listener;
+        uint16_t port;
+        uint64_t served;
+        bool shuttingDown;
+        int client;                                     // Connection being served, -1 between connections
+        string pending;                                 // Received from it but not yet handled
+
+        bool serve();                                   // One command from the client, false once it closes
+        bool clientWaiting();                           // Anything more from the client, even a hang up
+        string handle(const string& line);              // The reply, without its final newline
+        string stopReply(STOPREASON reason) const;
+};
+#endif
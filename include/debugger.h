@@ -0,0 +1,125 @@
+/*
+ * Breakpoints, watchpoints and a memory access heatmap for an NES, costing nothing it isn't
+ * using. The NES already reaches each 256 byte page of the CPU's address space through a table
+ * (see NES::trapPage()); the debugger swaps itself in only for the pages a watchpoint covers, or
+ * for all of them while the heatmap is on, and a count per page says whether any watchpoint
+ * covers it before any range is looked at. Every other page is reached as before.
+ *
+ * PC breakpoints are checked between instructions, which are the only block boundaries there
+ * are once the debugger is attached: it suspends the fused and recompiled paths, which run
+ * several instructions in one go, and gives them back when it is destroyed. The accurate core
+ * can't be debugged.
+ *
+ * Frames run through NES::runFrame() as usual, but stop part way when the debugger asks, and the
+ * next runFrame() carries on from there.
+ */
+
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+#define DEBUG_PAGES 256                                 // 256 byte pages in the CPU address space
+
+#include <bitset>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "bus_trap.h"
+#include "nes.h"
+
+using std::vector;
+
+enum STOPREASON {
+    RUNNING,
+    BREAKPOINT,                                         // About to run an instruction at a breakpoint
+    WATCHPOINT,                                         // The last cycle touched a watched address
+    STEPPED,                                            // Ran the instructions asked for
+    FRAMES_RUN,                                         // Ran the frames asked for
+    FRAME_LIMIT,                                        // The NES reached its frame limit
+    INTERRUPTED,                                        // The caller's interrupt check said stop
+};
+
+struct Watchpoint {
+    uint16_t first;                                     // Inclusive range
+    uint16_t last;
+    bool reads;
+    bool writes;
+};
+
+struct CPURegisters {
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t p;
+    uint8_t sp;
+    uint16_t pc;
+    unsigned int cyclesRemaining;                       // Of the instruction before pc, 0 between instructions
+};
+
+struct WatchHit {
+    uint16_t addr;
+    uint8_t value;
+    bool write;
+    uint16_t pc;                                        // Instruction that made the access
+};
+
+class Debugger : public BusTrap {
+    public:
+        Debugger(NES* nes);
+        ~Debugger();
+        Debugger(const Debugger&) = delete;
+        Debugger& operator=(const Debugger&) = delete;
+        bool isAttached() const;                        // False for an unloaded NES or the accurate core
+
+        // Runs until something stops it, at most frames whole frames (0 for no limit) or steps
+        // instructions (0 for no limit), or until the NES reaches its frame limit. interrupted, if
+        // given, is asked before each frame (or rest of one) runs and ends the run by returning true.
+        STOPREASON run(uint64_t frames, uint64_t steps, const std::function<bool()>& interrupted = nullptr);
+        const WatchHit& lastHit() const;                // The access that stopped the last WATCHPOINT
+
+        void setBreakpoint(uint16_t pc, bool set);
+        bool isBreakpoint(uint16_t pc) const;
+        vector<uint16_t> breakpoints() const;
+        void addWatchpoint(const Watchpoint& watch);
+        bool removeWatchpoint(uint16_t first, uint16_t last);      // False if there was no such range
+        const vector<Watchpoint>& watchpoints() const;
+
+        void setHeatmap(bool on);                       // Count accesses per page from now on
+        void clearHeatmap();
+        bool heatmapOn() const;
+        uint64_t pageReads(uint8_t page) const;
+        uint64_t pageWrites(uint8_t page) const;
+
+        // Memory without the side effects of a CPU access: registers read as 0 and aren't written
+        uint8_t peek(uint16_t addr) const;
+        bool poke(uint16_t addr, uint8_t val);          // RAM and PRG RAM only
+        CPURegisters registers() const;
+        uint64_t frameCount() const;
+        uint64_t masterClock() const;
+
+        uint8_t read(uint16_t addr) override;           // The CPU's accesses to trapped pages
+        void write(uint16_t addr, uint8_t val) override;
+        bool stopBefore(uint16_t pc);                   // From NES::runDebugged() before each instruction
+        bool stopAfter();                               // And after each cycle
+
+    private:
+        NES* nes;
+        bool attached;
+        const FusionTable* fusion;                      // Given back to the CPU on detaching
+        const CompiledBlock* compiled;
+        std::bitset<0x10000> breaks;
+        vector<Watchpoint> watches;
+        uint16_t pageWatches[DEBUG_PAGES];              // Watchpoints covering each page
+        bool heatmap;
+        uint64_t reads[DEBUG_PAGES];
+        uint64_t writes[DEBUG_PAGES];
+        uint64_t stepsLeft;                             // 0 when not stepping
+        bool atStart;                                   // Next stopBefore() is where the last run stopped
+        uint16_t instructionPC;
+        STOPREASON stopped;
+        WatchHit hit;
+
+        void updateTrap();                              // Trap only the pages something needs to see
+        void watchPages(const Watchpoint& watch, int change);
+        void check(uint16_t addr, uint8_t val, bool write);
+};
+#endif
@@ -0,0 +1,38 @@
+/*
+ * Runs the NES on its own thread for interactive use. Finished frames are published through a
+ * TripleBuffer and host input goes through an InputQueue that the NES drains whenever the game
+ * strobes the pads, so the emulation, presentation and input threads never share a lock. Frames are paced to the NTSC refresh rate unless
+ * throttling is turned off.
+ */
+
+#ifndef EMULATION_THREAD_H
+#define EMULATION_THREAD_H
+
+#include <atomic>
+#include <thread>
+
+#include "input_queue.h"
+#include "nes.h"
+#include "triple_buffer.h"
+
+class EmulationThread {
+    public:
+        EmulationThread(NES* nes, TripleBuffer* frames);
+        ~EmulationThread();
+        void start(bool throttled);                     // Start emulating into the triple buffer
+        void stop();                                    // Stop after the current frame and join
+        bool finished() const;                          // Thread has exited (frame limit or stop)
+        bool setInput(uint8_t port, uint8_t buttons);   // From one host thread, false if the queue is full
+        const InputQueue& inputQueue() const;           // Latencies are only read once the thread has finished
+
+    private:
+        NES* nes;
+        TripleBuffer* frames;
+        std::thread thread;
+        std::atomic<bool> stopRequested;
+        std::atomic<bool> done;
+        InputQueue input;
+
+        void loop(bool throttled);
+};
+#endif
@@ -0,0 +1,120 @@
+/*
+ * Frame output stage for recording video and taking screenshots. The PPU draws straight into
+ * buffers owned by a small pool here; when a frame is finished the NES swaps the PPU's buffer
+ * pointer for an empty one and queues the finished buffer, so pixels are never copied on the
+ * emulation thread. A worker thread converts queued frames to RGBA, either through the palette
+ * table or the (much heavier, optionally multithreaded) NTSC composite filter, and then
+ *
+ *  - streams them as raw RGB24 or YUV4MPEG2 (4:2:0) to a file, stdout ("-") or a command
+ *    ("|ffmpeg -i - out.mkv") and/or
+ *  - writes a PNG for each requested frame number.
+ *
+ * The emulation thread only waits when every buffer is queued or being converted; those waits
+ * are counted in poolStalls(). The worker times each stage per frame, see stageTiming().
+ */
+
+#ifndef FRAME_OUTPUT_H
+#define FRAME_OUTPUT_H
+#define FRAME_POOL_BUFFERS 4
+
+#include <cstdint>
+#include <cstdio>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "ntsc_filter.h"
+#include "ppu.h"
+#include "palette.h"
+
+using std::set;
+using std::string;
+
+enum VIDEOFORMAT {
+    RAW_RGB24,      // Packed 8-bit RGB, 256x240 per frame, no header
+    Y4M_420,        // YUV4MPEG2 with 4:2:0 BT.601 chroma, readable by ffmpeg and most encoders
+};
+
+// Work the output worker does per frame
+enum OUTPUTSTAGE {
+    PALETTE_STAGE,  // Pixel values to RGBA through the palette table
+    NTSC_STAGE,     // Pixel values to RGBA through the NTSC filter, replaces PALETTE_STAGE
+    ENCODE_STAGE,   // RGBA to RGB24 or Y4M and written to the stream
+    PNG_STAGE,      // Snapshot encoded and written
+    OUTPUT_STAGES,
+};
+
+struct StageTiming {
+    uint64_t frames;                                    // Frames that went through the stage
+    uint64_t totalNs;
+    uint64_t maxNs;
+};
+
+class FrameOutput {
+    public:
+        FrameOutput();
+        ~FrameOutput();
+        bool openStream(const char* target, VIDEOFORMAT format);    // File, "-" for stdout or "|command"
+        void addSnapshot(uint64_t frame);               // Write frame (1 = first frame) as a PNG
+        void setSnapshotPrefix(const string& prefix);   // PNGs are named <prefix><frame>.png
+        void enableNtscFilter(unsigned int helpers);    // Convert with the NTSC filter, helpers extra threads
+        void start();                                   // Start the worker, call after configuring
+
+        bool wants(uint64_t frame) const;               // Frame needs to go through the worker
+        uint16_t* acquire();                            // Empty buffer for the PPU to draw into
+        uint16_t* submit(uint16_t* frame, uint64_t frameNumber);   // Queue frame, get back an empty buffer
+        void release(uint16_t* frame);                  // Return an unused buffer to the pool
+        void close();                                   // Drain the queue and close outputs
+
+        uint64_t framesWritten() const;                 // Frames streamed
+        uint64_t snapshotsWritten() const;              // PNGs written
+        uint64_t poolStalls() const;                    // Times the emulation thread waited for a buffer
+        const StageTiming& stageTiming(OUTPUTSTAGE stage) const;   // Valid after close()
+
+    private:
+        struct Job {
+            uint16_t* frame;
+            uint64_t frameNumber;
+        };
+
+        FILE* stream;
+        bool streamIsPipe;
+        VIDEOFORMAT format;
+        set<uint64_t> snapshots;
+        string snapshotPrefix;
+
+        uint16_t* poolMemory;
+        uint16_t* freeBuffers[FRAME_POOL_BUFFERS];
+        unsigned int freeCount;
+        Job queue[FRAME_POOL_BUFFERS];                  // Ring of frames waiting for the worker
+        unsigned int queueHead;
+        unsigned int queueCount;
+
+        std::mutex lock;                                // Guards the pool and queue only
+        std::condition_variable frameQueued;
+        std::condition_variable bufferFreed;
+        std::thread worker;
+        bool running;
+        bool closing;
+
+        uint64_t frames;
+        uint64_t pngs;
+        uint64_t stalls;
+
+        // Worker side, only touched by the worker thread
+        uint32_t rgbaTable[PALETTE_ENTRIES];
+        NtscFilter* ntsc;
+        uint32_t* rgba;                                 // Frame being output, after conversion
+        uint8_t* rgb;
+        uint8_t* yuv;
+        StageTiming timings[OUTPUT_STAGES];
+
+        void workerLoop();
+        void packRGB();
+        void writeY4M();
+        bool writePNG(const string& fileName);
+        void recordStage(OUTPUTSTAGE stage, uint64_t startNs);
+};
+#endif
@@ -0,0 +1,62 @@
+/*
+ * DEFLATE (RFC 1951) decoder for ROMs kept in zip and gzip archives. It needs no buffer for the
+ * whole output: decoded bytes go into deflate's own 32KB history window, and every time the
+ * window fills it is handed to a ByteSink, which copies it to wherever it finally belongs.
+ *
+ * Huffman codes up to INFLATE_FAST_BITS long are decoded with one table lookup, longer ones a bit
+ * at a time from the canonical code counts.
+ */
+
+#ifndef INFLATE_H
+#define INFLATE_H
+#define INFLATE_WINDOW 32768u                           // Furthest back a match can reach
+#define INFLATE_FAST_BITS 9u
+#define INFLATE_MAX_BITS 15u
+
+#include <cstddef>
+#include <cstdint>
+
+// Where decoded bytes go, in order and in pieces of any size
+class ByteSink {
+    public:
+        virtual ~ByteSink() {}
+        virtual void write(const uint8_t* data, size_t size) = 0;
+};
+
+class Inflater {
+    public:
+        Inflater(const uint8_t* input, size_t size);
+        bool inflate(ByteSink& out, uint64_t limit);    // False on corrupt data or more than limit bytes out
+        uint64_t written() const;
+
+    private:
+        struct Huffman {
+            uint16_t fast[1 << INFLATE_FAST_BITS];      // Symbol << 4 | length, 0 when the code is longer
+            uint16_t count[INFLATE_MAX_BITS + 1];       // Codes of each length
+            uint16_t symbol[288];                       // Symbols ordered by code
+        };
+
+        const uint8_t* input;
+        size_t size;
+        size_t position;                                // Next input byte to load into bits
+        uint64_t bits;                                  // Loaded input, next bit lowest
+        unsigned int bitCount;
+        uint8_t window[INFLATE_WINDOW];
+        uint64_t total;                                 // Bytes decoded
+        uint64_t flushed;                               // Bytes handed to the sink
+        Huffman lengths;
+        Huffman distances;
+
+        void refill();
+        bool need(unsigned int count);                  // False if the input ran out
+        uint32_t take(unsigned int count);
+        bool build(Huffman& code, const uint8_t* lengths, unsigned int symbols);
+        int decode(const Huffman& code);                // -1 for a code that isn't in the table
+        void put(uint8_t byte, ByteSink& out);
+        void flush(ByteSink& out);
+        bool stored(ByteSink& out, uint64_t limit);
+        bool dynamicCodes();
+        void fixedCodes();
+        bool codes(ByteSink& out, uint64_t limit);
+};
+#endif
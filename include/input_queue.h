@@ -0,0 +1,50 @@
+/*
+ * Lock-free single producer, single consumer queue of host input events. The host thread pushes
+ * each change of a pad's buttons stamped with the steady_clock time it happened; the NES it is
+ * attached to (NES::setInputQueue) pops everything waiting at the moment the game strobes $4016,
+ * so an event is applied on the exact master clock dot the game next latches the pads rather
+ * than at the start of the following frame.
+ *
+ * The consumer also records, for each applied event, how long it took from being pushed until a
+ * CPU read of its port first saw it. The most recent INPUT_LATENCY_SAMPLES are kept.
+ */
+
+#ifndef INPUT_QUEUE_H
+#define INPUT_QUEUE_H
+#define INPUT_QUEUE_SIZE 256u                           // Events, a power of two
+#define INPUT_LATENCY_SAMPLES 4096u
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+struct InputEvent {
+    uint64_t hostTime;                                  // steady_clock nanoseconds when it happened
+    uint8_t port;
+    uint8_t buttons;
+};
+
+class InputQueue {
+    public:
+        InputQueue();
+        static uint64_t now();                          // steady_clock nanoseconds, the events' time base
+
+        // Producer (host input thread)
+        bool push(uint8_t port, uint8_t buttons);       // Stamped now, false if the queue is full
+        bool push(const InputEvent& event);
+
+        // Consumer (emulation thread)
+        bool pop(InputEvent& event);
+        void observed(uint64_t latency);                // Push to first read of an event, nanoseconds
+        vector<uint64_t> latencies() const;             // Recorded latencies, oldest first, once the consumer has stopped
+
+    private:
+        InputEvent events[INPUT_QUEUE_SIZE];
+        alignas(64) std::atomic<uint64_t> head;         // Next event to pop, written by the consumer
+        alignas(64) std::atomic<uint64_t> tail;         // Next slot to push, written by the producer
+        alignas(64) uint64_t latencySamples[INPUT_LATENCY_SAMPLES];
+        uint64_t latencyCount;
+};
+#endif
@@ -0,0 +1,60 @@
+/*
+ * Fixed set of slots for instances made by NES::fork(), for search workloads that branch the
+ * emulator thousands of times a second. Each slot holds an NES object, its state block and its
+ * output buffers; alongside them are the snapshots forks share pages from (an instance's pages
+ * are moved to a snapshot the first time it is forked after writing to them, and the snapshot
+ * stays until nothing reads from it). Everything comes out of one Arena up front, so forking and
+ * discarding never touch the global allocator.
+ *
+ * Roots are the instances not made by the pool that get forked into it; each holds a snapshot of
+ * its own, so the pool is sized for how many there will be. Forking from more roots than declared
+ * can run out of snapshots, and fork() then returns nullptr.
+ *
+ * The pool must outlive every instance forked into it and every instance forked from them. It is
+ * not thread safe; a thread searching in parallel should use its own pool.
+ */
+
+#ifndef INSTANCE_POOL_H
+#define INSTANCE_POOL_H
+
+#include <cstdint>
+#include <vector>
+
+#include "arena.h"
+#include "nes.h"
+
+using std::vector;
+
+class InstancePool {
+    friend class NES;
+
+    public:
+        InstancePool(unsigned int instances, unsigned int roots = 1);   // Room for this many forks alive at once
+        ~InstancePool();
+        InstancePool(const InstancePool&) = delete;
+        InstancePool& operator=(const InstancePool&) = delete;
+        void release(NES* nes);                         // Discard an instance made by NES::fork()
+        unsigned int available() const;                 // Forks that can be made before the pool is full
+
+    private:
+        struct Slot {
+            NESState state;
+            alignas(NES) uint8_t object[sizeof(NES)];   // The NES itself, constructed in place
+            uint16_t frame[SCREEN_WIDTH * SCREEN_HEIGHT];
+            int16_t samples[APU_SAMPLE_BUFFER_SIZE];
+        };
+
+        Arena arena;
+        Slot* slots;
+        StatePages* snapshots;
+        uint32_t* snapshotReferences;                   // Instances reading from each snapshot
+        vector<unsigned int> freeSlots;                 // Reserved up front, so never reallocated
+        vector<unsigned int> freeSnapshots;
+
+        static size_t arenaSize(unsigned int instances, unsigned int roots);
+        Slot* takeSlot(unsigned int& index);            // nullptr once every slot is in use
+        StatePages* takeSnapshot();                     // With one reference, nullptr if none are left
+        void retainSnapshot(StatePages* snapshot);
+        void releaseSnapshot(StatePages* snapshot);
+};
+#endif
@@ -0,0 +1,151 @@
+/*
+ * Process wide metrics for watching emulator health in production: counters and histograms held
+ * in one registry and written out every so often by a MetricsExporter, as Prometheus text or JSON.
+ *
+ * Every thread that updates a metric gets its own shard of every value, so an update is a load and
+ * a store to memory no other thread writes, with no locked instruction and no shared cache line.
+ * The exporter sums the shards as it reads them. Histograms have fixed HDR style buckets: exact
+ * below 16, then 16 linear steps per power of two (about 6% resolution) up to 2^40.
+ *
+ * Building with NES_METRICS off turns every update into an empty inline function, and the core
+ * skips the per-instruction and per-frame counting that feeds them.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+#define METRICS_MAX_COUNTERS 32
+#define METRICS_MAX_HISTOGRAMS 8
+#define HISTOGRAM_SUB_BITS 4                            // 16 buckets per power of two
+#define HISTOGRAM_MAX_BITS 40                           // Larger values land in the last bucket
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+// One thread's part of every metric, only ever written by that thread
+struct MetricsShard {
+    std::atomic<uint64_t> counters[METRICS_MAX_COUNTERS];
+    std::atomic<uint64_t> buckets[METRICS_MAX_HISTOGRAMS][HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> sums[METRICS_MAX_HISTOGRAMS];
+    std::atomic<uint64_t> maxima[METRICS_MAX_HISTOGRAMS];
+};
+
+struct HistogramSnapshot {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    vector<uint64_t> buckets;                           // HISTOGRAM_BUCKETS counts
+
+    uint64_t percentile(double p) const;                // Lower bound of the bucket holding it
+};
+
+class MetricsRegistry {
+    public:
+        static MetricsRegistry& instance();
+        unsigned int addCounter(const char* name, const char* help);
+        unsigned int addHistogram(const char* name, const char* help);
+        MetricsShard& shard();                          // The calling thread's, made on first use
+        uint64_t counter(unsigned int id) const;
+        HistogramSnapshot histogram(unsigned int id) const;
+        string prometheus() const;
+        string json() const;
+
+        static unsigned int bucket(uint64_t value);
+        static uint64_t bucketStart(unsigned int bucket);
+
+    private:
+        struct Metric {
+            const char* name;
+            const char* help;
+        };
+
+        mutable std::mutex lock;                        // Guards the lists, never taken by updates
+        vector<std::unique_ptr<MetricsShard>> shards;   // Kept after their thread exits so nothing is lost
+        vector<Metric> counters;
+        vector<Metric> histograms;
+
+        MetricsRegistry() {}
+};
+
+class Counter {
+    public:
+        Counter(const char* name, const char* help) : id(MetricsRegistry::instance().addCounter(name, help)) {}
+        void add(uint64_t n = 1) {
+#ifdef NES_METRICS
+            std::atomic<uint64_t>& value = MetricsRegistry::instance().shard().counters[id];
+            value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+#else
+            (void) n;
+#endif
+        }
+
+    private:
+        unsigned int id;
+};
+
+class Histogram {
+    public:
+        Histogram(const char* name, const char* help) : id(MetricsRegistry::instance().addHistogram(name, help)) {}
+        void record(uint64_t value) {
+#ifdef NES_METRICS
+            MetricsShard& shard = MetricsRegistry::instance().shard();
+            std::atomic<uint64_t>& count = shard.buckets[id][MetricsRegistry::bucket(value)];
+            count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            shard.sums[id].store(shard.sums[id].load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+            if (value > shard.maxima[id].load(std::memory_order_relaxed))
+                shard.maxima[id].store(value, std::memory_order_relaxed);
+#else
+            (void) value;
+#endif
+        }
+
+    private:
+        unsigned int id;
+};
+
+// Everything the emulator reports
+struct Metrics {
+    static Counter frames;
+    static Counter instructions;
+    static Counter cpuCycles;
+    static Counter ppuSyncs;                            // Catch-ups of the PPU to the CPU
+    static Counter nmis;
+    static Counter irqs;
+    static Counter audioStalls;                         // The audio writer had no free block
+    static Histogram frameTime;                         // Nanoseconds to emulate a frame
+    static Histogram presentLatency;                    // Nanoseconds from a frame's publish to its present
+    static Histogram frameInstructions;
+    static Histogram frameCycles;
+};
+
+// Writes the registry to a file on a low priority thread, replacing it whole each time. A path
+// ending in .json gets JSON, anything else Prometheus text.
+class MetricsExporter {
+    public:
+        MetricsExporter(const char* path, unsigned int intervalMs);
+        ~MetricsExporter();                             // Writes once more and stops
+        MetricsExporter(const MetricsExporter&) = delete;
+        MetricsExporter& operator=(const MetricsExporter&) = delete;
+        bool write();                                   // Write now
+
+    private:
+        string path;
+        bool json;
+        unsigned int intervalMs;
+        std::mutex lock;
+        std::condition_variable wake;
+        bool stopping;
+        std::thread thread;
+
+        void loop();
+};
+#endif
@@ -7,16 +7,36 @@
 #define NES_H
 
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <fstream>
 
+#include "arena.h"
 #include "cpu.h"
 #include "ppu.h"
+#include "apu.h"
+#include "audio_writer.h"
+#include "battery_ram.h"
+#include "bus_trap.h"
+#include "cheats.h"
+#include "checksum.h"
+#include "controller.h"
+#include "frame_output.h"
+#include "input_queue.h"
+#include "opcode_profile.h"
+#include "paged_memory.h"
+#include "triple_buffer.h"
 
 using std::ifstream;
+using std::shared_ptr;
 using std::vector;
 
 class MOS6502;
+class InstancePool;
+class CycleCore;
+class CartridgeBuilder;
+class Debugger;
+class AudioThread;
 
 struct ROMHeader {
     uint8_t string[4];
@@ -31,25 +51,183 @@ struct ROMHeader {
 };
 
 struct Cartridge {
-    struct ROMHeader* header;
+    struct ROMHeader header;
     vector<uint8_t> prgROM;
-    vector<uint8_t> chrROM;
-    char* romFileName;
+    vector<uint8_t> chrROM;                             // Empty if the cart has CHR RAM instead
+    const char* romFileName;
+    uint32_t crc32;                                     // Of the iNES image the cartridge was read from
+    uint8_t sha1[SHA1_SIZE];
 };
 
 const unsigned int HEADER_SIZE = 16u;
 const unsigned int TRAINER_SIZE = 512u;
+const unsigned int PRG_RAM_SIZE = 8192u;
+const unsigned int CHR_RAM_SIZE = 8192u;
+const unsigned int PRG_PAGE_SIZE = 4096u;               // Granularity of the PRG ROM page table
+const unsigned int PRG_PAGES = 8u;                      // $8000-$FFFF
+
+// Storage behind the paged memories, kept apart from the rest of the state so a fork can share
+// it a page at a time. Pages of a snapshot that forks read from are never written again.
+struct alignas(64) StatePages {
+    uint8_t wram[CPU_MEM_SIZE];                         // CPU work RAM
+    uint8_t vram[VRAM_SIZE];                            // Nametables
+    uint8_t prgRAM[PRG_RAM_SIZE];                       // Cartridge $6000-$7FFF
+    uint8_t chrRAM[CHR_RAM_SIZE];                       // Pattern tables for carts without CHR ROM
+};
+
+// Everything that changes while emulating, in one cache line aligned block taken from an Arena.
+// It is trivially copyable, so an instance can be cloned or saved with a memcpy; the only
+// pointers inside (component back-pointers, page tables, output buffers) are rebound by the
+// owning NES. The scheduler fields and CPU registers come first so the per-cycle loop stays in
+// one line. Everything before pages is copied whole by NES::fork(), pages are copied on write.
+struct alignas(64) NESState {
+    uint64_t masterClock;                               // PPU dots since power on
+    uint64_t ppuClock;                                  // Next dot the PPU will run, it lags masterClock
+    uint64_t vblankDot;                                 // Master clock dot the PPU next enters vblank
+    uint64_t frames;                                    // Frames completed
+    bool nmiPending;                                    // PPU raised NMI, taken at next instruction
+    ControllerPort controllers[2];                      // Pads on $4016 and $4017
+
+    MOS6502 cpu;                                        // Registers only
+    PPU ppu;                                            // Registers and pipeline, OAM, palette and page tables
+    APU apu;
+    PagedMemory<CPU_MEM_SIZE / MEMORY_PAGE_SIZE> wram;  // $0000-$07FF, mirrored through $1FFF
+    PagedMemory<PRG_RAM_SIZE / MEMORY_PAGE_SIZE> prgRAM;
+    StatePages pages;
+};
+
+// What each 256 byte page of the CPU's address space is wired to
+enum BUSPAGE : uint8_t {
+    BUS_RAM,                                            // $0000-$1FFF
+    BUS_PPU,                                            // $2000-$3FFF
+    BUS_IO,                                             // $4000-$40FF, APU, OAM DMA and controllers
+    BUS_OPEN,                                           // $4100-$5FFF, nothing on an NROM cart
+    BUS_PRG_RAM,                                        // $6000-$7FFF
+    BUS_PRG_ROM,                                        // $8000-$FFFF
+    BUS_TRAPPED,                                        // Handed to the page's BusTrap (see trapPage())
+};
 
 class NES {
+    friend class InstancePool;
+    friend class CycleCore;
+    friend class Debugger;                              // Runs frames a piece at a time and reads memory without side effects
+    friend class MOS6502;
+    friend struct Recompiled;
+    friend class NESBench;                              // Microbenchmarks drive the internals directly
+    friend class ConformanceRunner;                     // cpu_conformance runs the CPU with every page trapped
+
     public:
-        NES(const char* romFile);
-        void run();
+        // ROM files can be iNES, zip or gzip (see rom_loader.h), archives are cached in romCache if given
+        NES(const char* romFile, Arena* arena = nullptr, const char* romCache = nullptr);  // State comes from arena (or a private one)
+        NES(const uint8_t* rom, size_t size, Arena* arena = nullptr);   // iNES, zip or gzip image already in memory, copied
+        ~NES();
+        NES(const NES&) = delete;
+        NES& operator=(const NES&) = delete;
+        bool isLoaded() const;                          // ROM was read and is supported
+        NES* fork(InstancePool& pool);                  // Copy of this instance living in pool, nullptr if full
+        void run();                                     // Run until the frame limit (forever if 0)
+        void runFrame();                                // Emulate exactly one video frame (less if a debugger stops it)
+        void setFrameLimit(uint64_t frames);            // Stop run() after this many frames
+        bool frameLimitReached() const;
+        void setInput(uint8_t port, uint8_t buttons);   // Button state for controller port 0 or 1
+        void setInputQueue(InputQueue* queue);          // Apply queued host input as the game strobes the pads
+        void setFrameSkip(bool skip);                   // Don't compose pixels from the next frame on
+        void setAudioWriter(AudioWriter* writer);       // Stream every frame's samples to writer
+        void setAudioThread(bool threaded);             // Synthesize audio on a worker thread, a frame late (see audio_thread.h)
+        void setFrameOutput(FrameOutput* output);       // Hand finished frames to output (nullptr detaches)
+        void setPresentBuffer(TripleBuffer* frames);    // Publish finished frames for a presenter
+        void setFrameBuffer(uint16_t* pixels);          // Draw into caller memory instead (nullptr goes back)
+        void setOpcodeProfile(OpcodeProfile* profile);  // Count opcode pairs into profile (nullptr stops)
+        void setFusionTable(const FusionTable* table);  // Fuse the table's pairs, nullptr runs each instruction alone
+        bool loadCompiled(const char* path);            // Run PRG ROM through a shared object from nes_recompile
+        bool setAccurate(bool accurate);                // Cycle-interleaved core (see cycle_core.h), before the first frame
+        bool hasBattery() const;                        // Cart keeps $6000-$7FFF with a battery (iNES flags 6 bit 1)
+        bool attachBattery(const char* path);           // Keep $6000-$7FFF in path (see battery_ram.h), before the first frame
+        bool addCheat(const char* code);                // Game Genie or raw (see cheats.h), false if unreadable
+        void clearCheats();
+        size_t cheatCount() const;
+        uint64_t frameCount() const;
+        uint32_t romCRC() const;                        // CRC-32 of the whole iNES image
+        string romSHA1() const;                         // SHA-1 of the whole iNES image, in hex
+        const uint16_t* frameBuffer() const;            // Last composed frame while no output stage owns it
+        const int16_t* audioSamples(size_t& count) const;   // Last frame's samples (the one before with an audio thread)
+        void readRAM(uint8_t out[CPU_MEM_SIZE]) const;  // Copy of CPU work RAM
+        size_t stateSize() const;                       // Bytes saveState() writes
+        bool saveState(uint8_t* out, size_t size) const;
+        bool loadState(const uint8_t* data, size_t size);   // Only states saved with the same ROM and build
         uint8_t readMem(uint16_t addr);
         void writeMem(uint16_t addr, uint8_t val);
-    
+        uint8_t readUntrapped(uint16_t addr);           // As readMem() would with no traps, for traps and DMA
+        void writeUntrapped(uint16_t addr, uint8_t val);
+        void trapPage(uint8_t page, BusTrap* trap);     // Accesses to addr >> 8 == page go to trap, nullptr gives it back
+
     private:
-        MOS6502* cpu;
+        Arena* ownedArena;                              // Set when no arena was supplied
+        NESState* state;
+        MOS6502* cpu;                                   // Components inside state
         PPU* ppu;
+        APU* apu;
+        shared_ptr<const Cartridge> cartridge;          // Shared by every fork of the instance that read it
+        shared_ptr<void> compiledLibrary;               // Handle of the loadCompiled() object, shared with forks
+        std::unique_ptr<CycleCore> cycleCore;           // Set in accurate mode, which can't be forked or saved
+        std::unique_ptr<BatteryRAM> battery;            // PRG RAM's storage once attachBattery() succeeds
+        std::unique_ptr<AudioThread> audioThread;       // Set while the APU only keeps time, never in forks
+        const uint8_t* prgPages[PRG_PAGES];             // PRG ROM as the CPU reads it, a page at a time
+        BUSPAGE busPages[256];                          // How readMem() and writeMem() reach each page
+        BusTrap* pageTraps[256];                        // Set where busPages is BUS_TRAPPED
+        vector<Cheat> cheats;
+        shared_ptr<uint8_t> cheatPages;                 // Patched copies of the pages cheats apply to, shared with forks
+        bool loaded;
+        InstancePool* pool;                             // Pool a fork lives in, nullptr otherwise
+        unsigned int poolSlot;
+        InstancePool* snapshotPool;                     // Pool holding the snapshot pages are shared from
+        StatePages* snapshot;                           // nullptr until the instance is first forked
+
+        uint64_t frameLimit;
+        bool frameSkip;
+        uint16_t* internalFrame;                        // Drawn into when no output stage supplies a buffer
+        uint16_t* externalFrame;                        // Caller's buffer from setFrameBuffer(), replaces internalFrame
+        int16_t* sampleBuffer;                          // The APU's output for the current frame
+        AudioWriter* audioWriter;
+        FrameOutput* frameOutput;
+        TripleBuffer* presentBuffer;
+        InputQueue* inputQueue;                         // Consumed on this instance's thread, nullptr for none
+        uint64_t inputPushed[2];                        // Push time of each port's last applied event until a read sees it
+        uint64_t ppuSyncs;                              // Counted only when built with NES_METRICS
+        Debugger* debugger;                             // Attached by the Debugger itself, nullptr for none
+        bool midFrame;                                  // The debugger stopped the current frame part way
+        bool composing;                                 // The current frame is composed
+
+        // What a frame's metrics are taken from, read as it starts and ends
+        struct FrameCounts {
+            uint64_t time;
+            uint64_t masterClock;
+            uint64_t instructions;
+            uint64_t nmis;
+            uint64_t irqs;
+            uint64_t ppuSyncs;
+        };
+        FrameCounts frameStart;
+
+        NES(const NES& parent, InstancePool* pool, unsigned int slot);  // Fork of parent in a pool slot
+        bool setup(Arena* arena);                       // Power on state, false if arena was full
+        bool loadCartridge(CartridgeBuilder& builder, const char* romFileName);
+        void mapPRG();                                  // Point prgPages at the mapped banks and apply cheats
+        void wireBus();                                 // Every page untrapped
+        uint8_t readPage(BUSPAGE page, uint16_t addr);
+        void writePage(BUSPAGE page, uint16_t addr, uint8_t val);
+        bool validState(const uint8_t* unpaged) const;  // A saved unpaged state has nothing out of range to index with
+        void bindComponents();                          // Point at the components in state and back
+        bool freezePages(InstancePool& pool);           // Move pages to a snapshot before sharing them
+        void cpuCycle();                                // One CPU cycle plus the APU alongside it
+        void syncPPU();                                 // Catch the PPU up to the current dot
+        void oamDMA(uint8_t page);                      // $4014 copy of a CPU page into OAM
+        void drainInput();                              // Apply every queued event
+        bool quietFor(unsigned int cycles);             // No interrupt can be taken within cycles CPU cycles
+        uint16_t* idleFrameBuffer();                    // Where the PPU draws when no frame output owns it
+        FrameCounts frameCounts() const;
+        void recordFrame(const FrameCounts& start) const;       // Add a finished frame to Metrics
+        bool runDebugged();                             // The frame's CPU cycles under the debugger, false if it stopped
 };
 
 #endif
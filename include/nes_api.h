@@ -0,0 +1,67 @@
+/*
+ * C interface to the emulator core, for embedding it in other programs without a process per
+ * session. Everything goes through an opaque handle; one handle is one console, and separate
+ * handles can be used from separate threads (a single handle is not thread safe).
+ *
+ * Functions returning int give 0 on success and -1 on failure, with the reason printed to stderr.
+ * This header only changes in ways existing callers can't see; NES_API_VERSION goes up when
+ * something is added.
+ */
+
+#ifndef NES_API_H
+#define NES_API_H
+#define NES_API_VERSION 1
+#define NES_SCREEN_WIDTH 256
+#define NES_SCREEN_HEIGHT 240
+#define NES_PALETTE_ENTRIES 512
+#define NES_AUDIO_SAMPLE_RATE 44100
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Controller buttons, one bit each in the value given to nes_set_input
+enum nes_button {
+    NES_BUTTON_A = 1 << 0,
+    NES_BUTTON_B = 1 << 1,
+    NES_BUTTON_SELECT = 1 << 2,
+    NES_BUTTON_START = 1 << 3,
+    NES_BUTTON_UP = 1 << 4,
+    NES_BUTTON_DOWN = 1 << 5,
+    NES_BUTTON_LEFT = 1 << 6,
+    NES_BUTTON_RIGHT = 1 << 7,
+};
+
+typedef struct nes_instance nes_instance;
+
+nes_instance* nes_create(void);                         // NULL if out of memory
+void nes_destroy(nes_instance* nes);
+
+// Power on with an iNES image, or a zip or gzip file holding one; the image is copied, so it can be
+// freed straight after
+int nes_load_rom_from_memory(nes_instance* nes, const uint8_t* rom, size_t size);
+
+int nes_step_frame(nes_instance* nes);                  // Run until the next vblank
+void nes_set_input(nes_instance* nes, unsigned int port, uint8_t buttons);    // Port 0 or 1
+
+// The frame from the last step, valid until the next step. Each pixel is a palette index with the
+// colour emphasis bits above it (emphasis << 6 | index), which indexes the nes_get_palette table.
+const uint16_t* nes_get_framebuffer(const nes_instance* nes);
+void nes_get_palette(uint32_t rgba[NES_PALETTE_ENTRIES]);   // RGBA bytes in memory order
+
+// Mono samples at NES_AUDIO_SAMPLE_RATE produced by the last step, valid until the next step
+size_t nes_get_audio_samples(const nes_instance* nes, const int16_t** samples);
+
+// Save states only load into an instance running the same ROM on the same build of the library.
+// States with fields out of range are rejected, so a damaged or hostile buffer fails to load.
+size_t nes_state_size(const nes_instance* nes);        // 0 before a ROM is loaded
+int nes_save_state(const nes_instance* nes, void* out, size_t size);
+int nes_load_state(nes_instance* nes, const void* state, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,79 @@
+/*
+ * Two player rollback netplay. Each side runs its own NES and exchanges only controller input
+ * over a UdpTransport, so neither player waits on the network: the local pad is applied to the
+ * frame being run straight away, and the remote pad is predicted to be what it last was. When
+ * the remote side's real input for a frame arrives and differs from the prediction, the session
+ * loads its save state from the start of that frame and re-runs every frame since with the
+ * corrected input, all within the one advance() call, before running the current frame.
+ *
+ * A save state of the start of each of the last NETPLAY_MAX_ROLLBACK frames is kept, and a side
+ * that gets further than that ahead of the input it has heard from the other waits for it
+ * instead (advance() returns false). Every packet repeats the last NETPLAY_REDUNDANCY frames of
+ * local input, so a lost packet costs nothing as long as one of the next few arrives. Save states
+ * and packets live in buffers set up when the session is, so advancing never allocates.
+ *
+ * Re-run frames aren't composed. Audio and frame outputs attached to the NES would see them
+ * again, so a session's NES should have neither.
+ */
+
+#ifndef NETPLAY_H
+#define NETPLAY_H
+#define NETPLAY_MAGIC 0x4E45504Cu                       // "NEPL"
+#define NETPLAY_MAX_ROLLBACK 8u                         // Frames of prediction allowed
+#define NETPLAY_REDUNDANCY 16u                          // Frames of input in every packet
+#define NETPLAY_HISTORY 64u                             // Frames of input remembered, a power of two
+
+#include <cstdint>
+#include <vector>
+
+#include "nes.h"
+#include "udp_transport.h"
+
+using std::vector;
+
+struct NetplayPacket {
+    uint32_t magic;
+    uint32_t firstFrame;                                // Frame inputs[0] is for
+    uint8_t count;
+    uint8_t inputs[NETPLAY_REDUNDANCY];
+};
+
+struct NetplayStats {
+    uint64_t frames;                                    // Frames run for the first time
+    uint64_t stalls;                                    // advance() calls that waited on the other side
+    uint64_t rollbacks;                                 // Mispredictions corrected
+    uint64_t resimulatedFrames;
+    uint64_t resimulationNs;                            // Loading states and re-running frames
+    uint64_t maxResimulationNs;                         // Longest single rollback
+};
+
+class NetplaySession {
+    public:
+        NetplaySession(NES* nes, UdpTransport* transport, uint8_t localPort);  // Local pad is on port 0 or 1
+        bool advance(uint8_t buttons);                  // Run the next frame with this local input, false if it had to wait
+        void poll();                                    // Take in remote input (rolling back if needed) and resend ours
+        uint64_t frame() const;                         // Frames run
+        uint64_t confirmedFrame() const;                // Frames whose remote input is known
+        const NetplayStats& stats() const;
+
+    private:
+        NES* nes;
+        UdpTransport* transport;
+        uint8_t localPort;
+        uint64_t current;                               // Next frame to run
+        uint64_t confirmed;                             // Remote input is known for every frame before this
+        uint8_t localInputs[NETPLAY_HISTORY];
+        uint8_t remoteInputs[NETPLAY_HISTORY];          // Known, or what was predicted when the frame ran
+        uint64_t remoteKnown[NETPLAY_HISTORY];          // Frame + 1 once that frame's remote input is known
+        uint64_t rollbackFrom;                          // Earliest mispredicted frame, UINT64_MAX for none
+        vector<uint8_t> states;                         // NETPLAY_MAX_ROLLBACK + 1 save states, by frame
+        size_t stateSize;
+        NetplayStats counters;
+
+        void receive();
+        void send();
+        void rollback();
+        void runFrame(uint64_t frame);                  // Save the frame's start state then run it
+        uint8_t* stateFor(uint64_t frame);
+};
+#endif
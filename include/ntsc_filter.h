@@ -0,0 +1,57 @@
+/*
+ * Composite video filter. Instead of looking colours up, every pixel is turned back into the
+ * square wave the 2C02 puts on the composite line (eight samples per pixel, twelve samples per
+ * colour subcarrier cycle) and decoded the way a TV would: luma and chroma are recovered from a
+ * one cycle window centred on each pixel, so neighbouring pixels bleed into each other and fine
+ * patterns pick up colour fringes. The subcarrier phase moves from line to line and frame to
+ * frame as it does on the console (ignoring the odd frame dot skip).
+ *
+ * Rows are independent, so each frame is split into bands shared between the calling thread and
+ * a small pool of helper threads. Each row's window sums are done four samples at a time.
+ */
+
+#ifndef NTSC_FILTER_H
+#define NTSC_FILTER_H
+#define NTSC_SAMPLES_PER_PIXEL 8
+#define NTSC_PHASES 12
+
+#include <cstdint>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "palette.h"
+#include "ppu.h"
+
+using std::vector;
+
+class NtscFilter {
+    public:
+        NtscFilter(unsigned int helpers);               // helpers = threads besides the caller
+        ~NtscFilter();
+        void apply(const uint16_t* frame, uint64_t frameNumber, uint32_t* out);    // Whole frame to RGBA
+
+    private:
+        float signalLevel[PALETTE_ENTRIES][NTSC_PHASES * 2];    // Normalised signal by pixel value and phase, twice over
+        alignas(16) float window[NTSC_PHASES][3][NTSC_PHASES];  // Y, I, Q weights by window start phase
+        uint8_t gamma[1024];                            // Linear 0-1 (in 1/1023 steps) to 8-bit output
+
+        vector<std::thread> threads;
+        std::mutex lock;
+        std::condition_variable workReady;
+        std::condition_variable workDone;
+        uint64_t generation;                            // Bumped for every frame handed to the helpers
+        unsigned int pending;                           // Helpers still working on the current frame
+        bool stopping;
+
+        // Current frame, set before the helpers are woken
+        const uint16_t* frame;
+        uint64_t frameNumber;
+        uint32_t* out;
+
+        void helperLoop(unsigned int band);
+        void filterRows(unsigned int band);             // Rows of band out of threads.size() + 1
+        void filterRow(unsigned int row, float* signal);
+};
+#endif
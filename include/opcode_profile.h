@@ -0,0 +1,49 @@
+/*
+ * Opcode pair profiling and the superinstruction table built from it. A profile counts how often
+ * each opcode is immediately followed by each other opcode while a game runs; the pairs that
+ * dominate (a DEX; BNE loop, CMP #imm; BEQ, LDA abs,X; STA abs,Y) become a FusionTable. With a
+ * table attached the CPU runs an instruction and the ones the table says follow it in a single
+ * dispatch, adding up their cycles, whenever nothing could observe the difference (see
+ * MOS6502::fuseFollowing()). Chains of pairs give triples and longer runs.
+ *
+ * Profiles are saved as text, one pair per line, so a profiling run of one game can drive the
+ * table for later runs: "first second count" with the opcodes in hex, most frequent first.
+ */
+
+#ifndef OPCODE_PROFILE_H
+#define OPCODE_PROFILE_H
+#define FUSION_MAX_PAIRS 32                             // Most pairs a table built from a profile holds
+#define FUSION_MIN_SHARE 0.002                          // Pairs rarer than this share of all pairs aren't worth it
+
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+class OpcodeProfile {
+    public:
+        OpcodeProfile();
+        void count(uint8_t first, uint8_t second) { counts[first << 8 | second]++; }
+        uint64_t pairCount(uint8_t first, uint8_t second) const;
+        uint64_t total() const;                         // Pairs counted over all opcodes
+        void clear();
+        bool save(const char* path) const;
+        bool load(const char* path);                    // Adds to what's already counted
+
+    private:
+        vector<uint64_t> counts;                        // Indexed by first << 8 | second
+};
+
+class FusionTable {
+    public:
+        FusionTable();
+        static FusionTable fromProfile(const OpcodeProfile& profile);   // The most frequent fusible pairs
+        bool fuses(uint8_t first, uint8_t second) const { return (pairs[first][second >> 6] >> (second & 0x3F)) & 0x1; }
+        bool add(uint8_t first, uint8_t second);        // False if the CPU can't fuse the pair
+        size_t size() const;
+
+    private:
+        uint64_t pairs[256][4];                         // Bit per second opcode
+        size_t pairCount;
+};
+#endif
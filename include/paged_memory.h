@@ -0,0 +1,107 @@
+/*
+ * A memory split into 1KB pages, each read through a pointer. Normally every page points at the
+ * memory's own storage, but an instance made by NES::fork() starts out reading its parent's pages
+ * and copies a page into its own storage only the first time it writes to it. Forking then costs
+ * a few pointers per memory, and running the fork costs a copy of just the pages it dirties.
+ *
+ * Read only memories (CHR ROM) are mapped the same way and are simply never written.
+ *
+ * Address pages can also alias each other: mirror() points several of them at the same page of
+ * storage, which is how the PPU's nametable mirroring is wired. Reads are a pointer lookup either
+ * way, and a write lands in the one page of storage every alias of it reads.
+ */
+
+#ifndef PAGED_MEMORY_H
+#define PAGED_MEMORY_H
+#define MEMORY_PAGE_BITS 10
+#define MEMORY_PAGE_SIZE (1u << MEMORY_PAGE_BITS)
+
+#include <cstdint>
+#include <cstring>
+
+template <unsigned int PAGES>
+class PagedMemory {
+    public:
+        // Read and write storage in place
+        void attach(uint8_t* storage) {
+            this->storage = storage;
+            for (unsigned int n = 0; n < PAGES; n++) {
+                bank[n] = storage + n * MEMORY_PAGE_SIZE;
+                alias[n] = n;
+            }
+            shared = 0x0u;
+            remap();
+        }
+
+        // Read only memory, nothing of it is ever owned
+        void map(const uint8_t* memory) {
+            storage = nullptr;
+            for (unsigned int n = 0; n < PAGES; n++) {
+                bank[n] = memory + n * MEMORY_PAGE_SIZE;
+                alias[n] = n;
+            }
+            shared = ALL_PAGES;
+            remap();
+        }
+
+        // Read pages (laid out like storage) from elsewhere until each is first written
+        void share(const uint8_t* pages) {
+            for (unsigned int n = 0; n < PAGES; n++)
+                bank[n] = pages + n * MEMORY_PAGE_SIZE;
+            shared = ALL_PAGES;
+            remap();
+        }
+
+        // Keep reading the current pages, copying them into storage as they are written
+        void inherit(uint8_t* storage) {
+            this->storage = storage;
+            shared = ALL_PAGES;
+        }
+
+        // Address page n shows page banks[n] of storage from now on, so several can show the same one
+        void mirror(const uint8_t banks[PAGES]) {
+            for (unsigned int n = 0; n < PAGES; n++)
+                alias[n] = banks[n];
+            remap();
+        }
+
+        bool ownsAny() const {
+            return shared != ALL_PAGES;
+        }
+
+        // Every page of storage in order, whatever the address pages show
+        void copyTo(uint8_t* out) const {
+            for (unsigned int n = 0; n < PAGES; n++)
+                std::memcpy(out + n * MEMORY_PAGE_SIZE, bank[n], MEMORY_PAGE_SIZE);
+        }
+
+        uint8_t read(uint32_t addr) const {
+            return page[addr >> MEMORY_PAGE_BITS][addr & (MEMORY_PAGE_SIZE - 1)];
+        }
+
+        void write(uint32_t addr, uint8_t val) {
+            uint32_t n = alias[addr >> MEMORY_PAGE_BITS];
+            if (shared & (1u << n)) {
+                std::memcpy(storage + n * MEMORY_PAGE_SIZE, bank[n], MEMORY_PAGE_SIZE);
+                bank[n] = storage + n * MEMORY_PAGE_SIZE;
+                shared &= ~(1u << n);
+                remap();
+            }
+            storage[n * MEMORY_PAGE_SIZE + (addr & (MEMORY_PAGE_SIZE - 1))] = val;
+        }
+
+    private:
+        static const uint32_t ALL_PAGES = (uint32_t) ((1ull << PAGES) - 1);
+
+        const uint8_t* page[PAGES];                     // Where each address page is read from
+        const uint8_t* bank[PAGES];                     // Where each page of storage is read from
+        uint8_t* storage;                               // This instance's own copy of every page
+        uint32_t shared;                                // Bit n set while storage page n is read from elsewhere
+        uint8_t alias[PAGES];                           // Page of storage each address page shows
+
+        void remap() {
+            for (unsigned int n = 0; n < PAGES; n++)
+                page[n] = bank[alias[n]];
+        }
+};
+#endif
@@ -0,0 +1,22 @@
+/*
+ * Conversion from the PPU's 9-bit pixels (emphasis << 6 | palette index) to RGB. The base colours
+ * are a common approximation of the 2C02's NTSC output; emphasis dims the channels that are not
+ * emphasised.
+ *
+ * Whole frames are converted with convertToRGBA(), which gathers eight table entries at a time
+ * when built with AVX2.
+ */
+
+#ifndef PALETTE_H
+#define PALETTE_H
+#define PALETTE_ENTRIES 512
+
+#include <cstdint>
+
+// Fill table with RGBA for every PPU pixel value, bytes in memory order R, G, B, A
+void buildPaletteRGBA(uint32_t table[PALETTE_ENTRIES]);
+
+// Look up count pixels in a table from buildPaletteRGBA()
+void convertToRGBA(const uint16_t* pixels, uint32_t* out, unsigned int count, const uint32_t table[PALETTE_ENTRIES]);
+
+#endif
@@ -1,13 +1,139 @@
-#include <stdlib.h>
+/*
+ * The PPU (Picture Processing Unit, the 2C02 in NTSC consoles) generates a 256x240 picture by
+ * walking 262 scanlines of 341 dots each, three dots for every CPU cycle. Background tiles are
+ * fetched eight dots ahead into shift registers, and up to eight sprites are evaluated per
+ * scanline from the 256 bytes of OAM. The CPU talks to it through eight registers at $2000-$2007
+ * (mirrored to $3FFF) and copies OAM in bulk through $4014.
+ *
+ * Output pixels are not colours: each one is the 6-bit palette index the PPU would put on the
+ * video signal, with the three colour emphasis bits from PPUMASK above it (emphasis << 6 | index).
+ * Turning them into RGB is left to whoever consumes the frame.
+ *
+ * Pattern tables and nametables are read through 1KB pages (see paged_memory.h) that point at
+ * cartridge CHR and at VRAM storage held by the NES, so forked instances can share them.
+ * Nametable mirroring is the same four page pointers aliasing each other, set when the mode
+ * changes, and the palette keeps both copies of each mirrored entry, so fetches never work out
+ * where an address really lives.
+ *
+ * Sprite Y coordinates are mirrored out of OAM into their own array so one scanline's in-range
+ * test is a handful of SIMD byte compares. The resulting per-scanline sprite masks are cached
+ * until an OAM write changes a Y coordinate or the sprite size changes.
+ *
+ * With composition skipped (fast-forward, run-ahead, headless runs) nothing is drawn, but fetches,
+ * scrolling, sprite evaluation and vblank all run as normal and sprite 0 hit is still found by
+ * testing only the pixels sprite 0 covers, so everything the CPU can observe is unchanged.
+ */
+
+#include <cstdint>
+
+#include "paged_memory.h"
 
 #ifndef PPU_H
+#define PPU_H
 #define PPU_MEM_SIZE 256
+#define VRAM_SIZE 4096
+#define CHR_SIZE 8192
+#define SCREEN_WIDTH 256
+#define SCREEN_HEIGHT 240
+
+// Nametable arrangement, normally fixed by the cartridge wiring
+enum MIRRORING {
+    HORIZONTAL,
+    VERTICAL,
+    SINGLE_SCREEN_LOWER,
+    SINGLE_SCREEN_UPPER,
+    FOUR_SCREEN,
+};
+
+class NES;
 
 class PPU {
+    friend class NES;
+    friend class CycleCore;
+    friend class NESBench;                              // Microbenchmarks drive the internals directly
+    friend class SpriteRangeTest;                       // Feeds each range kernel's mask to evaluateSprites
+
     public:
         PPU();
+        void cycle();                                   // Perform one dot worth of work
+        void reset();                                   // Reset PPU
+        uint8_t readReg(uint16_t addr);                 // CPU read of $2000-$2007
+        void writeReg(uint16_t addr, uint8_t val);      // CPU write of $2000-$2007
+        void writeOAM(uint8_t val);                     // OAM DMA transfer of a single byte
+        void setCHR(uint8_t* chr, bool writable);       // Pattern tables ($0000-$1FFF) on cartridge
+        void setVRAM(uint8_t* vram);                    // VRAM_SIZE bytes of nametable storage
+        void setMirroring(MIRRORING mode);              // Any time, as mappers that switch mirroring do
+        void setSkipComposition(bool skip);             // Stop drawing pixels, keep timing and side effects
+        void rebuildSpriteCache();                      // Derive oamY and the line masks from OAM again (after a load)
+        uint32_t dotsUntilVblank() const;               // Dots to run before the one that starts vblank
+        const uint16_t* frame() const;                  // Frame being drawn / last frame drawn
 
     private:
-        uint8_t* memory;
+        // Hot state first: everything touched on every dot fits in the first cache lines
+        PagedMemory<CHR_SIZE / MEMORY_PAGE_SIZE> chr;
+        PagedMemory<VRAM_SIZE / MEMORY_PAGE_SIZE> vram; // Nametables (2KB on console, 4KB for four screen carts)
+        uint16_t* pixels;                               // Buffer the current frame is drawn into, owned by the NES
+        bool chrWritable;
+        MIRRORING mirroring;
+
+        // Registers
+        uint8_t ctrl;                                   // $2000 PPUCTRL
+        uint8_t mask;                                   // $2001 PPUMASK
+        uint8_t status;                                 // $2002 PPUSTATUS
+        uint8_t oamAddr;                                // $2003 OAMADDR
+        uint16_t vramAddr;                              // Current VRAM address (v)
+        uint16_t tempAddr;                              // Temporary VRAM address (t)
+        uint8_t fineX;                                  // Fine X scroll (x)
+        bool writeToggle;                               // First/second write of $2005/$2006 (w)
+        uint8_t readBuffer;                             // $2007 delayed read
+        uint8_t dataLatch;                              // Last value written to any register
+
+        // Timing
+        int scanline;                                   // 0-239 visible, 240 post-render, 241-260 vblank, 261 pre-render
+        int dot;                                        // 0-340
+        bool oddFrame;
+        bool frameComplete;                             // Set on entering vblank, cleared by the NES
+        bool nmi;                                       // NMI raised, cleared by the NES
+        bool skipComposition;
+
+        // Background pipeline
+        uint8_t nextTileId;
+        uint8_t nextTileAttr;
+        uint8_t nextTileLo;
+        uint8_t nextTileHi;
+        uint16_t patternShiftLo;
+        uint16_t patternShiftHi;
+        uint16_t attribShiftLo;
+        uint16_t attribShiftHi;
+
+        // Sprites found for the scanline being drawn, patterns already flipped
+        uint8_t spriteCount;
+        uint8_t spriteX[8];
+        uint8_t spriteAttr[8];
+        uint8_t spritePatternLo[8];
+        uint8_t spritePatternHi[8];
+        bool spriteZeroOnLine;
+        uint32_t oamGeneration;                         // Bumped when a Y coordinate or the sprite size changes
+
+        // Memories
+        uint8_t paletteRam[32];                         // $3F10/$3F14/$3F18/$3F1C written through to $3F00/4/8/C and back
+        alignas(32) uint8_t oamY[64];                   // Copy of each sprite's Y byte for evaluation
+        uint8_t memory[PPU_MEM_SIZE];                   // OAM (64 sprites, 4 bytes each)
+        uint64_t lineSprites[SCREEN_HEIGHT];            // Bit n set if sprite n is in range of the scanline
+        uint32_t lineGeneration[SCREEN_HEIGHT];         // oamGeneration each lineSprites entry was built at
+
+        uint8_t ppuRead(uint16_t addr);                 // Read PPU address space ($0000-$3FFF)
+        void ppuWrite(uint16_t addr, uint8_t val);      // Write PPU address space ($0000-$3FFF)
+        bool renderingEnabled() const;
+
+        void fetchBackground();                         // One dot of the background fetch pipeline
+        void loadBackgroundShifters();
+        void incrementScrollX();
+        void incrementScrollY();
+        void writeOAMByte(uint8_t val);                 // Store at OAMADDR, keeping oamY in step
+        uint64_t spritesInRange(int line, int height) const;
+        void evaluateSprites();                         // Find sprites for the next scanline
+        void renderPixel();                             // Compose the pixel at the current dot
+        void checkSpriteZeroHit();                      // Sprite 0 hit at the current dot without composing
 };
 #endif
@@ -0,0 +1,81 @@
+/*
+ * Presenters show frames published by the EmulationThread. run() polls the triple buffer on the
+ * calling thread, presents each new frame and records how long it took from the emulation
+ * thread publishing a frame to the presenter finishing with it. Two presenters exist so far,
+ * neither needs a GPU: NullPresenter only takes frames (for measuring the pipeline headless) and
+ * AsciiPresenter draws a downscaled preview in the terminal.
+ */
+
+#ifndef PRESENTER_H
+#define PRESENTER_H
+#define LATENCY_BUCKETS 10000
+#define LATENCY_BUCKET_NS 10000
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "emulation_thread.h"
+#include "palette.h"
+#include "triple_buffer.h"
+
+using std::ostream;
+using std::string;
+
+// Frame-to-present latency summary, times in microseconds
+struct PresentStats {
+    uint64_t presented;                                 // Frames presented
+    uint64_t dropped;                                   // Frames published but replaced before presenting
+    double meanLatency;
+    double p50Latency;
+    double p99Latency;
+    double maxLatency;
+};
+
+class Presenter {
+    public:
+        Presenter();
+        virtual ~Presenter();
+        void run(TripleBuffer& frames, const EmulationThread& emulation);   // Present until emulation finishes
+        PresentStats stats(const TripleBuffer& frames) const;
+
+    protected:
+        virtual void present(const uint16_t* frame) = 0;
+
+    private:
+        uint32_t* latencyHistogram;                     // LATENCY_BUCKET_NS wide buckets, last one open ended
+        uint64_t presented;
+        uint64_t latencySum;
+        uint64_t latencyMax;
+
+        void recordLatency(uint64_t ns);
+        double percentile(double p) const;
+};
+
+class NullPresenter : public Presenter {
+    public:
+        uint64_t checksum() const;                      // Sum over every presented frame
+
+    protected:
+        void present(const uint16_t* frame) override;
+
+    private:
+        uint64_t sum = 0;
+};
+
+class AsciiPresenter : public Presenter {
+    public:
+        AsciiPresenter(ostream& out, unsigned int columns);
+
+    protected:
+        void present(const uint16_t* frame) override;
+
+    private:
+        ostream& out;
+        unsigned int columns;
+        unsigned int rows;
+        uint8_t luma[PALETTE_ENTRIES];
+        string text;
+        bool cleared = false;
+};
+#endif
@@ -0,0 +1,98 @@
+/*
+ * Interface between MOS6502 and native code generated ahead of time from an NROM cartridge's PRG
+ * ROM by nes_recompile. The generated code is built into a shared object exporting
+ * nes_compiled_program(), which NES::loadCompiled() opens.
+ *
+ * Every instruction the tool found by following control flow from the vectors gets an entry: a
+ * block function that starts at that address and runs on to the end of its basic block. Each
+ * instruction's operand and addressing are resolved at generation time and the instruction itself
+ * is carried out by the same MOS6502 member the interpreter calls, so flags, bus accesses and
+ * cycle counts can't drift from the interpreter. The block returns the cycles it used.
+ *
+ * As with fused opcode pairs, instructions after the first are only run early while no interrupt
+ * could be taken in between and they touch nothing but RAM and ROM. Otherwise the block stops and
+ * the next instruction starts on its own cycle, through its own entry. Addresses without an entry
+ * (code in RAM, targets of JMP ($nnnn) or computed RTS the tool couldn't follow) are interpreted.
+ */
+
+#ifndef RECOMPILED_H
+#define RECOMPILED_H
+#define RECOMPILED_ABI 1u
+#define RECOMPILED_WINDOW 0x8000u                       // Entries cover $8000-$FFFF
+
+#include <cstddef>
+#include <cstdint>
+
+#include "cpu.h"                                        // CompiledBlock: runs from the cpu's pc, returns cycles used
+#include "nes.h"
+
+struct CompiledProgram {
+    uint32_t abi;                                       // RECOMPILED_ABI it was built against
+    uint32_t cpuSize;                                   // sizeof(MOS6502) it was built against
+    uint32_t prgSize;
+    uint32_t prgChecksum;                               // prgChecksum() of the PRG ROM it was generated from
+    const CompiledBlock* entries;                       // RECOMPILED_WINDOW entries from $8000, nullptr to interpret
+};
+
+// Name of the function the shared object exports, returning its CompiledProgram
+#define RECOMPILED_ENTRY_POINT "nes_compiled_program"
+
+// FNV-1a, enough to tell one PRG ROM from another
+inline uint32_t prgChecksum(const uint8_t* prg, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ prg[i]) * 16777619u;
+    return hash;
+}
+
+// What generated code may touch inside the CPU, all of it the interpreter's own state and members
+struct Recompiled {
+    static uint16_t pc(const MOS6502* c) { return c->pc; }
+    static uint8_t x(const MOS6502* c) { return c->x; }
+    static uint8_t y(const MOS6502* c) { return c->y; }
+    static uint8_t read(MOS6502* c, uint16_t addr) { return c->readMem(addr); }
+    static bool quiet(MOS6502* c, unsigned int cycles) { return c->nes->quietFor(cycles); }
+    static bool io(uint16_t addr) { return addr >= 0x2000 && addr < 0x6000; }
+
+    // State the addressing mode would have left, with pc past the operand
+    static void begin(MOS6502* c, uint8_t opcode, uint16_t next, uint16_t addr, bool crossed) {
+        c->opcode = opcode;
+        c->pc = next;
+        c->addr_abs = addr;
+        c->pageBoundaryCrossed = crossed;
+#ifdef NES_METRICS
+        c->instructions++;
+#endif
+    }
+    static void beginImplied(MOS6502* c, uint8_t opcode, uint16_t next) {
+        c->opcode = opcode;
+        c->pc = next;
+        c->fetched = c->a;
+        c->pageBoundaryCrossed = false;
+#ifdef NES_METRICS
+        c->instructions++;
+#endif
+    }
+    static void beginRelative(MOS6502* c, uint8_t opcode, uint16_t next, uint16_t rel, uint16_t target, bool crossed) {
+        begin(c, opcode, next, target, crossed);
+        c->addr_rel = rel;
+    }
+
+#define RECOMPILED_OP(name) static uint8_t name(MOS6502* c) { return c->name(); }
+    RECOMPILED_OP(ADC) RECOMPILED_OP(AND) RECOMPILED_OP(ASL) RECOMPILED_OP(BCC)
+    RECOMPILED_OP(BCS) RECOMPILED_OP(BEQ) RECOMPILED_OP(BIT) RECOMPILED_OP(BMI)
+    RECOMPILED_OP(BNE) RECOMPILED_OP(BPL) RECOMPILED_OP(BRK) RECOMPILED_OP(BVC)
+    RECOMPILED_OP(BVS) RECOMPILED_OP(CLC) RECOMPILED_OP(CLD) RECOMPILED_OP(CLI)
+    RECOMPILED_OP(CLV) RECOMPILED_OP(CMP) RECOMPILED_OP(CPX) RECOMPILED_OP(CPY)
+    RECOMPILED_OP(DEC) RECOMPILED_OP(DEX) RECOMPILED_OP(DEY) RECOMPILED_OP(EOR)
+    RECOMPILED_OP(INC) RECOMPILED_OP(INX) RECOMPILED_OP(INY) RECOMPILED_OP(JMP)
+    RECOMPILED_OP(JSR) RECOMPILED_OP(LDA) RECOMPILED_OP(LDX) RECOMPILED_OP(LDY)
+    RECOMPILED_OP(LSR) RECOMPILED_OP(NOP) RECOMPILED_OP(ORA) RECOMPILED_OP(PHA)
+    RECOMPILED_OP(PHP) RECOMPILED_OP(PLA) RECOMPILED_OP(PLP) RECOMPILED_OP(ROL)
+    RECOMPILED_OP(ROR) RECOMPILED_OP(RTI) RECOMPILED_OP(RTS) RECOMPILED_OP(SBC)
+    RECOMPILED_OP(SEC) RECOMPILED_OP(SED) RECOMPILED_OP(SEI) RECOMPILED_OP(STA)
+    RECOMPILED_OP(STX) RECOMPILED_OP(STY) RECOMPILED_OP(TAX) RECOMPILED_OP(TAY)
+    RECOMPILED_OP(TSX) RECOMPILED_OP(TXA) RECOMPILED_OP(TXS) RECOMPILED_OP(TYA)
+#undef RECOMPILED_OP
+};
+#endif
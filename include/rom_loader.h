@@ -0,0 +1,67 @@
+/*
+ * Loads a cartridge from an iNES image, the first .nes file in a zip archive, or a gzip file,
+ * told apart by their first bytes rather than their names. Files are mapped rather than read.
+ *
+ * Nothing holds a whole decompressed image: CartridgeBuilder takes the image a piece at a time,
+ * copying each piece straight into the PRG and CHR ROM it ends up in and hashing it on the way
+ * (CRC-32, checked against the archive's, and SHA-1). An archive's decompressed image can also be
+ * kept in a cache directory named after its CRC-32 and size, which the archive gives up front, so
+ * a later load of the same ROM maps the image instead of inflating it again. The mapped image
+ * still goes through CartridgeBuilder like any other, so it is copied and hashed in full.
+ */
+
+#ifndef ROM_LOADER_H
+#define ROM_LOADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "checksum.h"
+#include "inflate.h"
+#include "nes.h"
+
+using std::shared_ptr;
+using std::string;
+
+class CartridgeBuilder : public ByteSink {
+    public:
+        CartridgeBuilder();
+        void write(const uint8_t* data, size_t size) override;      // The next part of the image
+        bool isINES() const;                            // The header has arrived and has the iNES magic
+        bool complete() const;                          // All of PRG and CHR ROM has arrived
+        uint64_t size() const;                          // Bytes of image written
+        uint32_t crc() const;                           // Of the image so far
+        shared_ptr<Cartridge> finish();                 // The cartridge, ROM left empty unless complete()
+
+    private:
+        shared_ptr<Cartridge> cart;
+        uint8_t header[HEADER_SIZE];
+        uint64_t received;
+        uint64_t prgStart;                              // Offsets of the ROMs in the image
+        uint64_t chrStart;
+        bool iNES;
+        CRC32 crc32;
+        SHA1 sha1;
+};
+
+class RomLoader {
+    public:
+        RomLoader(const char* cacheDir);                // nullptr for no cache
+        bool load(const char* path, CartridgeBuilder& builder);     // False, having said why, if unreadable
+        bool load(const uint8_t* data, size_t size, CartridgeBuilder& builder);
+        bool cacheHit() const;                          // The last load mapped a cached image
+
+    private:
+        string cacheDir;
+        bool hit;
+
+        bool loadZip(const uint8_t* data, size_t size, CartridgeBuilder& builder);
+        bool loadGzip(const uint8_t* data, size_t size, CartridgeBuilder& builder);
+        // One compressed member (method 0 stored or 8 deflate) holding size bytes with this CRC-32
+        bool unpack(const uint8_t* data, size_t compressedSize, unsigned int method, uint32_t crc, uint64_t size,
+                    CartridgeBuilder& builder);
+        bool loadCached(const string& path, uint32_t crc, uint64_t size, CartridgeBuilder& builder);
+};
+#endif
@@ -0,0 +1,29 @@
+/*
+ * The other end of an ShmServer. step() fills in the request, wakes the server and waits for the
+ * answer; the frame and RAM it leaves are read in place until the next request.
+ */
+
+#ifndef SHM_CLIENT_H
+#define SHM_CLIENT_H
+#define SHM_TIMEOUT_MS 5000
+
+#include "shm_region.h"
+
+class ShmClient {
+    public:
+        ShmClient(const char* name);                    // Attach to a running server's region
+        ~ShmClient();
+        bool isOpen() const;
+        bool step(uint8_t input0, uint8_t input1, uint32_t frames);   // False if the server stopped answering
+        bool shutdown();                                // Ask the server to stop serving
+        uint64_t frameCount() const;
+        const uint8_t* ram() const;                     // CPU RAM after the last step
+        const uint16_t* frame() const;                  // Frame from the last step that ran any
+
+    private:
+        ShmRegion* region;
+        uint32_t seq;                                   // Last request sent
+
+        bool request(uint32_t command);
+};
+#endif
@@ -0,0 +1,57 @@
+/*
+ * Layout of the POSIX shared memory region an ShmServer serves through, shared with ShmClient.
+ * The client fills in the request and bumps requestSeq; the server applies the input, runs the
+ * frames, leaves the results in place and sets responseSeq to the same value. The frame is drawn
+ * straight into the region, so a step costs no copies of it and no system calls beyond the
+ * futex wakes, which are skipped entirely while the other side is still spinning.
+ *
+ * Both sequence numbers double as futex words. A side about to sleep sets its sleeping flag
+ * first, so the other side only makes the wake system call when someone is actually asleep.
+ */
+
+#ifndef SHM_REGION_H
+#define SHM_REGION_H
+#define SHM_MAGIC 0x4E455331u                           // "NES1"
+#define SHM_VERSION 1u
+#define SHM_SPIN_LIMIT 1000                             // Polls before a waiter goes to sleep
+
+#include <atomic>
+#include <cstdint>
+
+#include "cpu.h"
+#include "ppu.h"
+
+enum SHMCOMMAND {
+    SHM_STEP,                                           // Apply input, run frames
+    SHM_SHUTDOWN,                                       // Server answers then stops serving
+};
+
+struct ShmRegion {
+    uint32_t magic;
+    uint32_t version;
+
+    // Handshake, each on its own cache line so the two sides don't share a written line
+    alignas(64) std::atomic<uint32_t> requestSeq;       // Written by the client
+    std::atomic<uint32_t> serverSleeping;
+    alignas(64) std::atomic<uint32_t> responseSeq;      // Written by the server
+    std::atomic<uint32_t> clientSleeping;
+
+    // Request, valid once requestSeq moves
+    alignas(64) uint32_t command;                       // SHMCOMMAND
+    uint32_t frames;                                    // Frames to run, 0 just applies input
+    uint8_t input[2];                                   // Button state per controller port
+
+    // Response, valid once responseSeq catches up
+    alignas(64) uint64_t frameCount;                    // Frames run since power on
+    uint8_t ram[CPU_MEM_SIZE];                          // Copy of CPU RAM after the last frame
+    alignas(64) uint16_t frame[SCREEN_WIDTH * SCREEN_HEIGHT];   // Drawn in place, see ppu.h for the format
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "Shared memory handshake needs lock-free atomics");
+
+// Sleep until word no longer holds old, spinning first. False if timeoutMs passes (0 waits forever).
+bool shmWait(std::atomic<uint32_t>& word, std::atomic<uint32_t>& sleeping, uint32_t old, unsigned int timeoutMs);
+
+// Store val to word and wake the other side if it went to sleep on it
+void shmPublish(std::atomic<uint32_t>& word, std::atomic<uint32_t>& sleeping, uint32_t val);
+#endif
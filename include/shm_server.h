@@ -0,0 +1,38 @@
+/*
+ * Serves an NES to another process through a POSIX shared memory region (see shm_region.h), for
+ * agents that drive the emulator from outside. Each request applies input and runs some frames;
+ * the NES draws straight into the region and CPU RAM is copied out next to it when the request
+ * is done. One client at a time.
+ *
+ * A region that already exists under the name is left alone and the server doesn't open, since it
+ * may belong to a live server and its clients. Only when told to replace it (one left behind by a
+ * server that crashed) is it unlinked first.
+ */
+
+#ifndef SHM_SERVER_H
+#define SHM_SERVER_H
+
+#include <string>
+
+#include "nes.h"
+#include "shm_region.h"
+
+using std::string;
+
+class ShmServer {
+    public:
+        ShmServer(NES* nes, const char* name, bool replace = false);  // name as for shm_open, e.g. "/nes0"
+        ~ShmServer();                                   // Unmaps and unlinks the region
+        bool isOpen() const;
+        void run();                                     // Serve requests until a shutdown request
+        uint64_t requestsServed() const;
+
+    private:
+        NES* nes;
+        string name;
+        ShmRegion* region;
+        uint64_t served;
+
+        void handle(uint32_t command);
+};
+#endif
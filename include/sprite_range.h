@@ -0,0 +1,71 @@
+/*
+ * The PPU's sprite range test: given the Y byte of all 64 sprites, set bit n of the result when
+ * sprite n covers the scanline. PPU::spritesInRange() picks one kernel when the core is built
+ * (AVX2 with -mavx2 or NES_NATIVE on a machine that has it, SSE2 on any other x86-64, scalar
+ * elsewhere or with PPU_SCALAR_SPRITES). All of them are declared here so tests can check every
+ * kernel the machine can run against the others, whichever one the core ended up using.
+ *
+ * The vector kernels load oamY with aligned loads, so it must be 32 byte aligned.
+ */
+
+#ifndef SPRITE_RANGE_H
+#define SPRITE_RANGE_H
+
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SPRITE_RANGE_AVX2 1                             // Built for any x86 target, run only where the CPU has it
+#else
+#define SPRITE_RANGE_AVX2 0
+#endif
+#ifdef __SSE2__
+#define SPRITE_RANGE_SSE2 1
+#else
+#define SPRITE_RANGE_SSE2 0
+#endif
+
+// Sprite n is in range when Y <= line and line - Y < height
+inline uint64_t spritesInRangeScalar(const uint8_t* oamY, int line, int height) {
+    uint64_t mask = 0x0u;
+    for (int n = 0; n < 64; n++) {
+        int row = line - oamY[n];
+        if (row >= 0 && row < height)
+            mask |= (uint64_t) 1 << n;
+    }
+    return mask;
+}
+
+// Both tests are unsigned byte compares (via max/min and equality), so each vector covers 16 or
+// 32 sprites and movemask packs the results into the bits of the mask
+#if SPRITE_RANGE_SSE2
+inline uint64_t spritesInRangeSSE2(const uint8_t* oamY, int line, int height) {
+    const __m128i lines = _mm_set1_epi8((char) line);
+    const __m128i lastRow = _mm_set1_epi8((char) (height - 1));
+    uint64_t mask = 0x0u;
+    for (int i = 0; i < 4; i++) {
+        __m128i y = _mm_load_si128((const __m128i*) (oamY + i * 16));
+        __m128i row = _mm_sub_epi8(lines, y);
+        __m128i started = _mm_cmpeq_epi8(_mm_max_epu8(y, lines), lines);
+        __m128i notEnded = _mm_cmpeq_epi8(_mm_min_epu8(row, lastRow), row);
+        mask |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_and_si128(started, notEnded)) << (i * 16);
+    }
+    return mask;
+}
+#endif
+
+#if SPRITE_RANGE_AVX2
+__attribute__((target("avx2"))) inline uint64_t spritesInRangeAVX2(const uint8_t* oamY, int line, int height) {
+    const __m256i lines = _mm256_set1_epi8((char) line);
+    const __m256i lastRow = _mm256_set1_epi8((char) (height - 1));
+    uint64_t mask = 0x0u;
+    for (int i = 0; i < 2; i++) {
+        __m256i y = _mm256_load_si256((const __m256i*) (oamY + i * 32));
+        __m256i row = _mm256_sub_epi8(lines, y);
+        __m256i started = _mm256_cmpeq_epi8(_mm256_max_epu8(y, lines), lines);
+        __m256i notEnded = _mm256_cmpeq_epi8(_mm256_min_epu8(row, lastRow), row);
+        mask |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_and_si256(started, notEnded)) << (i * 32);
+    }
+    return mask;
+}
+#endif
+#endif
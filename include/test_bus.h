@@ -0,0 +1,38 @@
+/*
+ * Flat 64KB of RAM an NES can trap every page to (see bus_trap.h), for single instruction
+ * conformance tests. Every read and write the CPU makes through it is logged in order, so the
+ * bus activity of an instruction can be compared with a test vector's.
+ */
+
+#ifndef TEST_BUS_H
+#define TEST_BUS_H
+#define TEST_BUS_LOG_SIZE 64                            // More accesses than any instruction makes
+
+#include <cstddef>
+#include <cstdint>
+
+#include "bus_trap.h"
+
+struct BusAccess {
+    uint16_t addr;
+    uint8_t value;
+    bool write;
+};
+
+class TestBus : public BusTrap {
+    public:
+        TestBus();
+        uint8_t read(uint16_t addr) override;           // Logged
+        void write(uint16_t addr, uint8_t val) override;    // Logged
+        uint8_t peek(uint16_t addr) const;              // Not logged
+        void poke(uint16_t addr, uint8_t val);          // Not logged
+        void clearLog();
+        size_t logSize() const;                         // Accesses since clearLog(), including any past the log's end
+        const BusAccess* log() const;
+
+    private:
+        uint8_t memory[0x10000];
+        BusAccess accesses[TEST_BUS_LOG_SIZE];
+        size_t count;
+};
+#endif
@@ -0,0 +1,47 @@
+/*
+ * Lock-free triple buffer for handing frames from the emulation thread to the presenter. Of the
+ * three buffers one is being drawn into (back), one is being shown (front), and the third holds
+ * the newest finished frame. Publishing and consuming are a single atomic exchange each, so
+ * neither side ever waits and the presenter always gets the newest frame. Frames published
+ * over the top of one that was never consumed are counted as dropped.
+ */
+
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "ppu.h"
+
+class TripleBuffer {
+    public:
+        struct Slot {
+            uint16_t* frame;
+            uint64_t frameNumber;
+            uint64_t publishTime;                       // steady_clock nanoseconds at publish
+        };
+
+        TripleBuffer();
+        ~TripleBuffer();
+
+        // Producer (emulation thread)
+        uint16_t* back();                               // Buffer to draw the next frame into
+        uint16_t* publish(uint64_t frameNumber);        // Publish back buffer, returns the new back buffer
+        uint64_t dropped() const;                       // Frames replaced before being consumed
+
+        // Consumer (presenter thread)
+        bool consume();                                 // Take the newest frame if one was published
+        const Slot& front() const;                      // Frame taken by the last successful consume()
+
+    private:
+        static const uint8_t FRESH = 0x4;               // Middle slot holds an unconsumed frame
+
+        Slot slots[3];
+        uint16_t* memory;
+        std::atomic<uint8_t> middle;                    // Index of the middle slot | FRESH
+        uint8_t backIndex;
+        uint8_t frontIndex;
+        uint64_t droppedFrames;
+};
+#endif
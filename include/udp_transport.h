@@ -0,0 +1,57 @@
+/*
+ * Non-blocking UDP socket to a single peer, for netplay. Datagrams from anyone but the peer are
+ * ignored. For testing on localhost the transport can act as a bad network: outgoing datagrams
+ * are dropped with a given probability and the rest held back for a fixed latency before they
+ * are really sent. Held datagrams go out from send() and receive(), so the owner only has to
+ * keep calling those. Nothing allocates once the transport is open.
+ */
+
+#ifndef UDP_TRANSPORT_H
+#define UDP_TRANSPORT_H
+#define UDP_MAX_DATAGRAM 256                            // Largest datagram sent or received
+#define UDP_SHIM_SLOTS 256                              // Datagrams the latency shim can hold back
+
+#include <cstddef>
+#include <cstdint>
+#include <netinet/in.h>
+#include <random>
+
+class UdpTransport {
+    public:
+        UdpTransport(uint16_t localPort);               // 0 picks a free port
+        ~UdpTransport();
+        UdpTransport(const UdpTransport&) = delete;
+        UdpTransport& operator=(const UdpTransport&) = delete;
+        bool isOpen() const;
+        uint16_t localPort() const;
+        bool setPeer(const char* host, uint16_t port);  // IPv4 address or host name
+        void setShim(unsigned int latencyMs, double loss, uint32_t seed);  // Simulate a bad network on sends
+        bool send(const void* data, size_t size);       // False if it couldn't be sent or held
+        int receive(void* data, size_t size);           // Bytes of the next datagram from the peer, -1 if none
+        uint64_t sent() const;                          // Datagrams that reached the socket
+        uint64_t dropped() const;                       // Datagrams the shim dropped
+
+    private:
+        struct Held {
+            uint64_t due;                               // steady_clock nanoseconds to send at
+            uint16_t size;
+            uint8_t data[UDP_MAX_DATAGRAM];
+        };
+
+        int fd;
+        uint16_t port;
+        sockaddr_in peer;
+        bool hasPeer;
+        uint64_t latencyNs;
+        double loss;
+        std::mt19937 random;
+        Held held[UDP_SHIM_SLOTS];                      // Ring, in due order as the latency is fixed
+        unsigned int heldFirst;
+        unsigned int heldCount;
+        uint64_t sentCount;
+        uint64_t droppedCount;
+
+        bool sendNow(const void* data, size_t size);
+        void releaseDue();                              // Send held datagrams whose time has come
+};
+#endif
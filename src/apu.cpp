@@ -0,0 +1,501 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#include "apu.h"
+#include "nes.h"
+
+// Length counter load values indexed by the upper 5 bits of $4003/$4007/$400B/$400F
+static const uint8_t LENGTH_TABLE[32] = {
+    10, 254, 20,  2, 40,  4, 80,  6, 160,  8, 60, 10, 14, 12, 26, 14,
+    12,  16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30
+};
+
+static const uint8_t DUTY_TABLE[4][8] = {
+    { 0, 1, 0, 0, 0, 0, 0, 0 },     // 12.5%
+    { 0, 1, 1, 0, 0, 0, 0, 0 },     // 25%
+    { 0, 1, 1, 1, 1, 0, 0, 0 },     // 50%
+    { 1, 0, 0, 1, 1, 1, 1, 1 },     // 25% negated
+};
+
+static const uint8_t TRIANGLE_TABLE[32] = {
+    15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15
+};
+
+// Noise and DMC periods in CPU cycles (NTSC)
+static const uint16_t NOISE_TABLE[16] = {
+    4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068
+};
+
+static const uint16_t DMC_TABLE[16] = {
+    428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54
+};
+
+// Frame counter step positions in CPU cycles
+const unsigned int FRAME_STEP_1 = 7457u;
+const unsigned int FRAME_STEP_2 = 14913u;
+const unsigned int FRAME_STEP_3 = 22371u;
+const unsigned int FRAME_STEP_4 = 29829u;
+const unsigned int FRAME_STEP_5 = 37281u;
+
+// The mixer is non-linear, precompute it (see nesdev wiki APU Mixer) scaled to 16-bit output.
+// Built once here rather than per APU so it stays out of the state forks and saves copy.
+struct MixerTables {
+    int32_t pulse[31];
+    int32_t tnd[203];
+
+    MixerTables() {
+        pulse[0] = 0;
+        for (int i = 1; i < 31; i++)
+            pulse[i] = (int32_t) (32767.0 * 95.52 / (8128.0 / i + 100.0) + 0.5);
+        tnd[0] = 0;
+        for (int i = 1; i < 203; i++)
+            tnd[i] = (int32_t) (32767.0 * 163.67 / (24329.0 / i + 100.0) + 0.5);
+    }
+};
+
+static const MixerTables MIXER;
+
+APU::APU() {
+    nes = nullptr;
+    sampleBuffer = nullptr;
+    synthesize = true;
+    log = nullptr;
+    logNext = 0;
+    logCycle = 0;
+    reset();
+}
+
+void APU::reset() {
+    std::memset(&pulse1, 0, sizeof(pulse1));
+    std::memset(&pulse2, 0, sizeof(pulse2));
+    std::memset(&triangle, 0, sizeof(triangle));
+    std::memset(&noise, 0, sizeof(noise));
+    std::memset(&dmc, 0, sizeof(dmc));
+    pulse1.onesComplement = true;
+    noise.shiftReg = 1;
+    noise.timerPeriod = NOISE_TABLE[0];
+    dmc.rate = DMC_TABLE[0];
+    dmc.sampleBufferEmpty = true;
+    dmc.bitsRemaining = 8;
+    dmc.silence = true;
+
+    fiveStep = false;
+    irqInhibit = false;
+    frameIrq = false;
+    frameCycle = 0;
+    oddCycle = false;
+
+    mixSum = 0;
+    mixCount = 0;
+    sampleClock = 0;
+    numSamples = 0;
+}
+
+void APU::cycle() {
+    // Frame counter
+    frameCycle++;
+    if (frameCycle == FRAME_STEP_1 || frameCycle == FRAME_STEP_3) {
+        quarterFrame();
+    } else if (frameCycle == FRAME_STEP_2) {
+        quarterFrame();
+        halfFrame();
+    } else if (!fiveStep && frameCycle == FRAME_STEP_4) {
+        quarterFrame();
+        halfFrame();
+        if (!irqInhibit)
+            frameIrq = true;
+        frameCycle = 0;
+    } else if (fiveStep && frameCycle == FRAME_STEP_5) {
+        quarterFrame();
+        halfFrame();
+        frameCycle = 0;
+    }
+
+    // Keeping time, the only other thing the CPU can see is the DMC reader
+    if (!synthesize) {
+        clockDMC();
+        logCycle++;
+        return;
+    }
+
+    // Triangle, noise and DMC timers run at the CPU rate
+    if (triangle.timer == 0) {
+        triangle.timer = triangle.timerPeriod;
+        if (triangle.linearCounter > 0 && triangle.lengthCounter > 0)
+            triangle.seqPos = (triangle.seqPos + 1) & 0x1F;
+    } else {
+        triangle.timer--;
+    }
+
+    if (noise.timer == 0) {
+        noise.timer = noise.timerPeriod - 1;
+        uint16_t feedback = (noise.shiftReg & 0x1) ^ ((noise.shiftReg >> (noise.mode ? 6 : 1)) & 0x1);
+        noise.shiftReg = (noise.shiftReg >> 1) | (feedback << 14);
+    } else {
+        noise.timer--;
+    }
+
+    clockDMC();
+
+    // Pulse timers tick every other CPU cycle
+    if (oddCycle) {
+        Pulse* pulses[2] = { &pulse1, &pulse2 };
+        for (Pulse* pulse : pulses) {
+            if (pulse->timer == 0) {
+                pulse->timer = pulse->timerPeriod;
+                pulse->dutyPos = (pulse->dutyPos + 1) & 0x7;
+            } else {
+                pulse->timer--;
+            }
+        }
+    }
+    oddCycle = !oddCycle;
+
+    // Box filter the mixer down to the output rate
+    mixSum += mix();
+    mixCount++;
+    sampleClock += APU_SAMPLE_RATE;
+    if (sampleClock >= CPU_CLOCK_RATE) {
+        sampleClock -= CPU_CLOCK_RATE;
+        if (numSamples < APU_SAMPLE_BUFFER_SIZE)
+            sampleBuffer[numSamples++] = (int16_t) (mixSum / mixCount);
+        mixSum = 0;
+        mixCount = 0;
+    }
+    logCycle++;
+}
+
+uint8_t APU::readStatus() {
+    uint8_t status = 0x0u;
+    status |= pulse1.lengthCounter > 0 ? 0x01 : 0x00;
+    status |= pulse2.lengthCounter > 0 ? 0x02 : 0x00;
+    status |= triangle.lengthCounter > 0 ? 0x04 : 0x00;
+    status |= noise.lengthCounter > 0 ? 0x08 : 0x00;
+    status |= dmc.bytesRemaining > 0 ? 0x10 : 0x00;
+    status |= frameIrq ? 0x40 : 0x00;
+    status |= dmc.irq ? 0x80 : 0x00;
+
+    // Reading status acknowledges the frame interrupt
+    frameIrq = false;
+
+    return status;
+}
+
+void APU::writeReg(uint16_t addr, uint8_t val) {
+    if (!synthesize)
+        log->push_back(APUEvent{ logCycle, addr, val });
+    switch (addr) {
+        case 0x4000: case 0x4004: {
+            Pulse& pulse = addr == 0x4000 ? pulse1 : pulse2;
+            pulse.duty = val >> 6;
+            pulse.envelope.loop = val & 0x20;
+            pulse.envelope.constant = val & 0x10;
+            pulse.envelope.volume = val & 0x0F;
+            break;
+        }
+        case 0x4001: case 0x4005: {
+            Pulse& pulse = addr == 0x4001 ? pulse1 : pulse2;
+            pulse.sweepEnabled = val & 0x80;
+            pulse.sweepPeriod = (val >> 4) & 0x7;
+            pulse.sweepNegate = val & 0x08;
+            pulse.sweepShift = val & 0x07;
+            pulse.sweepReload = true;
+            break;
+        }
+        case 0x4002: case 0x4006: {
+            Pulse& pulse = addr == 0x4002 ? pulse1 : pulse2;
+            pulse.timerPeriod = (pulse.timerPeriod & 0x0700) | val;
+            break;
+        }
+        case 0x4003: case 0x4007: {
+            Pulse& pulse = addr == 0x4003 ? pulse1 : pulse2;
+            pulse.timerPeriod = (pulse.timerPeriod & 0x00FF) | ((uint16_t) (val & 0x07) << 8);
+            if (pulse.enabled)
+                pulse.lengthCounter = LENGTH_TABLE[val >> 3];
+            pulse.envelope.start = true;
+            pulse.dutyPos = 0;
+            break;
+        }
+        case 0x4008:
+            triangle.control = val & 0x80;
+            triangle.linearReloadValue = val & 0x7F;
+            break;
+        case 0x400A:
+            triangle.timerPeriod = (triangle.timerPeriod & 0x0700) | val;
+            break;
+        case 0x400B:
+            triangle.timerPeriod = (triangle.timerPeriod & 0x00FF) | ((uint16_t) (val & 0x07) << 8);
+            if (triangle.enabled)
+                triangle.lengthCounter = LENGTH_TABLE[val >> 3];
+            triangle.linearReload = true;
+            break;
+        case 0x400C:
+            noise.envelope.loop = val & 0x20;
+            noise.envelope.constant = val & 0x10;
+            noise.envelope.volume = val & 0x0F;
+            break;
+        case 0x400E:
+            noise.mode = val & 0x80;
+            noise.timerPeriod = NOISE_TABLE[val & 0x0F];
+            break;
+        case 0x400F:
+            if (noise.enabled)
+                noise.lengthCounter = LENGTH_TABLE[val >> 3];
+            noise.envelope.start = true;
+            break;
+        case 0x4010:
+            dmc.irqEnabled = val & 0x80;
+            dmc.loop = val & 0x40;
+            dmc.rate = DMC_TABLE[val & 0x0F];
+            if (!dmc.irqEnabled)
+                dmc.irq = false;
+            break;
+        case 0x4011:
+            dmc.output = val & 0x7F;
+            break;
+        case 0x4012:
+            dmc.sampleAddress = 0xC000 | ((uint16_t) val << 6);
+            break;
+        case 0x4013:
+            dmc.sampleLength = ((uint16_t) val << 4) | 0x1;
+            break;
+        case 0x4015:
+            pulse1.enabled = val & 0x01;
+            pulse2.enabled = val & 0x02;
+            triangle.enabled = val & 0x04;
+            noise.enabled = val & 0x08;
+            if (!pulse1.enabled) pulse1.lengthCounter = 0;
+            if (!pulse2.enabled) pulse2.lengthCounter = 0;
+            if (!triangle.enabled) triangle.lengthCounter = 0;
+            if (!noise.enabled) noise.lengthCounter = 0;
+
+            // DMC restarts its sample only if it had finished
+            if (!(val & 0x10)) {
+                dmc.bytesRemaining = 0;
+            } else if (dmc.bytesRemaining == 0) {
+                dmc.currentAddress = dmc.sampleAddress;
+                dmc.bytesRemaining = dmc.sampleLength;
+            }
+            dmc.irq = false;
+            break;
+        case 0x4017:
+            fiveStep = val & 0x80;
+            irqInhibit = val & 0x40;
+            if (irqInhibit)
+                frameIrq = false;
+
+            // Restart the sequence, 5-step mode clocks everything immediately
+            frameCycle = 0;
+            if (fiveStep) {
+                quarterFrame();
+                halfFrame();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+bool APU::irq() {
+    return frameIrq || dmc.irq;
+}
+
+unsigned int APU::cyclesUntilIRQ() const {
+    if (frameIrq || dmc.irq)
+        return 0;
+    unsigned int cycles = UINT_MAX;
+    if (!fiveStep && !irqInhibit)
+        cycles = FRAME_STEP_4 - frameCycle;
+
+    // The last sample byte raises the DMC interrupt when it's read. The reader has to wait for
+    // the output unit to empty the buffer again between bytes, which is at least a timer period.
+    if (dmc.irqEnabled && !dmc.loop && dmc.bytesRemaining > 0)
+        cycles = std::min(cycles, dmc.bytesRemaining > 1 ? (unsigned int) dmc.timer : 0u);
+    return cycles;
+}
+
+const int16_t* APU::samples() const {
+    return sampleBuffer;
+}
+
+size_t APU::sampleCount() const {
+    return numSamples;
+}
+
+void APU::clearSamples() {
+    numSamples = 0;
+}
+
+void APU::replay(uint32_t until) {
+    // A write logged at cycle c was made after c cycles had run, and the DMC byte fetched during
+    // cycle c follows the writes before it, so it is the next event whenever cycle() wants it
+    const vector<APUEvent>& events = *log;
+    while (true) {
+        for (; logNext < events.size() && events[logNext].cycle <= logCycle && events[logNext].addr != APU_DMC_FETCH; logNext++)
+            writeReg(events[logNext].addr, events[logNext].value);
+        if (logCycle >= until)
+            break;
+        cycle();
+    }
+}
+
+void APU::takeChannels(const APU& synth) {
+    // The timing model acknowledged the frame interrupt on $4015 reads, the synthesizer never saw them
+    NES* owner = nes;
+    int16_t* buffer = sampleBuffer;
+    size_t count = numSamples;
+    bool synthesizing = synthesize;
+    vector<APUEvent>* logging = log;
+    size_t next = logNext;
+    uint32_t cycles = logCycle;
+    bool irq = frameIrq;
+    *this = synth;
+    nes = owner;
+    sampleBuffer = buffer;
+    numSamples = count;
+    synthesize = synthesizing;
+    log = logging;
+    logNext = next;
+    logCycle = cycles;
+    frameIrq = irq;
+}
+
+void APU::quarterFrame() {
+    clockEnvelope(pulse1.envelope);
+    clockEnvelope(pulse2.envelope);
+    clockEnvelope(noise.envelope);
+
+    if (triangle.linearReload)
+        triangle.linearCounter = triangle.linearReloadValue;
+    else if (triangle.linearCounter > 0)
+        triangle.linearCounter--;
+    if (!triangle.control)
+        triangle.linearReload = false;
+}
+
+void APU::halfFrame() {
+    // Envelope loop flag doubles as the length counter halt flag
+    if (pulse1.lengthCounter > 0 && !pulse1.envelope.loop) pulse1.lengthCounter--;
+    if (pulse2.lengthCounter > 0 && !pulse2.envelope.loop) pulse2.lengthCounter--;
+    if (triangle.lengthCounter > 0 && !triangle.control) triangle.lengthCounter--;
+    if (noise.lengthCounter > 0 && !noise.envelope.loop) noise.lengthCounter--;
+
+    clockSweep(pulse1);
+    clockSweep(pulse2);
+}
+
+void APU::clockEnvelope(Envelope& env) {
+    if (env.start) {
+        env.start = false;
+        env.decay = 15;
+        env.divider = env.volume;
+    } else if (env.divider == 0) {
+        env.divider = env.volume;
+        if (env.decay > 0)
+            env.decay--;
+        else if (env.loop)
+            env.decay = 15;
+    } else {
+        env.divider--;
+    }
+}
+
+void APU::clockSweep(Pulse& pulse) {
+    uint16_t target = sweepTarget(pulse);
+    if (pulse.sweepDivider == 0 && pulse.sweepEnabled && pulse.sweepShift > 0
+            && pulse.timerPeriod >= 8 && target <= 0x7FF)
+        pulse.timerPeriod = target;
+
+    if (pulse.sweepDivider == 0 || pulse.sweepReload) {
+        pulse.sweepDivider = pulse.sweepPeriod;
+        pulse.sweepReload = false;
+    } else {
+        pulse.sweepDivider--;
+    }
+}
+
+void APU::clockDMC() {
+    // Memory reader refills the sample buffer as soon as it empties
+    if (dmc.sampleBufferEmpty && dmc.bytesRemaining > 0) {
+        dmc.sampleBuffer = fetchSample(dmc.currentAddress);
+        dmc.sampleBufferEmpty = false;
+        dmc.currentAddress = dmc.currentAddress == 0xFFFF ? 0x8000 : dmc.currentAddress + 1;
+        dmc.bytesRemaining--;
+        if (dmc.bytesRemaining == 0) {
+            if (dmc.loop) {
+                dmc.currentAddress = dmc.sampleAddress;
+                dmc.bytesRemaining = dmc.sampleLength;
+            } else if (dmc.irqEnabled) {
+                dmc.irq = true;
+            }
+        }
+    }
+
+    if (dmc.timer > 0) {
+        dmc.timer--;
+        return;
+    }
+    dmc.timer = dmc.rate - 1;
+
+    // Output unit moves the level by 2 per bit, clamped to 0-127
+    if (!dmc.silence) {
+        if (dmc.shiftReg & 0x1) {
+            if (dmc.output <= 125)
+                dmc.output += 2;
+        } else if (dmc.output >= 2) {
+            dmc.output -= 2;
+        }
+    }
+    dmc.shiftReg >>= 1;
+
+    dmc.bitsRemaining--;
+    if (dmc.bitsRemaining == 0) {
+        dmc.bitsRemaining = 8;
+        dmc.silence = dmc.sampleBufferEmpty;
+        if (!dmc.sampleBufferEmpty) {
+            dmc.shiftReg = dmc.sampleBuffer;
+            dmc.sampleBufferEmpty = true;
+        }
+    }
+}
+
+uint8_t APU::fetchSample(uint16_t addr) {
+    if (!log)
+        return nes->readUntrapped(addr);
+    if (synthesize)
+        return logNext < log->size() ? (*log)[logNext++].value : 0x0u;
+    uint8_t val = nes->readUntrapped(addr);
+    log->push_back(APUEvent{ logCycle, APU_DMC_FETCH, val });
+    return val;
+}
+
+uint16_t APU::sweepTarget(const Pulse& pulse) {
+    uint16_t change = pulse.timerPeriod >> pulse.sweepShift;
+    if (pulse.sweepNegate)
+        return pulse.timerPeriod - change - (pulse.onesComplement ? 1 : 0);
+    return pulse.timerPeriod + change;
+}
+
+uint8_t APU::pulseOutput(const Pulse& pulse) {
+    // Muted when silenced, when the period is too short, or when the sweep would overflow
+    if (pulse.lengthCounter == 0 || pulse.timerPeriod < 8 || sweepTarget(pulse) > 0x7FF)
+        return 0;
+    if (!DUTY_TABLE[pulse.duty][pulse.dutyPos])
+        return 0;
+    return envelopeOutput(pulse.envelope);
+}
+
+uint8_t APU::envelopeOutput(const Envelope& env) {
+    return env.constant ? env.volume : env.decay;
+}
+
+int32_t APU::mix() {
+    uint8_t p1 = pulseOutput(pulse1);
+    uint8_t p2 = pulseOutput(pulse2);
+    uint8_t t = TRIANGLE_TABLE[triangle.seqPos];
+    uint8_t n = (noise.lengthCounter == 0 || (noise.shiftReg & 0x1)) ? 0 : envelopeOutput(noise.envelope);
+
+    return MIXER.pulse[p1 + p2] + MIXER.tnd[3 * t + 2 * n + dmc.output];
+}
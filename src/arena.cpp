@@ -0,0 +1,48 @@
+#include <cstdlib>
+
+#include "arena.h"
+
+Arena::Arena(size_t capacity) {
+    // aligned_alloc wants a multiple of the alignment
+    size = (capacity + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1);
+    base = (uint8_t*) std::aligned_alloc(ARENA_ALIGNMENT, size);
+    if (!base)
+        size = 0;
+    offset = 0;
+    owned = true;
+}
+
+Arena::Arena(void* memory, size_t capacity) {
+    base = (uint8_t*) memory;
+    size = capacity;
+    offset = 0;
+    owned = false;
+}
+
+Arena::~Arena() {
+    if (owned)
+        std::free(base);
+}
+
+void* Arena::allocate(size_t size, size_t alignment) {
+    // Align the address rather than the offset so caller memory needn't be aligned itself
+    uintptr_t start = ((uintptr_t) base + offset + alignment - 1) & ~(uintptr_t) (alignment - 1);
+    size_t end = start - (uintptr_t) base + size;
+    if (!base || end > this->size)
+        return nullptr;
+
+    offset = end;
+    return (void*) start;
+}
+
+void Arena::reset() {
+    offset = 0;
+}
+
+size_t Arena::used() const {
+    return offset;
+}
+
+size_t Arena::capacity() const {
+    return size;
+}
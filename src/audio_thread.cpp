@@ -0,0 +1,118 @@
+#include <cstring>
+
+#include "audio_thread.h"
+
+// Room for a frame of register writes and DMC bytes before a log has to grow
+const size_t LOG_RESERVE = 1024u;
+
+AudioThread::AudioThread(APU* apu, size_t carried) : apu(apu) {
+    synth = *apu;
+    synth.log = nullptr;
+    for (Job& job : jobs)
+        job.events.reserve(LOG_RESERVE);
+    handedOver = nullptr;
+    work = nullptr;
+    quit = false;
+
+    // Samples the APU already made this frame come out with the rest of it
+    logging = &jobs[0];
+    startLog(*logging);
+    logging->sampleCount = carried;
+    std::memcpy(logging->samples, apu->sampleBuffer, carried * sizeof(int16_t));
+    apu->synthesize = false;
+
+    worker = std::thread(&AudioThread::loop, this);
+}
+
+AudioThread::~AudioThread() {
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        done.wait(guard, [this] { return work == nullptr; });
+        quit = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+size_t AudioThread::endFrame(int16_t* out) {
+    waitIdle();
+    size_t count = 0;
+    if (handedOver) {
+        count = handedOver->sampleCount;
+        std::memcpy(out, handedOver->samples, count * sizeof(int16_t));
+    }
+
+    logging->cycles = apu->logCycle;
+    handedOver = logging;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        work = logging;
+    }
+    wake.notify_one();
+
+    logging = logging == &jobs[0] ? &jobs[1] : &jobs[0];
+    startLog(*logging);
+    return count;
+}
+
+const APU& AudioThread::sync() {
+    waitIdle();
+    synthesize(*logging, apu->logCycle);
+    return synth;
+}
+
+const int16_t* AudioThread::finish(size_t& count) {
+    sync();
+    std::memcpy(apu->sampleBuffer, logging->samples, logging->sampleCount * sizeof(int16_t));
+    apu->numSamples = logging->sampleCount;
+    apu->takeChannels(synth);
+    apu->synthesize = true;
+    apu->log = nullptr;
+
+    count = handedOver ? handedOver->sampleCount : 0;
+    const int16_t* samples = handedOver ? handedOver->samples : nullptr;
+    handedOver = nullptr;
+    return samples;
+}
+
+void AudioThread::loop() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        wake.wait(guard, [this] { return work != nullptr || quit; });
+        if (quit)
+            return;
+        Job* job = work;
+        guard.unlock();
+        synthesize(*job, job->cycles);
+        guard.lock();
+        work = nullptr;
+        done.notify_one();
+    }
+}
+
+void AudioThread::waitIdle() {
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [this] { return work == nullptr; });
+}
+
+void AudioThread::synthesize(Job& job, uint32_t until) {
+    synth.log = &job.events;
+    synth.logNext = job.nextEvent;
+    synth.logCycle = job.replayed;
+    synth.sampleBuffer = job.samples;
+    synth.numSamples = job.sampleCount;
+    synth.replay(until);
+    job.nextEvent = synth.logNext;
+    job.replayed = until;
+    job.sampleCount = synth.numSamples;
+}
+
+void AudioThread::startLog(Job& job) {
+    job.events.clear();
+    job.sampleCount = 0;
+    job.nextEvent = 0;
+    job.replayed = 0;
+    job.cycles = 0;
+    apu->log = &job.events;
+    apu->logCycle = 0;
+}
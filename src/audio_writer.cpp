@@ -0,0 +1,177 @@
+#include <cstring>
+
+#include "audio_writer.h"
+#include "metrics.h"
+
+AudioWriter::AudioWriter(const char* fileName, AUDIOFORMAT format, unsigned int sampleRate) {
+    this->format = format;
+    this->sampleRate = sampleRate;
+    fullHead = 0;
+    fullCount = 0;
+    current = -1;
+    closing = false;
+    closed = false;
+    totalSamples = 0;
+    stalls = 0;
+
+    // One allocation for the whole pool, every block starts out free
+    poolMemory = new int16_t[AUDIO_POOL_BLOCKS * AUDIO_BLOCK_SAMPLES];
+    for (unsigned int i = 0; i < AUDIO_POOL_BLOCKS; i++) {
+        pool[i].data = poolMemory + i * AUDIO_BLOCK_SAMPLES;
+        pool[i].count = 0;
+        freeStack[i] = i;
+    }
+    freeCount = AUDIO_POOL_BLOCKS;
+
+    // Blocks are already large, so skip the stream's own buffering
+    file.rdbuf()->pubsetbuf(nullptr, 0);
+    file.open(fileName, std::ofstream::binary | std::ofstream::trunc);
+    if (!file.is_open()) {
+        closed = true;
+        return;
+    }
+
+    // Sizes are unknown until close, streams that can't seek keep the "unknown" placeholder
+    if (format == WAV_PCM16)
+        writeHeader(0xFFFFFFFFu);
+
+    writer = std::thread(&AudioWriter::writerLoop, this);
+}
+
+AudioWriter::~AudioWriter() {
+    close();
+    delete[] poolMemory;
+}
+
+bool AudioWriter::isOpen() const {
+    return file.is_open();
+}
+
+void AudioWriter::write(const int16_t* samples, size_t count) {
+    if (closed)
+        return;
+
+    while (count > 0) {
+        if (current < 0) {
+            std::unique_lock<std::mutex> guard(lock);
+            if (freeCount == 0) {
+                stalls++;
+                Metrics::audioStalls.add();
+                blockFreed.wait(guard, [this] { return freeCount > 0; });
+            }
+            current = freeStack[--freeCount];
+            pool[current].count = 0;
+        }
+
+        Block& block = pool[current];
+        size_t space = AUDIO_BLOCK_SAMPLES - block.count;
+        size_t chunk = count < space ? count : space;
+        std::memcpy(block.data + block.count, samples, chunk * sizeof(int16_t));
+        block.count += chunk;
+        samples += chunk;
+        count -= chunk;
+        totalSamples += chunk;
+
+        if (block.count == AUDIO_BLOCK_SAMPLES)
+            submitCurrent();
+    }
+}
+
+void AudioWriter::close() {
+    if (closed)
+        return;
+    closed = true;
+
+    if (current >= 0 && pool[current].count > 0)
+        submitCurrent();
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        closing = true;
+    }
+    blockFilled.notify_one();
+    writer.join();
+
+    if (format == WAV_PCM16) {
+        uint64_t dataBytes = totalSamples * sizeof(int16_t);
+        file.seekp(0);
+        if (file.good() && dataBytes <= 0xFFFFFFFFu - 36u)
+            writeHeader((uint32_t) dataBytes);
+        file.clear();
+    }
+    file.close();
+}
+
+uint64_t AudioWriter::samplesWritten() const {
+    return totalSamples;
+}
+
+uint64_t AudioWriter::poolStalls() const {
+    return stalls;
+}
+
+void AudioWriter::writerLoop() {
+    while (true) {
+        unsigned int index;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            blockFilled.wait(guard, [this] { return fullCount > 0 || closing; });
+            if (fullCount == 0)
+                return;
+            index = fullQueue[fullHead];
+        }
+
+        // Samples are little endian on disk, which is also the host order on every target we build
+        Block& block = pool[index];
+        file.write(reinterpret_cast<const char*>(block.data), block.count * sizeof(int16_t));
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            fullHead = (fullHead + 1) % AUDIO_POOL_BLOCKS;
+            fullCount--;
+            freeStack[freeCount++] = index;
+        }
+        blockFreed.notify_one();
+    }
+}
+
+void AudioWriter::submitCurrent() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        fullQueue[(fullHead + fullCount) % AUDIO_POOL_BLOCKS] = current;
+        fullCount++;
+    }
+    blockFilled.notify_one();
+    current = -1;
+}
+
+void AudioWriter::writeHeader(uint32_t dataBytes) {
+    // Canonical 44 byte header for 16-bit mono PCM
+    uint8_t header[44];
+    uint32_t byteRate = sampleRate * sizeof(int16_t);
+    uint32_t riffSize = dataBytes == 0xFFFFFFFFu ? dataBytes : dataBytes + 36u;
+    auto put16 = [&header](int offset, uint16_t val) {
+        header[offset + 0] = val & 0xFF;
+        header[offset + 1] = (val >> 8) & 0xFF;
+    };
+    auto put32 = [&header](int offset, uint32_t val) {
+        for (int i = 0; i < 4; i++)
+            header[offset + i] = (val >> (8 * i)) & 0xFF;
+    };
+
+    std::memcpy(header + 0, "RIFF", 4);
+    put32(4, riffSize);
+    std::memcpy(header + 8, "WAVE", 4);
+    std::memcpy(header + 12, "fmt ", 4);
+    put32(16, 16);                          // fmt chunk size
+    put16(20, 1);                           // PCM
+    put16(22, 1);                           // Mono
+    put32(24, sampleRate);
+    put32(28, byteRate);
+    put16(32, sizeof(int16_t));             // Block align
+    put16(34, 16);                          // Bits per sample
+    std::memcpy(header + 36, "data", 4);
+    put32(40, dataBytes);
+
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+}
@@ -0,0 +1,71 @@
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "battery_ram.h"
+
+BatteryRAM::BatteryRAM(const char* path, size_t size, const uint8_t* initial) : path(path), size(size), flushed(size) {
+    mapping = nullptr;
+    flushCount = 0;
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        std::cerr << "Could not open save file " << path << std::endl;
+        return;
+    }
+    struct stat info;
+    bool fresh = false;
+    void* memory = MAP_FAILED;
+    if (fstat(fd, &info) == 0) {
+        fresh = info.st_size == 0;
+        if ((size_t) info.st_size >= size || ftruncate(fd, size) == 0)
+            memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (memory == MAP_FAILED) {
+        std::cerr << "Could not map save file " << path << std::endl;
+        return;
+    }
+    mapping = (uint8_t*) memory;
+
+    // A file that didn't exist holds what the cart powered on with, written out straight away
+    std::memcpy(flushed.data(), mapping, size);
+    if (fresh) {
+        std::memcpy(mapping, initial, size);
+        flush();
+    }
+}
+
+BatteryRAM::~BatteryRAM() {
+    if (mapping) {
+        flush();
+        munmap(mapping, size);
+    }
+}
+
+bool BatteryRAM::isOpen() const {
+    return mapping != nullptr;
+}
+
+uint8_t* BatteryRAM::memory() {
+    return mapping;
+}
+
+bool BatteryRAM::flush() {
+    if (!mapping || std::memcmp(mapping, flushed.data(), size) == 0)
+        return true;
+    std::memcpy(flushed.data(), mapping, size);
+    flushCount++;
+    if (msync(mapping, size, MS_SYNC) != 0) {
+        std::cerr << "Could not write save file " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+uint64_t BatteryRAM::flushes() const {
+    return flushCount;
+}
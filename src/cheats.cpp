@@ -0,0 +1,61 @@
+#include <cctype>
+#include <cstring>
+
+#include "cheats.h"
+
+// Each letter is a nibble, the bits of which are shuffled into the address, value and compare
+static const char GENIE_LETTERS[] = "APZLGITYEOXUKSVN";
+
+bool decodeGameGenie(const char* code, Cheat& cheat) {
+    size_t length = std::strlen(code);
+    if (length != 6 && length != 8)
+        return false;
+    uint8_t n[8];
+    for (size_t i = 0; i < length; i++) {
+        const char* letter = std::strchr(GENIE_LETTERS, std::toupper((unsigned char) code[i]));
+        if (!letter || !*letter)
+            return false;
+        n[i] = letter - GENIE_LETTERS;
+    }
+
+    cheat.addr = 0x8000 | (n[3] & 7) << 12 | (n[5] & 7) << 8 | (n[4] & 8) << 8 | (n[2] & 7) << 4 | (n[1] & 8) << 4
+        | (n[4] & 7) | (n[3] & 8);
+    cheat.value = (n[1] & 7) << 4 | (n[0] & 8) << 4 | (n[0] & 7) | (n[length - 1] & 8);
+    cheat.compared = length == 8;
+    cheat.compare = cheat.compared ? ((n[7] & 7) << 4 | (n[6] & 8) << 4 | (n[6] & 7) | (n[5] & 8)) : 0;
+    return true;
+}
+
+// Exactly digits hex digits at text, advancing past them
+static bool hexDigits(const char*& text, unsigned int digits, uint32_t& value) {
+    value = 0;
+    for (unsigned int i = 0; i < digits; i++, text++) {
+        if (!std::isxdigit((unsigned char) *text))
+            return false;
+        value = value << 4 | (std::isdigit((unsigned char) *text) ? *text - '0' : std::toupper(*text) - 'A' + 10);
+    }
+    return true;
+}
+
+bool parseCheat(const char* code, Cheat& cheat) {
+    if (decodeGameGenie(code, cheat))
+        return true;
+
+    // AAAA:VV or AAAA?CC:VV
+    uint32_t addr;
+    uint32_t compare = 0;
+    uint32_t value;
+    bool compared = false;
+    if (!hexDigits(code, 4, addr) || addr < 0x8000)
+        return false;
+    if (*code == '?') {
+        code++;
+        compared = true;
+        if (!hexDigits(code, 2, compare))
+            return false;
+    }
+    if (*code++ != ':' || !hexDigits(code, 2, value) || *code)
+        return false;
+    cheat = Cheat{ (uint16_t) addr, (uint8_t) value, (uint8_t) compare, compared };
+    return true;
+}
@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <cstring>
+
+#include "checksum.h"
+
+// Reflected table for polynomial 0x04C11DB7, one entry per low byte of the running CRC
+struct CRCTable {
+    uint32_t entries[256];
+
+    CRCTable() {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int bit = 0; bit < 8; bit++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[n] = c;
+        }
+    }
+};
+
+static const CRCTable CRC_TABLE;
+
+CRC32::CRC32() {
+    crc = 0xFFFFFFFFu;
+}
+
+void CRC32::update(const uint8_t* data, size_t size) {
+    const uint32_t* table = CRC_TABLE.entries;
+    uint32_t c = crc;
+    for (size_t i = 0; i < size; i++)
+        c = table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+    crc = c;
+}
+
+uint32_t CRC32::value() const {
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static uint32_t rotl(uint32_t value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+SHA1::SHA1() {
+    h[0] = 0x67452301u;
+    h[1] = 0xEFCDAB89u;
+    h[2] = 0x98BADCFEu;
+    h[3] = 0x10325476u;
+    h[4] = 0xC3D2E1F0u;
+    blockUsed = 0;
+    length = 0;
+}
+
+void SHA1::update(const uint8_t* data, size_t size) {
+    length += size;
+    if (blockUsed) {
+        size_t take = std::min(size, sizeof(block) - blockUsed);
+        std::memcpy(block + blockUsed, data, take);
+        blockUsed += take;
+        data += take;
+        size -= take;
+        if (blockUsed < sizeof(block))
+            return;
+        compress(block);
+        blockUsed = 0;
+    }
+    // Whole blocks straight from the caller's buffer
+    for (; size >= sizeof(block); data += sizeof(block), size -= sizeof(block))
+        compress(data);
+    std::memcpy(block, data, size);
+    blockUsed = size;
+}
+
+void SHA1::finish(uint8_t digest[SHA1_SIZE]) {
+    // A 1 bit, zeros up to 8 bytes short of a block, then the length in bits big endian
+    uint64_t bits = length * 8;
+    uint8_t padding[72] = { 0x80 };
+    size_t padLength = (blockUsed < 56 ? 56 : 120) - blockUsed;
+    for (int i = 0; i < 8; i++)
+        padding[padLength + i] = (uint8_t) (bits >> (56 - 8 * i));
+    update(padding, padLength + 8);
+
+    for (int i = 0; i < 5; i++) {
+        digest[4 * i] = (uint8_t) (h[i] >> 24);
+        digest[4 * i + 1] = (uint8_t) (h[i] >> 16);
+        digest[4 * i + 2] = (uint8_t) (h[i] >> 8);
+        digest[4 * i + 3] = (uint8_t) h[i];
+    }
+}
+
+string SHA1::hex(const uint8_t digest[SHA1_SIZE]) {
+    static const char DIGITS[] = "0123456789abcdef";
+    string text;
+    for (unsigned int i = 0; i < SHA1_SIZE; i++) {
+        text += DIGITS[digest[i] >> 4];
+        text += DIGITS[digest[i] & 0xF];
+    }
+    return text;
+}
+
+void SHA1::compress(const uint8_t* data) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t) data[4 * i] << 24 | (uint32_t) data[4 * i + 1] << 16 | (uint32_t) data[4 * i + 2] << 8 | data[4 * i + 3];
+    for (int i = 16; i < 80; i++)
+        w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999u;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1u;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDCu;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6u;
+        }
+        uint32_t t = rotl(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotl(b, 30);
+        b = a;
+        a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
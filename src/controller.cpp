@@ -0,0 +1,28 @@
+#include "controller.h"
+
+void ControllerPort::reset() {
+    buttons = 0x0u;
+    shift = 0x0u;
+    strobeHigh = false;
+}
+
+void ControllerPort::setButtons(uint8_t buttons) {
+    this->buttons = buttons;
+    if (strobeHigh)
+        shift = buttons;
+}
+
+void ControllerPort::strobe(uint8_t val) {
+    // The register follows the buttons for as long as the strobe is high
+    strobeHigh = val & 0x1;
+    if (strobeHigh)
+        shift = buttons;
+}
+
+uint8_t ControllerPort::read() {
+    if (strobeHigh)
+        return CONTROLLER_OPEN_BUS | (buttons & 0x1);
+    uint8_t bit = shift & 0x1;
+    shift = 0x80 | (shift >> 1);
+    return CONTROLLER_OPEN_BUS | bit;
+}
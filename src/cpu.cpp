@@ -1,15 +1,157 @@
+#include <cstring>
+
 #include "cpu.h"
+#include "nes.h"
+
+// Setup instruction to function ptr map
+const MOS6502::INSTRUCTION MOS6502::oplist[256] = {
+    { "BRK", &MOS6502::BRK, &MOS6502::IMM, 7 },{ "ORA", &MOS6502::ORA, &MOS6502::IZX, 6 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 8 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 3 },{ "ORA", &MOS6502::ORA, &MOS6502::ZP0, 3 },
+    { "ASL", &MOS6502::ASL, &MOS6502::ZP0, 5 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 5 },
+    { "PHP", &MOS6502::PHP, &MOS6502::IMP, 3 },{ "ORA", &MOS6502::ORA, &MOS6502::IMM, 2 },
+    { "ASL", &MOS6502::ASL, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 4 },{ "ORA", &MOS6502::ORA, &MOS6502::ABS, 4 },
+    { "ASL", &MOS6502::ASL, &MOS6502::ABS, 6 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 6 },
+    { "BPL", &MOS6502::BPL, &MOS6502::REL, 2 },{ "ORA", &MOS6502::ORA, &MOS6502::IZY, 5 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 8 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 4 },{ "ORA", &MOS6502::ORA, &MOS6502::ZPX, 4 },
+    { "ASL", &MOS6502::ASL, &MOS6502::ZPX, 6 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 6 },
+    { "CLC", &MOS6502::CLC, &MOS6502::IMP, 2 },{ "ORA", &MOS6502::ORA, &MOS6502::ABY, 4 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 7 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 4 },{ "ORA", &MOS6502::ORA, &MOS6502::ABX, 4 },
+    { "ASL", &MOS6502::ASL, &MOS6502::ABX, 7 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 7 },
+    { "JSR", &MOS6502::JSR, &MOS6502::ABS, 6 },{ "AND", &MOS6502::AND, &MOS6502::IZX, 6 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 8 },
+    { "BIT", &MOS6502::BIT, &MOS6502::ZP0, 3 },{ "AND", &MOS6502::AND, &MOS6502::ZP0, 3 },
+    { "ROL", &MOS6502::ROL, &MOS6502::ZP0, 5 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 5 },
+    { "PLP", &MOS6502::PLP, &MOS6502::IMP, 4 },{ "AND", &MOS6502::AND, &MOS6502::IMM, 2 },
+    { "ROL", &MOS6502::ROL, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },
+    { "BIT", &MOS6502::BIT, &MOS6502::ABS, 4 },{ "AND", &MOS6502::AND, &MOS6502::ABS, 4 },
+    { "ROL", &MOS6502::ROL, &MOS6502::ABS, 6 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 6 },
+    { "BMI", &MOS6502::BMI, &MOS6502::REL, 2 },{ "AND", &MOS6502::AND, &MOS6502::IZY, 5 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 8 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 4 },{ "AND", &MOS6502::AND, &MOS6502::ZPX, 4 },
+    { "ROL", &MOS6502::ROL, &MOS6502::ZPX, 6 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 6 },
+    { "SEC", &MOS6502::SEC, &MOS6502::IMP, 2 },{ "AND", &MOS6502::AND, &MOS6502::ABY, 4 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 7 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 4 },{ "AND", &MOS6502::AND, &MOS6502::ABX, 4 },
+    { "ROL", &MOS6502::ROL, &MOS6502::ABX, 7 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 7 },
+    { "RTI", &MOS6502::RTI, &MOS6502::IMP, 6 },{ "EOR", &MOS6502::EOR, &MOS6502::IZX, 6 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 8 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 3 },{ "EOR", &MOS6502::EOR, &MOS6502::ZP0, 3 },
+    { "LSR", &MOS6502::LSR, &MOS6502::ZP0, 5 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 5 },
+    { "PHA", &MOS6502::PHA, &MOS6502::IMP, 3 },{ "EOR", &MOS6502::EOR, &MOS6502::IMM, 2 },
+    { "LSR", &MOS6502::LSR, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },
+    { "JMP", &MOS6502::JMP, &MOS6502::ABS, 3 },{ "EOR", &MOS6502::EOR, &MOS6502::ABS, 4 },
+    { "LSR", &MOS6502::LSR, &MOS6502::ABS, 6 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 6 },
+    { "BVC", &MOS6502::BVC, &MOS6502::REL, 2 },{ "EOR", &MOS6502::EOR, &MOS6502::IZY, 5 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 8 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 4 },{ "EOR", &MOS6502::EOR, &MOS6502::ZPX, 4 },
+    { "LSR", &MOS6502::LSR, &MOS6502::ZPX, 6 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 6 },
+    { "CLI", &MOS6502::CLI, &MOS6502::IMP, 2 },{ "EOR", &MOS6502::EOR, &MOS6502::ABY, 4 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 7 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 4 },{ "EOR", &MOS6502::EOR, &MOS6502::ABX, 4 },
+    { "LSR", &MOS6502::LSR, &MOS6502::ABX, 7 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 7 },
+    { "RTS", &MOS6502::RTS, &MOS6502::IMP, 6 },{ "ADC", &MOS6502::ADC, &MOS6502::IZX, 6 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 8 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 3 },{ "ADC", &MOS6502::ADC, &MOS6502::ZP0, 3 },
+    { "ROR", &MOS6502::ROR, &MOS6502::ZP0, 5 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 5 },
+    { "PLA", &MOS6502::PLA, &MOS6502::IMP, 4 },{ "ADC", &MOS6502::ADC, &MOS6502::IMM, 2 },
+    { "ROR", &MOS6502::ROR, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },
+    { "JMP", &MOS6502::JMP, &MOS6502::IND, 5 },{ "ADC", &MOS6502::ADC, &MOS6502::ABS, 4 },
+    { "ROR", &MOS6502::ROR, &MOS6502::ABS, 6 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 6 },
+    { "BVS", &MOS6502::BVS, &MOS6502::REL, 2 },{ "ADC", &MOS6502::ADC, &MOS6502::IZY, 5 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 8 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 4 },{ "ADC", &MOS6502::ADC, &MOS6502::ZPX, 4 },
+    { "ROR", &MOS6502::ROR, &MOS6502::ZPX, 6 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 6 },
+    { "SEI", &MOS6502::SEI, &MOS6502::IMP, 2 },{ "ADC", &MOS6502::ADC, &MOS6502::ABY, 4 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 7 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 4 },{ "ADC", &MOS6502::ADC, &MOS6502::ABX, 4 },
+    { "ROR", &MOS6502::ROR, &MOS6502::ABX, 7 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 7 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "STA", &MOS6502::STA, &MOS6502::IZX, 6 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 6 },
+    { "STY", &MOS6502::STY, &MOS6502::ZP0, 3 },{ "STA", &MOS6502::STA, &MOS6502::ZP0, 3 },
+    { "STX", &MOS6502::STX, &MOS6502::ZP0, 3 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 3 },
+    { "DEY", &MOS6502::DEY, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },
+    { "TXA", &MOS6502::TXA, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },
+    { "STY", &MOS6502::STY, &MOS6502::ABS, 4 },{ "STA", &MOS6502::STA, &MOS6502::ABS, 4 },
+    { "STX", &MOS6502::STX, &MOS6502::ABS, 4 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 4 },
+    { "BCC", &MOS6502::BCC, &MOS6502::REL, 2 },{ "STA", &MOS6502::STA, &MOS6502::IZY, 6 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 6 },
+    { "STY", &MOS6502::STY, &MOS6502::ZPX, 4 },{ "STA", &MOS6502::STA, &MOS6502::ZPX, 4 },
+    { "STX", &MOS6502::STX, &MOS6502::ZPY, 4 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 4 },
+    { "TYA", &MOS6502::TYA, &MOS6502::IMP, 2 },{ "STA", &MOS6502::STA, &MOS6502::ABY, 5 },
+    { "TXS", &MOS6502::TXS, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 5 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 5 },{ "STA", &MOS6502::STA, &MOS6502::ABX, 5 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 5 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 5 },
+    { "LDY", &MOS6502::LDY, &MOS6502::IMM, 2 },{ "LDA", &MOS6502::LDA, &MOS6502::IZX, 6 },
+    { "LDX", &MOS6502::LDX, &MOS6502::IMM, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 6 },
+    { "LDY", &MOS6502::LDY, &MOS6502::ZP0, 3 },{ "LDA", &MOS6502::LDA, &MOS6502::ZP0, 3 },
+    { "LDX", &MOS6502::LDX, &MOS6502::ZP0, 3 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 3 },
+    { "TAY", &MOS6502::TAY, &MOS6502::IMP, 2 },{ "LDA", &MOS6502::LDA, &MOS6502::IMM, 2 },
+    { "TAX", &MOS6502::TAX, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },
+    { "LDY", &MOS6502::LDY, &MOS6502::ABS, 4 },{ "LDA", &MOS6502::LDA, &MOS6502::ABS, 4 },
+    { "LDX", &MOS6502::LDX, &MOS6502::ABS, 4 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 4 },
+    { "BCS", &MOS6502::BCS, &MOS6502::REL, 2 },{ "LDA", &MOS6502::LDA, &MOS6502::IZY, 5 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 5 },
+    { "LDY", &MOS6502::LDY, &MOS6502::ZPX, 4 },{ "LDA", &MOS6502::LDA, &MOS6502::ZPX, 4 },
+    { "LDX", &MOS6502::LDX, &MOS6502::ZPY, 4 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 4 },
+    { "CLV", &MOS6502::CLV, &MOS6502::IMP, 2 },{ "LDA", &MOS6502::LDA, &MOS6502::ABY, 4 },
+    { "TSX", &MOS6502::TSX, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 4 },
+    { "LDY", &MOS6502::LDY, &MOS6502::ABX, 4 },{ "LDA", &MOS6502::LDA, &MOS6502::ABX, 4 },
+    { "LDX", &MOS6502::LDX, &MOS6502::ABY, 4 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 4 },
+    { "CPY", &MOS6502::CPY, &MOS6502::IMM, 2 },{ "CMP", &MOS6502::CMP, &MOS6502::IZX, 6 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 8 },
+    { "CPY", &MOS6502::CPY, &MOS6502::ZP0, 3 },{ "CMP", &MOS6502::CMP, &MOS6502::ZP0, 3 },
+    { "DEC", &MOS6502::DEC, &MOS6502::ZP0, 5 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 5 },
+    { "INY", &MOS6502::INY, &MOS6502::IMP, 2 },{ "CMP", &MOS6502::CMP, &MOS6502::IMM, 2 },
+    { "DEX", &MOS6502::DEX, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },
+    { "CPY", &MOS6502::CPY, &MOS6502::ABS, 4 },{ "CMP", &MOS6502::CMP, &MOS6502::ABS, 4 },
+    { "DEC", &MOS6502::DEC, &MOS6502::ABS, 6 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 6 },
+    { "BNE", &MOS6502::BNE, &MOS6502::REL, 2 },{ "CMP", &MOS6502::CMP, &MOS6502::IZY, 5 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 8 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 4 },{ "CMP", &MOS6502::CMP, &MOS6502::ZPX, 4 },
+    { "DEC", &MOS6502::DEC, &MOS6502::ZPX, 6 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 6 },
+    { "CLD", &MOS6502::CLD, &MOS6502::IMP, 2 },{ "CMP", &MOS6502::CMP, &MOS6502::ABY, 4 },
+    { "NOP", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 7 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 4 },{ "CMP", &MOS6502::CMP, &MOS6502::ABX, 4 },
+    { "DEC", &MOS6502::DEC, &MOS6502::ABX, 7 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 6 },
+    { "CPX", &MOS6502::CPX, &MOS6502::IMM, 2 },{ "SBC", &MOS6502::SBC, &MOS6502::IZX, 6 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 8 },
+    { "CPX", &MOS6502::CPX, &MOS6502::ZP0, 3 },{ "SBC", &MOS6502::SBC, &MOS6502::ZP0, 3 },
+    { "INC", &MOS6502::INC, &MOS6502::ZP0, 5 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 5 },
+    { "INX", &MOS6502::INX, &MOS6502::IMP, 2 },{ "SBC", &MOS6502::SBC, &MOS6502::IMM, 2 },
+    { "NOP", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::SBC, &MOS6502::IMP, 2 },
+    { "CPX", &MOS6502::CPX, &MOS6502::ABS, 4 },{ "SBC", &MOS6502::SBC, &MOS6502::ABS, 4 },
+    { "INC", &MOS6502::INC, &MOS6502::ABS, 6 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 6 },
+    { "BEQ", &MOS6502::BEQ, &MOS6502::REL, 2 },{ "SBC", &MOS6502::SBC, &MOS6502::IZY, 5 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 8 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 4 },{ "SBC", &MOS6502::SBC, &MOS6502::ZPX, 4 },
+    { "INC", &MOS6502::INC, &MOS6502::ZPX, 6 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 6 },
+    { "SED", &MOS6502::SED, &MOS6502::IMP, 2 },{ "SBC", &MOS6502::SBC, &MOS6502::ABY, 4 },
+    { "NOP", &MOS6502::NOP, &MOS6502::IMP, 2 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 7 },
+    { "ILL", &MOS6502::NOP, &MOS6502::IMP, 4 },{ "SBC", &MOS6502::SBC, &MOS6502::ABX, 4 },
+    { "INC", &MOS6502::INC, &MOS6502::ABX, 7 },{ "ILL", &MOS6502::NOP, &MOS6502::IMP, 7 },
+};
 
 MOS6502::MOS6502() {
-    // Setup registers, memory, and cycles counter
-    registers["A"] = 0x0u;  // accumulator
-    registers["X"] = 0x0u;  // x register
-    registers["Y"] = 0x0u;  // y register
-    registers["P"] = 0x0u;  // status
-    registers["SP"] = 0x0u; // stack pointer
+    // Setup registers and cycles counter, the 2KB of RAM is held by the NES
+    a = 0x0u;  // accumulator
+    x = 0x0u;  // x register
+    y = 0x0u;  // y register
+    p = 0x0u;  // status
+    sp = 0x0u; // stack pointer
     pc = 0x0u;              // program counter
-    memory = (uint8_t*) malloc(CPU_MEM_SIZE * sizeof(uint8_t));
+    opcode = 0x0u;
     cyclesRemaining = 0;
+    accessDots = 0;
+    profile = nullptr;
+    fusion = nullptr;
+    compiled = nullptr;
+    instructions = 0;
+    nmis = 0;
+    irqs = 0;
 }
 
 void MOS6502::cycle() {
@@ -17,17 +159,33 @@ void MOS6502::cycle() {
     // expect results completed after that many cycles, therefore, we can execute on the first
     // cycle and then wait until the final cycle has completed to execute the next instruction.
 
-    if (cyclesRemaining == 0) {
+    if (cyclesRemaining == 0 && compiled && pc >= 0x8000 && compiled[pc - 0x8000]) {
+        // Native code generated for this address runs it and as much of its block as it can, only
+        // the first instruction can touch anything but RAM and ROM
+        accessDots = 3 * (oplist[readMem(pc)].cycles - 1);
+        cyclesRemaining = compiled[pc - 0x8000](this);
+        accessDots = 0;
+    } else if (cyclesRemaining == 0) {
         // Read next inst
-        uint8_t opcode = memory[pc];
+        uint8_t previous = opcode;
+        opcode = readMem(pc);
+        if (profile)
+            profile->count(previous, opcode);
         // Increment pc
         pc++;
         // Calculate number of required cycles for inst
         cyclesRemaining = oplist[opcode].cycles;
         // Calculate number of additional required cycles for addressing mode and opcode
         pageBoundaryCrossed = false;
+        accessDots = 3 * (oplist[opcode].cycles - 1);
         cyclesRemaining += (this->*oplist[opcode].addrmode)();
         cyclesRemaining += (this->*oplist[opcode].execute)();
+        accessDots = 0;
+#ifdef NES_METRICS
+        instructions++;
+#endif
+        if (fusion)
+            fuseFollowing();
     }
 
     cyclesRemaining--;
@@ -41,11 +199,11 @@ void MOS6502::reset() {
     pc = (hi << 8) | lo;
 
     // Reset registers
-    registers["A"] = 0u;
-    registers["X"] = 0u;
-    registers["Y"] = 0u;
-    registers["SP"] = 0xFD;
-    registers["P"] = 0x00 | U;
+    a = 0u;
+    x = 0u;
+    y = 0u;
+    sp = 0xFD;
+    p = 0x00 | U;
 
     // Clear helper variables
     addr_rel = 0u;
@@ -62,17 +220,17 @@ void MOS6502::irq() {
 	{
 		// Push the program counter to the stack. It's 16-bits dont
 		// forget so that takes two pushes
-		writeMem(0x0100 + registers["SP"], (pc >> 8) & 0x00FF);
-		registers["SP"]--;
-		writeMem(0x0100 + registers["SP"], pc & 0x00FF);
-		registers["SP"]--;
+		writeMem(0x0100 + sp, (pc >> 8) & 0x00FF);
+		sp--;
+		writeMem(0x0100 + sp, pc & 0x00FF);
+		sp--;
 
 		// Then Push the status register to the stack
 		setFlag(B, 0);
 		setFlag(U, 1);
 		setFlag(I, 1);
-		writeMem(0x0100 + registers["SP"], registers["P"]);
-		registers["SP"]--;
+		writeMem(0x0100 + sp, p);
+		sp--;
 
 		// Read new program counter location from fixed address
 		addr_abs = 0xFFFE;
@@ -82,21 +240,24 @@ void MOS6502::irq() {
 
 		// IRQs take time
 		cyclesRemaining = 7;
+#ifdef NES_METRICS
+		irqs++;
+#endif
 	}
 }
 
 void MOS6502::nmi() {
     // Almost identical to interrupts except can't be ignored and reads pc from 0xFFFA
-    writeMem(0x0100 + registers["SP"], (pc >> 8) & 0x00FF);
-	registers["SP"]--;
-	writeMem(0x0100 + registers["SP"], pc & 0x00FF);
-	registers["SP"]--;
+    writeMem(0x0100 + sp, (pc >> 8) & 0x00FF);
+	sp--;
+	writeMem(0x0100 + sp, pc & 0x00FF);
+	sp--;
 
 	setFlag(B, 0);
 	setFlag(U, 1);
 	setFlag(I, 1);
-	writeMem(0x0100 + registers["SP"], registers["P"]);
-	registers["SP"]--;
+	writeMem(0x0100 + sp, p);
+	sp--;
 
 	addr_abs = 0xFFFA;
 	uint16_t lo = readMem(addr_abs + 0);
@@ -104,6 +265,54 @@ void MOS6502::nmi() {
 	pc = (hi << 8) | lo;
 
 	cyclesRemaining = 8;
+#ifdef NES_METRICS
+	nmis++;
+#endif
+}
+
+void MOS6502::fuseFollowing() {
+    // Running the next instruction now rather than when this one's cycles are up is invisible as
+    // long as no interrupt would be taken in between and it only touches RAM and ROM, which no
+    // other chip sees (the DMC only reads ROM). Anything else leaves it to start on its own cycle.
+    for (int fused = 1; fused < FUSION_MAX_LENGTH; fused++) {
+        if (pc >= 0x2000 - 2 && pc < 0x6000)             // Operands could be in I/O space too
+            return;
+        uint8_t next = readMem(pc);
+        if (!fusion->fuses(opcode, next) || !nes->quietFor(cyclesRemaining))
+            return;
+
+        uint16_t start = pc;
+        pc++;
+        pageBoundaryCrossed = false;
+        uint8_t extra = (this->*oplist[next].addrmode)();
+        if (oplist[next].addrmode != &MOS6502::IMP && addr_abs >= 0x2000 && addr_abs < 0x6000) {
+            pc = start;
+            return;
+        }
+
+        if (profile)
+            profile->count(opcode, next);
+        opcode = next;
+        cyclesRemaining += oplist[next].cycles + extra;
+        cyclesRemaining += (this->*oplist[next].execute)();
+#ifdef NES_METRICS
+        instructions++;
+#endif
+    }
+}
+
+const char* MOS6502::mnemonic(uint8_t opcode) {
+    return oplist[opcode].name;
+}
+
+bool MOS6502::fusible(uint8_t first, uint8_t second) {
+    // BRK and the unofficial opcodes always run alone, and JMP ($nnnn) reads its pointer from
+    // anywhere before there's a chance to check the address
+    const INSTRUCTION& a = oplist[first];
+    const INSTRUCTION& b = oplist[second];
+    if (std::strcmp(a.name, "ILL") == 0 || std::strcmp(b.name, "ILL") == 0)
+        return false;
+    return first != 0x00 && second != 0x00 && b.addrmode != &MOS6502::IND;
 }
 
 uint8_t MOS6502::fetch() {
@@ -123,14 +332,14 @@ void MOS6502::writeMem(uint16_t addr, uint8_t val) {
 }
 
 uint8_t MOS6502::getFlag(STATUSFLAGS flag) {
-    return (uint8_t)(registers["P"] & flag);
+    return (uint8_t)(p & flag);
 }
 
 void MOS6502::setFlag(STATUSFLAGS flag, bool val) {
     if (val)
-        registers["P"] |= flag;
+        p |= flag;
     else
-        registers["P"] &= ~flag;
+        p &= ~flag;
 }
 
 // Instruction function declarations
@@ -139,18 +348,18 @@ uint8_t MOS6502::ADC() {
     fetch();
 
     // Calculate sum
-    uint16_t sum = (uint16_t) registers["A"] + (uint16_t) fetched + (uint16_t) getFlag(C);
+    uint16_t sum = (uint16_t) a + (uint16_t) fetched + (uint16_t) getFlag(C);
 
     // Set flags
     setFlag(C, sum > 255);              // set carry bit if sum larger than 2^8 - 1
     setFlag(Z, (sum & 0x00FF) == 0);    // set zero bit if sum = 0
     setFlag(N, sum & 0x80);             // negative bit is set to most significant bit
-    setFlag(O, (~((uint16_t)registers["A"] ^ (uint16_t)fetched)
-                & ((uint16_t)registers["A"] ^ (uint16_t)sum)) & 0x0080);
+    setFlag(O, (~((uint16_t)a ^ (uint16_t)fetched)
+                & ((uint16_t)a ^ (uint16_t)sum)) & 0x0080);
                                         // overflow bit is set based on most sig. bit of formula
     
     // Convert sum to 8 bits and store in accumulator
-    registers["A"] = sum & 0x00FF;
+    a = sum & 0x00FF;
 
     // Can take an additional cycle
     return pageBoundaryCrossed ? 1u : 0u;
@@ -161,11 +370,11 @@ uint8_t MOS6502::AND() {
     fetch();
 
     // Compute bitwise and
-    registers["A"] &= fetched;
+    a &= fetched;
 
     // Set flags
-    setFlag(Z, (registers["A"] & 0x00FF) == 0);   // set zero bit if res = 0
-    setFlag(N, registers["A"] & 0x80);            // negative bit is set to most significant bit
+    setFlag(Z, (a & 0x00FF) == 0);   // set zero bit if res = 0
+    setFlag(N, a & 0x80);            // negative bit is set to most significant bit
 
     // Can take an additional cycle
     return pageBoundaryCrossed ? 1u : 0u;
@@ -174,7 +383,7 @@ uint8_t MOS6502::AND() {
 uint8_t MOS6502::ASL() {
     // Fetch neccessary data
     if (oplist[opcode].addrmode == &MOS6502::IMP){
-        fetched = registers["A"];
+        fetched = a;
     } else {
         fetch();
     }
@@ -188,7 +397,7 @@ uint8_t MOS6502::ASL() {
     setFlag(N, shifted & 0x80);
 
     if (oplist[opcode].addrmode == &MOS6502::IMP) {
-        registers["A"] = shifted & 0x00FF;
+        a = shifted & 0x00FF;
     } else {
         writeMem(addr_abs, shifted & 0x00FF);
     }
@@ -208,7 +417,7 @@ uint8_t MOS6502::BCC() {
 }
 
 uint8_t MOS6502::BCS() {
-    if (!getFlag(C)) {
+    if (getFlag(C)) {
         pc = addr_abs;
 
         // Can take an additional cycle
@@ -232,7 +441,7 @@ uint8_t MOS6502::BIT() {
     // Fetch neccessary data
     fetch();
     
-    uint16_t res = registers["A"] & fetched;
+    uint16_t res = a & fetched;
 
     // Set flags
     setFlag(Z, (res & 0x00FF) == 0x00);
@@ -276,17 +485,16 @@ uint8_t MOS6502::BPL() {
 }
 
 uint8_t MOS6502::BRK() {
-    pc++;
-
+    // pc already points past the padding byte thanks to the IMM address mode
     setFlag(I, 1);
-    writeMem(0x0100 + registers["SP"], (pc >> 8) & 0x00FF);
-    registers["SP"]--;
-    writeMem(0x0100 + registers["SP"], pc & 0x00FF);
-    registers["SP"]--;
+    writeMem(0x0100 + sp, (pc >> 8) & 0x00FF);
+    sp--;
+    writeMem(0x0100 + sp, pc & 0x00FF);
+    sp--;
 
     setFlag(B, 1);
-    writeMem(0x0100 + registers["SP"], registers["P"]);
-    registers["SP"]--;
+    writeMem(0x0100 + sp, p);
+    sp--;
     setFlag(B, 0);
 
     pc = (uint16_t) readMem(0xFFFE) | ((uint16_t) readMem(0xFFFF) << 8);
@@ -343,10 +551,10 @@ uint8_t MOS6502::CMP() {
     // Fetch neccessary data
     fetch();
 
-    uint16_t res = registers["A"] - fetched;
+    uint16_t res = a - fetched;
     setFlag(Z, (res & 0x00FF) == 0);        // set zero bit if res = 0
     setFlag(N, res & 0x80);                 // negative bit is set to most significant bit
-    setFlag(C, registers["A"] >= fetched);  // set carry if accumulator is bigger than the data from memory
+    setFlag(C, a >= fetched);  // set carry if accumulator is bigger than the data from memory
 
     // Can take an additional cycle
     return pageBoundaryCrossed ? 1u : 0u;
@@ -357,10 +565,10 @@ uint8_t MOS6502::CPX() {
     fetch();
 
     // Perform subtraction and set flags
-    uint16_t res = (uint16_t) registers["X"] - (uint16_t) fetched;
+    uint16_t res = (uint16_t) x - (uint16_t) fetched;
     setFlag(Z, (res & 0x00FF) == 0);        // set zero bit if res = 0
     setFlag(N, res & 0x80);                 // negative bit is set to most significant bit
-    setFlag(C, registers["X"] >= fetched);  // set carry if x is bigger than the data from memory
+    setFlag(C, x >= fetched);  // set carry if x is bigger than the data from memory
 
     return 0u;
 }
@@ -370,10 +578,10 @@ uint8_t MOS6502::CPY() {
     fetch();
 
     // Perform subtraction and set flags
-    uint16_t res = (uint16_t) registers["Y"] - (uint16_t) fetched;
+    uint16_t res = (uint16_t) y - (uint16_t) fetched;
     setFlag(Z, (res & 0x00FF) == 0);        // set zero bit if res = 0
     setFlag(N, res & 0x80);                 // negative bit is set to most significant bit
-    setFlag(C, registers["Y" ] >= fetched); // set carry if y is bigger than the data from memory
+    setFlag(C, y >= fetched); // set carry if y is bigger than the data from memory
 
     return 0u;
 }
@@ -385,30 +593,30 @@ uint8_t MOS6502::DEC() {
     writeMem(addr_abs, res);
 
     // Set flags
-    setFlag(Z, (registers["A"] & 0x00FF) == 0);   // set zero bit if res = 0
-    setFlag(N, registers["A"] & 0x80);            // negative bit is set to most significant bit
+    setFlag(Z, res == 0);                         // set zero bit if res = 0
+    setFlag(N, res & 0x80);                       // negative bit is set to most significant bit
 
     return 0u;
 }
 
 uint8_t MOS6502::DEX() {
     // Decrement X
-    registers["X"]--;
+    x--;
 
     // Set flags
-    setFlag(Z, (registers["X"] & 0x00FF) == 0);   // set zero bit if res = 0
-    setFlag(N, registers["X"] & 0x80);            // negative bit is set to most significant bit
+    setFlag(Z, (x & 0x00FF) == 0);   // set zero bit if res = 0
+    setFlag(N, x & 0x80);            // negative bit is set to most significant bit
 
     return 0u;
 }
 
 uint8_t MOS6502::DEY() {
     // Decrement Y
-    registers["Y"]--;
+    y--;
 
     // Set flags
-    setFlag(Z, (registers["Y"] & 0x00FF) == 0);   // set zero bit if res = 0
-    setFlag(N, registers["Y"] & 0x80);            // negative bit is set to most significant bit
+    setFlag(Z, (y & 0x00FF) == 0);   // set zero bit if res = 0
+    setFlag(N, y & 0x80);            // negative bit is set to most significant bit
 
     return 0u;
 }
@@ -418,11 +626,11 @@ uint8_t MOS6502::EOR() {
     fetch();
 
     // Compute bitwise and
-    registers["A"] ^= fetched;
+    a ^= fetched;
 
     // Set flags
-    setFlag(Z, (registers["A"] & 0x00FF) == 0);   // set zero bit if res = 0
-    setFlag(N, registers["A"] & 0x80);            // negative bit is set to most significant bit
+    setFlag(Z, (a & 0x00FF) == 0);   // set zero bit if res = 0
+    setFlag(N, a & 0x80);            // negative bit is set to most significant bit
 
     // Can take an additional cycle
     return pageBoundaryCrossed ? 1u : 0u;
@@ -435,30 +643,30 @@ uint8_t MOS6502::INC() {
     writeMem(addr_abs, res);
 
     // Set flags
-    setFlag(Z, (registers["A"] & 0x00FF) == 0);   // set zero bit if res = 0
-    setFlag(N, registers["A"] & 0x80);            // negative bit is set to most significant bit
+    setFlag(Z, res == 0);                         // set zero bit if res = 0
+    setFlag(N, res & 0x80);                       // negative bit is set to most significant bit
 
     return 0u;
 }
 
 uint8_t MOS6502::INX() {
     // Increment X
-    registers["X"]++;
+    x++;
 
     // Set flags
-    setFlag(Z, (registers["X"] & 0x00FF) == 0);   // set zero bit if res = 0
-    setFlag(N, registers["X"] & 0x80);            // negative bit is set to most significant bit
+    setFlag(Z, (x & 0x00FF) == 0);   // set zero bit if res = 0
+    setFlag(N, x & 0x80);            // negative bit is set to most significant bit
 
     return 0u;
 }
 
 uint8_t MOS6502::INY() {
     // Increment Y
-    registers["Y"]++;
+    y++;
 
     // Set flags
-    setFlag(Z, (registers["Y"] & 0x00FF) == 0);   // set zero bit if res = 0
-    setFlag(N, registers["Y"] & 0x80);            // negative bit is set to most significant bit
+    setFlag(Z, (y & 0x00FF) == 0);   // set zero bit if res = 0
+    setFlag(N, y & 0x80);            // negative bit is set to most significant bit
 
     return 0u;
 }
@@ -473,10 +681,10 @@ uint8_t MOS6502::JMP() {
 uint8_t MOS6502::JSR() {
     // Push pc to stack
     pc--;
-    writeMem(0x0100 + registers["SP"], (pc >> 8) & 0x00FF);
-    registers["SP"]--;
-    writeMem(0x0100 + registers["SP"], pc & 0xFF00);
-    registers["SP"]--;
+    writeMem(0x0100 + sp, (pc >> 8) & 0x00FF);
+    sp--;
+    writeMem(0x0100 + sp, pc & 0x00FF);
+    sp--;
 
     pc = addr_abs;
 
@@ -488,11 +696,11 @@ uint8_t MOS6502::LDA() {
     fetch();
 
     // Write fetched data to accumulator
-    registers["A"] = fetched;
+    a = fetched;
 
     // Set flags
-    setFlag(Z, (registers["A"] & 0x00FF) == 0);   // set zero bit if res = 0
-    setFlag(N, registers["A"] & 0x80);            // negative bit is set to most significant bit
+    setFlag(Z, (a & 0x00FF) == 0);   // set zero bit if res = 0
+    setFlag(N, a & 0x80);            // negative bit is set to most significant bit
 
     // Can take an additional cycle
     return pageBoundaryCrossed ? 1u : 0u;
@@ -503,11 +711,11 @@ uint8_t MOS6502::LDX() {
     fetch();
 
     // Write fetched data to X register
-    registers["X"] = fetched;
+    x = fetched;
 
     // Set flags
-    setFlag(Z, (registers["X"] & 0x00FF) == 0);   // set zero bit if res = 0
-    setFlag(N, registers["X"] & 0x80);            // negative bit is set to most significant bit
+    setFlag(Z, (x & 0x00FF) == 0);   // set zero bit if res = 0
+    setFlag(N, x & 0x80);            // negative bit is set to most significant bit
 
     // Can take an additional cycle
     return pageBoundaryCrossed ? 1u : 0u;
@@ -518,11 +726,11 @@ uint8_t MOS6502::LDY() {
     fetch();
 
     // Write fetched data to X register
-    registers["Y"] = fetched;
+    y = fetched;
 
     // Set flags
-    setFlag(Z, (registers["Y"] & 0x00FF) == 0);   // set zero bit if res = 0
-    setFlag(N, registers["Y"] & 0x80);            // negative bit is set to most significant bit
+    setFlag(Z, (y & 0x00FF) == 0);   // set zero bit if res = 0
+    setFlag(N, y & 0x80);            // negative bit is set to most significant bit
 
     // Can take an additional cycle
     return pageBoundaryCrossed ? 1u : 0u;
@@ -531,7 +739,7 @@ uint8_t MOS6502::LDY() {
 uint8_t MOS6502::LSR() {
     // Fetch neccessary data
     if (oplist[opcode].addrmode == &MOS6502::IMP){
-        fetched = registers["A"];
+        fetched = a;
     } else {
         fetch();
     }
@@ -547,7 +755,7 @@ uint8_t MOS6502::LSR() {
     setFlag(N, shifted & 0x80);
 
     if (oplist[opcode].addrmode == &MOS6502::IMP) {
-        registers["A"] = shifted & 0x00FF;
+        a = shifted & 0x00FF;
     } else {
         writeMem(addr_abs, shifted & 0x00FF);
     }
@@ -564,44 +772,44 @@ uint8_t MOS6502::ORA() {
     fetch();
 
     // Compute bitwise and
-    registers["A"] |= fetched;
+    a |= fetched;
 
     // Set flags
-    setFlag(Z, (registers["A"] & 0x00FF) == 0);   // set zero bit if res = 0
-    setFlag(N, registers["A"] & 0x80);            // negative bit is set to most significant bit
+    setFlag(Z, (a & 0x00FF) == 0);   // set zero bit if res = 0
+    setFlag(N, a & 0x80);            // negative bit is set to most significant bit
 
     // Can take an additional cycle
     return pageBoundaryCrossed ? 1u : 0u;
 }
 
 uint8_t MOS6502::PHA() {
-    writeMem(0x0100 + registers["SP"], registers["A"]);
-    registers["SP"]--;
+    writeMem(0x0100 + sp, a);
+    sp--;
 
     return 0u;
 }
 
 uint8_t MOS6502::PHP() {
-    writeMem(0x0100 + registers["SP"], registers["P"] | B | U);
+    writeMem(0x0100 + sp, p | B | U);
     setFlag(B, 0);
     setFlag(U, 0);
-    registers["SP"]--;
+    sp--;
 
     return 0u;
 }
 
 uint8_t MOS6502::PLA() {
-    registers["SP"]++;
-    readMem(0x0100 + registers["SP"]);
-    setFlag(Z, registers["A"] ? 0u : 1u);
-    setFlag(N, registers["A"] & 0x80);
+    sp++;
+    a = readMem(0x0100 + sp);
+    setFlag(Z, a ? 0u : 1u);
+    setFlag(N, a & 0x80);
 
     return 0u;
 }
 
 uint8_t MOS6502::PLP() {
-    registers["SP"]++;
-    registers["P"] = readMem(0x0100 + registers["SP"]);
+    sp++;
+    p = readMem(0x0100 + sp);
     setFlag(U, 1);
 
     return 0u;
@@ -609,7 +817,7 @@ uint8_t MOS6502::PLP() {
 
 uint8_t MOS6502::ROL() {
     if (oplist[opcode].addrmode == &MOS6502::IMP) {
-        fetched = registers["A"];
+        fetched = a;
     } else {
         fetch();
     }
@@ -630,7 +838,7 @@ uint8_t MOS6502::ROL() {
     setFlag(N, fetched & 0x80);            // negative bit is set to most significant bit
 
     if (oplist[opcode].addrmode == &MOS6502::IMP) {
-        registers["A"] = fetched;
+        a = fetched;
     } else {
         writeMem(addr_abs, fetched);
     }
@@ -640,7 +848,7 @@ uint8_t MOS6502::ROL() {
 
 uint8_t MOS6502::ROR() {
     if (oplist[opcode].addrmode == &MOS6502::IMP) {
-        fetched = registers["A"];
+        fetched = a;
     } else {
         fetch();
     }
@@ -661,7 +869,7 @@ uint8_t MOS6502::ROR() {
     setFlag(N, fetched & 0x80);            // negative bit is set to most significant bit
 
     if (oplist[opcode].addrmode == &MOS6502::IMP) {
-        registers["A"] = fetched;
+        a = fetched;
     } else {
         writeMem(addr_abs, fetched);
     }
@@ -671,26 +879,29 @@ uint8_t MOS6502::ROR() {
 
 uint8_t MOS6502::RTI() {
     // Pop status from stack
-    registers["SP"]++;
-    registers["P"] = readMem(0x0100 + registers["SP"]);
-    registers["P"] &= ~B;
-    registers["P"] &= ~U;
+    sp++;
+    p = readMem(0x0100 + sp);
+    p &= ~B;
+    p &= ~U;
 
     // Pop return address from stack (and shift + or to compose it)
-    registers["SP"]++;
-    pc = (uint16_t) readMem(0x0100 + registers["SP"]);
-    registers["SP"]++;
-    pc |= (uint16_t) readMem(0x0100 + registers["SP"]) << 8;
+    sp++;
+    pc = (uint16_t) readMem(0x0100 + sp);
+    sp++;
+    pc |= (uint16_t) readMem(0x0100 + sp) << 8;
 
     return 0u;
 }
 
 uint8_t MOS6502::RTS() {
     // Pop return address from stack (and shift + or to compose it)
-    registers["SP"]++;
-    pc = (uint16_t) readMem(0x0100 + registers["SP"]);
-    registers["SP"]++;
-    pc |= (uint16_t) readMem(0x0100 + registers["SP"]) << 8;
+    sp++;
+    pc = (uint16_t) readMem(0x0100 + sp);
+    sp++;
+    pc |= (uint16_t) readMem(0x0100 + sp) << 8;
+
+    // JSR pushed the address of its last byte
+    pc++;
 
     return 0u;
 }
@@ -701,12 +912,12 @@ uint8_t MOS6502::SBC() {
 
     // 2s complement subtraction
     uint16_t complement = ((uint16_t) fetched) ^ 0x00FF;
-    uint16_t res = (uint16_t) registers["A"] + complement + (uint16_t) getFlag(C);
+    uint16_t res = (uint16_t) a + complement + (uint16_t) getFlag(C);
     setFlag(C, res & 0xFF00);
     setFlag(Z, ((res & 0x00FF) == 0));
-    setFlag(O, (res ^ (uint16_t) registers["A"]) & (res ^ complement) & 0x0080);
+    setFlag(O, (res ^ (uint16_t) a) & (res ^ complement) & 0x0080);
     setFlag(N, res & 0x0080);
-    registers["A"] = res & 0x00FF;
+    a = res & 0x00FF;
 
     // Can take an additional cycle
     return pageBoundaryCrossed ? 1u : 0u;
@@ -732,90 +943,90 @@ uint8_t MOS6502::SEI() {
 
 uint8_t MOS6502::STA() {
     // Write A register contents to given address
-    writeMem(addr_abs, registers["A"]);
+    writeMem(addr_abs, a);
 
     return 0u;
 }
 
 uint8_t MOS6502::STX() {
     // Write X register contents to given address
-    writeMem(addr_abs, registers["X"]);
+    writeMem(addr_abs, x);
 
     return 0u;
 }
 
 uint8_t MOS6502::STY() {
     // Write Y register contents to given address
-    writeMem(addr_abs, registers["Y"]);
+    writeMem(addr_abs, y);
 
     return 0u;
 }
 
 uint8_t MOS6502::TAX() {
     // Copy A to X
-    registers["X"] = registers["A"];
+    x = a;
 
     // Set flags
-    setFlag(Z, (registers["X"] & 0x00FF) == 0);   // set zero bit if res = 0
-    setFlag(N, registers["X"] & 0x80);            // negative bit is set to most significant bit
+    setFlag(Z, (x & 0x00FF) == 0);   // set zero bit if res = 0
+    setFlag(N, x & 0x80);            // negative bit is set to most significant bit
 
     return 0u;
 }
 
 uint8_t MOS6502::TAY() {
     // Copy A to Y
-    registers["Y"] = registers["A"];
+    y = a;
 
     // Set flags
-    setFlag(Z, (registers["Y"] & 0x00FF) == 0);   // set zero bit if res = 0
-    setFlag(N, registers["Y"] & 0x80);            // negative bit is set to most significant bit
+    setFlag(Z, (y & 0x00FF) == 0);   // set zero bit if res = 0
+    setFlag(N, y & 0x80);            // negative bit is set to most significant bit
 
     return 0u;
 }
 
 uint8_t MOS6502::TSX() {
     // Copy A to X
-    registers["X"] = registers["SP"];
+    x = sp;
 
     // Set flags
-    setFlag(Z, (registers["X"] & 0x00FF) == 0);   // set zero bit if res = 0
-    setFlag(N, registers["X"] & 0x80);            // negative bit is set to most significant bit
+    setFlag(Z, (x & 0x00FF) == 0);   // set zero bit if res = 0
+    setFlag(N, x & 0x80);            // negative bit is set to most significant bit
 
     return 0u;
 }
 
 uint8_t MOS6502::TXA() {
     // Copy X to A
-    registers["A"] = registers["X"];
+    a = x;
 
     // Set flags
-    setFlag(Z, (registers["A"] & 0x00FF) == 0);   // set zero bit if res = 0
-    setFlag(N, registers["A"] & 0x80);            // negative bit is set to most significant bit
+    setFlag(Z, (a & 0x00FF) == 0);   // set zero bit if res = 0
+    setFlag(N, a & 0x80);            // negative bit is set to most significant bit
 
     return 0u;
 }
 
 uint8_t MOS6502::TXS() {
     // Copy A to X
-    registers["SP"] = registers["X"];
+    sp = x;
 
     return 0u;
 }
 
 uint8_t MOS6502::TYA() {
     // Copy Y to A
-    registers["A"] = registers["Y"];
+    a = y;
 
     // Set flags
-    setFlag(Z, (registers["A"] & 0x00FF) == 0);   // set zero bit if res = 0
-    setFlag(N, registers["A"] & 0x80);            // negative bit is set to most significant bit
+    setFlag(Z, (a & 0x00FF) == 0);   // set zero bit if res = 0
+    setFlag(N, a & 0x80);            // negative bit is set to most significant bit
 
     return 0u;
 }
 
 // Addressing modes
 uint8_t MOS6502::IMP() {
-    fetched = registers["A"];
+    fetched = a;
 
     return 0u;
 }
@@ -836,7 +1047,7 @@ uint8_t MOS6502::ZP0() {
 }
 
 uint8_t MOS6502::ZPX() {
-    addr_abs = readMem(pc) + registers["X"];
+    addr_abs = readMem(pc) + x;
     pc++;
     addr_abs &= 0x00FF;
 
@@ -844,7 +1055,7 @@ uint8_t MOS6502::ZPX() {
 }
 
 uint8_t MOS6502::ZPY() {
-    addr_abs = readMem(pc) + registers["Y"];
+    addr_abs = readMem(pc) + y;
     pc++;
     addr_abs &= 0x00FF;
 
@@ -852,10 +1063,14 @@ uint8_t MOS6502::ZPY() {
 }
 
 uint8_t MOS6502::REL() {
-    addr_abs = readMem(pc);
+    addr_rel = readMem(pc);
     pc++;
-    if (addr_abs & 0x80)
-        addr_abs |= 0xFF00;
+    if (addr_rel & 0x80)
+        addr_rel |= 0xFF00;
+
+    // Branch target is relative to the instruction following the branch
+    addr_abs = pc + addr_rel;
+    pageBoundaryCrossed = (addr_abs & 0xFF00) != (pc & 0xFF00);
 
     return 0u;
 }
@@ -878,10 +1093,10 @@ uint8_t MOS6502::ABX() {
     pc++;
 
     addr_abs = (hi << 8) | lo;
-    addr_abs += registers["X"];
+    addr_abs += x;
 
-    if ((addr_abs & 0xFF00) != (hi << 8))
-        return 1u;
+    // Only instructions that read can take the extra cycle, so just flag the crossing
+    pageBoundaryCrossed = (addr_abs & 0xFF00) != (hi << 8);
 
     return 0u;
 }
@@ -893,10 +1108,10 @@ uint8_t MOS6502::ABY() {
     pc++;
     
     addr_abs = (hi << 8) | lo;
-    addr_abs += registers["Y"];
+    addr_abs += y;
 
-    if ((addr_abs & 0xFF00) != (hi << 8))
-        return 1u;
+    // Only instructions that read can take the extra cycle, so just flag the crossing
+    pageBoundaryCrossed = (addr_abs & 0xFF00) != (hi << 8);
 
     return 0u;
 }
@@ -921,8 +1136,8 @@ uint8_t MOS6502::IZX() {
     uint16_t t = readMem(pc);
     pc++;
     
-    uint16_t lo = readMem((uint16_t)(t + (uint16_t)registers["X"]) & 0x00FF);
-    uint16_t hi = readMem((uint16_t)(t + (uint16_t)registers["Y"] + 1) & 0x00FF);
+    uint16_t lo = readMem((uint16_t)(t + (uint16_t)x) & 0x00FF);
+    uint16_t hi = readMem((uint16_t)(t + (uint16_t)x + 1) & 0x00FF);
     
     addr_abs = (hi << 8) | lo;
 
@@ -937,10 +1152,10 @@ uint8_t MOS6502::IZY() {
     uint16_t hi = readMem((t + 1) & 0x00FF);
 
     addr_abs = (hi << 8) | lo;
-    addr_abs += registers["Y"];
+    addr_abs += y;
 
-    if ((addr_abs & 0xFF00) != (hi << 8))
-        return 1u;
+    // Only instructions that read can take the extra cycle, so just flag the crossing
+    pageBoundaryCrossed = (addr_abs & 0xFF00) != (hi << 8);
 
     return 0u;
 }
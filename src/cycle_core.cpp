@@ -0,0 +1,84 @@
+#include "cycle_core.h"
+#include "nes.h"
+
+CycleCore::CycleCore(NES* nes)
+    : nes(nes), arena(CYCLE_CORE_ARENA_SIZE), cpu(runCPU(arena, nes)), ppu(runPPU(arena, nes)), apu(runAPU(arena, nes)) {
+}
+
+bool CycleCore::isValid() const {
+    return cpu.isValid() && ppu.isValid() && apu.isValid();
+}
+
+void CycleCore::runFrame() {
+    // The PPU goes first within a dot, so a CPU access on the same dot sees it already done and
+    // the catch-up in NES::readMem()/writeMem() has nothing left to do
+    NESState* state = nes->state;
+    PPU* ppuUnit = nes->ppu;
+    do {
+        ppu.resume();
+        state->ppuClock = state->masterClock + 1;
+        if (state->masterClock % 3 == 0) {
+            if (ppuUnit->nmi) {
+                ppuUnit->nmi = false;
+                state->nmiPending = true;
+            }
+            cpu.resume();
+            apu.resume();
+        }
+        state->masterClock++;
+    } while (!ppuUnit->frameComplete);
+}
+
+CycleTask CycleCore::runCPU(Arena&, NES* nes) {
+    MOS6502* cpu = nes->cpu;
+    NESState* state = nes->state;
+    while (true) {
+        // Whatever is still owed from reset, interrupt entry, DMA or the last instruction
+        while (cpu->cyclesRemaining > 0) {
+            cpu->cyclesRemaining--;
+            co_await BusCycle{};
+        }
+
+        // Interrupts are only taken between instructions
+        if (state->nmiPending) {
+            state->nmiPending = false;
+            cpu->nmi();
+            continue;
+        }
+        if (nes->apu->irq() && !cpu->getFlag(I)) {
+            cpu->irq();
+            continue;
+        }
+
+        cpu->opcode = cpu->readMem(cpu->pc);
+        cpu->pc++;
+        co_await BusCycle{};
+
+        const MOS6502::INSTRUCTION& inst = MOS6502::oplist[cpu->opcode];
+        cpu->pageBoundaryCrossed = false;
+        (cpu->*inst.addrmode)();
+        for (unsigned int cycle = 2; cycle < inst.cycles; cycle++)
+            co_await BusCycle{};
+
+        // The access itself on the last base cycle, anything it adds is waited out above
+        cpu->cyclesRemaining += (cpu->*inst.execute)();
+#ifdef NES_METRICS
+        cpu->instructions++;
+#endif
+        co_await BusCycle{};
+    }
+}
+
+CycleTask CycleCore::runPPU(Arena&, NES* nes) {
+    while (true) {
+        nes->ppu->cycle();
+        co_await BusCycle{};
+    }
+}
+
+CycleTask CycleCore::runAPU(Arena&, NES* nes) {
+    while (true) {
+        nes->apu->cycle();
+        co_await BusCycle{};
+    }
+}
@@ -0,0 +1,263 @@
+#include <arpa/inet.h>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "debug_server.h"
+
+// Hex with an optional $ or 0x, no larger than max
+static bool parseHex(string text, uint32_t max, uint32_t& value) {
+    if (!text.empty() && text[0] == '$')
+        text.erase(0, 1);
+    else if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X'))
+        text.erase(0, 2);
+    if (text.empty() || text.size() > 8 || text.find_first_not_of("0123456789abcdefABCDEF") != string::npos)
+        return false;
+    value = std::stoul(text, nullptr, 16);
+    return value <= max;
+}
+
+// FIRST or FIRST-LAST
+static bool parseRange(const string& text, uint16_t& first, uint16_t& last) {
+    size_t dash = text.find('-');
+    uint32_t from;
+    uint32_t to;
+    if (!parseHex(text.substr(0, dash), 0xFFFF, from))
+        return false;
+    to = from;
+    if (dash != string::npos && !parseHex(text.substr(dash + 1), 0xFFFF, to))
+        return false;
+    if (to < from)
+        return false;
+    first = from;
+    last = to;
+    return true;
+}
+
+static string hex(uint32_t value, int digits) {
+    std::ostringstream out;
+    out << std::hex << std::uppercase << std::setw(digits) << std::setfill('0') << value;
+    return out.str();
+}
+
+DebugServer::DebugServer(NES* nes, uint16_t port) : debugger(nes) {
+    this->port = 0;
+    served = 0;
+    shuttingDown = false;
+    client = -1;
+    listener = -1;
+    if (!debugger.isAttached())
+        return;
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) {
+        std::cerr << "Could not create a TCP socket" << std::endl;
+        return;
+    }
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    // Local only, the protocol can rewrite memory and has no authentication
+    sockaddr_in local;
+    std::memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    local.sin_port = htons(port);
+    socklen_t length = sizeof(local);
+    if (bind(listener, (sockaddr*) &local, sizeof(local)) != 0 || listen(listener, 1) != 0
+            || getsockname(listener, (sockaddr*) &local, &length) != 0) {
+        std::cerr << "Could not listen on TCP port " << port << std::endl;
+        close(listener);
+        listener = -1;
+        return;
+    }
+    this->port = ntohs(local.sin_port);
+}
+
+DebugServer::~DebugServer() {
+    if (listener >= 0)
+        close(listener);
+}
+
+bool DebugServer::isOpen() const {
+    return listener >= 0;
+}
+
+uint16_t DebugServer::localPort() const {
+    return port;
+}
+
+uint64_t DebugServer::commandsServed() const {
+    return served;
+}
+
+void DebugServer::run() {
+    while (listener >= 0 && !shuttingDown) {
+        client = accept(listener, nullptr, nullptr);
+        if (client < 0)
+            continue;
+        pending.clear();
+        while (serve()) {}
+        close(client);
+        client = -1;
+    }
+}
+
+bool DebugServer::serve() {
+    // Lines can arrive in any number of pieces, or several to a piece
+    char buffer[512];
+    size_t newline;
+    while ((newline = pending.find('\n')) == string::npos) {
+        if (pending.size() > DEBUG_MAX_LINE)
+            return false;
+        ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+        if (received <= 0)
+            return false;
+        pending.append(buffer, received);
+    }
+    string line = pending.substr(0, newline);
+    pending.erase(0, newline + 1);
+    if (!line.empty() && line.back() == '\r')
+        line.pop_back();
+
+    string reply = handle(line) + "\n";
+    served++;
+    if (send(client, reply.data(), reply.size(), MSG_NOSIGNAL) != (ssize_t) reply.size())
+        return false;
+    return line != "quit" && !shuttingDown;
+}
+
+bool DebugServer::clientWaiting() {
+    if (!pending.empty())
+        return true;
+    pollfd poller = { client, POLLIN, 0 };
+    return poll(&poller, 1, 0) > 0;
+}
+
+string DebugServer::handle(const string& line) {
+    std::istringstream words(line);
+    string command;
+    words >> command;
+    vector<string> args;
+    string arg;
+    while (words >> arg)
+        args.push_back(arg);
+
+    // Without breakpoints, watchpoints or a frame limit nothing else would end a continue, and
+    // the client could never be heard from again
+    auto interrupt = [this] { return clientWaiting(); };
+    uint32_t value;
+    uint16_t first;
+    uint16_t last;
+    if (command.empty()) {
+        return "error empty command";
+    } else if (command == "break" || command == "delete") {
+        if (args.size() != 1 || !parseHex(args[0], 0xFFFF, value))
+            return "error usage: " + command + " ADDR";
+        debugger.setBreakpoint(value, command == "break");
+        return "ok";
+    } else if (command == "breaks") {
+        string reply;
+        for (uint16_t pc : debugger.breakpoints())
+            reply += hex(pc, 4) + "\n";
+        return reply + "ok";
+    } else if (command == "watch") {
+        if (args.empty() || args.size() > 2 || !parseRange(args[0], first, last))
+            return "error usage: watch FIRST[-LAST] [r|w|rw]";
+        string kind = args.size() == 2 ? args[1] : "rw";
+        if (kind != "r" && kind != "w" && kind != "rw")
+            return "error usage: watch FIRST[-LAST] [r|w|rw]";
+        debugger.addWatchpoint(Watchpoint{ first, last, kind != "w", kind != "r" });
+        return "ok";
+    } else if (command == "unwatch") {
+        if (args.size() != 1 || !parseRange(args[0], first, last))
+            return "error usage: unwatch FIRST[-LAST]";
+        return debugger.removeWatchpoint(first, last) ? "ok" : "error no such watchpoint";
+    } else if (command == "watches") {
+        string reply;
+        for (const Watchpoint& watch : debugger.watchpoints())
+            reply += hex(watch.first, 4) + "-" + hex(watch.last, 4) + " " + (watch.reads ? "r" : "") + (watch.writes ? "w" : "") + "\n";
+        return reply + "ok";
+    } else if (command == "step" || command == "frame") {
+        value = 1;
+        if (args.size() > 1 || (args.size() == 1 && (!parseHex(args[0], 0xFFFFFFFFu, value) || value == 0)))
+            return "error usage: " + command + " [N]";
+        return stopReply(debugger.run(command == "frame" ? value : 0, command == "step" ? value : 0, interrupt));
+    } else if (command == "continue") {
+        return stopReply(debugger.run(0, 0, interrupt));
+    } else if (command == "stop") {
+        return "ok";
+    } else if (command == "regs") {
+        CPURegisters regs = debugger.registers();
+        return "ok a=" + hex(regs.a, 2) + " x=" + hex(regs.x, 2) + " y=" + hex(regs.y, 2) + " p=" + hex(regs.p, 2)
+            + " sp=" + hex(regs.sp, 2) + " pc=" + hex(regs.pc, 4) + " cycles=" + std::to_string(regs.cyclesRemaining)
+            + " frame=" + std::to_string(debugger.frameCount()) + " clock=" + std::to_string(debugger.masterClock());
+    } else if (command == "read") {
+        uint32_t count = 1;
+        if (args.empty() || args.size() > 2 || !parseHex(args[0], 0xFFFF, value)
+                || (args.size() == 2 && (!parseHex(args[1], 0x100, count) || count == 0)))
+            return "error usage: read ADDR [LEN]";
+        string reply = "ok";
+        for (uint32_t i = 0; i < count; i++) {
+            reply += ' ';
+            reply += hex(debugger.peek((uint16_t) (value + i)), 2);
+        }
+        return reply;
+    } else if (command == "write") {
+        if (args.size() < 2 || !parseHex(args[0], 0xFFFF, value))
+            return "error usage: write ADDR BYTE...";
+        vector<uint8_t> bytes;
+        for (size_t i = 1; i < args.size(); i++) {
+            uint32_t byte;
+            if (!parseHex(args[i], 0xFF, byte))
+                return "error usage: write ADDR BYTE...";
+            bytes.push_back(byte);
+        }
+        for (size_t i = 0; i < bytes.size(); i++) {
+            if (!debugger.poke((uint16_t) (value + i), bytes[i]))
+                return "error " + hex((uint16_t) (value + i), 4) + " isn't RAM";
+        }
+        return "ok";
+    } else if (command == "heatmap") {
+        if (args.size() == 1 && (args[0] == "on" || args[0] == "off")) {
+            debugger.setHeatmap(args[0] == "on");
+            return "ok";
+        }
+        if (args.size() == 1 && args[0] == "clear") {
+            debugger.clearHeatmap();
+            return "ok";
+        }
+        if (!args.empty())
+            return "error usage: heatmap [on|off|clear]";
+        string reply;
+        for (unsigned int page = 0; page < DEBUG_PAGES; page++) {
+            if (debugger.pageReads(page) || debugger.pageWrites(page))
+                reply += hex(page, 2) + " " + std::to_string(debugger.pageReads(page)) + " "
+                    + std::to_string(debugger.pageWrites(page)) + "\n";
+        }
+        return reply + "ok";
+    } else if (command == "quit") {
+        return "ok";
+    } else if (command == "shutdown") {
+        shuttingDown = true;
+        return "ok";
+    }
+    return "error unknown command " + command;
+}
+
+string DebugServer::stopReply(STOPREASON reason) const {
+    static const char* const REASONS[] = { "running", "breakpoint", "watchpoint", "step", "frames", "limit", "interrupted" };
+    string reply = string("ok stopped ") + REASONS[reason] + " pc=" + hex(debugger.registers().pc, 4)
+        + " frame=" + std::to_string(debugger.frameCount());
+    if (reason == WATCHPOINT) {
+        const WatchHit& hit = debugger.lastHit();
+        reply += string(hit.write ? " write=" : " read=") + hex(hit.addr, 4) + " value=" + hex(hit.value, 2)
+            + " by=" + hex(hit.pc, 4);
+    }
+    return reply;
+}
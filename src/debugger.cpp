@@ -0,0 +1,230 @@
+#include <iostream>
+
+#include "debugger.h"
+
+Debugger::Debugger(NES* nes) : nes(nes) {
+    fusion = nullptr;
+    compiled = nullptr;
+    for (unsigned int page = 0; page < DEBUG_PAGES; page++) {
+        pageWatches[page] = 0;
+        reads[page] = 0;
+        writes[page] = 0;
+    }
+    heatmap = false;
+    stepsLeft = 0;
+    atStart = false;
+    instructionPC = 0;
+    stopped = RUNNING;
+    hit = WatchHit{ 0, 0, false, 0 };
+
+    attached = nes->isLoaded() && !nes->cycleCore && !nes->debugger;
+    if (!attached) {
+        std::cerr << "The debugger needs a loaded NES on the fast core without another debugger" << std::endl;
+        return;
+    }
+    nes->debugger = this;
+    fusion = nes->cpu->fusion;
+    compiled = nes->cpu->compiled;
+    nes->cpu->fusion = nullptr;
+    nes->cpu->compiled = nullptr;
+    instructionPC = nes->cpu->pc;
+}
+
+Debugger::~Debugger() {
+    if (!attached)
+        return;
+    // A frame stopped part way still finishes, just without stopping again
+    nes->debugger = nullptr;
+    nes->wireBus();
+    nes->cpu->fusion = fusion;
+    nes->cpu->compiled = compiled;
+}
+
+bool Debugger::isAttached() const {
+    return attached;
+}
+
+STOPREASON Debugger::run(uint64_t frames, uint64_t steps, const std::function<bool()>& interrupted) {
+    if (!attached)
+        return FRAME_LIMIT;
+    atStart = nes->cpu->cyclesRemaining == 0;           // Don't stop again on the breakpoint just stopped at
+    // Every boundary after the first retires an instruction the run started. Started part way
+    // through one (after reset, or stopped by a watchpoint or the end of a frame), the first
+    // boundary only finishes that one, so it counts towards nothing.
+    stepsLeft = (steps && !atStart) ? steps + 1 : steps;
+    stopped = RUNNING;
+    uint64_t target = nes->frameCount() + frames;
+    while (stopped == RUNNING) {
+        if (nes->frameLimitReached() && !nes->midFrame) {
+            stopped = FRAME_LIMIT;
+        } else if (frames && nes->frameCount() >= target) {
+            stopped = FRAMES_RUN;
+        } else if (interrupted && interrupted()) {
+            stopped = INTERRUPTED;
+        } else {
+            nes->runFrame();
+        }
+    }
+    stepsLeft = 0;
+    return stopped;
+}
+
+const WatchHit& Debugger::lastHit() const {
+    return hit;
+}
+
+void Debugger::setBreakpoint(uint16_t pc, bool set) {
+    breaks[pc] = set;
+}
+
+bool Debugger::isBreakpoint(uint16_t pc) const {
+    return breaks[pc];
+}
+
+vector<uint16_t> Debugger::breakpoints() const {
+    vector<uint16_t> set;
+    for (uint32_t pc = 0; pc < breaks.size(); pc++) {
+        if (breaks[pc])
+            set.push_back(pc);
+    }
+    return set;
+}
+
+void Debugger::addWatchpoint(const Watchpoint& watch) {
+    watches.push_back(watch);
+    watchPages(watch, 1);
+    updateTrap();
+}
+
+bool Debugger::removeWatchpoint(uint16_t first, uint16_t last) {
+    for (auto it = watches.begin(); it != watches.end(); it++) {
+        if (it->first == first && it->last == last) {
+            watchPages(*it, -1);
+            watches.erase(it);
+            updateTrap();
+            return true;
+        }
+    }
+    return false;
+}
+
+const vector<Watchpoint>& Debugger::watchpoints() const {
+    return watches;
+}
+
+void Debugger::setHeatmap(bool on) {
+    heatmap = on;
+    updateTrap();
+}
+
+void Debugger::clearHeatmap() {
+    for (unsigned int page = 0; page < DEBUG_PAGES; page++) {
+        reads[page] = 0;
+        writes[page] = 0;
+    }
+}
+
+bool Debugger::heatmapOn() const {
+    return heatmap;
+}
+
+uint64_t Debugger::pageReads(uint8_t page) const {
+    return reads[page];
+}
+
+uint64_t Debugger::pageWrites(uint8_t page) const {
+    return writes[page];
+}
+
+uint8_t Debugger::peek(uint16_t addr) const {
+    if (addr < 0x2000)
+        return nes->state->wram.read(addr & 0x07FF);
+    if (addr >= 0x6000 && addr < 0x8000)
+        return nes->state->prgRAM.read(addr & 0x1FFF);
+    if (addr >= 0x8000)
+        return nes->prgPages[(addr - 0x8000) / PRG_PAGE_SIZE][addr % PRG_PAGE_SIZE];
+    return 0x0u;
+}
+
+bool Debugger::poke(uint16_t addr, uint8_t val) {
+    if (addr < 0x2000) {
+        nes->state->wram.write(addr & 0x07FF, val);
+        return true;
+    }
+    if (addr >= 0x6000 && addr < 0x8000) {
+        nes->state->prgRAM.write(addr & 0x1FFF, val);
+        return true;
+    }
+    return false;
+}
+
+CPURegisters Debugger::registers() const {
+    const MOS6502* cpu = nes->cpu;
+    return CPURegisters{ cpu->a, cpu->x, cpu->y, cpu->p, cpu->sp, cpu->pc, cpu->cyclesRemaining };
+}
+
+uint64_t Debugger::frameCount() const {
+    return nes->frameCount();
+}
+
+uint64_t Debugger::masterClock() const {
+    return nes->state->masterClock;
+}
+
+uint8_t Debugger::read(uint16_t addr) {
+    uint8_t val = nes->readUntrapped(addr);
+    if (heatmap)
+        reads[addr >> 8]++;
+    if (pageWatches[addr >> 8])
+        check(addr, val, false);
+    return val;
+}
+
+void Debugger::write(uint16_t addr, uint8_t val) {
+    nes->writeUntrapped(addr, val);
+    if (heatmap)
+        writes[addr >> 8]++;
+    if (pageWatches[addr >> 8])
+        check(addr, val, true);
+}
+
+bool Debugger::stopBefore(uint16_t pc) {
+    instructionPC = pc;
+    if (atStart) {
+        atStart = false;
+        return false;
+    }
+    if (stepsLeft && --stepsLeft == 0) {
+        stopped = STEPPED;
+        return true;
+    }
+    if (breaks[pc]) {
+        stopped = BREAKPOINT;
+        return true;
+    }
+    return false;
+}
+
+bool Debugger::stopAfter() {
+    return stopped != RUNNING;
+}
+
+void Debugger::updateTrap() {
+    for (unsigned int page = 0; page < DEBUG_PAGES; page++)
+        nes->trapPage(page, (heatmap || pageWatches[page]) ? this : nullptr);
+}
+
+void Debugger::watchPages(const Watchpoint& watch, int change) {
+    for (unsigned int page = watch.first >> 8; page <= (unsigned int) (watch.last >> 8); page++)
+        pageWatches[page] += change;
+}
+
+void Debugger::check(uint16_t addr, uint8_t val, bool write) {
+    for (const Watchpoint& watch : watches) {
+        if (addr >= watch.first && addr <= watch.last && (write ? watch.writes : watch.reads)) {
+            hit = WatchHit{ addr, val, write, instructionPC };
+            stopped = WATCHPOINT;
+            return;
+        }
+    }
+}
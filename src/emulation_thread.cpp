@@ -0,0 +1,60 @@
+#include <chrono>
+
+#include "emulation_thread.h"
+
+// NTSC frame period, 655171 / 39375000 seconds
+const std::chrono::nanoseconds FRAME_PERIOD(16639267);
+
+EmulationThread::EmulationThread(NES* nes, TripleBuffer* frames) {
+    this->nes = nes;
+    this->frames = frames;
+    stopRequested = false;
+    done = false;
+}
+
+EmulationThread::~EmulationThread() {
+    stop();
+}
+
+void EmulationThread::start(bool throttled) {
+    nes->setPresentBuffer(frames);
+    nes->setInputQueue(&input);
+    thread = std::thread(&EmulationThread::loop, this, throttled);
+}
+
+void EmulationThread::stop() {
+    stopRequested = true;
+    if (thread.joinable())
+        thread.join();
+}
+
+bool EmulationThread::finished() const {
+    return done.load(std::memory_order_acquire);
+}
+
+bool EmulationThread::setInput(uint8_t port, uint8_t buttons) {
+    return input.push(port, buttons);
+}
+
+const InputQueue& EmulationThread::inputQueue() const {
+    return input;
+}
+
+void EmulationThread::loop(bool throttled) {
+    auto deadline = std::chrono::steady_clock::now();
+
+    while (!stopRequested.load(std::memory_order_relaxed) && !nes->frameLimitReached()) {
+        nes->runFrame();
+
+        if (throttled) {
+            // Catch up instead of drifting if a frame ran long, but never bank more than a frame
+            deadline += FRAME_PERIOD;
+            auto now = std::chrono::steady_clock::now();
+            if (deadline < now - FRAME_PERIOD)
+                deadline = now;
+            std::this_thread::sleep_until(deadline);
+        }
+    }
+
+    done.store(true, std::memory_order_release);
+}
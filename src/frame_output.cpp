@@ -0,0 +1,322 @@
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include "checksum.h"
+#include "frame_output.h"
+
+using std::vector;
+
+const unsigned int FRAME_PIXELS = SCREEN_WIDTH * SCREEN_HEIGHT;
+const unsigned int CHROMA_PIXELS = (SCREEN_WIDTH / 2) * (SCREEN_HEIGHT / 2);
+
+// NTSC frame rate is 39375000 / 655171 (~60.0988) frames per second, pixels are 8:7
+static const char Y4M_HEADER[] = "YUV4MPEG2 W256 H240 F39375000:655171 Ip A8:7 C420jpeg\n";
+
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void put32BE(vector<uint8_t>& out, uint32_t val) {
+    out.push_back((val >> 24) & 0xFF);
+    out.push_back((val >> 16) & 0xFF);
+    out.push_back((val >> 8) & 0xFF);
+    out.push_back(val & 0xFF);
+}
+
+FrameOutput::FrameOutput() {
+    stream = nullptr;
+    streamIsPipe = false;
+    format = RAW_RGB24;
+    snapshotPrefix = "frame_";
+    queueHead = 0;
+    queueCount = 0;
+    running = false;
+    closing = false;
+    frames = 0;
+    pngs = 0;
+    stalls = 0;
+
+    poolMemory = new uint16_t[FRAME_POOL_BUFFERS * FRAME_PIXELS]();
+    for (unsigned int i = 0; i < FRAME_POOL_BUFFERS; i++)
+        freeBuffers[i] = poolMemory + i * FRAME_PIXELS;
+    freeCount = FRAME_POOL_BUFFERS;
+
+    rgba = new uint32_t[FRAME_PIXELS];
+    rgb = new uint8_t[FRAME_PIXELS * 3];
+    yuv = new uint8_t[FRAME_PIXELS + 2 * CHROMA_PIXELS];
+    ntsc = nullptr;
+    std::memset(timings, 0, sizeof(timings));
+
+    // Only 512 pixel values exist, so conversion is a table lookup per pixel
+    buildPaletteRGBA(rgbaTable);
+}
+
+FrameOutput::~FrameOutput() {
+    close();
+    delete ntsc;
+    delete[] poolMemory;
+    delete[] rgba;
+    delete[] rgb;
+    delete[] yuv;
+}
+
+bool FrameOutput::openStream(const char* target, VIDEOFORMAT format) {
+    this->format = format;
+
+    if (std::strcmp(target, "-") == 0) {
+        stream = stdout;
+    } else if (target[0] == '|') {
+        stream = popen(target + 1, "w");
+        streamIsPipe = true;
+    } else {
+        stream = std::fopen(target, "wb");
+    }
+    if (!stream)
+        return false;
+
+    if (format == Y4M_420)
+        std::fwrite(Y4M_HEADER, 1, sizeof(Y4M_HEADER) - 1, stream);
+    return true;
+}
+
+void FrameOutput::addSnapshot(uint64_t frame) {
+    snapshots.insert(frame);
+}
+
+void FrameOutput::setSnapshotPrefix(const string& prefix) {
+    snapshotPrefix = prefix;
+}
+
+void FrameOutput::enableNtscFilter(unsigned int helpers) {
+    delete ntsc;
+    ntsc = new NtscFilter(helpers);
+}
+
+void FrameOutput::start() {
+    running = true;
+    worker = std::thread(&FrameOutput::workerLoop, this);
+}
+
+bool FrameOutput::wants(uint64_t frame) const {
+    return stream || snapshots.count(frame);
+}
+
+uint16_t* FrameOutput::acquire() {
+    std::unique_lock<std::mutex> guard(lock);
+    if (freeCount == 0) {
+        stalls++;
+        bufferFreed.wait(guard, [this] { return freeCount > 0; });
+    }
+    return freeBuffers[--freeCount];
+}
+
+uint16_t* FrameOutput::submit(uint16_t* frame, uint64_t frameNumber) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        queue[(queueHead + queueCount) % FRAME_POOL_BUFFERS] = { frame, frameNumber };
+        queueCount++;
+    }
+    frameQueued.notify_one();
+
+    return acquire();
+}
+
+void FrameOutput::release(uint16_t* frame) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        freeBuffers[freeCount++] = frame;
+    }
+    bufferFreed.notify_one();
+}
+
+void FrameOutput::close() {
+    if (running) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            closing = true;
+        }
+        frameQueued.notify_one();
+        worker.join();
+        running = false;
+    }
+
+    if (stream) {
+        if (streamIsPipe)
+            pclose(stream);
+        else if (stream == stdout)
+            std::fflush(stream);
+        else
+            std::fclose(stream);
+        stream = nullptr;
+    }
+}
+
+uint64_t FrameOutput::framesWritten() const {
+    return frames;
+}
+
+uint64_t FrameOutput::snapshotsWritten() const {
+    return pngs;
+}
+
+uint64_t FrameOutput::poolStalls() const {
+    return stalls;
+}
+
+const StageTiming& FrameOutput::stageTiming(OUTPUTSTAGE stage) const {
+    return timings[stage];
+}
+
+void FrameOutput::recordStage(OUTPUTSTAGE stage, uint64_t startNs) {
+    uint64_t ns = nowNs() - startNs;
+    timings[stage].frames++;
+    timings[stage].totalNs += ns;
+    if (ns > timings[stage].maxNs)
+        timings[stage].maxNs = ns;
+}
+
+void FrameOutput::workerLoop() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            frameQueued.wait(guard, [this] { return queueCount > 0 || closing; });
+            if (queueCount == 0)
+                return;
+            job = queue[queueHead];
+        }
+
+        bool snapshot = snapshots.count(job.frameNumber);
+
+        uint64_t start = nowNs();
+        if (ntsc) {
+            ntsc->apply(job.frame, job.frameNumber, rgba);
+            recordStage(NTSC_STAGE, start);
+        } else {
+            convertToRGBA(job.frame, rgba, FRAME_PIXELS, rgbaTable);
+            recordStage(PALETTE_STAGE, start);
+        }
+
+        if (stream) {
+            start = nowNs();
+            if (format == Y4M_420) {
+                writeY4M();
+            } else {
+                packRGB();
+                std::fwrite(rgb, 1, FRAME_PIXELS * 3, stream);
+            }
+            frames++;
+            recordStage(ENCODE_STAGE, start);
+        }
+        if (snapshot) {
+            start = nowNs();
+            if (!stream || format != RAW_RGB24)
+                packRGB();
+            if (writePNG(snapshotPrefix + std::to_string(job.frameNumber) + ".png"))
+                pngs++;
+            recordStage(PNG_STAGE, start);
+        }
+
+        // The buffer only goes back once the worker is done reading it
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            queueHead = (queueHead + 1) % FRAME_POOL_BUFFERS;
+            queueCount--;
+            freeBuffers[freeCount++] = job.frame;
+        }
+        bufferFreed.notify_one();
+    }
+}
+
+void FrameOutput::packRGB() {
+    uint8_t* out = rgb;
+    for (unsigned int i = 0; i < FRAME_PIXELS; i++) {
+        std::memcpy(out, &rgba[i], 3);
+        out += 3;
+    }
+}
+
+void FrameOutput::writeY4M() {
+    uint8_t* y = yuv;
+    uint8_t* u = yuv + FRAME_PIXELS;
+    uint8_t* v = u + CHROMA_PIXELS;
+
+    // BT.601 studio range, chroma is the average of each 2x2 block
+    auto luma = [](const uint8_t* c) { return (uint8_t) (((66 * c[0] + 129 * c[1] + 25 * c[2] + 128) >> 8) + 16); };
+    auto blue = [](const uint8_t* c) { return ((-38 * c[0] - 74 * c[1] + 112 * c[2] + 128) >> 8) + 128; };
+    auto red = [](const uint8_t* c) { return ((112 * c[0] - 94 * c[1] - 18 * c[2] + 128) >> 8) + 128; };
+
+    const uint8_t* pixels = (const uint8_t*) rgba;
+    for (unsigned int i = 0; i < FRAME_PIXELS; i++)
+        y[i] = luma(pixels + i * 4);
+
+    for (unsigned int row = 0; row < SCREEN_HEIGHT / 2; row++) {
+        const uint8_t* top = pixels + (row * 2) * SCREEN_WIDTH * 4;
+        const uint8_t* bottom = top + SCREEN_WIDTH * 4;
+        for (unsigned int col = 0; col < SCREEN_WIDTH / 2; col++) {
+            const uint8_t* a = top + col * 8;
+            const uint8_t* b = a + 4;
+            const uint8_t* c = bottom + col * 8;
+            const uint8_t* d = c + 4;
+            u[row * (SCREEN_WIDTH / 2) + col] = (uint8_t) ((blue(a) + blue(b) + blue(c) + blue(d) + 2) >> 2);
+            v[row * (SCREEN_WIDTH / 2) + col] = (uint8_t) ((red(a) + red(b) + red(c) + red(d) + 2) >> 2);
+        }
+    }
+
+    std::fwrite("FRAME\n", 1, 6, stream);
+    std::fwrite(yuv, 1, FRAME_PIXELS + 2 * CHROMA_PIXELS, stream);
+}
+
+bool FrameOutput::writePNG(const string& fileName) {
+    FILE* file = std::fopen(fileName.c_str(), "wb");
+    if (!file)
+        return false;
+
+    // Scanlines with filter type 0, stored in uncompressed deflate blocks (screenshots stay
+    // small enough at 180KB that pulling in a compressor isn't worth it)
+    const uint32_t rowBytes = SCREEN_WIDTH * 3 + 1;
+    vector<uint8_t> raw(rowBytes * SCREEN_HEIGHT);
+    for (unsigned int row = 0; row < SCREEN_HEIGHT; row++) {
+        raw[row * rowBytes] = 0;
+        std::memcpy(&raw[row * rowBytes + 1], rgb + row * SCREEN_WIDTH * 3, SCREEN_WIDTH * 3);
+    }
+
+    vector<uint8_t> idat = { 'I', 'D', 'A', 'T', 0x78, 0x01 };
+    uint32_t a = 1, b = 0;
+    for (uint8_t byte : raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    for (size_t pos = 0; pos < raw.size(); pos += 65535) {
+        uint16_t len = (uint16_t) (raw.size() - pos < 65535 ? raw.size() - pos : 65535);
+        idat.push_back(pos + len == raw.size() ? 1 : 0);
+        idat.push_back(len & 0xFF);
+        idat.push_back(len >> 8);
+        idat.push_back(~len & 0xFF);
+        idat.push_back((~len >> 8) & 0xFF);
+        idat.insert(idat.end(), raw.begin() + pos, raw.begin() + pos + len);
+    }
+    put32BE(idat, (b << 16) | a);
+
+    vector<uint8_t> ihdr = { 'I', 'H', 'D', 'R' };
+    put32BE(ihdr, SCREEN_WIDTH);
+    put32BE(ihdr, SCREEN_HEIGHT);
+    ihdr.insert(ihdr.end(), { 8, 2, 0, 0, 0 });     // 8-bit RGB, no interlace
+
+    vector<uint8_t> iend = { 'I', 'E', 'N', 'D' };
+
+    vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    for (vector<uint8_t>* chunk : { &ihdr, &idat, &iend }) {
+        put32BE(png, (uint32_t) chunk->size() - 4);
+        png.insert(png.end(), chunk->begin(), chunk->end());
+        CRC32 crc;
+        crc.update(chunk->data(), chunk->size());
+        put32BE(png, crc.value());
+    }
+
+    bool ok = std::fwrite(png.data(), 1, png.size(), file) == png.size();
+    std::fclose(file);
+    return ok;
+}
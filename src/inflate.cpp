@@ -0,0 +1,271 @@
+#include "inflate.h"
+
+// Lengths and distances are a base from the symbol plus some extra bits read after it
+static const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+                                          67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513,
+                                            769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+                                            11, 11, 12, 12, 13, 13 };
+// Order a dynamic block gives the code length code's lengths in
+static const uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+static const unsigned int END_OF_BLOCK = 256u;
+
+Inflater::Inflater(const uint8_t* input, size_t size) : input(input), size(size) {
+    position = 0;
+    bits = 0;
+    bitCount = 0;
+    total = 0;
+    flushed = 0;
+}
+
+bool Inflater::inflate(ByteSink& out, uint64_t limit) {
+    bool final = false;
+    while (!final) {
+        if (!need(3))
+            return false;
+        final = take(1);
+        bool ok;
+        switch (take(2)) {
+            case 0:
+                ok = stored(out, limit);
+                break;
+            case 1:
+                fixedCodes();
+                ok = codes(out, limit);
+                break;
+            case 2:
+                ok = dynamicCodes() && codes(out, limit);
+                break;
+            default:
+                ok = false;
+                break;
+        }
+        if (!ok)
+            return false;
+    }
+    flush(out);
+    return true;
+}
+
+uint64_t Inflater::written() const {
+    return total;
+}
+
+void Inflater::refill() {
+    while (bitCount <= 56 && position < size) {
+        bits |= (uint64_t) input[position++] << bitCount;
+        bitCount += 8;
+    }
+}
+
+bool Inflater::need(unsigned int count) {
+    if (bitCount < count)
+        refill();
+    return bitCount >= count;
+}
+
+uint32_t Inflater::take(unsigned int count) {
+    uint32_t value = (uint32_t) (bits & ((1ull << count) - 1));
+    bits >>= count;
+    bitCount -= count;
+    return value;
+}
+
+bool Inflater::build(Huffman& code, const uint8_t* lengths, unsigned int symbols) {
+    for (unsigned int length = 0; length <= INFLATE_MAX_BITS; length++)
+        code.count[length] = 0;
+    for (unsigned int symbol = 0; symbol < symbols; symbol++)
+        code.count[lengths[symbol]]++;
+    code.count[0] = 0;
+
+    // More codes of a length than the shorter ones leave room for can't be decoded
+    int left = 1;
+    for (unsigned int length = 1; length <= INFLATE_MAX_BITS; length++) {
+        left = (left << 1) - code.count[length];
+        if (left < 0)
+            return false;
+    }
+
+    uint16_t offsets[INFLATE_MAX_BITS + 2] = {};
+    for (unsigned int length = 1; length <= INFLATE_MAX_BITS; length++)
+        offsets[length + 1] = offsets[length] + code.count[length];
+    for (unsigned int symbol = 0; symbol < symbols; symbol++) {
+        if (lengths[symbol])
+            code.symbol[offsets[lengths[symbol]]++] = symbol;
+    }
+
+    // Codes are stored first bit lowest, so a short code fills every table entry it is a prefix of
+    for (unsigned int i = 0; i < (1u << INFLATE_FAST_BITS); i++)
+        code.fast[i] = 0;
+    unsigned int next = 0;
+    unsigned int index = 0;
+    for (unsigned int length = 1; length <= INFLATE_FAST_BITS; length++) {
+        for (unsigned int i = 0; i < code.count[length]; i++, next++) {
+            unsigned int reversed = 0;
+            for (unsigned int bit = 0; bit < length; bit++)
+                reversed |= ((next >> bit) & 1) << (length - 1 - bit);
+            for (unsigned int entry = reversed; entry < (1u << INFLATE_FAST_BITS); entry += 1u << length)
+                code.fast[entry] = code.symbol[index + i] << 4 | length;
+        }
+        index += code.count[length];
+        next <<= 1;
+    }
+    return true;
+}
+
+int Inflater::decode(const Huffman& code) {
+    if (bitCount < INFLATE_MAX_BITS)
+        refill();
+    uint16_t entry = code.fast[bits & ((1u << INFLATE_FAST_BITS) - 1)];
+    if (entry) {
+        unsigned int length = entry & 0xF;
+        if (length > bitCount)
+            return -1;
+        take(length);
+        return entry >> 4;
+    }
+
+    // Canonical codes of each length follow on from the last code of the length before
+    int value = 0;
+    int first = 0;
+    int index = 0;
+    for (unsigned int length = 1; length <= INFLATE_MAX_BITS && length <= bitCount; length++) {
+        value |= (bits >> (length - 1)) & 1;
+        int count = code.count[length];
+        if (value - first < count) {
+            take(length);
+            return code.symbol[index + value - first];
+        }
+        index += count;
+        first = (first + count) << 1;
+        value <<= 1;
+    }
+    return -1;
+}
+
+void Inflater::put(uint8_t byte, ByteSink& out) {
+    window[total & (INFLATE_WINDOW - 1)] = byte;
+    total++;
+    if (total - flushed == INFLATE_WINDOW)
+        flush(out);
+}
+
+void Inflater::flush(ByteSink& out) {
+    // flushed is always a multiple of the window size until the final flush, so this is contiguous
+    if (total > flushed)
+        out.write(window + (flushed & (INFLATE_WINDOW - 1)), total - flushed);
+    flushed = total;
+}
+
+bool Inflater::stored(ByteSink& out, uint64_t limit) {
+    take(bitCount % 8);
+    if (!need(32))
+        return false;
+    uint32_t length = take(16);
+    if ((take(16) ^ 0xFFFF) != length || total + length > limit)
+        return false;
+    for (uint32_t i = 0; i < length; i++) {
+        if (!need(8))
+            return false;
+        put(take(8), out);
+    }
+    return true;
+}
+
+bool Inflater::dynamicCodes() {
+    if (!need(14))
+        return false;
+    unsigned int literalCount = take(5) + 257;
+    unsigned int distanceCount = take(5) + 1;
+    unsigned int lengthCodeCount = take(4) + 4;
+    if (literalCount > 286 || distanceCount > 30)
+        return false;
+
+    uint8_t sizes[19] = {};
+    for (unsigned int i = 0; i < lengthCodeCount; i++) {
+        if (!need(3))
+            return false;
+        sizes[CODE_LENGTH_ORDER[i]] = take(3);
+    }
+    Huffman& lengthCode = distances;                    // Free until the distance code is built
+    if (!build(lengthCode, sizes, 19))
+        return false;
+
+    // Code lengths of both codes in one run, which repeats can carry from one into the other
+    uint8_t codeSizes[286 + 30];
+    unsigned int filled = 0;
+    while (filled < literalCount + distanceCount) {
+        int symbol = decode(lengthCode);
+        if (symbol < 0)
+            return false;
+        if (symbol < 16) {
+            codeSizes[filled++] = symbol;
+            continue;
+        }
+        uint8_t repeated = 0;
+        unsigned int times;
+        if (symbol == 16) {
+            if (filled == 0 || !need(2))
+                return false;
+            repeated = codeSizes[filled - 1];
+            times = 3 + take(2);
+        } else if (symbol == 17) {
+            if (!need(3))
+                return false;
+            times = 3 + take(3);
+        } else {
+            if (!need(7))
+                return false;
+            times = 11 + take(7);
+        }
+        if (filled + times > literalCount + distanceCount)
+            return false;
+        while (times--)
+            codeSizes[filled++] = repeated;
+    }
+
+    if (codeSizes[END_OF_BLOCK] == 0)
+        return false;
+    return build(lengths, codeSizes, literalCount) && build(distances, codeSizes + literalCount, distanceCount);
+}
+
+void Inflater::fixedCodes() {
+    uint8_t sizes[288];
+    for (unsigned int symbol = 0; symbol < 288; symbol++)
+        sizes[symbol] = symbol < 144 ? 8 : symbol < 256 ? 9 : symbol < 280 ? 7 : 8;
+    build(lengths, sizes, 288);
+    for (unsigned int symbol = 0; symbol < 30; symbol++)
+        sizes[symbol] = 5;
+    build(distances, sizes, 30);
+}
+
+bool Inflater::codes(ByteSink& out, uint64_t limit) {
+    while (true) {
+        int symbol = decode(lengths);
+        if (symbol < 0)
+            return false;
+        if (symbol < (int) END_OF_BLOCK) {
+            put(symbol, out);
+            if (total > limit)
+                return false;
+            continue;
+        }
+        if (symbol == (int) END_OF_BLOCK)
+            return true;
+
+        symbol -= END_OF_BLOCK + 1;
+        if (symbol >= 29 || !need(LENGTH_EXTRA[symbol]))
+            return false;
+        unsigned int length = LENGTH_BASE[symbol] + take(LENGTH_EXTRA[symbol]);
+        symbol = decode(distances);
+        if (symbol < 0 || symbol >= 30 || !need(DISTANCE_EXTRA[symbol]))
+            return false;
+        unsigned int distance = DISTANCE_BASE[symbol] + take(DISTANCE_EXTRA[symbol]);
+        if (distance > total || total + length > limit)
+            return false;
+        for (unsigned int i = 0; i < length; i++)
+            put(window[(total - distance) & (INFLATE_WINDOW - 1)], out);
+    }
+}
@@ -0,0 +1,50 @@
+#include <chrono>
+
+#include "input_queue.h"
+
+InputQueue::InputQueue() {
+    head = 0;
+    tail = 0;
+    latencyCount = 0;
+}
+
+uint64_t InputQueue::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool InputQueue::push(uint8_t port, uint8_t buttons) {
+    return push({ now(), port, buttons });
+}
+
+bool InputQueue::push(const InputEvent& event) {
+    // Only this side writes tail, so it reads its own value relaxed
+    uint64_t slot = tail.load(std::memory_order_relaxed);
+    if (slot - head.load(std::memory_order_acquire) == INPUT_QUEUE_SIZE)
+        return false;
+    events[slot & (INPUT_QUEUE_SIZE - 1)] = event;
+    tail.store(slot + 1, std::memory_order_release);
+    return true;
+}
+
+bool InputQueue::pop(InputEvent& event) {
+    uint64_t slot = head.load(std::memory_order_relaxed);
+    if (slot == tail.load(std::memory_order_acquire))
+        return false;
+    event = events[slot & (INPUT_QUEUE_SIZE - 1)];
+    head.store(slot + 1, std::memory_order_release);
+    return true;
+}
+
+void InputQueue::observed(uint64_t latency) {
+    latencySamples[latencyCount % INPUT_LATENCY_SAMPLES] = latency;
+    latencyCount++;
+}
+
+vector<uint64_t> InputQueue::latencies() const {
+    vector<uint64_t> samples;
+    uint64_t first = latencyCount > INPUT_LATENCY_SAMPLES ? latencyCount - INPUT_LATENCY_SAMPLES : 0;
+    for (uint64_t i = first; i < latencyCount; i++)
+        samples.push_back(latencySamples[i % INPUT_LATENCY_SAMPLES]);
+    return samples;
+}
@@ -0,0 +1,74 @@
+#include <iostream>
+
+#include "instance_pool.h"
+
+// Every instance reads from at most one snapshot, so one per fork and one per root is enough,
+// plus one more for a freeze taking a new one before releasing its old one
+static unsigned int snapshotCount(unsigned int instances, unsigned int roots) {
+    return instances + roots + 1;
+}
+
+size_t InstancePool::arenaSize(unsigned int instances, unsigned int roots) {
+    return instances * sizeof(InstancePool::Slot) + snapshotCount(instances, roots) * (sizeof(StatePages) + sizeof(uint32_t))
+        + 2 * ARENA_ALIGNMENT;
+}
+
+InstancePool::InstancePool(unsigned int instances, unsigned int roots) : arena(arenaSize(instances, roots)) {
+    slots = (Slot*) arena.allocate(instances * sizeof(Slot), alignof(Slot));
+    snapshots = (StatePages*) arena.allocate(snapshotCount(instances, roots) * sizeof(StatePages), alignof(StatePages));
+    snapshotReferences = (uint32_t*) arena.allocate(snapshotCount(instances, roots) * sizeof(uint32_t), alignof(uint32_t));
+    if (!slots || !snapshots || !snapshotReferences) {
+        std::cerr << "Couldn't allocate an instance pool of " << instances << std::endl;
+        instances = 0;
+    }
+
+    // Handed out lowest first
+    freeSlots.reserve(instances);
+    for (unsigned int i = instances; i > 0; i--)
+        freeSlots.push_back(i - 1);
+    unsigned int snapshotTotal = instances ? snapshotCount(instances, roots) : 0;
+    freeSnapshots.reserve(snapshotTotal);
+    for (unsigned int i = snapshotTotal; i > 0; i--)
+        freeSnapshots.push_back(i - 1);
+}
+
+InstancePool::~InstancePool() {
+    // Slots and snapshots go back with the arena
+}
+
+void InstancePool::release(NES* nes) {
+    unsigned int index = nes->poolSlot;
+    nes->~NES();
+    freeSlots.push_back(index);
+}
+
+unsigned int InstancePool::available() const {
+    return (unsigned int) freeSlots.size();
+}
+
+InstancePool::Slot* InstancePool::takeSlot(unsigned int& index) {
+    if (freeSlots.empty())
+        return nullptr;
+    index = freeSlots.back();
+    freeSlots.pop_back();
+    return &slots[index];
+}
+
+StatePages* InstancePool::takeSnapshot() {
+    if (freeSnapshots.empty())
+        return nullptr;
+    unsigned int index = freeSnapshots.back();
+    freeSnapshots.pop_back();
+    snapshotReferences[index] = 1;
+    return &snapshots[index];
+}
+
+void InstancePool::retainSnapshot(StatePages* snapshot) {
+    snapshotReferences[snapshot - snapshots]++;
+}
+
+void InstancePool::releaseSnapshot(StatePages* snapshot) {
+    unsigned int index = (unsigned int) (snapshot - snapshots);
+    if (--snapshotReferences[index] == 0)
+        freeSnapshots.push_back(index);
+}
@@ -1,14 +1,375 @@
 #include <iostream>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
 #include "nes.h"
+#include "debug_server.h"
+#include "emulation_thread.h"
+#include "metrics.h"
+#include "presenter.h"
+#include "shm_server.h"
+
+static bool endsWith(const char* str, const char* suffix) {
+    size_t len = std::strlen(str);
+    size_t suffixLen = std::strlen(suffix);
+    return len >= suffixLen && std::strcmp(str + len - suffixLen, suffix) == 0;
+}
+
+// Parses a whole decimal argument that fits in value, false (and value untouched) for anything else
+template <typename T>
+static bool parseNumber(const char* text, T& value) {
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long parsed = (text[0] >= '0' && text[0] <= '9') ? std::strtoull(text, &end, 10) : 0;
+    if (!end || *end != '\0' || errno == ERANGE || parsed > (unsigned long long) std::numeric_limits<T>::max()) {
+        std::cerr << "Expected a number in range, got " << text << std::endl;
+        return false;
+    }
+    value = (T) parsed;
+    return true;
+}
+
+// Where archived ROMs are unpacked to unless --rom-cache says otherwise, empty if there's no home
+static string defaultRomCache() {
+    if (const char* cache = std::getenv("XDG_CACHE_HOME"))
+        return string(cache) + "/nesemu";
+    if (const char* home = std::getenv("HOME"))
+        return string(home) + "/.cache/nesemu";
+    return string();
+}
+
+static void usage() {
+    std::cout << "Usage: NESEmu [options] ROM" << std::endl
+              << "  --frames N               Emulate N frames then exit (batch mode)" << std::endl
+              << "  --audio-out FILE         Stream audio to FILE, WAV if it ends in .wav, raw s16le otherwise" << std::endl
+              << "  --audio-thread           Synthesize audio on its own thread, a frame behind the emulation" << std::endl
+              << "  --video-out TARGET       Stream frames to a file, - for stdout or |command, Y4M if it" << std::endl
+              << "                           ends in .y4m, raw RGB24 otherwise" << std::endl
+              << "  --y4m                    Force Y4M for --video-out (e.g. when piping)" << std::endl
+              << "  --snapshot N[,N...]      Save these frames as PNGs" << std::endl
+              << "  --snapshot-prefix PATH   PNG names are PATH<frame>.png (default frame_)" << std::endl
+              << "  --ntsc THREADS           Video/snapshots go through the NTSC filter, THREADS helper threads" << std::endl
+              << "  --present MODE           Emulate on a separate thread and present frames with MODE:" << std::endl
+              << "                           none (take frames only) or ascii (terminal preview)" << std::endl
+              << "  --unthrottled            Don't pace --present to 60Hz" << std::endl
+              << "  --render-every N         Batch mode only composes every Nth frame (snapshots always are)" << std::endl
+              << "  --serve NAME             Serve step requests through POSIX shared memory NAME (e.g. /nes0)" << std::endl
+              << "  --serve-replace          Take over NAME if it exists, e.g. left behind by a server that crashed" << std::endl
+              << "  --debug PORT             Serve a debugger on 127.0.0.1:PORT (see debug_server.h for commands)" << std::endl
+              << "  --profile-pairs FILE     Count which opcodes follow which and save the counts to FILE" << std::endl
+              << "  --fuse FILE              Run the most frequent opcode pairs of a saved profile as one" << std::endl
+              << "  --native FILE            Run PRG ROM through code nes_recompile generated for this ROM" << std::endl
+              << "  --accurate               Step CPU, PPU and APU in lockstep every cycle (experimental, slower)" << std::endl
+              << "  --cheat CODE             Apply a Game Genie code, or AAAA:VV or AAAA?CC:VV in hex (repeatable)" << std::endl
+              << "  --save FILE              Battery backed RAM goes to FILE (default: the ROM's name with .sav)" << std::endl
+              << "  --no-save                Don't keep battery backed RAM between runs" << std::endl
+              << "  --rom-cache DIR          Keep ROMs unpacked from .zip/.gz archives in DIR (default ~/.cache/nesemu)" << std::endl
+              << "  --no-rom-cache           Unpack archived ROMs every time" << std::endl
+              << "  --metrics FILE           Keep FILE updated with emulator metrics, JSON if it ends in .json," << std::endl
+              << "                           Prometheus text otherwise" << std::endl
+              << "  --metrics-interval MS    How often --metrics is rewritten (default 1000)" << std::endl;
+}
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
+    const char* romFile = nullptr;
+    const char* audioFile = nullptr;
+    bool audioThread = false;
+    const char* videoTarget = nullptr;
+    bool forceY4M = false;
+    const char* snapshotList = nullptr;
+    const char* snapshotPrefix = nullptr;
+    int ntscHelpers = -1;
+    const char* presentMode = nullptr;
+    bool throttled = true;
+    uint64_t frameLimit = 0;
+    uint64_t renderEvery = 1;
+    const char* serveName = nullptr;
+    bool serveReplace = false;
+    int debugPort = -1;
+    const char* profileFile = nullptr;
+    const char* fuseFile = nullptr;
+    const char* nativeFile = nullptr;
+    bool accurate = false;
+    const char* saveFile = nullptr;
+    vector<const char*> cheatCodes;
+    bool keepSave = true;
+    const char* metricsFile = nullptr;
+    const char* romCache = nullptr;
+    bool useRomCache = true;
+    unsigned int metricsInterval = 1000;
+    bool numbersValid = true;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            numbersValid &= parseNumber(argv[++i], frameLimit);
+        } else if (std::strcmp(argv[i], "--audio-out") == 0 && i + 1 < argc) {
+            audioFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--audio-thread") == 0) {
+            audioThread = true;
+        } else if (std::strcmp(argv[i], "--video-out") == 0 && i + 1 < argc) {
+            videoTarget = argv[++i];
+        } else if (std::strcmp(argv[i], "--y4m") == 0) {
+            forceY4M = true;
+        } else if (std::strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            snapshotList = argv[++i];
+        } else if (std::strcmp(argv[i], "--snapshot-prefix") == 0 && i + 1 < argc) {
+            snapshotPrefix = argv[++i];
+        } else if (std::strcmp(argv[i], "--ntsc") == 0 && i + 1 < argc) {
+            numbersValid &= parseNumber(argv[++i], ntscHelpers);
+        } else if (std::strcmp(argv[i], "--present") == 0 && i + 1 < argc) {
+            presentMode = argv[++i];
+        } else if (std::strcmp(argv[i], "--unthrottled") == 0) {
+            throttled = false;
+        } else if (std::strcmp(argv[i], "--render-every") == 0 && i + 1 < argc) {
+            numbersValid &= parseNumber(argv[++i], renderEvery);
+        } else if (std::strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serveName = argv[++i];
+        } else if (std::strcmp(argv[i], "--serve-replace") == 0) {
+            serveReplace = true;
+        } else if (std::strcmp(argv[i], "--debug") == 0 && i + 1 < argc) {
+            numbersValid &= parseNumber(argv[++i], debugPort);
+        } else if (std::strcmp(argv[i], "--profile-pairs") == 0 && i + 1 < argc) {
+            profileFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--fuse") == 0 && i + 1 < argc) {
+            fuseFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--native") == 0 && i + 1 < argc) {
+            nativeFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--accurate") == 0) {
+            accurate = true;
+        } else if (std::strcmp(argv[i], "--cheat") == 0 && i + 1 < argc) {
+            cheatCodes.push_back(argv[++i]);
+        } else if (std::strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            saveFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--rom-cache") == 0 && i + 1 < argc) {
+            romCache = argv[++i];
+        } else if (std::strcmp(argv[i], "--no-rom-cache") == 0) {
+            useRomCache = false;
+        } else if (std::strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metricsFile = argv[++i];
+        } else if (std::strcmp(argv[i], "--metrics-interval") == 0 && i + 1 < argc) {
+            numbersValid &= parseNumber(argv[++i], metricsInterval);
+        } else if (std::strcmp(argv[i], "--no-save") == 0) {
+            keepSave = false;
+        } else if (argv[i][0] == '-' || romFile) {
+            usage();
+            return -1;
+        } else {
+            romFile = argv[i];
+        }
+    }
+
+    vector<uint64_t> snapshotFrames;
+    if (snapshotList) {
+        std::stringstream frames(snapshotList);
+        string frame;
+        while (std::getline(frames, frame, ',')) {
+            uint64_t number = 0;
+            numbersValid &= parseNumber(frame.c_str(), number);
+            snapshotFrames.push_back(number);
+        }
+    }
+
+    if (!numbersValid) {
+        usage();
+        return -1;
+    }
+
+    // Served frames are drawn into shared memory, so nothing else can take them, and --serve-replace needs --serve
+    if ((serveName && (presentMode || videoTarget || snapshotList)) || (serveReplace && !serveName)) {
+        usage();
+        return -1;
+    }
+
+    // The debugger runs frames when its client asks, on the fast core
+    if (debugPort >= 0 && (serveName || presentMode || accurate || debugPort > 0xFFFF)) {
+        usage();
+        return -1;
+    }
+
+    // The accurate core runs every instruction itself, one cycle at a time
+    if (accurate && (profileFile || fuseFile || nativeFile)) {
+        usage();
+        return -1;
+    }
+
+    // Native code has the ROM's bytes built in, so patches to them wouldn't be seen
+    if (nativeFile && !cheatCodes.empty()) {
+        usage();
+        return -1;
+    }
+
+    if (presentMode && std::strcmp(presentMode, "none") != 0 && std::strcmp(presentMode, "ascii") != 0) {
+        usage();
+        return -1;
+    }
+
+    if (!romFile) {
         std::cout << "ROM file must be given as argument" << std::endl;
+        usage();
+        return -1;
+    }
+
+    string romCacheDir;
+    if (useRomCache)
+        romCacheDir = romCache ? romCache : defaultRomCache();
+    NES nes(romFile, nullptr, romCacheDir.empty() ? nullptr : romCacheDir.c_str());
+    if (!nes.isLoaded())
         return -1;
+
+    OpcodeProfile profile;
+    if (profileFile)
+        nes.setOpcodeProfile(&profile);
+    FusionTable fusion;
+    if (fuseFile) {
+        OpcodeProfile fuseProfile;
+        if (!fuseProfile.load(fuseFile)) {
+            std::cerr << "Could not read opcode profile " << fuseFile << std::endl;
+            return -1;
+        }
+        fusion = FusionTable::fromProfile(fuseProfile);
+        nes.setFusionTable(&fusion);
+        std::cerr << "Fusing " << fusion.size() << " opcode pairs" << std::endl;
+    }
+    if (nativeFile && !nes.loadCompiled(nativeFile))
+        return -1;
+    for (const char* code : cheatCodes) {
+        if (!nes.addCheat(code))
+            return -1;
+    }
+    if (accurate && !nes.setAccurate(true))
+        return -1;
+    if (keepSave && nes.hasBattery()) {
+        string savePath = saveFile ? saveFile : std::filesystem::path(romFile).replace_extension(".sav").string();
+        if (!nes.attachBattery(savePath.c_str()))
+            return -1;
+    }
+
+    // Written once more when main returns, so the last file holds the whole run
+    std::unique_ptr<MetricsExporter> metrics;
+    if (metricsFile) {
+        metrics = std::make_unique<MetricsExporter>(metricsFile, metricsInterval);
+        if (!metrics->write()) {
+            std::cerr << "Could not write metrics to " << metricsFile << std::endl;
+            return -1;
+        }
     }
 
-    NES nes(argv[1]);
-    nes.run();
+    // Held so every return closes the files, patching the WAV header and finishing queued frames
+    std::unique_ptr<AudioWriter> audio;
+    if (audioFile) {
+        audio = std::make_unique<AudioWriter>(audioFile, endsWith(audioFile, ".wav") ? WAV_PCM16 : RAW_PCM16, APU_SAMPLE_RATE);
+        if (!audio->isOpen()) {
+            std::cerr << "Could not open " << audioFile << " for writing" << std::endl;
+            return -1;
+        }
+        nes.setAudioWriter(audio.get());
+    }
+    nes.setAudioThread(audioThread);
+
+    std::unique_ptr<FrameOutput> video;
+    if (videoTarget || snapshotList) {
+        video = std::make_unique<FrameOutput>();
+        if (videoTarget) {
+            VIDEOFORMAT format = (forceY4M || endsWith(videoTarget, ".y4m")) ? Y4M_420 : RAW_RGB24;
+            if (!video->openStream(videoTarget, format)) {
+                std::cerr << "Could not open " << videoTarget << " for video output" << std::endl;
+                return -1;
+            }
+        }
+        for (uint64_t frame : snapshotFrames)
+            video->addSnapshot(frame);
+        if (snapshotPrefix)
+            video->setSnapshotPrefix(snapshotPrefix);
+        if (ntscHelpers >= 0)
+            video->enableNtscFilter(ntscHelpers);
+        video->start();
+        nes.setFrameOutput(video.get());
+    }
+
+    nes.setFrameLimit(frameLimit);
+    if (debugPort >= 0) {
+        DebugServer server(&nes, debugPort);
+        if (!server.isOpen())
+            return -1;
+        std::cerr << "Debugging on 127.0.0.1:" << server.localPort() << std::endl;
+        server.run();
+        std::cerr << "Served " << server.commandsServed() << " commands, " << nes.frameCount() << " frames" << std::endl;
+    } else if (serveName) {
+        ShmServer server(&nes, serveName, serveReplace);
+        if (!server.isOpen()) {
+            if (!serveReplace)
+                std::cerr << "If no server is running on " << serveName << ", --serve-replace removes it" << std::endl;
+            return -1;
+        }
+        std::cerr << "Serving on " << serveName << std::endl;
+        server.run();
+        std::cerr << "Served " << server.requestsServed() << " requests, " << nes.frameCount() << " frames" << std::endl;
+    } else if (presentMode) {
+        // Emulation moves to its own thread, this one presents
+        TripleBuffer frames;
+        EmulationThread emulation(&nes, &frames);
+        Presenter* presenter;
+        if (std::strcmp(presentMode, "ascii") == 0)
+            presenter = new AsciiPresenter(std::cout, 64);
+        else
+            presenter = new NullPresenter();
+
+        emulation.start(throttled);
+        presenter->run(frames, emulation);
+        emulation.stop();
+
+        PresentStats stats = presenter->stats(frames);
+        std::cerr << "Presented " << stats.presented << " frames, dropped " << stats.dropped
+                  << ", latency us mean " << stats.meanLatency << " p50 " << stats.p50Latency
+                  << " p99 " << stats.p99Latency << " max " << stats.maxLatency << std::endl;
+        delete presenter;
+        nes.setPresentBuffer(nullptr);
+    } else if (renderEvery > 1) {
+        // Skipped frames keep full timing, they just aren't drawn
+        while (!nes.frameLimitReached()) {
+            nes.setFrameSkip((nes.frameCount() + 1) % renderEvery != 0);
+            nes.runFrame();
+        }
+    } else {
+        nes.run();
+    }
+
+    // Statistics go to stderr so stdout can carry a video stream
+    if (profileFile) {
+        nes.setOpcodeProfile(nullptr);
+        if (profile.save(profileFile))
+            std::cerr << "Counted " << profile.total() << " opcode pairs into " << profileFile << std::endl;
+        else
+            std::cerr << "Could not write opcode profile " << profileFile << std::endl;
+    }
+
+    // The last frame's audio is still with the audio thread
+    nes.setAudioThread(false);
+    if (audio) {
+        audio->close();
+        std::cerr << "Wrote " << audio->samplesWritten() << " samples to " << audioFile
+                  << " (" << audio->poolStalls() << " pool stalls)" << std::endl;
+    }
+
+    if (video) {
+        nes.setFrameOutput(nullptr);
+        video->close();
+        std::cerr << "Wrote " << video->framesWritten() << " frames and " << video->snapshotsWritten()
+                  << " snapshots (" << video->poolStalls() << " pool stalls)" << std::endl;
+        static const char* STAGE_NAMES[OUTPUT_STAGES] = { "palette", "ntsc", "encode", "png" };
+        for (int stage = 0; stage < OUTPUT_STAGES; stage++) {
+            const StageTiming& timing = video->stageTiming((OUTPUTSTAGE) stage);
+            if (timing.frames)
+                std::cerr << "  " << STAGE_NAMES[stage] << ": " << timing.totalNs / 1e6 / timing.frames
+                          << " ms/frame, max " << timing.maxNs / 1e6 << " ms" << std::endl;
+        }
+    }
 
     return 0;
 }
@@ -0,0 +1,213 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+
+#include "metrics.h"
+
+Counter Metrics::frames("nes_frames_total", "Frames emulated");
+Counter Metrics::instructions("nes_instructions_total", "CPU instructions executed");
+Counter Metrics::cpuCycles("nes_cpu_cycles_total", "CPU cycles emulated");
+Counter Metrics::ppuSyncs("nes_ppu_syncs_total", "Times the PPU was caught up to the CPU");
+Counter Metrics::nmis("nes_nmis_total", "NMIs taken");
+Counter Metrics::irqs("nes_irqs_total", "IRQs taken");
+Counter Metrics::audioStalls("nes_audio_stalls_total", "Times emulation waited for the audio writer");
+Histogram Metrics::frameTime("nes_frame_emulation_ns", "Time to emulate one frame");
+Histogram Metrics::presentLatency("nes_present_latency_ns", "Time from a frame being published to being presented");
+Histogram Metrics::frameInstructions("nes_frame_instructions", "CPU instructions per frame");
+Histogram Metrics::frameCycles("nes_frame_cpu_cycles", "CPU cycles per frame");
+
+uint64_t HistogramSnapshot::percentile(double p) const {
+    uint64_t target = (uint64_t) (p * count);
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < buckets.size(); i++) {
+        seen += buckets[i];
+        if (seen > target)
+            return MetricsRegistry::bucketStart(i);
+    }
+    return max;
+}
+
+MetricsRegistry& MetricsRegistry::instance() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+unsigned int MetricsRegistry::addCounter(const char* name, const char* help) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (counters.size() == METRICS_MAX_COUNTERS) {
+        std::cerr << "Too many counters, " << name << " isn't recorded separately" << std::endl;
+        return METRICS_MAX_COUNTERS - 1;
+    }
+    counters.push_back({ name, help });
+    return counters.size() - 1;
+}
+
+unsigned int MetricsRegistry::addHistogram(const char* name, const char* help) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (histograms.size() == METRICS_MAX_HISTOGRAMS) {
+        std::cerr << "Too many histograms, " << name << " isn't recorded separately" << std::endl;
+        return METRICS_MAX_HISTOGRAMS - 1;
+    }
+    histograms.push_back({ name, help });
+    return histograms.size() - 1;
+}
+
+MetricsShard& MetricsRegistry::shard() {
+    thread_local MetricsShard* mine = nullptr;
+    if (!mine) {
+        std::lock_guard<std::mutex> guard(lock);
+        shards.push_back(std::make_unique<MetricsShard>());
+        mine = shards.back().get();
+    }
+    return *mine;
+}
+
+uint64_t MetricsRegistry::counter(unsigned int id) const {
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t sum = 0;
+    for (const auto& shard : shards)
+        sum += shard->counters[id].load(std::memory_order_relaxed);
+    return sum;
+}
+
+HistogramSnapshot MetricsRegistry::histogram(unsigned int id) const {
+    HistogramSnapshot snapshot = { 0, 0, 0, vector<uint64_t>(HISTOGRAM_BUCKETS) };
+    std::lock_guard<std::mutex> guard(lock);
+    for (const auto& shard : shards) {
+        for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            uint64_t count = shard->buckets[id][i].load(std::memory_order_relaxed);
+            snapshot.buckets[i] += count;
+            snapshot.count += count;
+        }
+        snapshot.sum += shard->sums[id].load(std::memory_order_relaxed);
+        snapshot.max = std::max(snapshot.max, shard->maxima[id].load(std::memory_order_relaxed));
+    }
+    return snapshot;
+}
+
+unsigned int MetricsRegistry::bucket(uint64_t value) {
+    // Below 16 each value has its own bucket, above that the 4 bits after the leading one pick
+    // one of 16 buckets in that power of two
+    if (value >= (uint64_t) 1 << HISTOGRAM_MAX_BITS)
+        return HISTOGRAM_BUCKETS - 1;
+    if (value < (1u << HISTOGRAM_SUB_BITS))
+        return (unsigned int) value;
+    unsigned int top = 63 - __builtin_clzll(value);
+    unsigned int group = top - HISTOGRAM_SUB_BITS + 1;
+    unsigned int sub = (value >> (top - HISTOGRAM_SUB_BITS)) & ((1u << HISTOGRAM_SUB_BITS) - 1);
+    return (group << HISTOGRAM_SUB_BITS) | sub;
+}
+
+uint64_t MetricsRegistry::bucketStart(unsigned int bucket) {
+    unsigned int group = bucket >> HISTOGRAM_SUB_BITS;
+    uint64_t sub = bucket & ((1u << HISTOGRAM_SUB_BITS) - 1);
+    if (group == 0)
+        return sub;
+    return (((uint64_t) 1 << HISTOGRAM_SUB_BITS) + sub) << (group - 1);
+}
+
+string MetricsRegistry::prometheus() const {
+    // Histogram buckets are given at each power of two, the full resolution is in the JSON
+    std::ostringstream out;
+    vector<Metric> counterList, histogramList;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        counterList = counters;
+        histogramList = histograms;
+    }
+    for (unsigned int id = 0; id < counterList.size(); id++) {
+        out << "# HELP " << counterList[id].name << " " << counterList[id].help << "\n"
+            << "# TYPE " << counterList[id].name << " counter\n"
+            << counterList[id].name << " " << counter(id) << "\n";
+    }
+    for (unsigned int id = 0; id < histogramList.size(); id++) {
+        const char* name = histogramList[id].name;
+        HistogramSnapshot snapshot = histogram(id);
+        out << "# HELP " << name << " " << histogramList[id].help << "\n" << "# TYPE " << name << " histogram\n";
+        uint64_t cumulative = 0;
+        unsigned int next = 0;
+        for (unsigned int bits = 0; bits <= HISTOGRAM_MAX_BITS; bits++) {
+            uint64_t limit = (uint64_t) 1 << bits;
+            for (; next < HISTOGRAM_BUCKETS && bucketStart(next) < limit; next++)
+                cumulative += snapshot.buckets[next];
+            out << name << "_bucket{le=\"" << limit - 1 << "\"} " << cumulative << "\n";
+        }
+        out << name << "_bucket{le=\"+Inf\"} " << snapshot.count << "\n"
+            << name << "_sum " << snapshot.sum << "\n" << name << "_count " << snapshot.count << "\n";
+    }
+    return out.str();
+}
+
+string MetricsRegistry::json() const {
+    std::ostringstream out;
+    vector<Metric> counterList, histogramList;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        counterList = counters;
+        histogramList = histograms;
+    }
+    out << "{\"counters\": {";
+    for (unsigned int id = 0; id < counterList.size(); id++)
+        out << (id ? ", " : "") << "\"" << counterList[id].name << "\": " << counter(id);
+    out << "}, \"histograms\": {";
+    for (unsigned int id = 0; id < histogramList.size(); id++) {
+        HistogramSnapshot snapshot = histogram(id);
+        out << (id ? ", " : "") << "\"" << histogramList[id].name << "\": {\"count\": " << snapshot.count
+            << ", \"sum\": " << snapshot.sum << ", \"p50\": " << snapshot.percentile(0.5) << ", \"p90\": "
+            << snapshot.percentile(0.9) << ", \"p99\": " << snapshot.percentile(0.99) << ", \"max\": " << snapshot.max << "}";
+    }
+    out << "}}\n";
+    return out.str();
+}
+
+MetricsExporter::MetricsExporter(const char* path, unsigned int intervalMs) : path(path), intervalMs(intervalMs) {
+    size_t length = this->path.size();
+    json = length >= 5 && this->path.compare(length - 5, 5, ".json") == 0;
+    stopping = false;
+    thread = std::thread(&MetricsExporter::loop, this);
+}
+
+MetricsExporter::~MetricsExporter() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+    write();
+}
+
+bool MetricsExporter::write() {
+    // Readers never see a half written file
+    string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary);
+        if (!file.is_open())
+            return false;
+        file << (json ? MetricsRegistry::instance().json() : MetricsRegistry::instance().prometheus());
+        if (!file.good())
+            return false;
+    }
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+void MetricsExporter::loop() {
+    // Exporting must never take time from emulation, so this thread only runs when nothing else wants the CPU
+    sched_param param = {};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+    std::unique_lock<std::mutex> guard(lock);
+    while (!stopping) {
+        wake.wait_for(guard, std::chrono::milliseconds(intervalMs));
+        if (stopping)
+            break;
+        guard.unlock();
+        if (!write())
+            std::cerr << "Could not write metrics to " << path << std::endl;
+        guard.lock();
+    }
+}
@@ -1,65 +1,944 @@
+#include <chrono>
+#include <cstring>
+#include <dlfcn.h>
+#include <new>
+#include <type_traits>
+
+#include "audio_thread.h"
+#include "cycle_core.h"
+#include "debugger.h"
+#include "instance_pool.h"
+#include "metrics.h"
 #include "nes.h"
+#include "recompiled.h"
+#include "rom_loader.h"
+
+static_assert(std::is_trivially_copyable<NESState>::value, "NESState must stay copyable with memcpy");
+
+// Pages are the last member, everything in front of them is copied whole by forks and save states
+const size_t UNPAGED_STATE_SIZE = sizeof(NESState) - sizeof(StatePages);
+
+// Read from PRG ROM until a cartridge is mapped
+static const uint8_t UNMAPPED_PAGE[PRG_PAGE_SIZE] = {};
+
+// Save states are this header, the unpaged state as it is in memory, then every page
+const char STATE_MAGIC[4] = { 'N', 'E', 'S', 'S' };
+const uint32_t STATE_VERSION = 10u;
+
+// Bounds for loaded counters: more CPU cycles than any instruction plus OAM DMA can owe, and a
+// whole frame of PPU dots
+const unsigned int MAX_CYCLES_OWED = 1024u;
+const uint64_t FRAME_DOTS = 341u * 262u;
+
+struct SaveStateHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t size;                                      // Whole save state including this header
+    uint8_t romHeader[HEADER_SIZE];                     // iNES header of the ROM it was saved from
+};
+
+#ifdef NES_METRICS
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+NES::NES(const char* romFileName, Arena* arena, const char* romCache) {
+    bool arenaHadRoom = setup(arena);
+
+    CartridgeBuilder builder;
+    RomLoader loader(romCache);
+    if (loader.load(romFileName, builder))
+        loaded = loadCartridge(builder, romFileName);
+
+    loaded = loaded && arenaHadRoom;
+    if (loaded)
+        cpu->reset();
+}
 
-NES::NES(const char* romFileName) {
+NES::NES(const uint8_t* rom, size_t size, Arena* arena) {
+    bool arenaHadRoom = setup(arena);
+    CartridgeBuilder builder;
+    RomLoader loader(nullptr);
+    loaded = loader.load(rom, size, builder) && loadCartridge(builder, nullptr) && arenaHadRoom;
+    if (loaded)
+        cpu->reset();
+}
+
+bool NES::setup(Arena* arena) {
     // Setup hardware - the NES used a modified version of the MOS6502, a PPU (Picture
     // Processing Unit), APU (Audio Processing Unit), and a variety of mappers that were
     // hosted on cartridge. See the respective header files for details.
-    // Hardware will be added as implemented
-    MOS6502 tempCPU;
-    cpu = &tempCPU;
-   
-    // Read rom file
-    ifstream romFile;
-    romFile.open(romFileName, std::ifstream::binary);
-    if (romFile.is_open()) {
-        Cartridge cartridge;
-
-        char buf[HEADER_SIZE];
-        romFile.read(buf, HEADER_SIZE);
-        cartridge.header = reinterpret_cast<ROMHeader*>(buf);
-
-        if (cartridge.header->flags6 & 0x4) {
-            char trainerBuf[TRAINER_SIZE];
-            romFile.read(trainerBuf, TRAINER_SIZE);
-        }
+    // All of their state lives in one block from the arena
+    ownedArena = nullptr;
+    if (!arena)
+        arena = ownedArena = new Arena(sizeof(NESState));
+    void* block = arena->allocate(sizeof(NESState), alignof(NESState));
+    bool arenaHadRoom = block != nullptr;
+    if (!arenaHadRoom) {
+        // Still give the instance somewhere to live so it can be destroyed cleanly
+        std::cerr << "Arena has no room for another NES" << std::endl;
+        delete ownedArena;
+        arena = ownedArena = new Arena(sizeof(NESState));
+        block = arena->allocate(sizeof(NESState), alignof(NESState));
+    }
+    state = new (block) NESState();
+    bindComponents();
 
-        uint32_t prgSize = cartridge.header->prgSize * 16384;
-        cartridge.prgROM.resize(prgSize);
-        romFile.read(reinterpret_cast<char*>(cartridge.prgROM.data()), prgSize);
+    internalFrame = new uint16_t[SCREEN_WIDTH * SCREEN_HEIGHT]();
+    externalFrame = nullptr;
+    sampleBuffer = new int16_t[APU_SAMPLE_BUFFER_SIZE];
+    ppu->pixels = internalFrame;
+    apu->sampleBuffer = sampleBuffer;
+    state->wram.attach(state->pages.wram);
+    state->prgRAM.attach(state->pages.prgRAM);
+    ppu->setVRAM(state->pages.vram);
+    for (unsigned int page = 0; page < PRG_PAGES; page++)
+        prgPages[page] = UNMAPPED_PAGE;
+    wireBus();
+    pool = nullptr;
+    poolSlot = 0;
+    snapshotPool = nullptr;
+    snapshot = nullptr;
 
-        uint32_t chrSize = cartridge.header->chrSize * 8192;
+    loaded = false;
+    state->masterClock = 0;
+    state->ppuClock = 0;
+    state->vblankDot = ppu->dotsUntilVblank();
+    state->frames = 0;
+    state->nmiPending = false;
+    state->controllers[0].reset();
+    state->controllers[1].reset();
+    frameLimit = 0;
+    frameSkip = false;
+    audioWriter = nullptr;
+    frameOutput = nullptr;
+    presentBuffer = nullptr;
+    inputQueue = nullptr;
+    inputPushed[0] = inputPushed[1] = 0;
+    ppuSyncs = 0;
+    debugger = nullptr;
+    midFrame = false;
+    composing = true;
+    return arenaHadRoom;
+}
 
-        if (chrSize > 0) {
-            cartridge.chrROM.resize(chrSize);
-            romFile.read(reinterpret_cast<char*>(cartridge.chrROM.data()), chrSize);
-        }
+bool NES::loadCartridge(CartridgeBuilder& builder, const char* romFileName) {
+    // The builder has already put PRG and CHR ROM in place as the image was read
+    shared_ptr<Cartridge> cart = builder.finish();
+    cart->romFileName = romFileName;
+    cartridge = cart;
 
-        romFile.close();
+    if (!builder.isINES()) {
+        std::cerr << "Not an iNES ROM" << std::endl;
+        return false;
     }
+    uint32_t prgSize = cart->header.prgSize * 16384;
+    uint32_t chrSize = cart->header.chrSize * 8192;
+    bool complete = builder.complete();
+
+    if (chrSize > 0 && complete)
+        ppu->setCHR(cart->chrROM.data(), false);
+    else
+        ppu->setCHR(state->pages.chrRAM, true);
+
+    if (cart->header.flags6 & 0x08)
+        ppu->setMirroring(FOUR_SCREEN);
+    else
+        ppu->setMirroring((cart->header.flags6 & 0x01) ? VERTICAL : HORIZONTAL);
+
+    // Only NROM is wired up so far, which has 16KB or 32KB of PRG ROM
+    uint8_t mapper = (cart->header.flags7 & 0xF0) | (cart->header.flags6 >> 4);
+    bool supported = complete && mapper == 0 && (prgSize == 16384 || prgSize == 32768);
+    if (!supported)
+        std::cerr << "Unsupported or truncated ROM (mapper " << (int) mapper << ")" << std::endl;
+    else
+        mapPRG();
+    return supported;
 }
 
-void NES::run() {
+void NES::mapPRG() {
+    // 16KB carts mirror their only bank into $C000-$FFFF
+    const vector<uint8_t>& prg = cartridge->prgROM;
+    for (unsigned int page = 0; page < PRG_PAGES; page++)
+        prgPages[page] = prg.data() + ((page * PRG_PAGE_SIZE) & (prg.size() - 1));
+
+    // Compare values are checked against the banks mapped now, so a bank switch has to call this again
+    uint32_t patched = 0;
+    for (const Cheat& cheat : cheats) {
+        unsigned int offset = cheat.addr - 0x8000;
+        if (!cheat.compared || prgPages[offset / PRG_PAGE_SIZE][offset % PRG_PAGE_SIZE] == cheat.compare)
+            patched |= 1u << (offset / PRG_PAGE_SIZE);
+    }
+    if (!patched) {
+        cheatPages.reset();
+        return;
+    }
+
+    shared_ptr<uint8_t> copies(new uint8_t[PRG_PAGES * PRG_PAGE_SIZE], std::default_delete<uint8_t[]>());
+    for (unsigned int page = 0; page < PRG_PAGES; page++) {
+        if (patched & (1u << page))
+            std::memcpy(copies.get() + page * PRG_PAGE_SIZE, prgPages[page], PRG_PAGE_SIZE);
+    }
+    for (const Cheat& cheat : cheats) {
+        unsigned int offset = cheat.addr - 0x8000;
+        if (!cheat.compared || prgPages[offset / PRG_PAGE_SIZE][offset % PRG_PAGE_SIZE] == cheat.compare)
+            copies.get()[offset] = cheat.value;
+    }
+    for (unsigned int page = 0; page < PRG_PAGES; page++) {
+        if (patched & (1u << page))
+            prgPages[page] = copies.get() + page * PRG_PAGE_SIZE;
+    }
+    cheatPages = copies;
+}
+
+void NES::bindComponents() {
+    cpu = &state->cpu;
+    ppu = &state->ppu;
+    apu = &state->apu;
     cpu->nes = this;
-    bool quit = false;
-    int cycleCount = 0;
+    apu->nes = this;
+}
+
+NES::NES(const NES& parent, InstancePool* pool, unsigned int slot) {
+    // Everything up to the pages is copied, the pages are read from the parent's snapshot until
+    // they are written. The parent has no pages of its own at this point (see fork()).
+    InstancePool::Slot& memory = pool->slots[slot];
+    state = &memory.state;
+    std::memcpy((void*) state, parent.state, UNPAGED_STATE_SIZE);
+    bindComponents();
+    cpu->profile = nullptr;                             // Forks run the parent's fusion table but don't profile
+    apu->synthesize = true;                             // Forks synthesize their own audio, from the parent's channels
+    apu->log = nullptr;
+    if (parent.audioThread)
+        apu->takeChannels(parent.audioThread->sync());
+    state->wram.inherit(state->pages.wram);
+    state->prgRAM.inherit(state->pages.prgRAM);
+    ppu->vram.inherit(state->pages.vram);
+    ppu->chr.inherit(state->pages.chrRAM);
+
+    // Nothing useful is in the frame buffer until the fork composes a frame of its own
+    internalFrame = memory.frame;
+    externalFrame = nullptr;
+    sampleBuffer = memory.samples;
+    ppu->pixels = internalFrame;
+    apu->sampleBuffer = sampleBuffer;
+
+    ownedArena = nullptr;
+    this->pool = pool;
+    poolSlot = slot;
+    snapshotPool = parent.snapshotPool;
+    snapshot = parent.snapshot;
+    snapshotPool->retainSnapshot(snapshot);
+    cartridge = parent.cartridge;
+    std::memcpy(prgPages, parent.prgPages, sizeof(prgPages));
+    wireBus();                                          // Nothing traps a fork's accesses
+    cheats = parent.cheats;
+    cheatPages = parent.cheatPages;
+    compiledLibrary = parent.compiledLibrary;
+    loaded = parent.loaded;
+    frameLimit = parent.frameLimit;
+    frameSkip = parent.frameSkip;
+    audioWriter = nullptr;
+    frameOutput = nullptr;
+    presentBuffer = nullptr;
+    inputQueue = nullptr;                               // The parent is the queue's only consumer
+    inputPushed[0] = inputPushed[1] = 0;
+    ppuSyncs = 0;
+    debugger = nullptr;                                 // Forks run undebugged, from where the parent stopped
+    midFrame = parent.midFrame;
+    composing = parent.composing;
+}
+
+NES::~NES() {
+    // The state block is trivially destructible, its memory goes back with the arena or pool
+    if (snapshot)
+        snapshotPool->releaseSnapshot(snapshot);
+    if (!pool) {
+        delete[] internalFrame;
+        delete[] sampleBuffer;
+    }
+    delete ownedArena;
+}
+
+bool NES::isLoaded() const {
+    return loaded;
+}
+
+NES* NES::fork(InstancePool& pool) {
+    if (cycleCore) {
+        std::cerr << "Instances in accurate mode can't be forked" << std::endl;
+        return nullptr;
+    }
+    if (!freezePages(pool)) {
+        std::cerr << "Instance pool has no room for another snapshot" << std::endl;
+        return nullptr;
+    }
+
+    unsigned int slot;
+    InstancePool::Slot* memory = pool.takeSlot(slot);
+    if (!memory) {
+        std::cerr << "Instance pool has no room for another fork" << std::endl;
+        return nullptr;
+    }
+    return new (memory->object) NES(*this, &pool, slot);
+}
+
+bool NES::freezePages(InstancePool& pool) {
+    // Pages this instance owns would change under its forks, so their current contents move to
+    // a fresh snapshot that this instance then shares too. An instance that hasn't written since
+    // it was last forked already reads everything from its snapshot and forks straight away.
+    bool writable = ppu->chrWritable;
+    if (!state->wram.ownsAny() && !state->prgRAM.ownsAny() && !ppu->vram.ownsAny() && !(writable && ppu->chr.ownsAny()))
+        return true;
 
+    StatePages* pages = pool.takeSnapshot();
+    if (!pages)
+        return false;
+    state->wram.copyTo(pages->wram);
+    state->wram.share(pages->wram);
+    state->prgRAM.copyTo(pages->prgRAM);
+    state->prgRAM.share(pages->prgRAM);
+    ppu->vram.copyTo(pages->vram);
+    ppu->vram.share(pages->vram);
+    if (writable) {
+        ppu->chr.copyTo(pages->chrRAM);
+        ppu->chr.share(pages->chrRAM);
+    }
+
+    if (snapshot)
+        snapshotPool->releaseSnapshot(snapshot);
+    snapshotPool = &pool;
+    snapshot = pages;
+    return true;
+}
+
+void NES::run() {
     // Main loop
-    while (!quit) {
-        // Each master clock cycle should be one ppu clock cycle and every 3rd master clock
-        // cycle should be one cpu clock cycle as the ppu's frequency is 3x faster.
+    while (!frameLimitReached())
+        runFrame();
+}
 
-        // ppu.cycle();
-        if (cycleCount % 3 == 0)
-            cpu->cycle();
+void NES::runFrame() {
+    // Frames the frame output asked for are always composed, skipped frames are never handed on.
+    // A frame the debugger stopped part way through carries on from where it stopped.
+    if (!midFrame) {
+        composing = !frameSkip || (frameOutput && frameOutput->wants(state->frames + 1));
+        ppu->setSkipComposition(!composing);
+        apu->clearSamples();
+#ifdef NES_METRICS
+        frameStart = frameCounts();
+#endif
+    }
 
-        cycleCount++;
+    // Each master clock cycle is one PPU dot and every 3rd is a CPU cycle. Rather than stepping
+    // both in lockstep the CPU runs alone and the PPU is caught up only when the CPU touches its
+    // registers or OAM DMA, when vblank raises NMI, and here at the end of the frame. A frame ends
+    // when the PPU enters vblank. Either way masterClock ends on the dot after it, and so does
+    // ppuClock unless an access late in the frame already caught the PPU up past it.
+    if (cycleCore) {
+        cycleCore->runFrame();
+    } else {
+        if (debugger) {
+            midFrame = !runDebugged();
+            if (midFrame)
+                return;
+        } else {
+            for (state->masterClock = (state->masterClock + 2) / 3 * 3; state->masterClock <= state->vblankDot; state->masterClock += 3)
+                cpuCycle();
+        }
+        state->masterClock = state->vblankDot;
+        syncPPU();
+        state->masterClock++;
+    }
+    state->vblankDot = state->ppuClock + ppu->dotsUntilVblank();
+
+    ppu->frameComplete = false;
+    state->frames++;
+#ifdef NES_METRICS
+    recordFrame(frameStart);
+#endif
+    if (battery && state->frames % BATTERY_FLUSH_FRAMES == 0)
+        battery->flush();
+
+    // Swap a finished frame out for an empty buffer rather than copying it. While a frame output
+    // is attached it owns the PPU's buffers, so the presenter gets a copy instead.
+    if (presentBuffer && composing) {
+        if (frameOutput) {
+            std::memcpy(presentBuffer->back(), ppu->pixels, SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(uint16_t));
+            presentBuffer->publish(state->frames);
+        } else {
+            ppu->pixels = presentBuffer->publish(state->frames);
+        }
+    }
+    if (composing && frameOutput && frameOutput->wants(state->frames))
+        ppu->pixels = frameOutput->submit(ppu->pixels, state->frames);
+
+    // Hand the frame's audio over, the writer copies it so the APU can reuse its buffer. The
+    // samples stay readable through audioSamples() until the next frame starts. An audio thread
+    // has only just been given this frame, so what comes out is the frame before.
+    if (audioThread)
+        apu->numSamples = audioThread->endFrame(sampleBuffer);
+    if (audioWriter)
+        audioWriter->write(apu->samples(), apu->sampleCount());
+}
+
+#ifdef NES_METRICS
+NES::FrameCounts NES::frameCounts() const {
+    return { nowNs(), state->masterClock, cpu->instructions, cpu->nmis, cpu->irqs, ppuSyncs };
+}
+
+void NES::recordFrame(const FrameCounts& start) const {
+    // Totals are fed from the same per-frame deltas as the histograms, so rolling back a save state
+    // (which rewinds the CPU's counts) never makes a counter go backwards
+    FrameCounts end = frameCounts();
+    uint64_t cycles = (end.masterClock - start.masterClock) / 3;
+    uint64_t instructions = end.instructions - start.instructions;
+    Metrics::frames.add();
+    Metrics::cpuCycles.add(cycles);
+    Metrics::instructions.add(instructions);
+    Metrics::nmis.add(end.nmis - start.nmis);
+    Metrics::irqs.add(end.irqs - start.irqs);
+    Metrics::ppuSyncs.add(end.ppuSyncs - start.ppuSyncs);
+    Metrics::frameTime.record(end.time - start.time);
+    Metrics::frameCycles.record(cycles);
+    Metrics::frameInstructions.record(instructions);
+}
+#endif
+
+void NES::setFrameLimit(uint64_t frames) {
+    frameLimit = frames;
+}
+
+bool NES::frameLimitReached() const {
+    return frameLimit != 0 && state->frames >= frameLimit;
+}
+
+void NES::setInput(uint8_t port, uint8_t buttons) {
+    state->controllers[port & 0x1].setButtons(buttons);
+}
+
+void NES::setInputQueue(InputQueue* queue) {
+    inputQueue = queue;
+    inputPushed[0] = inputPushed[1] = 0;
+}
+
+void NES::setFrameSkip(bool skip) {
+    frameSkip = skip;
+}
+
+void NES::setAudioWriter(AudioWriter* writer) {
+    audioWriter = writer;
+}
+
+void NES::setAudioThread(bool threaded) {
+    if (threaded && !audioThread) {
+        // Only a frame the debugger stopped part way has samples that aren't handed on yet
+        audioThread.reset(new AudioThread(apu, midFrame ? apu->sampleCount() : 0));
+    } else if (!threaded && audioThread) {
+        // The frame still with the worker is written straight away, the current one is finished here
+        size_t count;
+        const int16_t* samples = audioThread->finish(count);
+        if (audioWriter && count)
+            audioWriter->write(samples, count);
+        audioThread.reset();
+    }
+}
+
+void NES::setFrameOutput(FrameOutput* output) {
+    if (frameOutput)
+        frameOutput->release(ppu->pixels);
+    frameOutput = output;
+    ppu->pixels = output ? output->acquire() : idleFrameBuffer();
+}
+
+void NES::setPresentBuffer(TripleBuffer* frames) {
+    presentBuffer = frames;
+    if (!frameOutput)
+        ppu->pixels = idleFrameBuffer();
+}
+
+void NES::setFrameBuffer(uint16_t* pixels) {
+    externalFrame = pixels;
+    if (!frameOutput)
+        ppu->pixels = idleFrameBuffer();
+}
+
+void NES::setOpcodeProfile(OpcodeProfile* profile) {
+    cpu->profile = profile;
+}
+
+void NES::setFusionTable(const FusionTable* table) {
+    cpu->fusion = table;
+}
+
+bool NES::loadCompiled(const char* path) {
+    if (!loaded)
+        return false;
+    if (!cheats.empty()) {
+        std::cerr << "Compiled code can't be combined with cheats, it has the ROM's bytes built in" << std::endl;
+        return false;
+    }
+    void* library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!library) {
+        std::cerr << "Couldn't load compiled code: " << dlerror() << std::endl;
+        return false;
+    }
+    shared_ptr<void> handle(library, dlclose);
+
+    auto entryPoint = (const CompiledProgram* (*)()) dlsym(library, RECOMPILED_ENTRY_POINT);
+    const CompiledProgram* program = entryPoint ? entryPoint() : nullptr;
+    if (!program || program->abi != RECOMPILED_ABI || program->cpuSize != sizeof(MOS6502)) {
+        std::cerr << path << " was built for a different version of the emulator" << std::endl;
+        return false;
+    }
+    const vector<uint8_t>& prg = cartridge->prgROM;
+    if (program->prgSize != prg.size() || program->prgChecksum != prgChecksum(prg.data(), prg.size())) {
+        std::cerr << path << " was compiled from a different ROM" << std::endl;
+        return false;
+    }
+
+    compiledLibrary = handle;
+    cpu->compiled = program->entries;
+    return true;
+}
+
+bool NES::setAccurate(bool accurate) {
+    if (!loaded)
+        return false;
+    if (state->frames || pool || snapshot) {
+        std::cerr << "Accurate mode can only be chosen before the first frame of an unforked instance" << std::endl;
+        return false;
+    }
+    if (!accurate) {
+        cycleCore.reset();
+        return true;
+    }
+    if (!cycleCore)
+        cycleCore.reset(new CycleCore(this));
+    if (!cycleCore->isValid()) {
+        std::cerr << "Accurate core's coroutines didn't fit in its arena" << std::endl;
+        cycleCore.reset();
+        return false;
+    }
+    return true;
+}
+
+bool NES::hasBattery() const {
+    return loaded && (cartridge->header.flags6 & 0x02);
+}
+
+bool NES::attachBattery(const char* path) {
+    if (!loaded)
+        return false;
+    if (state->frames || pool || snapshot) {
+        std::cerr << "Save RAM can only be attached before the first frame of an unforked instance" << std::endl;
+        return false;
+    }
+    std::unique_ptr<BatteryRAM> file(new BatteryRAM(path, PRG_RAM_SIZE, state->pages.prgRAM));
+    if (!file->isOpen())
+        return false;
+    battery = std::move(file);
+    state->prgRAM.attach(battery->memory());
+    return true;
+}
+
+bool NES::addCheat(const char* code) {
+    if (!loaded)
+        return false;
+    Cheat cheat;
+    if (!parseCheat(code, cheat)) {
+        std::cerr << "Not a Game Genie code or AAAA:VV / AAAA?CC:VV cheat: " << code << std::endl;
+        return false;
+    }
+    if (compiledLibrary) {
+        std::cerr << "Cheats can't be combined with compiled code, it has the ROM's bytes built in" << std::endl;
+        return false;
+    }
+    cheats.push_back(cheat);
+    mapPRG();
+    return true;
+}
+
+void NES::clearCheats() {
+    cheats.clear();
+    if (loaded)
+        mapPRG();
+}
+
+size_t NES::cheatCount() const {
+    return cheats.size();
+}
+
+uint32_t NES::romCRC() const {
+    return cartridge->crc32;
+}
+
+string NES::romSHA1() const {
+    return SHA1::hex(cartridge->sha1);
+}
+
+uint64_t NES::frameCount() const {
+    return state->frames;
+}
+
+const uint16_t* NES::frameBuffer() const {
+    return ppu->frame();
+}
+
+const int16_t* NES::audioSamples(size_t& count) const {
+    count = apu->sampleCount();
+    return apu->samples();
+}
+
+void NES::readRAM(uint8_t out[CPU_MEM_SIZE]) const {
+    state->wram.copyTo(out);
+}
+
+size_t NES::stateSize() const {
+    return sizeof(SaveStateHeader) + UNPAGED_STATE_SIZE + sizeof(StatePages);
+}
+
+bool NES::saveState(uint8_t* out, size_t size) const {
+    if (size < stateSize())
+        return false;
+    if (cycleCore) {
+        std::cerr << "Instances in accurate mode can't be saved" << std::endl;
+        return false;
+    }
+
+    SaveStateHeader header;
+    std::memcpy(header.magic, STATE_MAGIC, sizeof(STATE_MAGIC));
+    header.version = STATE_VERSION;
+    header.size = (uint32_t) stateSize();
+    std::memcpy(header.romHeader, &cartridge->header, HEADER_SIZE);
+    std::memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+
+    // Pointers in the unpaged state are saved as they are and rebound on load. With an audio
+    // thread the APU in the state only kept time, the channels are the worker's.
+    std::memcpy(out, state, UNPAGED_STATE_SIZE);
+    if (audioThread) {
+        APU channels = *apu;
+        channels.takeChannels(audioThread->sync());
+        channels.synthesize = true;
+        channels.log = nullptr;
+        std::memcpy(out + ((const uint8_t*) apu - (const uint8_t*) state), (const void*) &channels, sizeof(APU));
+    }
+    StatePages* pages = (StatePages*) (out + UNPAGED_STATE_SIZE);
+    state->wram.copyTo(pages->wram);
+    state->prgRAM.copyTo(pages->prgRAM);
+    ppu->vram.copyTo(pages->vram);
+    if (ppu->chrWritable)
+        ppu->chr.copyTo(pages->chrRAM);
+    else
+        std::memset(pages->chrRAM, 0, sizeof(pages->chrRAM));
+
+    // A save state is a point the player expects to come back to, so the save file is made current too
+    if (battery)
+        battery->flush();
+    return true;
+}
+
+bool NES::loadState(const uint8_t* data, size_t size) {
+    SaveStateHeader header;
+    if (!loaded || size < sizeof(header))
+        return false;
+    if (cycleCore) {
+        std::cerr << "Instances in accurate mode can't load states" << std::endl;
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, STATE_MAGIC, sizeof(STATE_MAGIC)) != 0 || header.version != STATE_VERSION
+            || header.size != stateSize() || size < stateSize()) {
+        std::cerr << "Save state is from a different build or corrupt" << std::endl;
+        return false;
+    }
+    if (std::memcmp(header.romHeader, &cartridge->header, HEADER_SIZE) != 0) {
+        std::cerr << "Save state is for a different ROM" << std::endl;
+        return false;
+    }
+    data += sizeof(header);
+    if (!validState(data)) {
+        std::cerr << "Save state is corrupt" << std::endl;
+        return false;
+    }
+
+    // Audio still with the worker belongs to before the load, the loaded APU is handed over afresh
+    bool threaded = audioThread != nullptr;
+    setAudioThread(false);
+
+    // Output buffers belong to this instance rather than to the saved one
+    uint16_t* pixels = ppu->pixels;
+    int16_t* samples = apu->sampleBuffer;
+    OpcodeProfile* profile = cpu->profile;
+    const FusionTable* fusion = cpu->fusion;
+    const CompiledBlock* compiled = cpu->compiled;
+    std::memcpy((void*) state, data, UNPAGED_STATE_SIZE);
+    std::memcpy(&state->pages, data + UNPAGED_STATE_SIZE, sizeof(StatePages));
+    if (battery)
+        std::memcpy(battery->memory(), state->pages.prgRAM, PRG_RAM_SIZE);
+    bindComponents();
+    ppu->pixels = pixels;
+    ppu->rebuildSpriteCache();
+    apu->sampleBuffer = samples;
+    apu->clearSamples();
+    apu->synthesize = true;
+    apu->log = nullptr;
+    cpu->profile = profile;
+    cpu->fusion = fusion;
+    cpu->compiled = compiled;
+    cpu->accessDots = 0;                                // States are taken between instructions
+    midFrame = false;                                   // The loaded frame starts over from wherever it was saved
+
+    // Every page is this instance's own again
+    state->wram.attach(state->pages.wram);
+    state->prgRAM.attach(battery ? battery->memory() : state->pages.prgRAM);
+    ppu->setVRAM(state->pages.vram);
+    if (ppu->chrWritable)
+        ppu->setCHR(state->pages.chrRAM, true);
+    else
+        ppu->setCHR(const_cast<uint8_t*>(cartridge->chrROM.data()), false);
+    if (snapshot)
+        snapshotPool->releaseSnapshot(snapshot);
+    snapshot = nullptr;
+    snapshotPool = nullptr;
+    if (battery)
+        battery->flush();
+    setAudioThread(threaded);
+    return true;
+}
+
+// The bytes of a saved state that sit where field does in state, read as a Stored
+template <typename Stored, typename T>
+static Stored savedAs(const uint8_t* unpaged, const NESState* state, const T& field) {
+    static_assert(sizeof(Stored) == sizeof(T), "a field is read back at its own size");
+    Stored value;
+    std::memcpy(&value, unpaged + ((const uint8_t*) &field - (const uint8_t*) state), sizeof(Stored));
+    return value;
+}
+
+template <typename T>
+static T savedField(const uint8_t* unpaged, const NESState* state, const T& field) {
+    return savedAs<T>(unpaged, state, field);
+}
+
+bool NES::validState(const uint8_t* unpaged) const {
+    // Only fields that index tables or bound loops, everything else is harmless whatever it holds
+    auto saved = [&](const auto& field) { return savedField(unpaged, state, field); };
+    typedef std::underlying_type<MIRRORING>::type MirroringValue;
+    uint64_t masterClock = saved(state->masterClock);
+    uint64_t ppuClock = saved(state->ppuClock);
+    uint64_t vblankDot = saved(state->vblankDot);
+    int scanline = saved(ppu->scanline);
+    int dot = saved(ppu->dot);
+    // As its integer, since an enum holding a value outside its enumerators can't be relied on
+    MirroringValue mirroring = savedAs<MirroringValue>(unpaged, state, ppu->mirroring);
+    bool ppuValid = (unsigned int) mirroring <= FOUR_SCREEN
+        && scanline >= 0 && scanline <= 261 && dot >= 0 && dot <= 340 && saved(ppu->spriteCount) <= 8;
+    bool clocksValid = ppuClock + FRAME_DOTS >= masterClock && ppuClock <= masterClock + FRAME_DOTS
+        && vblankDot + FRAME_DOTS >= masterClock && vblankDot <= masterClock + FRAME_DOTS
+        && saved(cpu->cyclesRemaining) <= MAX_CYCLES_OWED;
+
+    // The mixer tables are indexed by channel outputs, sweeps shift by up to 7
+    bool apuValid = saved(apu->triangle.seqPos) < 32 && saved(apu->dmc.output) < 128;
+    for (const APU::Pulse* pulse : { &apu->pulse1, &apu->pulse2 })
+        apuValid = apuValid && saved(pulse->duty) < 4 && saved(pulse->dutyPos) < 8 && saved(pulse->sweepShift) < 8;
+    for (const APU::Envelope* envelope : { &apu->pulse1.envelope, &apu->pulse2.envelope, &apu->noise.envelope })
+        apuValid = apuValid && saved(envelope->volume) < 16 && saved(envelope->decay) < 16;
+    return ppuValid && clocksValid && apuValid;
+}
+
+void NES::cpuCycle() {
+    // Vblank is the only PPU event the CPU sees without reading a register
+    if (state->masterClock >= state->vblankDot)
+        syncPPU();
+
+    if (ppu->nmi) {
+        ppu->nmi = false;
+        state->nmiPending = true;
+    }
+
+    // Interrupts are only taken between instructions
+    if (cpu->cyclesRemaining == 0) {
+        if (state->nmiPending) {
+            state->nmiPending = false;
+            cpu->nmi();
+        } else if (apu->irq()) {
+            cpu->irq();
+        }
+    }
+
+    cpu->cycle();
+    apu->cycle();
+}
+
+bool NES::runDebugged() {
+    // The frame loop with the debugger asked before each instruction and told after each cycle,
+    // stopping part way if it wants. The interrupted cycle was run, so the loop resumes after it.
+    for (state->masterClock = (state->masterClock + 2) / 3 * 3; state->masterClock <= state->vblankDot; state->masterClock += 3) {
+        if (cpu->cyclesRemaining == 0 && debugger->stopBefore(cpu->pc))
+            return false;
+        cpuCycle();
+        if (debugger->stopAfter()) {
+            state->masterClock += 3;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool NES::quietFor(unsigned int cycles) {
+    // Interrupts are taken between instructions, so instructions run together must not straddle
+    // one. Vblank (NMI) and the APU are the only sources that don't need a register access.
+    if (state->nmiPending || ppu->nmi || state->masterClock + 3 * (uint64_t) cycles >= state->vblankDot)
+        return false;
+    return cpu->getFlag(I) || apu->cyclesUntilIRQ() > cycles;
+}
+
+void NES::syncPPU() {
+    // The CPU runs a whole instruction on its first cycle, but the read or write it exists for
+    // happens on its last base cycle (as in the cycle core), so registers are caught up to that
+    uint64_t dot = state->masterClock + cpu->accessDots;
+#ifdef NES_METRICS
+    if (state->ppuClock <= dot)
+        ppuSyncs++;
+#endif
+    while (state->ppuClock <= dot) {
+        ppu->cycle();
+        state->ppuClock++;
     }
 }
 
 uint8_t NES::readMem(uint16_t addr) {
-    return 0x0u;
+    return readPage(busPages[addr >> 8], addr);
 }
 
 void NES::writeMem(uint16_t addr, uint8_t val) {
-    cpu->memory[addr] = val;
+    writePage(busPages[addr >> 8], addr, val);
+}
+
+// Where a page is wired to when nothing traps it
+static BUSPAGE wiredPage(unsigned int page) {
+    if (page < 0x20)
+        return BUS_RAM;
+    if (page < 0x40)
+        return BUS_PPU;
+    if (page == 0x40)
+        return BUS_IO;
+    if (page < 0x60)
+        return BUS_OPEN;
+    return page < 0x80 ? BUS_PRG_RAM : BUS_PRG_ROM;
+}
+
+uint8_t NES::readUntrapped(uint16_t addr) {
+    return readPage(wiredPage(addr >> 8), addr);
+}
+
+void NES::writeUntrapped(uint16_t addr, uint8_t val) {
+    writePage(wiredPage(addr >> 8), addr, val);
+}
+
+void NES::trapPage(uint8_t page, BusTrap* trap) {
+    pageTraps[page] = trap;
+    busPages[page] = trap ? BUS_TRAPPED : wiredPage(page);
+}
+
+void NES::wireBus() {
+    for (unsigned int page = 0; page < 256; page++)
+        trapPage(page, nullptr);
+}
+
+uint8_t NES::readPage(BUSPAGE page, uint16_t addr) {
+    switch (page) {
+        case BUS_RAM:
+            // 2KB of internal RAM mirrored four times
+            return state->wram.read(addr & 0x07FF);
+        case BUS_PPU:
+            // 8 PPU registers mirrored through $3FFF
+            syncPPU();
+            return ppu->readReg(addr);
+        case BUS_IO:
+            if (addr == 0x4015) {
+                return apu->readStatus();
+            } else if (addr == 0x4016 || addr == 0x4017) {
+                uint8_t port = addr & 0x1;
+                if (inputPushed[port]) {
+                    inputQueue->observed(InputQueue::now() - inputPushed[port]);
+                    inputPushed[port] = 0;
+                }
+                return state->controllers[port].read();
+            }
+            return 0x0u;
+        case BUS_PRG_RAM:
+            return state->prgRAM.read(addr & 0x1FFF);
+        case BUS_PRG_ROM:
+            return prgPages[(addr - 0x8000) / PRG_PAGE_SIZE][addr % PRG_PAGE_SIZE];
+        case BUS_TRAPPED:
+            return pageTraps[addr >> 8]->read(addr);
+        default:
+            return 0x0u;
+    }
+}
+
+void NES::writePage(BUSPAGE page, uint16_t addr, uint8_t val) {
+    switch (page) {
+        case BUS_RAM:
+            state->wram.write(addr & 0x07FF, val);
+            break;
+        case BUS_PPU:
+            // Rendering changes the odd frame dot skip, so vblank may have moved
+            syncPPU();
+            ppu->writeReg(addr, val);
+            state->vblankDot = state->ppuClock + ppu->dotsUntilVblank();
+            break;
+        case BUS_IO:
+            if (addr == 0x4014) {
+                syncPPU();
+                oamDMA(val);
+            } else if (addr == 0x4016) {
+                // Host input lands on the dot the game latches the pads, not at the start of the frame
+                if (inputQueue)
+                    drainInput();
+                state->controllers[0].strobe(val);
+                state->controllers[1].strobe(val);
+            } else if (addr <= 0x4013 || addr == 0x4015 || addr == 0x4017) {
+                apu->writeReg(addr, val);
+            }
+            break;
+        case BUS_PRG_RAM:
+            state->prgRAM.write(addr & 0x1FFF, val);
+            break;
+        case BUS_TRAPPED:
+            pageTraps[addr >> 8]->write(addr, val);
+            break;
+        default:
+            break;
+    }
+}
+
+void NES::oamDMA(uint8_t page) {
+    // The DMA unit's reads aren't the CPU's, so a trap on the page doesn't see them
+    uint16_t base = (uint16_t) page << 8;
+    BUSPAGE wired = wiredPage(page);
+    for (uint16_t i = 0; i < 256; i++)
+        ppu->writeOAM(readPage(wired, base + i));
+
+    // The CPU is halted for the transfer, one extra cycle to align on odd cycles
+    cpu->cyclesRemaining += 513 + (((state->masterClock + cpu->accessDots) / 3) & 0x1);
+}
+
+void NES::drainInput() {
+    InputEvent event;
+    while (inputQueue->pop(event)) {
+        state->controllers[event.port & 0x1].setButtons(event.buttons);
+        inputPushed[event.port & 0x1] = event.hostTime;
+    }
+}
+
+uint16_t* NES::idleFrameBuffer() {
+    if (presentBuffer)
+        return presentBuffer->back();
+    return externalFrame ? externalFrame : internalFrame;
 }
@@ -0,0 +1,80 @@
+#include <new>
+
+#include "nes.h"
+#include "nes_api.h"
+#include "palette.h"
+
+static_assert(NES_SCREEN_WIDTH == SCREEN_WIDTH && NES_SCREEN_HEIGHT == SCREEN_HEIGHT, "C API screen size is out of date");
+static_assert(NES_PALETTE_ENTRIES == PALETTE_ENTRIES, "C API palette size is out of date");
+static_assert(NES_AUDIO_SAMPLE_RATE == APU_SAMPLE_RATE, "C API sample rate is out of date");
+
+struct nes_instance {
+    NES* nes;                                           // nullptr until a ROM is loaded
+};
+
+nes_instance* nes_create(void) {
+    nes_instance* instance = new (std::nothrow) nes_instance;
+    if (instance)
+        instance->nes = nullptr;
+    return instance;
+}
+
+void nes_destroy(nes_instance* instance) {
+    if (!instance)
+        return;
+    delete instance->nes;
+    delete instance;
+}
+
+int nes_load_rom_from_memory(nes_instance* instance, const uint8_t* rom, size_t size) {
+    delete instance->nes;
+    instance->nes = new (std::nothrow) NES(rom, size);
+    if (!instance->nes || !instance->nes->isLoaded()) {
+        delete instance->nes;
+        instance->nes = nullptr;
+        return -1;
+    }
+    return 0;
+}
+
+int nes_step_frame(nes_instance* instance) {
+    if (!instance->nes)
+        return -1;
+    instance->nes->runFrame();
+    return 0;
+}
+
+void nes_set_input(nes_instance* instance, unsigned int port, uint8_t buttons) {
+    if (instance->nes)
+        instance->nes->setInput((uint8_t) port, buttons);
+}
+
+const uint16_t* nes_get_framebuffer(const nes_instance* instance) {
+    return instance->nes ? instance->nes->frameBuffer() : nullptr;
+}
+
+void nes_get_palette(uint32_t rgba[NES_PALETTE_ENTRIES]) {
+    buildPaletteRGBA(rgba);
+}
+
+size_t nes_get_audio_samples(const nes_instance* instance, const int16_t** samples) {
+    size_t count = 0;
+    *samples = instance->nes ? instance->nes->audioSamples(count) : nullptr;
+    return count;
+}
+
+size_t nes_state_size(const nes_instance* instance) {
+    return instance->nes ? instance->nes->stateSize() : 0;
+}
+
+int nes_save_state(const nes_instance* instance, void* out, size_t size) {
+    if (!instance->nes || !instance->nes->saveState((uint8_t*) out, size))
+        return -1;
+    return 0;
+}
+
+int nes_load_state(nes_instance* instance, const void* state, size_t size) {
+    if (!instance->nes || !instance->nes->loadState((const uint8_t*) state, size))
+        return -1;
+    return 0;
+}
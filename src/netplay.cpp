@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+
+#include "netplay.h"
+
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+NetplaySession::NetplaySession(NES* nes, UdpTransport* transport, uint8_t localPort) {
+    this->nes = nes;
+    this->transport = transport;
+    this->localPort = localPort & 0x1;
+    current = 0;
+    confirmed = 0;
+    std::memset(localInputs, 0, sizeof(localInputs));
+    std::memset(remoteInputs, 0, sizeof(remoteInputs));
+    std::memset(remoteKnown, 0, sizeof(remoteKnown));
+    rollbackFrom = UINT64_MAX;
+    stateSize = nes->stateSize();
+    states.resize((NETPLAY_MAX_ROLLBACK + 1) * stateSize);
+    std::memset(&counters, 0, sizeof(counters));
+}
+
+bool NetplaySession::advance(uint8_t buttons) {
+    receive();
+    if (rollbackFrom != UINT64_MAX)
+        rollback();
+
+    // Running on would mean predicting further than the saved states reach back
+    if (current - confirmed >= NETPLAY_MAX_ROLLBACK) {
+        counters.stalls++;
+        send();
+        return false;
+    }
+
+    unsigned int slot = current % NETPLAY_HISTORY;
+    localInputs[slot] = buttons;
+    if (remoteKnown[slot] != current + 1)
+        remoteInputs[slot] = current ? remoteInputs[(current - 1) % NETPLAY_HISTORY] : 0x0u;
+    nes->setFrameSkip(false);
+    runFrame(current);
+    current++;
+    counters.frames++;
+    send();
+    return true;
+}
+
+void NetplaySession::poll() {
+    receive();
+    if (rollbackFrom != UINT64_MAX)
+        rollback();
+    send();
+}
+
+uint64_t NetplaySession::frame() const {
+    return current;
+}
+
+uint64_t NetplaySession::confirmedFrame() const {
+    return confirmed;
+}
+
+const NetplayStats& NetplaySession::stats() const {
+    return counters;
+}
+
+void NetplaySession::receive() {
+    NetplayPacket packet;
+    int size;
+    while ((size = transport->receive(&packet, sizeof(packet))) >= 0) {
+        if ((size_t) size < offsetof(NetplayPacket, inputs) || packet.magic != NETPLAY_MAGIC
+                || packet.count > NETPLAY_REDUNDANCY || (size_t) size < offsetof(NetplayPacket, inputs) + packet.count)
+            continue;
+
+        // Input from before what's confirmed is old news, and the other side can't be far enough
+        // ahead to send anything past the history
+        for (unsigned int i = 0; i < packet.count; i++) {
+            uint64_t frame = (uint64_t) packet.firstFrame + i;
+            unsigned int slot = frame % NETPLAY_HISTORY;
+            if (frame < confirmed || frame >= confirmed + NETPLAY_HISTORY || remoteKnown[slot] == frame + 1)
+                continue;
+            if (frame < current && remoteInputs[slot] != packet.inputs[i])
+                rollbackFrom = std::min(rollbackFrom, frame);
+            remoteInputs[slot] = packet.inputs[i];
+            remoteKnown[slot] = frame + 1;
+        }
+        while (remoteKnown[confirmed % NETPLAY_HISTORY] == confirmed + 1)
+            confirmed++;
+    }
+}
+
+void NetplaySession::send() {
+    NetplayPacket packet;
+    uint64_t first = current > NETPLAY_REDUNDANCY ? current - NETPLAY_REDUNDANCY : 0;
+    packet.magic = NETPLAY_MAGIC;
+    packet.firstFrame = (uint32_t) first;
+    packet.count = (uint8_t) (current - first);
+    for (uint64_t frame = first; frame < current; frame++)
+        packet.inputs[frame - first] = localInputs[frame % NETPLAY_HISTORY];
+    transport->send(&packet, offsetof(NetplayPacket, inputs) + packet.count);
+}
+
+void NetplaySession::rollback() {
+    // Frames still unheard of are predicted again from the corrected ones before them
+    uint64_t start = nowNs();
+    nes->loadState(stateFor(rollbackFrom), stateSize);
+    nes->setFrameSkip(true);
+    for (uint64_t frame = rollbackFrom; frame < current; frame++) {
+        unsigned int slot = frame % NETPLAY_HISTORY;
+        if (remoteKnown[slot] != frame + 1)
+            remoteInputs[slot] = remoteInputs[(frame - 1) % NETPLAY_HISTORY];
+        runFrame(frame);
+    }
+
+    uint64_t ns = nowNs() - start;
+    counters.rollbacks++;
+    counters.resimulatedFrames += current - rollbackFrom;
+    counters.resimulationNs += ns;
+    counters.maxResimulationNs = std::max(counters.maxResimulationNs, ns);
+    rollbackFrom = UINT64_MAX;
+}
+
+void NetplaySession::runFrame(uint64_t frame) {
+    unsigned int slot = frame % NETPLAY_HISTORY;
+    nes->saveState(stateFor(frame), stateSize);
+    nes->setInput(localPort, localInputs[slot]);
+    nes->setInput(localPort ^ 0x1, remoteInputs[slot]);
+    nes->runFrame();
+}
+
+uint8_t* NetplaySession::stateFor(uint64_t frame) {
+    return states.data() + (frame % (NETPLAY_MAX_ROLLBACK + 1)) * stateSize;
+}
@@ -0,0 +1,208 @@
+#include <cmath>
+#include <cstring>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "ntsc_filter.h"
+
+const unsigned int ROW_SAMPLES = SCREEN_WIDTH * NTSC_SAMPLES_PER_PIXEL;
+const unsigned int ROW_PADDING = 4;                     // Black samples either side of the picture
+const unsigned int WINDOW_LEAD = 2;                     // Window for pixel x starts at sample 8x - 2
+
+// Composite voltages relative to sync for the four luma levels, low and high half of the wave
+static const float LEVEL_LOW[4] = { 0.350f, 0.518f, 0.962f, 1.550f };
+static const float LEVEL_HIGH[4] = { 1.094f, 1.506f, 1.962f, 1.962f };
+static const float BLACK_LEVEL = 0.518f;
+static const float WHITE_LEVEL = 1.962f;
+static const float EMPHASIS_ATTENUATION = 0.746f;
+
+// Decoder tuning: subcarrier phase offset (in samples) so hues line up with the RGB palette, and
+// the display gamma the output is corrected for
+static const float HUE_SHIFT = 3.9f;
+static const float DISPLAY_GAMMA = 2.0f;
+
+#if defined(__SSE2__)
+static inline float sum4(__m128 v) {
+    __m128 pairs = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 0x55)));
+}
+#endif
+
+static inline unsigned int gammaIndex(float v) {
+    if (v <= 0.0f)
+        return 0;
+    if (v >= 1.0f)
+        return 1023;
+    return (unsigned int) (v * 1023.0f + 0.5f);
+}
+
+NtscFilter::NtscFilter(unsigned int helpers) {
+    for (unsigned int value = 0; value < PALETTE_ENTRIES; value++) {
+        int hue = value & 0x0F;
+        int luma = (value >> 4) & 0x3;
+        int emphasis = value >> 6;                      // Bit 0 red, bit 1 green, bit 2 blue
+
+        // Hues 14 and 15 are black, hue 0 is flat at the high level and 13-15 flat at the low
+        if (hue > 13)
+            luma = 1;
+        float low = LEVEL_LOW[luma];
+        float high = LEVEL_HIGH[luma];
+        if (hue == 0)
+            low = high;
+        if (hue > 12)
+            high = low;
+
+        for (int phase = 0; phase < NTSC_PHASES; phase++) {
+            auto inPhase = [phase](int colour) { return (colour + phase) % NTSC_PHASES < 6; };
+            float level = inPhase(hue) ? high : low;
+            if (((emphasis & 0x1) && inPhase(0)) || ((emphasis & 0x2) && inPhase(4)) || ((emphasis & 0x4) && inPhase(8)))
+                level *= EMPHASIS_ATTENUATION;
+
+            // Stored twice over so a pixel's eight samples never need wrapping
+            level = (level - BLACK_LEVEL) / (WHITE_LEVEL - BLACK_LEVEL);
+            signalLevel[value][phase] = level;
+            signalLevel[value][phase + NTSC_PHASES] = level;
+        }
+    }
+
+    for (int start = 0; start < NTSC_PHASES; start++) {
+        for (int k = 0; k < NTSC_PHASES; k++) {
+            float angle = 3.14159265f * (start + k + HUE_SHIFT) / 6.0f;
+            window[start][0][k] = 1.0f / NTSC_PHASES;
+            window[start][1][k] = std::cos(angle) / NTSC_PHASES;
+            window[start][2][k] = std::sin(angle) / NTSC_PHASES;
+        }
+    }
+
+    for (unsigned int i = 0; i < 1024; i++) {
+        float v = 255.95f * std::pow(i / 1023.0f, 2.2f / DISPLAY_GAMMA);
+        gamma[i] = (uint8_t) (v > 255.0f ? 255.0f : v);
+    }
+
+    generation = 0;
+    pending = 0;
+    stopping = false;
+    frame = nullptr;
+    frameNumber = 0;
+    out = nullptr;
+    for (unsigned int i = 0; i < helpers; i++)
+        threads.emplace_back(&NtscFilter::helperLoop, this, i + 1);
+}
+
+NtscFilter::~NtscFilter() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    workReady.notify_all();
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+void NtscFilter::apply(const uint16_t* frame, uint64_t frameNumber, uint32_t* out) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        this->frame = frame;
+        this->frameNumber = frameNumber;
+        this->out = out;
+        pending = (unsigned int) threads.size();
+        generation++;
+    }
+    workReady.notify_all();
+
+    // The caller takes the first band rather than sitting idle
+    filterRows(0);
+
+    std::unique_lock<std::mutex> guard(lock);
+    workDone.wait(guard, [this] { return pending == 0; });
+}
+
+void NtscFilter::helperLoop(unsigned int band) {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            workReady.wait(guard, [this, seen] { return generation != seen || stopping; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+
+        filterRows(band);
+
+        bool last;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            last = --pending == 0;
+        }
+        if (last)
+            workDone.notify_one();
+    }
+}
+
+void NtscFilter::filterRows(unsigned int band) {
+    alignas(16) float signal[ROW_SAMPLES + 2 * ROW_PADDING];
+    std::memset(signal, 0, sizeof(signal));
+
+    unsigned int bands = (unsigned int) threads.size() + 1;
+    unsigned int first = band * SCREEN_HEIGHT / bands;
+    unsigned int last = (band + 1) * SCREEN_HEIGHT / bands;
+    for (unsigned int row = first; row < last; row++)
+        filterRow(row, signal + ROW_PADDING);
+}
+
+void NtscFilter::filterRow(unsigned int row, float* signal) {
+    const uint16_t* pixels = frame + row * SCREEN_WIDTH;
+    uint32_t* rgba = out + row * SCREEN_WIDTH;
+
+    // A scanline is 341 dots of 8 samples, 4 samples of phase more than a whole number of
+    // subcarrier cycles, and a frame of 262 lines moves the phase by 4 samples in the same way
+    unsigned int rowPhase = (unsigned int) (((frameNumber + row) * 4) % NTSC_PHASES);
+
+    for (unsigned int x = 0; x < SCREEN_WIDTH; x++) {
+        unsigned int phase = (rowPhase + x * NTSC_SAMPLES_PER_PIXEL) % NTSC_PHASES;
+        const float* level = &signalLevel[pixels[x] & (PALETTE_ENTRIES - 1)][phase];
+        std::memcpy(signal + x * NTSC_SAMPLES_PER_PIXEL, level, NTSC_SAMPLES_PER_PIXEL * sizeof(float));
+    }
+
+    for (unsigned int x = 0; x < SCREEN_WIDTH; x++) {
+        // One subcarrier cycle of samples centred on the pixel
+        const float* samples = signal + x * NTSC_SAMPLES_PER_PIXEL - WINDOW_LEAD;
+        unsigned int start = (rowPhase + x * NTSC_SAMPLES_PER_PIXEL + NTSC_PHASES - WINDOW_LEAD) % NTSC_PHASES;
+        const float (*weights)[NTSC_PHASES] = window[start];
+
+        float y, i, q;
+#if defined(__SSE2__)
+        __m128 a = _mm_loadu_ps(samples);
+        __m128 b = _mm_loadu_ps(samples + 4);
+        __m128 c = _mm_loadu_ps(samples + 8);
+        float sums[3];
+        for (int component = 0; component < 3; component++) {
+            const float* w = weights[component];
+            __m128 sum = _mm_mul_ps(a, _mm_load_ps(w));
+            sum = _mm_add_ps(sum, _mm_mul_ps(b, _mm_load_ps(w + 4)));
+            sum = _mm_add_ps(sum, _mm_mul_ps(c, _mm_load_ps(w + 8)));
+            sums[component] = sum4(sum);
+        }
+        y = sums[0];
+        i = sums[1];
+        q = sums[2];
+#else
+        y = i = q = 0.0f;
+        for (int k = 0; k < NTSC_PHASES; k++) {
+            y += samples[k] * weights[0][k];
+            i += samples[k] * weights[1][k];
+            q += samples[k] * weights[2][k];
+        }
+#endif
+
+        // FCC YIQ to RGB
+        uint8_t colour[4];
+        colour[0] = gamma[gammaIndex(y + 0.946882f * i + 0.623557f * q)];
+        colour[1] = gamma[gammaIndex(y - 0.274788f * i - 0.635691f * q)];
+        colour[2] = gamma[gammaIndex(y - 1.108545f * i + 1.709007f * q)];
+        colour[3] = 0xFF;
+        std::memcpy(&rgba[x], colour, sizeof(colour));
+    }
+}
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+#include "cpu.h"
+#include "opcode_profile.h"
+
+OpcodeProfile::OpcodeProfile() : counts(256 * 256, 0u) {
+}
+
+uint64_t OpcodeProfile::pairCount(uint8_t first, uint8_t second) const {
+    return counts[first << 8 | second];
+}
+
+uint64_t OpcodeProfile::total() const {
+    uint64_t sum = 0;
+    for (uint64_t count : counts)
+        sum += count;
+    return sum;
+}
+
+void OpcodeProfile::clear() {
+    std::fill(counts.begin(), counts.end(), 0u);
+}
+
+bool OpcodeProfile::save(const char* path) const {
+    std::ofstream file(path);
+    if (!file.is_open())
+        return false;
+
+    vector<unsigned int> order;
+    for (unsigned int pair = 0; pair < counts.size(); pair++) {
+        if (counts[pair])
+            order.push_back(pair);
+    }
+    std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) { return counts[a] > counts[b]; });
+
+    // Mnemonics trail each line for whoever reads the file, load() ignores them
+    for (unsigned int pair : order) {
+        file << std::hex << std::setw(2) << std::setfill('0') << (pair >> 8) << " " << std::setw(2) << (pair & 0xFF)
+             << std::dec << std::setfill(' ') << " " << counts[pair] << " " << MOS6502::mnemonic(pair >> 8) << " "
+             << MOS6502::mnemonic(pair & 0xFF) << std::endl;
+    }
+    return file.good();
+}
+
+bool OpcodeProfile::load(const char* path) {
+    std::ifstream file(path);
+    if (!file.is_open())
+        return false;
+
+    unsigned int first, second;
+    uint64_t count;
+    string rest;
+    while (file >> std::hex >> first >> second >> std::dec >> count) {
+        std::getline(file, rest);
+        if (first > 0xFF || second > 0xFF)
+            return false;
+        counts[first << 8 | second] += count;
+    }
+    return file.eof();
+}
+
+FusionTable::FusionTable() {
+    std::memset(pairs, 0, sizeof(pairs));
+    pairCount = 0;
+}
+
+FusionTable FusionTable::fromProfile(const OpcodeProfile& profile) {
+    struct Pair {
+        uint8_t first;
+        uint8_t second;
+        uint64_t count;
+    };
+    vector<Pair> candidates;
+    for (unsigned int first = 0; first < 256; first++) {
+        for (unsigned int second = 0; second < 256; second++) {
+            uint64_t count = profile.pairCount(first, second);
+            if (count && MOS6502::fusible(first, second))
+                candidates.push_back({ (uint8_t) first, (uint8_t) second, count });
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Pair& a, const Pair& b) { return a.count > b.count; });
+
+    FusionTable table;
+    uint64_t threshold = (uint64_t) (profile.total() * FUSION_MIN_SHARE);
+    for (const Pair& pair : candidates) {
+        if (table.size() == FUSION_MAX_PAIRS || pair.count < threshold)
+            break;
+        table.add(pair.first, pair.second);
+    }
+    return table;
+}
+
+bool FusionTable::add(uint8_t first, uint8_t second) {
+    if (!MOS6502::fusible(first, second))
+        return false;
+    if (!fuses(first, second)) {
+        pairs[first][second >> 6] |= (uint64_t) 1 << (second & 0x3F);
+        pairCount++;
+    }
+    return true;
+}
+
+size_t FusionTable::size() const {
+    return pairCount;
+}
@@ -0,0 +1,70 @@
+#include <cstring>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "palette.h"
+
+static const uint8_t NTSC_PALETTE[64][3] = {
+    { 84,  84,  84}, {  0,  30, 116}, {  8,  16, 144}, { 48,   0, 136},
+    { 68,   0, 100}, { 92,   0,  48}, { 84,   4,   0}, { 60,  24,   0},
+    { 32,  42,   0}, {  8,  58,   0}, {  0,  64,   0}, {  0,  60,   0},
+    {  0,  50,  60}, {  0,   0,   0}, {  0,   0,   0}, {  0,   0,   0},
+    {152, 150, 152}, {  8,  76, 196}, { 48,  50, 236}, { 92,  30, 228},
+    {136,  20, 176}, {160,  20, 100}, {152,  34,  32}, {120,  60,   0},
+    { 84,  90,   0}, { 40, 114,   0}, {  8, 124,   0}, {  0, 118,  40},
+    {  0, 102, 120}, {  0,   0,   0}, {  0,   0,   0}, {  0,   0,   0},
+    {236, 238, 236}, { 76, 154, 236}, {120, 124, 236}, {176,  98, 236},
+    {228,  84, 236}, {236,  88, 180}, {236, 106, 100}, {212, 136,  32},
+    {160, 170,   0}, {116, 196,   0}, { 76, 208,  32}, { 56, 204, 108},
+    { 56, 180, 204}, { 60,  60,  60}, {  0,   0,   0}, {  0,   0,   0},
+    {236, 238, 236}, {168, 204, 236}, {188, 188, 236}, {212, 178, 236},
+    {236, 174, 236}, {236, 174, 212}, {236, 180, 176}, {228, 196, 144},
+    {204, 210, 120}, {180, 222, 120}, {168, 226, 144}, {152, 226, 180},
+    {160, 214, 228}, {160, 162, 160}, {  0,   0,   0}, {  0,   0,   0},
+};
+
+void buildPaletteRGBA(uint32_t table[PALETTE_ENTRIES]) {
+    for (unsigned int entry = 0; entry < PALETTE_ENTRIES; entry++) {
+        const uint8_t* base = NTSC_PALETTE[entry & 0x3F];
+        uint8_t emphasis = entry >> 6;                  // Bit 0 red, bit 1 green, bit 2 blue
+
+        uint8_t rgba[4];
+        for (int channel = 0; channel < 3; channel++) {
+            // Emphasising a channel attenuates the other two (all three if everything is set)
+            bool dimmed = emphasis && (emphasis == 0x7 || !(emphasis & (1 << channel)));
+            rgba[channel] = dimmed ? (uint8_t) (base[channel] * 816 / 1000) : base[channel];
+        }
+        rgba[3] = 0xFF;
+
+        std::memcpy(&table[entry], rgba, sizeof(rgba));
+    }
+}
+
+void convertToRGBA(const uint16_t* pixels, uint32_t* out, unsigned int count, const uint32_t table[PALETTE_ENTRIES]) {
+    unsigned int i = 0;
+#if defined(__AVX2__)
+    // Widen eight pixels to 32-bit indices and gather their table entries in one go
+    const __m256i valueMask = _mm256_set1_epi32(PALETTE_ENTRIES - 1);
+    for (; i + 8 <= count; i += 8) {
+        __m256i index = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) (pixels + i)));
+        index = _mm256_and_si256(index, valueMask);
+        __m256i rgba = _mm256_i32gather_epi32((const int*) table, index, 4);
+        _mm256_storeu_si256((__m256i*) (out + i), rgba);
+    }
+#else
+    // Four independent lookups per iteration keep the loads overlapped
+    for (; i + 4 <= count; i += 4) {
+        uint32_t a = table[pixels[i] & (PALETTE_ENTRIES - 1)];
+        uint32_t b = table[pixels[i + 1] & (PALETTE_ENTRIES - 1)];
+        uint32_t c = table[pixels[i + 2] & (PALETTE_ENTRIES - 1)];
+        uint32_t d = table[pixels[i + 3] & (PALETTE_ENTRIES - 1)];
+        out[i] = a;
+        out[i + 1] = b;
+        out[i + 2] = c;
+        out[i + 3] = d;
+    }
+#endif
+    for (; i < count; i++)
+        out[i] = table[pixels[i] & (PALETTE_ENTRIES - 1)];
+}
@@ -1,5 +1,496 @@
+#include <cstring>
+
 #include "ppu.h"
+#include "sprite_range.h"
+
+// Storage page ($000, $400, $800, $C00 of VRAM) shown at $2000, $2400, $2800 and $2C00 in each mode
+static const uint8_t NAMETABLE_BANKS[5][4] = {
+    { 0, 0, 1, 1 },                                     // HORIZONTAL
+    { 0, 1, 0, 1 },                                     // VERTICAL
+    { 0, 0, 0, 0 },                                     // SINGLE_SCREEN_LOWER
+    { 1, 1, 1, 1 },                                     // SINGLE_SCREEN_UPPER
+    { 0, 1, 2, 3 },                                     // FOUR_SCREEN
+};
 
 PPU::PPU() {
-    this->memory = (uint8_t*) malloc(PPU_MEM_SIZE * sizeof(uint8_t));
+    std::memset(memory, 0, sizeof(memory));
+    rebuildSpriteCache();
+    std::memset(paletteRam, 0, sizeof(paletteRam));
+    pixels = nullptr;
+    chrWritable = false;
+    mirroring = HORIZONTAL;
+    skipComposition = false;
+    reset();
+}
+
+void PPU::reset() {
+    ctrl = 0x0u;
+    mask = 0x0u;
+    status = 0x0u;
+    oamAddr = 0x0u;
+    vramAddr = 0x0u;
+    tempAddr = 0x0u;
+    fineX = 0x0u;
+    writeToggle = false;
+    readBuffer = 0x0u;
+    dataLatch = 0x0u;
+
+    scanline = 0;
+    dot = 0;
+    oddFrame = false;
+    frameComplete = false;
+    nmi = false;
+
+    nextTileId = nextTileAttr = nextTileLo = nextTileHi = 0x0u;
+    patternShiftLo = patternShiftHi = attribShiftLo = attribShiftHi = 0x0u;
+    spriteCount = 0;
+    spriteZeroOnLine = false;
+}
+
+void PPU::cycle() {
+    bool visibleLine = scanline < 240;
+    bool preRenderLine = scanline == 261;
+
+    if (preRenderLine && dot == 1) {
+        // Clear vblank, sprite 0 hit and sprite overflow
+        status &= 0x1F;
+    }
+
+    if ((visibleLine || preRenderLine) && renderingEnabled()) {
+        if ((dot >= 2 && dot <= 257) || (dot >= 321 && dot <= 337))
+            fetchBackground();
+
+        if (dot == 256) {
+            incrementScrollY();
+        } else if (dot == 257) {
+            // Copy horizontal scroll from t to v
+            vramAddr = (vramAddr & ~0x041F) | (tempAddr & 0x041F);
+            if (visibleLine)
+                evaluateSprites();
+            else
+                spriteCount = 0;
+        } else if (preRenderLine && dot >= 280 && dot <= 304) {
+            // Copy vertical scroll from t to v
+            vramAddr = (vramAddr & ~0x7BE0) | (tempAddr & 0x7BE0);
+        }
+    }
+
+    if (visibleLine && dot >= 1 && dot <= 256) {
+        if (skipComposition)
+            checkSpriteZeroHit();
+        else
+            renderPixel();
+    }
+
+    if (scanline == 241 && dot == 1) {
+        status |= 0x80;
+        if (ctrl & 0x80)
+            nmi = true;
+        frameComplete = true;
+    }
+
+    // Advance, odd frames skip the last dot of the pre-render line while rendering
+    dot++;
+    if (preRenderLine && dot == 340 && oddFrame && renderingEnabled())
+        dot++;
+    if (dot > 340) {
+        dot = 0;
+        scanline++;
+        if (scanline > 261) {
+            scanline = 0;
+            oddFrame = !oddFrame;
+        }
+    }
+}
+
+uint8_t PPU::readReg(uint16_t addr) {
+    uint8_t data = dataLatch;
+
+    switch (addr & 0x7) {
+        case 0x2: // PPUSTATUS
+            data = (status & 0xE0) | (dataLatch & 0x1F);
+            status &= ~0x80;
+            writeToggle = false;
+            break;
+        case 0x4: // OAMDATA
+            data = memory[oamAddr];
+            break;
+        case 0x7: // PPUDATA
+            // Reads below the palette come through a one byte buffer
+            data = readBuffer;
+            readBuffer = ppuRead(vramAddr);
+            if ((vramAddr & 0x3FFF) >= 0x3F00) {
+                data = (dataLatch & 0xC0) | ppuRead(vramAddr);
+                readBuffer = ppuRead(vramAddr - 0x1000);
+            }
+            vramAddr += (ctrl & 0x04) ? 32 : 1;
+            break;
+        default:
+            break;
+    }
+
+    dataLatch = data;
+    return data;
+}
+
+void PPU::writeReg(uint16_t addr, uint8_t val) {
+    dataLatch = val;
+
+    switch (addr & 0x7) {
+        case 0x0: // PPUCTRL
+            // Enabling NMI during vblank raises one straight away
+            if (!(ctrl & 0x80) && (val & 0x80) && (status & 0x80))
+                nmi = true;
+            if ((ctrl ^ val) & 0x20)
+                oamGeneration++;
+            ctrl = val;
+            tempAddr = (tempAddr & ~0x0C00) | ((uint16_t) (val & 0x03) << 10);
+            break;
+        case 0x1: // PPUMASK
+            mask = val;
+            break;
+        case 0x3: // OAMADDR
+            oamAddr = val;
+            break;
+        case 0x4: // OAMDATA
+            writeOAMByte(val);
+            break;
+        case 0x5: // PPUSCROLL
+            if (!writeToggle) {
+                tempAddr = (tempAddr & ~0x001F) | (val >> 3);
+                fineX = val & 0x07;
+            } else {
+                tempAddr = (tempAddr & ~0x73E0) | ((uint16_t) (val & 0x07) << 12) | ((uint16_t) (val & 0xF8) << 2);
+            }
+            writeToggle = !writeToggle;
+            break;
+        case 0x6: // PPUADDR
+            if (!writeToggle) {
+                tempAddr = (tempAddr & 0x00FF) | ((uint16_t) (val & 0x3F) << 8);
+            } else {
+                tempAddr = (tempAddr & 0xFF00) | val;
+                vramAddr = tempAddr;
+            }
+            writeToggle = !writeToggle;
+            break;
+        case 0x7: // PPUDATA
+            ppuWrite(vramAddr, val);
+            vramAddr += (ctrl & 0x04) ? 32 : 1;
+            break;
+        default:
+            break;
+    }
+}
+
+void PPU::writeOAM(uint8_t val) {
+    writeOAMByte(val);
+}
+
+void PPU::writeOAMByte(uint8_t val) {
+    // Only Y coordinates feed the cached sprite masks, rewriting the same Y keeps them valid
+    if ((oamAddr & 0x3) == 0 && oamY[oamAddr >> 2] != val) {
+        oamY[oamAddr >> 2] = val;
+        oamGeneration++;
+    }
+    memory[oamAddr++] = val;
+}
+
+void PPU::rebuildSpriteCache() {
+    for (unsigned int n = 0; n < 64; n++)
+        oamY[n] = memory[n * 4];
+    std::memset(lineGeneration, 0, sizeof(lineGeneration));
+    oamGeneration = 1;
+}
+
+void PPU::setCHR(uint8_t* chr, bool writable) {
+    if (writable)
+        this->chr.attach(chr);
+    else
+        this->chr.map(chr);
+    chrWritable = writable;
+}
+
+void PPU::setVRAM(uint8_t* vram) {
+    this->vram.attach(vram);
+    this->vram.mirror(NAMETABLE_BANKS[mirroring]);
+}
+
+void PPU::setMirroring(MIRRORING mode) {
+    mirroring = mode;
+    vram.mirror(NAMETABLE_BANKS[mode]);
+}
+
+void PPU::setSkipComposition(bool skip) {
+    skipComposition = skip;
+}
+
+uint32_t PPU::dotsUntilVblank() const {
+    // Vblank starts at scanline 241 dot 1, which may be in the next frame
+    const uint32_t vblankPos = 241 * 341 + 1;
+    uint32_t pos = scanline * 341 + dot;
+    if (pos <= vblankPos)
+        return vblankPos - pos;
+
+    // Count the dot odd frames skip if the pre-render line hasn't reached it yet
+    uint32_t dots = 262 * 341 - pos + vblankPos;
+    if (oddFrame && renderingEnabled() && pos <= 261 * 341 + 339)
+        dots--;
+    return dots;
+}
+
+const uint16_t* PPU::frame() const {
+    return pixels;
+}
+
+uint8_t PPU::ppuRead(uint16_t addr) {
+    addr &= 0x3FFF;
+
+    if (addr < 0x2000) {
+        return chr.read(addr);
+    } else if (addr < 0x3F00) {
+        // $3000-$3EFF mirrors the nametables
+        return vram.read(addr & 0x0FFF);
+    }
+    return paletteRam[addr & 0x1F];
+}
+
+void PPU::ppuWrite(uint16_t addr, uint8_t val) {
+    addr &= 0x3FFF;
+
+    if (addr < 0x2000) {
+        if (chrWritable)
+            chr.write(addr, val);
+    } else if (addr < 0x3F00) {
+        vram.write(addr & 0x0FFF, val);
+    } else {
+        // Backdrop entries of the sprite palettes and the background ones are the same memory
+        uint8_t index = addr & 0x1F;
+        paletteRam[index] = val & 0x3F;
+        if ((index & 0x03) == 0)
+            paletteRam[index ^ 0x10] = val & 0x3F;
+    }
+}
+
+bool PPU::renderingEnabled() const {
+    return mask & 0x18;
+}
+
+void PPU::fetchBackground() {
+    // Shift one pixel out of the pipeline, then do this dot's part of the eight dot fetch
+    patternShiftLo <<= 1;
+    patternShiftHi <<= 1;
+    attribShiftLo <<= 1;
+    attribShiftHi <<= 1;
+
+    switch ((dot - 1) & 0x7) {
+        case 0:
+            loadBackgroundShifters();
+            nextTileId = vram.read(vramAddr & 0x0FFF);
+            break;
+        case 2: {
+            uint8_t attr = vram.read(0x03C0 | (vramAddr & 0x0C00) | ((vramAddr >> 4) & 0x38) | ((vramAddr >> 2) & 0x07));
+            if (vramAddr & 0x0040)
+                attr >>= 4;
+            if (vramAddr & 0x0002)
+                attr >>= 2;
+            nextTileAttr = attr & 0x03;
+            break;
+        }
+        case 4:
+            nextTileLo = chr.read(((uint16_t) (ctrl & 0x10) << 8) + ((uint16_t) nextTileId << 4) + ((vramAddr >> 12) & 0x7));
+            break;
+        case 6:
+            nextTileHi = chr.read(((uint16_t) (ctrl & 0x10) << 8) + ((uint16_t) nextTileId << 4) + ((vramAddr >> 12) & 0x7) + 8);
+            break;
+        case 7:
+            incrementScrollX();
+            break;
+    }
+}
+
+void PPU::loadBackgroundShifters() {
+    patternShiftLo = (patternShiftLo & 0xFF00) | nextTileLo;
+    patternShiftHi = (patternShiftHi & 0xFF00) | nextTileHi;
+    attribShiftLo = (attribShiftLo & 0xFF00) | ((nextTileAttr & 0x1) ? 0xFF : 0x00);
+    attribShiftHi = (attribShiftHi & 0xFF00) | ((nextTileAttr & 0x2) ? 0xFF : 0x00);
+}
+
+void PPU::incrementScrollX() {
+    // Coarse X wraps into the horizontally adjacent nametable
+    if ((vramAddr & 0x001F) == 31) {
+        vramAddr &= ~0x001F;
+        vramAddr ^= 0x0400;
+    } else {
+        vramAddr++;
+    }
+}
+
+void PPU::incrementScrollY() {
+    // Fine Y first, then coarse Y which wraps at row 29 into the vertically adjacent nametable
+    if ((vramAddr & 0x7000) != 0x7000) {
+        vramAddr += 0x1000;
+        return;
+    }
+
+    vramAddr &= ~0x7000;
+    uint16_t coarseY = (vramAddr & 0x03E0) >> 5;
+    if (coarseY == 29) {
+        coarseY = 0;
+        vramAddr ^= 0x0800;
+    } else if (coarseY == 31) {
+        coarseY = 0;
+    } else {
+        coarseY++;
+    }
+    vramAddr = (vramAddr & ~0x03E0) | (coarseY << 5);
+}
+
+uint64_t PPU::spritesInRange(int line, int height) const {
+#if defined(__AVX2__) && !defined(PPU_SCALAR_SPRITES)
+    return spritesInRangeAVX2(oamY, line, height);
+#elif SPRITE_RANGE_SSE2 && !defined(PPU_SCALAR_SPRITES)
+    return spritesInRangeSSE2(oamY, line, height);
+#else
+    return spritesInRangeScalar(oamY, line, height);
+#endif
+}
+
+void PPU::evaluateSprites() {
+    // Sprites are drawn one line below their OAM Y, so the current scanline selects the next one's
+    int height = (ctrl & 0x20) ? 16 : 8;
+    if (lineGeneration[scanline] != oamGeneration) {
+        lineSprites[scanline] = spritesInRange(scanline, height);
+        lineGeneration[scanline] = oamGeneration;
+    }
+
+    uint64_t inRange = lineSprites[scanline];
+    spriteCount = 0;
+    spriteZeroOnLine = inRange & 0x1;
+
+    // Take the first eight in OAM order
+    int n = 64;
+    while (inRange && spriteCount < 8) {
+        n = __builtin_ctzll(inRange);
+        inRange &= inRange - 1;
+
+        int row = scanline - oamY[n];
+        uint8_t tile = memory[n * 4 + 1];
+        uint8_t attr = memory[n * 4 + 2];
+        if (attr & 0x80)
+            row = height - 1 - row;
+
+        uint16_t addr;
+        if (height == 16)
+            addr = ((uint16_t) (tile & 0x01) << 12) | ((uint16_t) ((tile & 0xFE) + (row >> 3)) << 4) | (row & 0x7);
+        else
+            addr = ((uint16_t) (ctrl & 0x08) << 9) | ((uint16_t) tile << 4) | row;
+
+        uint8_t lo = chr.read(addr);
+        uint8_t hi = chr.read(addr + 8);
+        if (!(attr & 0x40)) {
+            // Store patterns with the leftmost pixel in bit 0
+            auto reverse = [](uint8_t b) {
+                b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+                b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+                b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
+                return b;
+            };
+            lo = reverse(lo);
+            hi = reverse(hi);
+        }
+
+        spriteX[spriteCount] = memory[n * 4 + 3];
+        spriteAttr[spriteCount] = attr;
+        spritePatternLo[spriteCount] = lo;
+        spritePatternHi[spriteCount] = hi;
+        spriteCount++;
+    }
+
+    // Overflow is only checked once eight sprites were found. The hardware bug walks diagonally
+    // through OAM from there, comparing tile, attribute and X bytes as if they were Y, so this
+    // part can't use the Y mask.
+    if (spriteCount < 8)
+        return;
+    int m = 0;
+    for (n++; n < 64; n++) {
+        int row = scanline - memory[n * 4 + m];
+        if (row >= 0 && row < height) {
+            status |= 0x20;
+            break;
+        }
+        m = (m + 1) & 0x3;
+    }
+}
+
+void PPU::renderPixel() {
+    int x = dot - 1;
+
+    uint8_t bgPixel = 0x0u;
+    uint8_t bgPalette = 0x0u;
+    if ((mask & 0x08) && (x >= 8 || (mask & 0x02))) {
+        uint16_t bit = 0x8000 >> fineX;
+        bgPixel = ((patternShiftHi & bit) ? 0x2 : 0x0) | ((patternShiftLo & bit) ? 0x1 : 0x0);
+        bgPalette = ((attribShiftHi & bit) ? 0x2 : 0x0) | ((attribShiftLo & bit) ? 0x1 : 0x0);
+    }
+
+    uint8_t fgPixel = 0x0u;
+    uint8_t fgPalette = 0x0u;
+    bool fgPriority = false;
+    bool spriteZero = false;
+    if ((mask & 0x10) && (x >= 8 || (mask & 0x04))) {
+        for (int i = 0; i < spriteCount; i++) {
+            int offset = x - spriteX[i];
+            if (offset < 0 || offset >= 8)
+                continue;
+
+            uint8_t pixel = (((spritePatternHi[i] >> offset) & 0x1) << 1) | ((spritePatternLo[i] >> offset) & 0x1);
+            if (pixel == 0)
+                continue;
+
+            fgPixel = pixel;
+            fgPalette = (spriteAttr[i] & 0x03) + 4;
+            fgPriority = !(spriteAttr[i] & 0x20);
+            spriteZero = i == 0 && spriteZeroOnLine;
+            break;
+        }
+    }
+
+    uint8_t pixel = 0x0u;
+    uint8_t palette = 0x0u;
+    if (bgPixel && fgPixel) {
+        if (spriteZero && x != 255)
+            status |= 0x40;
+        pixel = fgPriority ? fgPixel : bgPixel;
+        palette = fgPriority ? fgPalette : bgPalette;
+    } else if (fgPixel) {
+        pixel = fgPixel;
+        palette = fgPalette;
+    } else if (bgPixel) {
+        pixel = bgPixel;
+        palette = bgPalette;
+    }
+
+    uint8_t colour = paletteRam[(palette << 2) | pixel] & ((mask & 0x01) ? 0x30 : 0x3F);
+    pixels[scanline * SCREEN_WIDTH + x] = ((uint16_t) (mask & 0xE0) << 1) | colour;
+}
+
+void PPU::checkSpriteZeroHit() {
+    // The only thing a pixel can change is the sprite 0 hit flag, and only under sprite 0
+    if (!spriteZeroOnLine || (status & 0x40))
+        return;
+
+    int x = dot - 1;
+    int offset = x - spriteX[0];
+    if (offset < 0 || offset >= 8 || x == 255)
+        return;
+
+    // Same conditions renderPixel() applies: both layers on and neither clipped at the left edge
+    if ((mask & 0x18) != 0x18 || (x < 8 && (mask & 0x06) != 0x06))
+        return;
+
+    uint16_t bit = 0x8000 >> fineX;
+    bool bgOpaque = (patternShiftLo | patternShiftHi) & bit;
+    bool fgOpaque = ((spritePatternLo[0] | spritePatternHi[0]) >> offset) & 0x1;
+    if (bgOpaque && fgOpaque)
+        status |= 0x40;
 }
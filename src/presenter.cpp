@@ -0,0 +1,128 @@
+#include <chrono>
+#include <cstring>
+
+#include "metrics.h"
+#include "presenter.h"
+
+// How long the presenter sleeps when no new frame is waiting
+const std::chrono::microseconds POLL_INTERVAL(200);
+
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Presenter::Presenter() {
+    latencyHistogram = new uint32_t[LATENCY_BUCKETS]();
+    presented = 0;
+    latencySum = 0;
+    latencyMax = 0;
+}
+
+Presenter::~Presenter() {
+    delete[] latencyHistogram;
+}
+
+void Presenter::run(TripleBuffer& frames, const EmulationThread& emulation) {
+    while (true) {
+        // Check before consuming so the last frame published is never missed
+        bool emulationDone = emulation.finished();
+
+        if (frames.consume()) {
+            const TripleBuffer::Slot& slot = frames.front();
+            present(slot.frame);
+            recordLatency(nowNs() - slot.publishTime);
+        } else if (emulationDone) {
+            break;
+        } else {
+            std::this_thread::sleep_for(POLL_INTERVAL);
+        }
+    }
+}
+
+PresentStats Presenter::stats(const TripleBuffer& frames) const {
+    PresentStats stats;
+    stats.presented = presented;
+    stats.dropped = frames.dropped();
+    stats.meanLatency = presented ? (double) latencySum / presented / 1000.0 : 0.0;
+    stats.p50Latency = percentile(0.50);
+    stats.p99Latency = percentile(0.99);
+    stats.maxLatency = latencyMax / 1000.0;
+    return stats;
+}
+
+void Presenter::recordLatency(uint64_t ns) {
+    uint64_t bucket = ns / LATENCY_BUCKET_NS;
+    latencyHistogram[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1]++;
+    presented++;
+    latencySum += ns;
+    if (ns > latencyMax)
+        latencyMax = ns;
+    Metrics::presentLatency.record(ns);
+}
+
+double Presenter::percentile(double p) const {
+    if (presented == 0)
+        return 0.0;
+
+    // Report the upper edge of the bucket the percentile lands in
+    uint64_t target = (uint64_t) (p * presented);
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += latencyHistogram[i];
+        if (seen > target)
+            return (i + 1) * (LATENCY_BUCKET_NS / 1000.0);
+    }
+    return latencyMax / 1000.0;
+}
+
+uint64_t NullPresenter::checksum() const {
+    return sum;
+}
+
+void NullPresenter::present(const uint16_t* frame) {
+    // Read the whole frame like a real presenter would when uploading it
+    for (unsigned int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++)
+        sum += frame[i];
+}
+
+AsciiPresenter::AsciiPresenter(ostream& out, unsigned int columns) : out(out) {
+    // Terminal cells are roughly twice as tall as they are wide
+    this->columns = columns;
+    rows = (columns * SCREEN_HEIGHT) / (SCREEN_WIDTH * 2);
+
+    uint32_t rgba[PALETTE_ENTRIES];
+    buildPaletteRGBA(rgba);
+    for (unsigned int i = 0; i < PALETTE_ENTRIES; i++) {
+        uint8_t c[4];
+        std::memcpy(c, &rgba[i], sizeof(c));
+        luma[i] = (uint8_t) ((77 * c[0] + 150 * c[1] + 29 * c[2]) >> 8);
+    }
+
+    text.reserve((columns + 1) * rows + 16);
+}
+
+void AsciiPresenter::present(const uint16_t* frame) {
+    static const char RAMP[] = " .:-=+*#%@";
+    const unsigned int cellWidth = SCREEN_WIDTH / columns;
+    const unsigned int cellHeight = SCREEN_HEIGHT / rows;
+
+    // Cursor home (clearing the screen the first time), then one character per cell from its
+    // average brightness
+    text.assign(cleared ? "\x1b[H" : "\x1b[2J\x1b[H");
+    cleared = true;
+    for (unsigned int row = 0; row < rows; row++) {
+        for (unsigned int col = 0; col < columns; col++) {
+            unsigned int total = 0;
+            for (unsigned int y = 0; y < cellHeight; y++)
+                for (unsigned int x = 0; x < cellWidth; x++)
+                    total += luma[frame[(row * cellHeight + y) * SCREEN_WIDTH + col * cellWidth + x] & 0x1FF];
+            unsigned int level = total / (cellWidth * cellHeight);
+            text.push_back(RAMP[level * (sizeof(RAMP) - 2) / 255]);
+        }
+        text.push_back('\n');
+    }
+
+    out << text;
+    out.flush();
+}
@@ -0,0 +1,326 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rom_loader.h"
+
+const uint32_t ZIP_LOCAL_HEADER = 0x04034B50u;
+const uint32_t ZIP_CENTRAL_HEADER = 0x02014B50u;
+const uint32_t ZIP_END_OF_DIRECTORY = 0x06054B50u;
+const size_t ZIP_END_SIZE = 22u;
+const size_t ZIP_CENTRAL_SIZE = 46u;
+const size_t ZIP_LOCAL_SIZE = 30u;
+const size_t GZIP_HEADER_SIZE = 10u;
+const size_t GZIP_TRAILER_SIZE = 8u;
+const unsigned int METHOD_STORED = 0u;
+const unsigned int METHOD_DEFLATE = 8u;
+
+static uint16_t le16(const uint8_t* p) {
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t le32(const uint8_t* p) {
+    return (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+// A whole file mapped read only
+class MappedFile {
+    public:
+        MappedFile(const char* path) {
+            data = nullptr;
+            size = 0;
+            int fd = open(path, O_RDONLY);
+            if (fd < 0)
+                return;
+            struct stat info;
+            if (fstat(fd, &info) == 0 && info.st_size > 0) {
+                void* memory = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (memory != MAP_FAILED) {
+                    data = (const uint8_t*) memory;
+                    size = info.st_size;
+                }
+            }
+            close(fd);
+        }
+        ~MappedFile() {
+            if (data)
+                munmap((void*) data, size);
+        }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const uint8_t* data;                            // nullptr if it couldn't be opened or is empty
+        size_t size;
+};
+
+// Passes the image on to the cartridge and a cache file being written alongside
+class CachingSink : public ByteSink {
+    public:
+        CachingSink(ByteSink& target, std::ofstream* cache) : target(target), cache(cache) {}
+        void write(const uint8_t* data, size_t size) override {
+            target.write(data, size);
+            if (cache)
+                cache->write((const char*) data, size);
+        }
+
+    private:
+        ByteSink& target;
+        std::ofstream* cache;
+};
+
+CartridgeBuilder::CartridgeBuilder() : cart(std::make_shared<Cartridge>()) {
+    std::memset(header, 0, sizeof(header));
+    cart->romFileName = nullptr;
+    received = 0;
+    prgStart = 0;
+    chrStart = 0;
+    iNES = false;
+}
+
+// Copies the part of [start, start + size) of the image that falls in [from, to) to dest + its offset from from
+static void copyPart(const uint8_t* data, uint64_t start, size_t size, uint64_t from, uint64_t to, uint8_t* dest) {
+    uint64_t begin = std::max(start, from);
+    uint64_t end = std::min(start + size, to);
+    if (begin < end)
+        std::memcpy(dest + (begin - from), data + (begin - start), end - begin);
+}
+
+void CartridgeBuilder::write(const uint8_t* data, size_t size) {
+    crc32.update(data, size);
+    sha1.update(data, size);
+    uint64_t start = received;
+    received += size;
+
+    copyPart(data, start, size, 0, HEADER_SIZE, header);
+    if (start < HEADER_SIZE && received >= HEADER_SIZE) {
+        // Now the sizes are known the ROMs can take the rest as it comes
+        std::memcpy(&cart->header, header, HEADER_SIZE);
+        iNES = std::memcmp(header, "NES\x1A", 4) == 0;
+        if (iNES) {
+            prgStart = HEADER_SIZE + ((cart->header.flags6 & 0x4) ? TRAINER_SIZE : 0);
+            cart->prgROM.resize(cart->header.prgSize * 16384);
+            chrStart = prgStart + cart->prgROM.size();
+            cart->chrROM.resize(cart->header.chrSize * 8192);
+        }
+    }
+    if (iNES) {
+        copyPart(data, start, size, prgStart, prgStart + cart->prgROM.size(), cart->prgROM.data());
+        copyPart(data, start, size, chrStart, chrStart + cart->chrROM.size(), cart->chrROM.data());
+    }
+}
+
+bool CartridgeBuilder::isINES() const {
+    return iNES;
+}
+
+bool CartridgeBuilder::complete() const {
+    return iNES && received >= chrStart + cart->chrROM.size();
+}
+
+uint64_t CartridgeBuilder::size() const {
+    return received;
+}
+
+uint32_t CartridgeBuilder::crc() const {
+    return crc32.value();
+}
+
+shared_ptr<Cartridge> CartridgeBuilder::finish() {
+    if (!complete()) {
+        cart->prgROM.clear();
+        cart->chrROM.clear();
+    }
+    cart->crc32 = crc32.value();
+    sha1.finish(cart->sha1);
+    return cart;
+}
+
+RomLoader::RomLoader(const char* cacheDir) : cacheDir(cacheDir ? cacheDir : "") {
+    hit = false;
+}
+
+bool RomLoader::load(const char* path, CartridgeBuilder& builder) {
+    MappedFile file(path);
+    if (!file.data) {
+        std::cerr << "Couldn't open ROM " << path << std::endl;
+        return false;
+    }
+    return load(file.data, file.size, builder);
+}
+
+bool RomLoader::load(const uint8_t* data, size_t size, CartridgeBuilder& builder) {
+    hit = false;
+    if (size >= 4 && le32(data) == ZIP_LOCAL_HEADER)
+        return loadZip(data, size, builder);
+    if (size >= 2 && data[0] == 0x1F && data[1] == 0x8B)
+        return loadGzip(data, size, builder);
+    builder.write(data, size);
+    return true;
+}
+
+bool RomLoader::cacheHit() const {
+    return hit;
+}
+
+bool RomLoader::loadZip(const uint8_t* data, size_t size, CartridgeBuilder& builder) {
+    // The end of directory record is last, followed only by a comment of up to 64KB
+    if (size < ZIP_END_SIZE) {
+        std::cerr << "Truncated zip archive" << std::endl;
+        return false;
+    }
+    size_t end = size - ZIP_END_SIZE;
+    size_t lowest = end > 0xFFFF ? end - 0xFFFF : 0;
+    while (le32(data + end) != ZIP_END_OF_DIRECTORY) {
+        if (end == lowest) {
+            std::cerr << "Zip archive has no central directory" << std::endl;
+            return false;
+        }
+        end--;
+    }
+
+    unsigned int entries = le16(data + end + 10);
+    size_t entry = le32(data + end + 16);
+    for (unsigned int i = 0; i < entries; i++) {
+        if (entry + ZIP_CENTRAL_SIZE > size || le32(data + entry) != ZIP_CENTRAL_HEADER)
+            break;
+        const uint8_t* central = data + entry;
+        size_t nameLength = le16(central + 28);
+        size_t entryLength = ZIP_CENTRAL_SIZE + nameLength + le16(central + 30) + le16(central + 32);
+        if (entry + ZIP_CENTRAL_SIZE + nameLength > size)
+            break;
+        string name((const char*) central + ZIP_CENTRAL_SIZE, nameLength);
+        entry += entryLength;
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        if (name.size() < 4 || name.compare(name.size() - 4, 4, ".nes") != 0)
+            continue;
+
+        // Sizes come from the central directory, a local header may leave them to a trailing descriptor
+        uint16_t flags = le16(central + 8);
+        size_t local = le32(central + 42);
+        uint32_t compressedSize = le32(central + 20);
+        if ((flags & 0x1) || compressedSize == 0xFFFFFFFFu) {
+            std::cerr << "Encrypted or zip64 archive member " << name << std::endl;
+            return false;
+        }
+        if (local + ZIP_LOCAL_SIZE > size || le32(data + local) != ZIP_LOCAL_HEADER) {
+            std::cerr << "Corrupt zip archive" << std::endl;
+            return false;
+        }
+        size_t start = local + ZIP_LOCAL_SIZE + le16(data + local + 26) + le16(data + local + 28);
+        if (start > size || size - start < compressedSize) {
+            std::cerr << "Truncated zip archive" << std::endl;
+            return false;
+        }
+        return unpack(data + start, compressedSize, le16(central + 10), le32(central + 16), le32(central + 24), builder);
+    }
+    std::cerr << "No .nes file in zip archive" << std::endl;
+    return false;
+}
+
+bool RomLoader::loadGzip(const uint8_t* data, size_t size, CartridgeBuilder& builder) {
+    if (size < GZIP_HEADER_SIZE + GZIP_TRAILER_SIZE || data[2] != METHOD_DEFLATE) {
+        std::cerr << "Not a gzip deflate stream" << std::endl;
+        return false;
+    }
+
+    // Optional extra field, file name, comment and header CRC, in that order
+    uint8_t flags = data[3];
+    size_t start = GZIP_HEADER_SIZE;
+    size_t limit = size - GZIP_TRAILER_SIZE;
+    if ((flags & 0x04) && start + 2 <= limit)
+        start += 2 + le16(data + start);
+    for (int text : { 0x08, 0x10 }) {
+        if (flags & text) {
+            while (start < limit && data[start])
+                start++;
+            start++;
+        }
+    }
+    if (flags & 0x02)
+        start += 2;
+    if (start > limit) {
+        std::cerr << "Truncated gzip file" << std::endl;
+        return false;
+    }
+
+    // The trailer only keeps the size modulo 4GB, which is plenty for a ROM
+    return unpack(data + start, limit - start, METHOD_DEFLATE, le32(data + limit), le32(data + limit + 4), builder);
+}
+
+bool RomLoader::unpack(const uint8_t* data, size_t compressedSize, unsigned int method, uint32_t crc, uint64_t size,
+                       CartridgeBuilder& builder) {
+    if (method != METHOD_STORED && method != METHOD_DEFLATE) {
+        std::cerr << "Unsupported compression method " << method << std::endl;
+        return false;
+    }
+
+    string cached;
+    if (!cacheDir.empty()) {
+        std::ostringstream name;
+        name << std::hex << std::setw(8) << std::setfill('0') << crc << std::dec << "-" << size << ".nes";
+        cached = (std::filesystem::path(cacheDir) / name.str()).string();
+        if (loadCached(cached, crc, size, builder))
+            return true;
+    }
+
+    // Written next to where it goes and renamed over it once the CRC checks out, so a cached image
+    // is always whole
+    std::ofstream cache;
+    string temporary;
+    if (!cached.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(cacheDir, error);
+        temporary = cached + "." + std::to_string(getpid()) + ".tmp";
+        cache.open(temporary, std::ofstream::binary);
+    }
+    CachingSink sink(builder, cache.is_open() ? &cache : nullptr);
+
+    bool ok;
+    if (method == METHOD_STORED) {
+        ok = compressedSize >= size;
+        if (ok)
+            sink.write(data, size);
+    } else {
+        std::unique_ptr<Inflater> inflater = std::make_unique<Inflater>(data, compressedSize);
+        ok = inflater->inflate(sink, size) && inflater->written() == size;
+    }
+    ok = ok && builder.crc() == crc;
+    if (!ok)
+        std::cerr << "Corrupt archive, the ROM doesn't match its CRC" << std::endl;
+
+    if (cache.is_open()) {
+        cache.close();
+        std::error_code error;
+        if (ok && cache.good())
+            std::filesystem::rename(temporary, cached, error);
+        if (!ok || !cache.good() || error)
+            std::filesystem::remove(temporary, error);
+    }
+    return ok;
+}
+
+bool RomLoader::loadCached(const string& path, uint32_t crc, uint64_t size, CartridgeBuilder& builder) {
+    MappedFile image(path.c_str());
+    if (!image.data || image.size != size)
+        return false;
+
+    // Only the inflate is saved, the cartridge owns copies of its ROM and the CRC guards against
+    // a cached file damaged since it was written
+    builder.write(image.data, image.size);
+    if (builder.crc() != crc) {
+        std::cerr << "Ignoring damaged cached ROM " << path << std::endl;
+        builder = CartridgeBuilder();
+        return false;
+    }
+    hit = true;
+    return true;
+}
@@ -0,0 +1,83 @@
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shm_client.h"
+
+ShmClient::ShmClient(const char* name) {
+    region = nullptr;
+    seq = 0;
+
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+        return;
+    void* memory = MAP_FAILED;
+    struct stat info;
+    if (fstat(fd, &info) == 0 && (size_t) info.st_size >= sizeof(ShmRegion))
+        memory = mmap(nullptr, sizeof(ShmRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+        return;
+
+    // No magic yet means the server is still setting the region up
+    region = (ShmRegion*) memory;
+    if (region->magic != SHM_MAGIC || region->version != SHM_VERSION) {
+        if (region->magic != 0)
+            std::cerr << "Shared memory " << name << " isn't a compatible NES server" << std::endl;
+        munmap(region, sizeof(ShmRegion));
+        region = nullptr;
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    seq = region->requestSeq.load(std::memory_order_acquire);
+}
+
+ShmClient::~ShmClient() {
+    if (region)
+        munmap(region, sizeof(ShmRegion));
+}
+
+bool ShmClient::isOpen() const {
+    return region != nullptr;
+}
+
+bool ShmClient::step(uint8_t input0, uint8_t input1, uint32_t frames) {
+    region->input[0] = input0;
+    region->input[1] = input1;
+    region->frames = frames;
+    return request(SHM_STEP);
+}
+
+bool ShmClient::shutdown() {
+    return request(SHM_SHUTDOWN);
+}
+
+uint64_t ShmClient::frameCount() const {
+    return region->frameCount;
+}
+
+const uint8_t* ShmClient::ram() const {
+    return region->ram;
+}
+
+const uint16_t* ShmClient::frame() const {
+    return region->frame;
+}
+
+bool ShmClient::request(uint32_t command) {
+    region->command = command;
+    uint32_t answered = seq;
+    shmPublish(region->requestSeq, region->serverSleeping, ++seq);
+
+    // The server answers with the same sequence number, anything else is still the old answer
+    while (region->responseSeq.load(std::memory_order_acquire) != seq) {
+        if (!shmWait(region->responseSeq, region->clientSleeping, answered, SHM_TIMEOUT_MS)) {
+            std::cerr << "NES server didn't answer within " << SHM_TIMEOUT_MS << " ms" << std::endl;
+            return false;
+        }
+        answered = region->responseSeq.load(std::memory_order_acquire);
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+#include <chrono>
+#include <climits>
+#include <thread>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "shm_region.h"
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Futex words must be plain 32-bit integers");
+
+// The region is mapped by two processes, so these are shared (not FUTEX_PRIVATE) futex calls
+static long futexWait(std::atomic<uint32_t>& word, uint32_t old, const struct timespec* timeout) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, old, timeout, nullptr, 0);
+}
+
+static void futexWake(std::atomic<uint32_t>& word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+bool shmWait(std::atomic<uint32_t>& word, std::atomic<uint32_t>& sleeping, uint32_t old, unsigned int timeoutMs) {
+    // The other side usually answers within a frame, polling avoids two system calls per request.
+    // With a single CPU the other side can't run while this one polls, so go straight to sleep.
+    static const int spinLimit = std::thread::hardware_concurrency() > 1 ? SHM_SPIN_LIMIT : 0;
+    for (int i = 0; i < spinLimit; i++) {
+        if (word.load(std::memory_order_acquire) != old)
+            return true;
+#if defined(__SSE2__)
+        _mm_pause();
+#endif
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (true) {
+        // Announce the sleep before the last check, publishers look at the flag after storing
+        sleeping.store(1, std::memory_order_seq_cst);
+        if (word.load(std::memory_order_seq_cst) != old)
+            break;
+
+        struct timespec timeout;
+        struct timespec* timeoutArg = nullptr;
+        if (timeoutMs) {
+            auto left = deadline - std::chrono::steady_clock::now();
+            if (left <= std::chrono::nanoseconds::zero()) {
+                sleeping.store(0, std::memory_order_relaxed);
+                return false;
+            }
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+            timeout.tv_sec = ns / 1000000000;
+            timeout.tv_nsec = ns % 1000000000;
+            timeoutArg = &timeout;
+        }
+        futexWait(word, old, timeoutArg);
+    }
+    sleeping.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+void shmPublish(std::atomic<uint32_t>& word, std::atomic<uint32_t>& sleeping, uint32_t val) {
+    word.store(val, std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_seq_cst))
+        futexWake(word);
+}
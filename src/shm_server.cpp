@@ -0,0 +1,87 @@
+#include <cerrno>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "shm_server.h"
+
+ShmServer::ShmServer(NES* nes, const char* name, bool replace) {
+    this->nes = nes;
+    this->name = name;
+    region = nullptr;
+    served = 0;
+
+    // Unlinking a live server's region would strand it and its clients, so only on request
+    if (replace)
+        shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        std::cerr << "Shared memory " << name << " already exists, another server may be using it" << std::endl;
+        return;
+    }
+    if (fd < 0) {
+        std::cerr << "Could not create shared memory " << name << std::endl;
+        return;
+    }
+    void* memory = MAP_FAILED;
+    if (ftruncate(fd, sizeof(ShmRegion)) == 0)
+        memory = mmap(nullptr, sizeof(ShmRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        std::cerr << "Could not map shared memory " << name << std::endl;
+        shm_unlink(name);
+        return;
+    }
+
+    // Fresh from ftruncate so already zeroed, the magic goes in last so clients see a whole header
+    region = new (memory) ShmRegion();
+    region->version = SHM_VERSION;
+    region->frameCount = nes->frameCount();
+    std::atomic_thread_fence(std::memory_order_release);
+    region->magic = SHM_MAGIC;
+    nes->setFrameBuffer(region->frame);
+}
+
+ShmServer::~ShmServer() {
+    if (!region)
+        return;
+    nes->setFrameBuffer(nullptr);
+    munmap(region, sizeof(ShmRegion));
+    shm_unlink(name.c_str());
+}
+
+bool ShmServer::isOpen() const {
+    return region != nullptr;
+}
+
+void ShmServer::run() {
+    uint32_t seen = region->requestSeq.load(std::memory_order_acquire);
+    while (true) {
+        shmWait(region->requestSeq, region->serverSleeping, seen, 0);
+        seen = region->requestSeq.load(std::memory_order_acquire);
+
+        uint32_t command = region->command;
+        handle(command);
+        served++;
+        shmPublish(region->responseSeq, region->clientSleeping, seen);
+        if (command == SHM_SHUTDOWN)
+            return;
+    }
+}
+
+uint64_t ShmServer::requestsServed() const {
+    return served;
+}
+
+void ShmServer::handle(uint32_t command) {
+    if (command != SHM_STEP)
+        return;
+
+    nes->setInput(0, region->input[0]);
+    nes->setInput(1, region->input[1]);
+    for (uint32_t i = 0; i < region->frames; i++)
+        nes->runFrame();
+    nes->readRAM(region->ram);
+    region->frameCount = nes->frameCount();
+}
@@ -0,0 +1,42 @@
+#include <cstring>
+
+#include "test_bus.h"
+
+TestBus::TestBus() {
+    std::memset(memory, 0, sizeof(memory));
+    count = 0;
+}
+
+uint8_t TestBus::read(uint16_t addr) {
+    if (count < TEST_BUS_LOG_SIZE)
+        accesses[count] = { addr, memory[addr], false };
+    count++;
+    return memory[addr];
+}
+
+void TestBus::write(uint16_t addr, uint8_t val) {
+    if (count < TEST_BUS_LOG_SIZE)
+        accesses[count] = { addr, val, true };
+    count++;
+    memory[addr] = val;
+}
+
+uint8_t TestBus::peek(uint16_t addr) const {
+    return memory[addr];
+}
+
+void TestBus::poke(uint16_t addr, uint8_t val) {
+    memory[addr] = val;
+}
+
+void TestBus::clearLog() {
+    count = 0;
+}
+
+size_t TestBus::logSize() const {
+    return count;
+}
+
+const BusAccess* TestBus::log() const {
+    return accesses;
+}
@@ -0,0 +1,54 @@
+#include <chrono>
+
+#include "triple_buffer.h"
+
+TripleBuffer::TripleBuffer() {
+    memory = new uint16_t[3 * SCREEN_WIDTH * SCREEN_HEIGHT]();
+    for (int i = 0; i < 3; i++)
+        slots[i] = { memory + i * SCREEN_WIDTH * SCREEN_HEIGHT, 0, 0 };
+
+    backIndex = 0;
+    middle = 1;
+    frontIndex = 2;
+    droppedFrames = 0;
+}
+
+TripleBuffer::~TripleBuffer() {
+    delete[] memory;
+}
+
+uint16_t* TripleBuffer::back() {
+    return slots[backIndex].frame;
+}
+
+uint16_t* TripleBuffer::publish(uint64_t frameNumber) {
+    Slot& slot = slots[backIndex];
+    slot.frameNumber = frameNumber;
+    slot.publishTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    // Release makes the frame contents visible to the consumer along with the index
+    uint8_t previous = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel);
+    if (previous & FRESH)
+        droppedFrames++;
+    backIndex = previous & 0x3;
+
+    return slots[backIndex].frame;
+}
+
+uint64_t TripleBuffer::dropped() const {
+    return droppedFrames;
+}
+
+bool TripleBuffer::consume() {
+    if (!(middle.load(std::memory_order_acquire) & FRESH))
+        return false;
+
+    uint8_t previous = middle.exchange(frontIndex, std::memory_order_acq_rel);
+    frontIndex = previous & 0x3;
+    return true;
+}
+
+const TripleBuffer::Slot& TripleBuffer::front() const {
+    return slots[frontIndex];
+}
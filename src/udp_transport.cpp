@@ -0,0 +1,145 @@
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "udp_transport.h"
+
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+UdpTransport::UdpTransport(uint16_t localPort) {
+    port = 0;
+    hasPeer = false;
+    std::memset(&peer, 0, sizeof(peer));
+    latencyNs = 0;
+    loss = 0.0;
+    heldFirst = 0;
+    heldCount = 0;
+    sentCount = 0;
+    droppedCount = 0;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        std::cerr << "Could not create a UDP socket" << std::endl;
+        return;
+    }
+    sockaddr_in local;
+    std::memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons(localPort);
+    socklen_t length = sizeof(local);
+    if (bind(fd, (sockaddr*) &local, sizeof(local)) != 0 || getsockname(fd, (sockaddr*) &local, &length) != 0
+            || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+        std::cerr << "Could not bind UDP port " << localPort << std::endl;
+        close(fd);
+        fd = -1;
+        return;
+    }
+    port = ntohs(local.sin_port);
+}
+
+UdpTransport::~UdpTransport() {
+    if (fd >= 0)
+        close(fd);
+}
+
+bool UdpTransport::isOpen() const {
+    return fd >= 0;
+}
+
+uint16_t UdpTransport::localPort() const {
+    return port;
+}
+
+bool UdpTransport::setPeer(const char* host, uint16_t port) {
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* found = nullptr;
+    if (getaddrinfo(host, nullptr, &hints, &found) != 0 || !found) {
+        std::cerr << "Could not resolve " << host << std::endl;
+        return false;
+    }
+    std::memcpy(&peer, found->ai_addr, sizeof(peer));
+    peer.sin_port = htons(port);
+    freeaddrinfo(found);
+    hasPeer = true;
+    return true;
+}
+
+void UdpTransport::setShim(unsigned int latencyMs, double loss, uint32_t seed) {
+    latencyNs = (uint64_t) latencyMs * 1000000u;
+    this->loss = loss;
+    random.seed(seed);
+}
+
+bool UdpTransport::send(const void* data, size_t size) {
+    if (fd < 0 || !hasPeer || size > UDP_MAX_DATAGRAM)
+        return false;
+    releaseDue();
+    if (loss > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(random) < loss) {
+        droppedCount++;
+        return true;
+    }
+    if (!latencyNs)
+        return sendNow(data, size);
+
+    if (heldCount == UDP_SHIM_SLOTS)
+        return false;
+    Held& datagram = held[(heldFirst + heldCount) % UDP_SHIM_SLOTS];
+    datagram.due = nowNs() + latencyNs;
+    datagram.size = (uint16_t) size;
+    std::memcpy(datagram.data, data, size);
+    heldCount++;
+    return true;
+}
+
+int UdpTransport::receive(void* data, size_t size) {
+    if (fd < 0)
+        return -1;
+    releaseDue();
+
+    // Anything not from the peer is skipped rather than reported
+    while (true) {
+        sockaddr_in from;
+        socklen_t length = sizeof(from);
+        ssize_t received = recvfrom(fd, data, size, 0, (sockaddr*) &from, &length);
+        if (received < 0)
+            return -1;
+        if (hasPeer && from.sin_addr.s_addr == peer.sin_addr.s_addr && from.sin_port == peer.sin_port)
+            return (int) received;
+    }
+}
+
+uint64_t UdpTransport::sent() const {
+    return sentCount;
+}
+
+uint64_t UdpTransport::dropped() const {
+    return droppedCount;
+}
+
+bool UdpTransport::sendNow(const void* data, size_t size) {
+    if (sendto(fd, data, size, 0, (const sockaddr*) &peer, sizeof(peer)) != (ssize_t) size)
+        return false;
+    sentCount++;
+    return true;
+}
+
+void UdpTransport::releaseDue() {
+    uint64_t now = heldCount ? nowNs() : 0;
+    while (heldCount && held[heldFirst].due <= now) {
+        sendNow(held[heldFirst].data, held[heldFirst].size);
+        heldFirst = (heldFirst + 1) % UDP_SHIM_SLOTS;
+        heldCount--;
+    }
+}
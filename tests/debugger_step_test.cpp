@@ -0,0 +1,76 @@
+/*
+ * Debugger::run() with a step count, which must retire exactly that many instructions whether
+ * the run starts between two instructions or part way through one (just after reset, when the
+ * reset sequence is still counting down, and just after a watchpoint stopped it mid-instruction).
+ * The cart is NOPs from $8000, so every instruction moves pc on by one and the instructions
+ * retired are how far pc has moved.
+ *
+ * Prints each mismatch and exits non-zero if there were any.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "debugger.h"
+#include "nes.h"
+
+static const uint64_t STEPS[] = { 1, 2, 3, 7 };
+
+static unsigned int failures = 0;
+
+static void expect(bool ok, const char* start, uint64_t steps, unsigned int got, unsigned int want) {
+    if (ok)
+        return;
+    failures++;
+    std::cout << "step " << steps << " from " << start << ": pc $" << std::hex << got << ", want $" << want
+              << std::dec << std::endl;
+}
+
+// NROM, 32KB of NOP with the reset vector at $8000
+static std::vector<uint8_t> nopCart() {
+    std::vector<uint8_t> rom(16 + 32768 + 8192, 0x0u);
+    const uint8_t header[6] = { 'N', 'E', 'S', 0x1A, 2, 1 };
+    std::memcpy(rom.data(), header, sizeof(header));
+    std::memset(rom.data() + 16, 0xEA, 32768);
+    rom[16 + 0x7FFC] = 0x00;
+    rom[16 + 0x7FFD] = 0x80;
+    return rom;
+}
+
+static void check(const char* start, Debugger& debugger, uint64_t steps) {
+    uint16_t from = debugger.registers().pc;
+    STOPREASON reason = debugger.run(0, steps);
+    uint16_t to = debugger.registers().pc;
+    expect(reason == STEPPED && debugger.registers().cyclesRemaining == 0 && to == from + steps, start, steps, to,
+        from + steps);
+}
+
+int main() {
+    std::vector<uint8_t> rom = nopCart();
+    for (uint64_t steps : STEPS) {
+        // Reset's cycles are still to run, pc is the vector
+        NES reset(rom.data(), rom.size());
+        Debugger afterReset(&reset);
+        check("reset", afterReset, steps);
+
+        // Stopped between instructions by the step just taken
+        check("a step", afterReset, steps);
+
+        // A watchpoint stops after the access, with the NOP's second cycle still to run
+        NES watched(rom.data(), rom.size());
+        Debugger watcher(&watched);
+        watcher.addWatchpoint(Watchpoint{ 0x8000u, 0x80FFu, true, false });
+        STOPREASON reason = watcher.run(0, 0);
+        expect(reason == WATCHPOINT && watcher.registers().cyclesRemaining != 0, "setup", 0, reason, WATCHPOINT);
+        watcher.removeWatchpoint(0x8000u, 0x80FFu);
+        check("a watchpoint", watcher, steps);
+    }
+    if (failures) {
+        std::cout << failures << " mismatches" << std::endl;
+        return 1;
+    }
+    std::cout << "Every step count retired that many instructions" << std::endl;
+    return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * Nametable and palette mirroring, checked from the CPU's side of the PPU. For every mirroring
+ * mode, a byte written through $2006/$2007 to one nametable must read back from exactly the
+ * nametables that mirror it (and their $3000-$3EFF mirrors), and not from the others. Switching
+ * modes afterwards (as MMC1 or AxROM would) must show the same two 1KB pages of console VRAM in
+ * their new places: single screen lower and upper are what vertical shows at $2000 and $2400.
+ * Palette entries must read back through $3F00-$3FFF with the sprite backdrop entries shared.
+ * Last, mirrored pages of a forked memory must still copy on write and all see the write.
+ *
+ * Prints each mismatch and exits non-zero if there were any.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include "paged_memory.h"
+#include "ppu.h"
+
+// Nametables ($2000, $2400, $2800 and $2C00 as bits 0-3) a byte written to each one reads back from
+static const uint8_t READ_BACK[5][4] = {
+    { 0x3, 0x3, 0xC, 0xC },                             // $2000 = $2400, $2800 = $2C00
+    { 0x5, 0xA, 0x5, 0xA },                             // $2000 = $2800, $2400 = $2C00
+    { 0xF, 0xF, 0xF, 0xF },                             // All one table
+    { 0xF, 0xF, 0xF, 0xF },
+    { 0x1, 0x2, 0x4, 0x8 },                             // Four separate tables
+};
+static const char* const MODES[5] = { "horizontal", "vertical", "single screen lower", "single screen upper", "four screen" };
+static const uint16_t OFFSETS[] = { 0x000, 0x001, 0x155, 0x2FF, 0x3C0, 0x3FF };
+
+static unsigned int failures = 0;
+
+static void expect(bool ok, const char* what, unsigned int addr, unsigned int got, unsigned int want) {
+    if (ok)
+        return;
+    failures++;
+    std::cout << what << " $" << std::hex << addr << ": got " << got << ", want " << want << std::dec << std::endl;
+}
+
+static void setAddress(PPU& ppu, uint16_t addr) {
+    ppu.readReg(0x2002);                                // Reset the write toggle
+    ppu.writeReg(0x2006, addr >> 8);
+    ppu.writeReg(0x2006, addr & 0xFF);
+}
+
+static void write(PPU& ppu, uint16_t addr, uint8_t val) {
+    setAddress(ppu, addr);
+    ppu.writeReg(0x2007, val);
+}
+
+// Nametable reads come through the read buffer, so the second read is the byte at addr
+static uint8_t read(PPU& ppu, uint16_t addr) {
+    setAddress(ppu, addr);
+    ppu.readReg(0x2007);
+    setAddress(ppu, addr);
+    return ppu.readReg(0x2007);
+}
+
+// Palette reads aren't buffered, the top two bits are whatever was last on the bus
+static uint8_t readPalette(PPU& ppu, uint16_t addr) {
+    setAddress(ppu, addr);
+    return ppu.readReg(0x2007) & 0x3F;
+}
+
+static void nametables(MIRRORING mode) {
+    static uint8_t vram[VRAM_SIZE];
+    std::memset(vram, 0, sizeof(vram));
+    PPU ppu;
+    ppu.setVRAM(vram);
+    ppu.setMirroring(mode);
+    std::cout << MODES[mode] << std::endl;
+
+    // Fill the same offset of every table, then write another byte to one and see who reads it
+    for (unsigned int table = 0; table < 4; table++) {
+        for (size_t i = 0; i < sizeof(OFFSETS) / sizeof(OFFSETS[0]); i++) {
+            uint8_t marker = (uint8_t) (table * 61 + OFFSETS[i] * 7 + 1);
+            for (unsigned int other = 0; other < 4; other++)
+                write(ppu, 0x2000 + other * 0x400 + OFFSETS[i], ~marker);
+            uint16_t addr = 0x2000 + table * 0x400 + OFFSETS[i];
+            write(ppu, addr, marker);
+
+            unsigned int readers = 0x0u;
+            for (unsigned int other = 0; other < 4; other++) {
+                uint16_t otherAddr = 0x2000 + other * 0x400 + OFFSETS[i];
+                uint8_t got = read(ppu, otherAddr);
+                if (got == marker)
+                    readers |= 1u << other;
+                if (otherAddr + 0x1000 < 0x3F00)
+                    expect(read(ppu, otherAddr + 0x1000) == got, "mirror read", otherAddr + 0x1000,
+                        read(ppu, otherAddr + 0x1000), got);
+            }
+            expect(readers == READ_BACK[mode][table], "tables reading back", addr, readers, READ_BACK[mode][table]);
+        }
+    }
+
+    // Writes through the $3000 mirror reach the same table
+    write(ppu, 0x3000 + 0x0C00 + 0x010, 0xA5);
+    expect(read(ppu, 0x2C10) == 0xA5, "read after mirror write", 0x2C10, read(ppu, 0x2C10), 0xA5);
+}
+
+// A mapper switching mode mid-game moves no data, the console's two tables just show up elsewhere
+static void switching() {
+    static uint8_t vram[VRAM_SIZE];
+    std::memset(vram, 0, sizeof(vram));
+    PPU ppu;
+    ppu.setVRAM(vram);
+    std::cout << "switching" << std::endl;
+
+    ppu.setMirroring(SINGLE_SCREEN_LOWER);
+    write(ppu, 0x2155, 0x11);
+    ppu.setMirroring(SINGLE_SCREEN_UPPER);
+    write(ppu, 0x2155, 0x22);
+
+    // What $2000, $2400, $2800 and $2C00 read in each mode
+    static const struct {
+        MIRRORING mode;
+        uint8_t want[4];
+    } SHOWN[] = {
+        { SINGLE_SCREEN_UPPER, { 0x22, 0x22, 0x22, 0x22 } },
+        { SINGLE_SCREEN_LOWER, { 0x11, 0x11, 0x11, 0x11 } },
+        { VERTICAL, { 0x11, 0x22, 0x11, 0x22 } },
+        { HORIZONTAL, { 0x11, 0x11, 0x22, 0x22 } },
+    };
+    for (const auto& shown : SHOWN) {
+        ppu.setMirroring(shown.mode);
+        for (unsigned int table = 0; table < 4; table++) {
+            uint16_t addr = 0x2000 + table * 0x400 + 0x155;
+            expect(read(ppu, addr) == shown.want[table], MODES[shown.mode], addr, read(ppu, addr), shown.want[table]);
+        }
+    }
+}
+
+static void palette() {
+    static uint8_t vram[VRAM_SIZE];
+    PPU ppu;
+    ppu.setVRAM(vram);
+    std::cout << "palette" << std::endl;
+
+    // Backdrop entries of the sprite palettes ($3F10/4/8/C) are the background ones
+    uint8_t want[32];
+    for (unsigned int index = 0; index < 32; index++) {
+        write(ppu, 0x3F00 + index, (uint8_t) (index + 0x20) & 0x3F);
+        want[index] = (index + 0x20) & 0x3F;
+        if ((index & 0x03) == 0)
+            want[index ^ 0x10] = want[index];
+    }
+    for (uint16_t addr = 0x3F00; addr < 0x4000; addr++)
+        expect(readPalette(ppu, addr) == want[addr & 0x1F], "palette read", addr, readPalette(ppu, addr), want[addr & 0x1F]);
+
+    // And written from the background side, through a mirror above $3F20
+    write(ppu, 0x3FE4, 0x11);
+    expect(readPalette(ppu, 0x3F14) == 0x11, "palette backdrop", 0x3F14, readPalette(ppu, 0x3F14), 0x11);
+}
+
+static void forked() {
+    // A fork reads its parent's pages until it writes, then every alias sees its own copy
+    static uint8_t parent[VRAM_SIZE];
+    static uint8_t child[VRAM_SIZE];
+    for (unsigned int i = 0; i < VRAM_SIZE; i++)
+        parent[i] = (uint8_t) i;
+    std::memset(child, 0, sizeof(child));
+    static const uint8_t horizontal[VRAM_SIZE / MEMORY_PAGE_SIZE] = { 0, 0, 1, 1 };
+    PagedMemory<VRAM_SIZE / MEMORY_PAGE_SIZE> memory;
+    memory.attach(child);
+    memory.mirror(horizontal);
+    memory.share(parent);
+    memory.inherit(child);
+    std::cout << "fork" << std::endl;
+
+    expect(memory.read(0x0412) == parent[0x0012], "shared read", 0x0412, memory.read(0x0412), parent[0x0012]);
+    memory.write(0x0412, 0xEE);
+    expect(memory.read(0x0012) == 0xEE, "alias after copy", 0x0012, memory.read(0x0012), 0xEE);
+    expect(memory.read(0x0413) == parent[0x0013], "copied page", 0x0413, memory.read(0x0413), parent[0x0013]);
+    expect(parent[0x0012] == 0x12, "parent after copy", 0x0012, parent[0x0012], 0x12);
+    expect(memory.read(0x0812) == parent[0x0412], "other bank still shared", 0x0812, memory.read(0x0812), parent[0x0412]);
+
+    uint8_t out[VRAM_SIZE];
+    memory.copyTo(out);
+    expect(out[0x0012] == 0xEE && out[0x0412] == parent[0x0412], "copyTo", 0x0012, out[0x0012], 0xEE);
+}
+
+int main() {
+    for (unsigned int mode = 0; mode < 5; mode++)
+        nametables((MIRRORING) mode);
+    switching();
+    palette();
+    forked();
+    if (failures) {
+        std::cout << failures << " mismatches" << std::endl;
+        return 1;
+    }
+    std::cout << "All mirrors read back" << std::endl;
+    return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * Every sprite range kernel in sprite_range.h this machine can run (scalar always, SSE2 and AVX2
+ * where the CPU has them) and the one PPU::spritesInRange() was built with, over random OAM and
+ * scanlines with 8x8 and 8x16 sprites. Each kernel's mask must match the scalar one, and fed to
+ * PPU::evaluateSprites() must give the same sprites and the same overflow flag.
+ *
+ * Y coordinates are drawn near the scanline for a random share of the sprites, so lines with more
+ * than eight sprites, and the overflow walk after them, come up often. The rest of OAM is random, as the walk reads it too.
+ *
+ * Prints each mismatch and exits non-zero if there were any.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include "ppu.h"
+#include "sprite_range.h"
+
+#define SPRITE_RANGE_CASES 50000                        // Per sprite height
+
+typedef uint64_t (*RangeKernel)(const uint8_t* oamY, int line, int height);
+
+struct Kernel {
+    const char* name;
+    RangeKernel range;
+};
+
+struct Evaluated {
+    uint64_t mask;
+    uint8_t spriteCount;
+    uint8_t spriteX[8];
+    bool overflow;
+};
+
+static unsigned int failures = 0;
+
+class SpriteRangeTest {
+    public:
+        SpriteRangeTest() {
+            std::memset(chr, 0, sizeof(chr));
+            ppu.setCHR(chr, false);
+        }
+
+        void load(std::mt19937& rng, int line) {
+            std::uniform_int_distribution<int> byte(0, 255);
+            std::uniform_int_distribution<int> near(-20, 4);
+            unsigned int crowd = rng() % 64;            // Sprites out of 64 placed near the line
+            for (unsigned int i = 0; i < PPU_MEM_SIZE; i++)
+                ppu.memory[i] = (uint8_t) byte(rng);
+            for (unsigned int n = 0; n < 64; n++) {
+                if (rng() % 64 < crowd)
+                    ppu.memory[n * 4] = (uint8_t) (line + near(rng));
+            }
+            ppu.rebuildSpriteCache();
+        }
+
+        const uint8_t* oamY() const {
+            return ppu.oamY;
+        }
+
+        uint64_t built(int line, int height) const {
+            return ppu.spritesInRange(line, height);
+        }
+
+        // Run evaluation on the mask as if the PPU had computed it for this line
+        Evaluated evaluate(uint64_t mask, int line, int height) {
+            ppu.ctrl = (height == 16) ? 0x20 : 0x0u;
+            ppu.status = 0x0u;
+            ppu.scanline = line;
+            ppu.lineSprites[line] = mask;
+            ppu.lineGeneration[line] = ppu.oamGeneration;
+            ppu.evaluateSprites();
+
+            Evaluated result;
+            result.mask = mask;
+            result.spriteCount = ppu.spriteCount;
+            std::memcpy(result.spriteX, ppu.spriteX, sizeof(result.spriteX));
+            result.overflow = ppu.status & 0x20;
+            return result;
+        }
+
+    private:
+        PPU ppu;
+        uint8_t chr[CHR_SIZE];
+};
+
+static bool same(const Evaluated& a, const Evaluated& b) {
+    return a.mask == b.mask && a.spriteCount == b.spriteCount && a.overflow == b.overflow &&
+           std::memcmp(a.spriteX, b.spriteX, a.spriteCount) == 0;
+}
+
+static void expect(const Evaluated& got, const Evaluated& want, const char* kernel, int line, int height) {
+    if (same(got, want))
+        return;
+    failures++;
+    std::cout << kernel << " 8x" << height << " line " << line << ": mask " << std::hex << got.mask << " overflow "
+              << got.overflow << ", want mask " << want.mask << " overflow " << want.overflow << std::dec
+              << std::endl;
+}
+
+int main() {
+    Kernel kernels[3];
+    unsigned int count = 0;
+    kernels[count++] = Kernel{ "scalar", spritesInRangeScalar };
+#if SPRITE_RANGE_SSE2
+    kernels[count++] = Kernel{ "sse2", spritesInRangeSSE2 };
+#endif
+#if SPRITE_RANGE_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        kernels[count++] = Kernel{ "avx2", spritesInRangeAVX2 };
+#endif
+
+    static SpriteRangeTest test;
+    std::mt19937 rng(0x5EED);
+    std::uniform_int_distribution<int> lines(0, SCREEN_HEIGHT - 1);
+    unsigned int overflows = 0;
+    for (int height : { 8, 16 }) {
+        for (unsigned int i = 0; i < SPRITE_RANGE_CASES; i++) {
+            int line = lines(rng);
+            test.load(rng, line);
+
+            Evaluated want = test.evaluate(kernels[0].range(test.oamY(), line, height), line, height);
+            overflows += want.overflow;
+            for (unsigned int k = 1; k < count; k++)
+                expect(test.evaluate(kernels[k].range(test.oamY(), line, height), line, height), want, kernels[k].name,
+                    line, height);
+            expect(test.evaluate(test.built(line, height), line, height), want, "PPU::spritesInRange", line, height);
+        }
+    }
+
+    std::cout << "Kernels:";
+    for (unsigned int k = 0; k < count; k++)
+        std::cout << " " << kernels[k].name;
+    std::cout << " (" << overflows << " of " << 2 * SPRITE_RANGE_CASES << " cases overflowed)" << std::endl;
+    if (failures) {
+        std::cout << failures << " mismatches" << std::endl;
+        return 1;
+    }
+    std::cout << "Every kernel agreed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,445 @@
+/*
+ * Runs single instruction test vectors against MOS6502, in the per-opcode JSON layout of the
+ * SingleStepTests 6502 suites: one file per opcode (a9.json, ...) holding an array of cases,
+ * each with the registers and RAM before and after one instruction and the bus cycles it makes.
+ * Use the NES variant (nes6502), which has no decimal mode.
+ *
+ *   cpu_conformance DIR [--threads N] [--official] [--bus] [--show N]
+ *
+ * Files are read with a small streaming parser that fills in one case at a time, never holding
+ * a whole file, and opcodes are handed out to the threads one file at a time. Each thread runs the
+ * CPU of its own NES, built around an empty NROM cart, with every page trapped to a flat 64KB
+ * TestBus. A case passes if the registers, the RAM the vector lists
+ * and the number of cycles match. The interpreter does all of an instruction's accesses at once
+ * and skips the 6502's dummy reads, so the bus cycles themselves are only compared with --bus.
+ * --official skips the unofficial opcodes, which the core runs as single cycle no-ops.
+ *
+ * The first few mismatches of each opcode are printed with every field that differed. The exit
+ * status is 1 if anything failed.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nes.h"
+#include "test_bus.h"
+
+const size_t READ_CHUNK = 1 << 20;
+const unsigned int DEFAULT_SHOW = 3u;
+
+struct CPUState {
+    uint16_t pc;
+    uint8_t s, a, x, y, p;
+    vector<std::pair<uint16_t, uint8_t>> ram;
+};
+
+struct TestCase {
+    string name;
+    CPUState initial;
+    CPUState final;
+    vector<BusAccess> cycles;
+};
+
+// Pull parser over a file read a chunk at a time, just enough JSON for the test vectors
+class JsonReader {
+    public:
+        JsonReader(const char* path) : file(std::fopen(path, "rb")), buffer(READ_CHUNK), pos(0), end(0), failed(!file) {}
+        ~JsonReader() { if (file) std::fclose(file); }
+        bool ok() const { return !failed; }
+
+        bool consume(char c) {
+            if (peek() != c)
+                return false;
+            pos++;
+            return true;
+        }
+        bool expect(char c) {
+            if (!consume(c))
+                failed = true;
+            return !failed;
+        }
+        // Walks an array or object: true while there's another element, eating the commas
+        bool more(char close) {
+            if (consume(close))
+                return false;
+            consume(',');
+            return !failed && peek() != 0;
+        }
+        bool text(std::string& out) {
+            out.clear();
+            if (!expect('"'))
+                return false;
+            for (int c = get(); c != '"'; c = get()) {
+                if (c < 0) {
+                    failed = true;
+                    return false;
+                }
+                if (c == '\\')
+                    c = get();
+                out.push_back((char) c);
+            }
+            return true;
+        }
+        bool number(long long& out) {
+            peek();
+            bool negative = consume('-');
+            out = 0;
+            int digits = 0;
+            for (int c = peekRaw(); c >= '0' && c <= '9'; c = peekRaw(), digits++) {
+                out = out * 10 + (c - '0');
+                pos++;
+            }
+            if (!digits)
+                failed = true;
+            if (negative)
+                out = -out;
+            return !failed;
+        }
+        bool skip() {
+            char c = peek();
+            std::string ignored;
+            long long n;
+            if (c == '"')
+                return text(ignored);
+            if (c == '[' || c == '{') {
+                char close = c == '[' ? ']' : '}';
+                pos++;
+                while (more(close)) {
+                    if (close == '}' && (!text(ignored) || !expect(':')))
+                        return false;
+                    if (!skip())
+                        return false;
+                }
+                return !failed;
+            }
+            if (c == '-' || (c >= '0' && c <= '9'))
+                return number(n);
+            // true, false, null
+            while (peekRaw() >= 'a' && peekRaw() <= 'z')
+                pos++;
+            return !failed;
+        }
+
+    private:
+        FILE* file;
+        vector<char> buffer;
+        size_t pos;
+        size_t end;
+        bool failed;
+
+        int peekRaw() {
+            if (pos == end) {
+                end = file ? std::fread(buffer.data(), 1, buffer.size(), file) : 0;
+                pos = 0;
+                if (end == 0)
+                    return -1;
+            }
+            return (unsigned char) buffer[pos];
+        }
+        int get() {
+            int c = peekRaw();
+            if (c >= 0)
+                pos++;
+            return c;
+        }
+        char peek() {
+            int c;
+            while ((c = peekRaw()) == ' ' || c == '\n' || c == '\r' || c == '\t')
+                pos++;
+            return c < 0 ? 0 : (char) c;
+        }
+};
+
+static bool readState(JsonReader& json, CPUState& state) {
+    std::string key;
+    long long value;
+    state.ram.clear();
+    json.expect('{');
+    while (json.more('}')) {
+        if (!json.text(key) || !json.expect(':'))
+            return false;
+        if (key == "ram") {
+            json.expect('[');
+            while (json.more(']')) {
+                long long addr;
+                json.expect('[');
+                json.number(addr);
+                json.expect(',');
+                json.number(value);
+                json.expect(']');
+                state.ram.push_back({ (uint16_t) addr, (uint8_t) value });
+            }
+            continue;
+        }
+        if (key != "pc" && key != "s" && key != "a" && key != "x" && key != "y" && key != "p") {
+            json.skip();
+            continue;
+        }
+        json.number(value);
+        if (key == "pc") state.pc = (uint16_t) value;
+        else if (key == "s") state.s = (uint8_t) value;
+        else if (key == "a") state.a = (uint8_t) value;
+        else if (key == "x") state.x = (uint8_t) value;
+        else if (key == "y") state.y = (uint8_t) value;
+        else state.p = (uint8_t) value;
+    }
+    return json.ok();
+}
+
+static bool readCase(JsonReader& json, TestCase& test) {
+    std::string key, kind;
+    test.cycles.clear();
+    json.expect('{');
+    while (json.more('}')) {
+        if (!json.text(key) || !json.expect(':'))
+            return false;
+        if (key == "name") {
+            json.text(test.name);
+        } else if (key == "initial") {
+            readState(json, test.initial);
+        } else if (key == "final") {
+            readState(json, test.final);
+        } else if (key == "cycles") {
+            json.expect('[');
+            while (json.more(']')) {
+                long long addr, value;
+                json.expect('[');
+                json.number(addr);
+                json.expect(',');
+                json.number(value);
+                json.expect(',');
+                json.text(kind);
+                json.expect(']');
+                test.cycles.push_back({ (uint16_t) addr, (uint8_t) value, kind == "write" });
+            }
+        } else {
+            json.skip();
+        }
+    }
+    return json.ok();
+}
+
+static std::string hex(unsigned int value, int digits) {
+    std::ostringstream out;
+    out << std::hex << std::setw(digits) << std::setfill('0') << value;
+    return out.str();
+}
+
+struct OpcodeResult {
+    bool found;
+    bool readable;
+    uint64_t cases;
+    uint64_t failed;
+    vector<std::string> reports;                        // First mismatches, one line each
+};
+
+// Smallest image an NES will load: NROM with one 16KB PRG bank and one 8KB CHR bank, all zero
+const size_t EMPTY_CART_SIZE = 16 + 16384 + 8192;
+
+static vector<uint8_t> emptyCart() {
+    vector<uint8_t> image(EMPTY_CART_SIZE, 0);
+    const uint8_t header[6] = { 'N', 'E', 'S', 0x1A, 1, 1 };
+    std::memcpy(image.data(), header, sizeof(header));
+    return image;
+}
+
+class ConformanceRunner {
+    public:
+        ConformanceRunner(bool compareBus, unsigned int show)
+                : nes(emptyCart().data(), EMPTY_CART_SIZE), cpu(*nes.cpu), compareBus(compareBus), show(show) {
+            for (unsigned int page = 0; page < 256; page++)
+                nes.trapPage(page, &bus);
+        }
+        void run(const std::filesystem::path& file, OpcodeResult& result);
+
+    private:
+        NES nes;
+        MOS6502& cpu;
+        TestBus bus;
+        bool compareBus;
+        unsigned int show;
+
+        std::string check(const TestCase& test, unsigned int cycles);   // Empty if it passed
+};
+
+void ConformanceRunner::run(const std::filesystem::path& file, OpcodeResult& result) {
+    JsonReader json(file.c_str());
+    TestCase test;
+    result.readable = json.ok() && json.expect('[');
+    while (result.readable && json.more(']')) {
+        if (!readCase(json, test)) {
+            result.readable = false;
+            break;
+        }
+
+        for (const auto& [addr, value] : test.initial.ram)
+            bus.poke(addr, value);
+        cpu.pc = test.initial.pc;
+        cpu.sp = test.initial.s;
+        cpu.a = test.initial.a;
+        cpu.x = test.initial.x;
+        cpu.y = test.initial.y;
+        cpu.p = test.initial.p;
+        cpu.cyclesRemaining = 0;
+        bus.clearLog();
+
+        // The whole instruction runs on its first cycle, the rest are counted down afterwards
+        cpu.cycle();
+        std::string mismatch = check(test, cpu.cyclesRemaining + 1);
+        result.cases++;
+        if (!mismatch.empty()) {
+            result.failed++;
+            if (result.reports.size() < show)
+                result.reports.push_back(test.name + ":" + mismatch);
+        }
+
+        // Only what this case touched needs clearing for the next
+        for (const auto& [addr, value] : test.initial.ram)
+            bus.poke(addr, 0);
+        for (const auto& [addr, value] : test.final.ram)
+            bus.poke(addr, 0);
+        for (size_t i = 0; i < std::min(bus.logSize(), (size_t) TEST_BUS_LOG_SIZE); i++)
+            bus.poke(bus.log()[i].addr, 0);
+    }
+}
+
+std::string ConformanceRunner::check(const TestCase& test, unsigned int cycles) {
+    std::ostringstream diff;
+    auto field = [&diff](const char* name, unsigned int expected, unsigned int actual, int digits) {
+        if (expected != actual)
+            diff << " " << name << " " << hex(actual, digits) << " want " << hex(expected, digits);
+    };
+    const CPUState& want = test.final;
+    field("pc", want.pc, cpu.pc, 4);
+    field("s", want.s, cpu.sp, 2);
+    field("a", want.a, cpu.a, 2);
+    field("x", want.x, cpu.x, 2);
+    field("y", want.y, cpu.y, 2);
+    field("p", want.p, cpu.p, 2);
+    for (const auto& [addr, value] : want.ram) {
+        if (bus.peek(addr) != value)
+            diff << " [" << hex(addr, 4) << "] " << hex(bus.peek(addr), 2) << " want " << hex(value, 2);
+    }
+    if (cycles != test.cycles.size())
+        diff << " cycles " << cycles << " want " << test.cycles.size();
+
+    if (compareBus) {
+        size_t count = std::min(bus.logSize(), (size_t) TEST_BUS_LOG_SIZE);
+        for (size_t i = 0; i < std::max(count, test.cycles.size()); i++) {
+            const BusAccess* got = i < count ? &bus.log()[i] : nullptr;
+            const BusAccess* expected = i < test.cycles.size() ? &test.cycles[i] : nullptr;
+            if (got && expected && got->addr == expected->addr && got->value == expected->value && got->write == expected->write)
+                continue;
+            diff << " bus " << i << ": ";
+            diff << (got ? (got->write ? "write " : "read ") + hex(got->addr, 4) + " " + hex(got->value, 2) : "nothing");
+            diff << " want ";
+            diff << (expected ? (expected->write ? "write " : "read ") + hex(expected->addr, 4) + " " + hex(expected->value, 2) : "nothing");
+            break;
+        }
+    }
+    return diff.str();
+}
+
+static std::filesystem::path vectorFile(const std::filesystem::path& dir, unsigned int opcode) {
+    std::filesystem::path lower = dir / (hex(opcode, 2) + ".json");
+    if (std::filesystem::exists(lower))
+        return lower;
+    std::string upper = hex(opcode, 2);
+    std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+    return dir / (upper + ".json");
+}
+
+int main(int argc, char* argv[]) {
+    const char* dir = nullptr;
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    bool officialOnly = false;
+    bool compareBus = false;
+    unsigned int show = DEFAULT_SHOW;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = std::max(1ul, std::stoul(argv[++i]));
+        } else if (std::strcmp(argv[i], "--official") == 0) {
+            officialOnly = true;
+        } else if (std::strcmp(argv[i], "--bus") == 0) {
+            compareBus = true;
+        } else if (std::strcmp(argv[i], "--show") == 0 && i + 1 < argc) {
+            show = std::stoul(argv[++i]);
+        } else if (argv[i][0] == '-' || dir) {
+            dir = nullptr;
+            break;
+        } else {
+            dir = argv[i];
+        }
+    }
+    if (!dir) {
+        std::cout << "Usage: cpu_conformance DIR [--threads N] [--official] [--bus] [--show N]" << std::endl;
+        return -1;
+    }
+
+    vector<unsigned int> opcodes;
+    for (unsigned int opcode = 0; opcode < 256; opcode++) {
+        if (!officialOnly || std::strcmp(MOS6502::mnemonic(opcode), "ILL") != 0)
+            opcodes.push_back(opcode);
+    }
+
+    // Each thread takes the next opcode's file until none are left
+    vector<OpcodeResult> results(256);
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        ConformanceRunner runner(compareBus, show);
+        for (size_t i = next++; i < opcodes.size(); i = next++) {
+            std::filesystem::path file = vectorFile(dir, opcodes[i]);
+            OpcodeResult& result = results[opcodes[i]];
+            result.found = std::filesystem::exists(file);
+            if (result.found)
+                runner.run(file, result);
+        }
+    };
+    auto start = std::chrono::steady_clock::now();
+    vector<std::thread> pool;
+    for (unsigned int t = 0; t < threads; t++)
+        pool.emplace_back(work);
+    for (std::thread& thread : pool)
+        thread.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t cases = 0, failed = 0;
+    unsigned int files = 0, failedOpcodes = 0, unreadable = 0;
+    for (unsigned int opcode : opcodes) {
+        const OpcodeResult& result = results[opcode];
+        if (!result.found)
+            continue;
+        files++;
+        cases += result.cases;
+        failed += result.failed;
+        if (!result.readable) {
+            unreadable++;
+            std::cout << hex(opcode, 2) << " " << MOS6502::mnemonic(opcode) << ": couldn't parse past case "
+                      << result.cases << std::endl;
+        }
+        if (result.failed) {
+            failedOpcodes++;
+            std::cout << hex(opcode, 2) << " " << MOS6502::mnemonic(opcode) << ": " << result.failed << " of "
+                      << result.cases << " failed" << std::endl;
+            for (const std::string& report : result.reports)
+                std::cout << "    " << report << std::endl;
+        }
+    }
+    if (!files) {
+        std::cout << "No test vectors (XX.json) in " << dir << std::endl;
+        return -1;
+    }
+    std::cout << cases << " cases from " << files << " opcodes in " << std::fixed << std::setprecision(2) << seconds
+              << "s on " << threads << " threads: " << failed << " failed in " << failedOpcodes << " opcodes" << std::endl;
+    return failed || unreadable ? 1 : 0;
+}
@@ -0,0 +1,326 @@
+/*
+ * Ahead-of-time translation of an NROM (mapper 0) cartridge's PRG ROM into C++ for
+ * NES::loadCompiled(), see recompiled.h for how the generated code runs.
+ *
+ * Code is found by following control flow from the reset, NMI and IRQ vectors: both ways out of
+ * a branch, into and back from a JSR, through absolute jumps and to the byte after a BRK where
+ * RTI resumes. JMP ($nnnn), RTS and RTI end a path since their targets are only known at run
+ * time; whatever they reach that wasn't found some other way is interpreted. Basic blocks start
+ * at every address control can arrive at by anything but falling through, and end after any
+ * instruction that changes pc. Each becomes a function with a case per instruction, so it can be
+ * entered wherever an interrupt returned or the previous block left off.
+ *
+ *   nes_recompile ROM OUT.cpp
+ *
+ * Build OUT.cpp as a shared object against the emulator's headers (nes_add_recompiled() in
+ * CMakeLists.txt does both steps) and give it to NESEmu with --native.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "cpu.h"
+#include "nes.h"
+#include "recompiled.h"
+
+class Recompiler {
+    public:
+        Recompiler(const vector<uint8_t>& prg);
+        void discover();                                // Follow control flow from the vectors
+        bool write(const char* path, const char* romName) const;
+        size_t instructions() const;
+        size_t blocks() const;
+        size_t unresolved() const;                      // Indirect jumps, returns and interrupts left to run time
+
+    private:
+        typedef uint8_t (MOS6502::*Mode)();
+
+        const vector<uint8_t>& prg;
+        vector<bool> decoded;                           // Instruction starts at $8000 + index
+        vector<bool> leader;                            // Block starts at $8000 + index
+        size_t decodedCount;
+        size_t unresolvedCount;
+
+        uint8_t byteAt(uint16_t addr) const { return prg[(addr - 0x8000) & (prg.size() - 1)]; }
+        uint16_t wordAt(uint16_t addr) const { return byteAt(addr) | (uint16_t) byteAt(addr + 1) << 8; }
+        static unsigned int length(Mode mode);
+        static bool official(uint8_t opcode);
+        static bool endsBlock(uint8_t opcode);
+        static string hex(unsigned int value, int digits);
+        void emitInstruction(std::ostream& out, uint16_t addr, bool first) const;
+};
+
+Recompiler::Recompiler(const vector<uint8_t>& prg) : prg(prg), decoded(RECOMPILED_WINDOW), leader(RECOMPILED_WINDOW) {
+    decodedCount = 0;
+    unresolvedCount = 0;
+}
+
+unsigned int Recompiler::length(Mode mode) {
+    if (mode == &MOS6502::IMP)
+        return 1;
+    if (mode == &MOS6502::ABS || mode == &MOS6502::ABX || mode == &MOS6502::ABY || mode == &MOS6502::IND)
+        return 3;
+    return 2;
+}
+
+bool Recompiler::official(uint8_t opcode) {
+    // 0xDA and 0xFA are unofficial NOPs the table spells out
+    return std::strcmp(MOS6502::oplist[opcode].name, "ILL") != 0 && opcode != 0xDA && opcode != 0xFA;
+}
+
+bool Recompiler::endsBlock(uint8_t opcode) {
+    const MOS6502::INSTRUCTION& inst = MOS6502::oplist[opcode];
+    return inst.addrmode == &MOS6502::REL || inst.execute == &MOS6502::JMP || inst.execute == &MOS6502::JSR
+        || inst.execute == &MOS6502::RTS || inst.execute == &MOS6502::RTI || inst.execute == &MOS6502::BRK;
+}
+
+void Recompiler::discover() {
+    vector<uint16_t> work;
+    for (uint16_t vector = 0xFFFA; vector != 0x0000; vector += 2) {
+        uint16_t target = wordAt(vector);
+        if (target >= 0x8000) {
+            work.push_back(target);
+            leader[target - 0x8000] = true;
+        }
+    }
+
+    auto follow = [&](uint16_t target) {
+        if (target < 0x8000)
+            return;
+        leader[target - 0x8000] = true;
+        work.push_back(target);
+    };
+
+    while (!work.empty()) {
+        uint16_t addr = work.back();
+        work.pop_back();
+        // Walk straight-line code until something leaves it
+        while (addr >= 0x8000 && !decoded[addr - 0x8000]) {
+            uint8_t opcode = byteAt(addr);
+            const MOS6502::INSTRUCTION& inst = MOS6502::oplist[opcode];
+            unsigned int size = length(inst.addrmode);
+            if (!official(opcode) || addr + size - 1 > 0xFFFF)
+                break;
+            decoded[addr - 0x8000] = true;
+            decodedCount++;
+            uint16_t next = addr + size;
+
+            if (inst.addrmode == &MOS6502::REL) {
+                follow(next + (uint16_t) (int8_t) byteAt(addr + 1));
+                follow(next);
+                break;
+            } else if (inst.execute == &MOS6502::JSR) {
+                follow(wordAt(addr + 1));
+                follow(next);
+                break;
+            } else if (inst.execute == &MOS6502::JMP) {
+                if (inst.addrmode == &MOS6502::ABS)
+                    follow(wordAt(addr + 1));
+                else
+                    unresolvedCount++;
+                break;
+            } else if (inst.execute == &MOS6502::BRK) {
+                follow(next);                           // RTI comes back past the padding byte
+                break;
+            } else if (inst.execute == &MOS6502::RTS || inst.execute == &MOS6502::RTI) {
+                unresolvedCount++;
+                break;
+            }
+            addr = next;
+        }
+    }
+}
+
+string Recompiler::hex(unsigned int value, int digits) {
+    std::ostringstream out;
+    out << "0x" << std::uppercase << std::hex << std::setw(digits) << std::setfill('0') << value;
+    return out.str();
+}
+
+void Recompiler::emitInstruction(std::ostream& out, uint16_t addr, bool first) const {
+    uint8_t opcode = byteAt(addr);
+    const MOS6502::INSTRUCTION& inst = MOS6502::oplist[opcode];
+    Mode mode = inst.addrmode;
+    uint16_t next = addr + length(mode);
+    uint8_t zp = byteAt(addr + 1);
+    uint16_t abs = wordAt(addr + 1);
+    string op = hex(opcode, 2);
+    string nextPC = hex(next, 4);
+    bool jump = inst.execute == &MOS6502::JMP || inst.execute == &MOS6502::JSR;
+    const char* indent = "        ";
+
+    // Everything but the first instruction has to leave I/O registers for when they're due, an
+    // address known to be I/O (or a pointer that could be) always waits
+    bool waits = mode == &MOS6502::IND || (mode == &MOS6502::ABS && !jump && Recompiled::io(abs));
+    string checkIO = string(indent) + "if (cycles && Recompiled::io(addr)) return cycles;\n";
+    // Each case runs on into the next, the block continues with the following instruction
+    if (!first)
+        out << indent << "[[fallthrough]];" << std::endl;
+    out << "    case " << hex(addr, 4) << ":    // " << inst.name << std::endl;
+    if (!first && waits)
+        out << indent << "if (cycles) return cycles;" << std::endl;
+    else if (!first)
+        out << indent << "if (cycles && !Recompiled::quiet(c, cycles)) return cycles;" << std::endl;
+
+    if (mode == &MOS6502::IMP) {
+        out << indent << "Recompiled::beginImplied(c, " << op << ", " << nextPC << ");" << std::endl;
+    } else if (mode == &MOS6502::IMM) {
+        out << indent << "Recompiled::begin(c, " << op << ", " << nextPC << ", " << hex(addr + 1, 4) << ", false);" << std::endl;
+    } else if (mode == &MOS6502::ZP0) {
+        out << indent << "Recompiled::begin(c, " << op << ", " << nextPC << ", " << hex(zp, 4) << ", false);" << std::endl;
+    } else if (mode == &MOS6502::ZPX || mode == &MOS6502::ZPY) {
+        const char* index = mode == &MOS6502::ZPX ? "x" : "y";
+        out << indent << "{ uint16_t addr = (" << hex(zp, 2) << " + Recompiled::" << index << "(c)) & 0xFF;" << std::endl
+            << indent << "  Recompiled::begin(c, " << op << ", " << nextPC << ", addr, false); }" << std::endl;
+    } else if (mode == &MOS6502::REL) {
+        uint16_t rel = (uint16_t) (int8_t) zp;
+        uint16_t target = next + rel;
+        bool crossed = (target & 0xFF00) != (next & 0xFF00);
+        out << indent << "Recompiled::beginRelative(c, " << op << ", " << nextPC << ", " << hex(rel, 4) << ", "
+            << hex(target, 4) << ", " << (crossed ? "true" : "false") << ");" << std::endl;
+    } else if (mode == &MOS6502::ABS) {
+        out << indent << "Recompiled::begin(c, " << op << ", " << nextPC << ", " << hex(abs, 4) << ", false);" << std::endl;
+    } else if (mode == &MOS6502::ABX || mode == &MOS6502::ABY) {
+        const char* index = mode == &MOS6502::ABX ? "x" : "y";
+        out << indent << "{ uint16_t addr = " << hex(abs, 4) << " + Recompiled::" << index << "(c);" << std::endl;
+        // Only check at run time when the indexed range reaches I/O
+        bool reachesIO = false;
+        for (unsigned int i = 0; i < 256; i++)
+            reachesIO = reachesIO || Recompiled::io((uint16_t) (abs + i));
+        if (!first && reachesIO)
+            out << "  " << checkIO;
+        out << indent << "  Recompiled::begin(c, " << op << ", " << nextPC << ", addr, (addr & 0xFF00) != "
+            << hex(abs & 0xFF00, 4) << "); }" << std::endl;
+    } else if (mode == &MOS6502::IND) {
+        uint16_t pointerHi = (abs & 0xFF) == 0xFF ? abs & 0xFF00 : abs + 1;
+        out << indent << "Recompiled::begin(c, " << op << ", " << nextPC << ", Recompiled::read(c, " << hex(pointerHi, 4)
+            << ") << 8 | Recompiled::read(c, " << hex(abs, 4) << "), false);" << std::endl;
+    } else if (mode == &MOS6502::IZX) {
+        out << indent << "{ uint8_t t = " << hex(zp, 2) << " + Recompiled::x(c);" << std::endl
+            << indent << "  uint16_t addr = Recompiled::read(c, (uint8_t) (t + 1)) << 8 | Recompiled::read(c, t);" << std::endl;
+        if (!first)
+            out << "  " << checkIO;
+        out << indent << "  Recompiled::begin(c, " << op << ", " << nextPC << ", addr, false); }" << std::endl;
+    } else if (mode == &MOS6502::IZY) {
+        out << indent << "{ uint16_t base = Recompiled::read(c, " << hex((uint8_t) (zp + 1), 2) << ") << 8 | Recompiled::read(c, "
+            << hex(zp, 2) << ");" << std::endl
+            << indent << "  uint16_t addr = base + Recompiled::y(c);" << std::endl;
+        if (!first)
+            out << "  " << checkIO;
+        out << indent << "  Recompiled::begin(c, " << op << ", " << nextPC << ", addr, (addr & 0xFF00) != (base & 0xFF00)); }" << std::endl;
+    }
+
+    out << indent << "cycles += " << (int) inst.cycles << " + Recompiled::" << inst.name << "(c);" << std::endl;
+    if (endsBlock(opcode))
+        out << indent << "return cycles;" << std::endl;
+}
+
+bool Recompiler::write(const char* path, const char* romName) const {
+    std::ofstream out(path);
+    if (!out.is_open())
+        return false;
+
+    out << "// Generated by nes_recompile from " << romName << ", don't edit" << std::endl << std::endl
+        << "#include \"recompiled.h\"" << std::endl << std::endl;
+
+    vector<uint16_t> entries;
+    vector<uint16_t> entryBlocks;
+    for (unsigned int start = 0; start < RECOMPILED_WINDOW; start++) {
+        if (!leader[start] || !decoded[start])
+            continue;
+        uint16_t block = 0x8000 + start;
+        out << "static unsigned int block" << hex(block, 4).substr(2) << "(MOS6502* c) {" << std::endl
+            << "    unsigned int cycles = 0;" << std::endl
+            << "    switch (Recompiled::pc(c)) {" << std::endl;
+
+        uint16_t addr = block;
+        bool first = true;
+        while (true) {
+            emitInstruction(out, addr, first);
+            entries.push_back(addr);
+            entryBlocks.push_back(block);
+            uint8_t opcode = byteAt(addr);
+            uint16_t next = addr + length(MOS6502::oplist[opcode].addrmode);
+            first = false;
+            if (endsBlock(opcode) || next < 0x8000 || !decoded[next - 0x8000] || leader[next - 0x8000])
+                break;
+            addr = next;
+        }
+        out << "    }" << std::endl << "    return cycles;" << std::endl << "}" << std::endl << std::endl;
+    }
+
+    out << "extern \"C\" const CompiledProgram* " << RECOMPILED_ENTRY_POINT << "() {" << std::endl
+        << "    static CompiledBlock entries[RECOMPILED_WINDOW];" << std::endl
+        << "    static CompiledProgram program = { RECOMPILED_ABI, sizeof(MOS6502), " << prg.size() << "u, "
+        << hex(prgChecksum(prg.data(), prg.size()), 8) << "u, entries };" << std::endl
+        << "    if (!entries[" << hex(entries[0] - 0x8000, 4) << "]) {" << std::endl;
+    for (size_t i = 0; i < entries.size(); i++) {
+        out << "        entries[" << hex(entries[i] - 0x8000, 4) << "] = block" << hex(entryBlocks[i], 4).substr(2)
+            << ";" << std::endl;
+    }
+    out << "    }" << std::endl << "    return &program;" << std::endl << "}" << std::endl;
+    return out.good();
+}
+
+size_t Recompiler::instructions() const {
+    return decodedCount;
+}
+
+size_t Recompiler::blocks() const {
+    size_t count = 0;
+    for (unsigned int i = 0; i < RECOMPILED_WINDOW; i++)
+        count += leader[i] && decoded[i];
+    return count;
+}
+
+size_t Recompiler::unresolved() const {
+    return unresolvedCount;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cout << "Usage: nes_recompile ROM OUT.cpp" << std::endl;
+        return -1;
+    }
+
+    std::ifstream romFile(argv[1], std::ifstream::binary);
+    if (!romFile.is_open()) {
+        std::cerr << "Couldn't open ROM " << argv[1] << std::endl;
+        return -1;
+    }
+    vector<uint8_t> rom((std::istreambuf_iterator<char>(romFile)), std::istreambuf_iterator<char>());
+    ROMHeader header;
+    if (rom.size() < HEADER_SIZE || std::memcmp(rom.data(), "NES\x1A", 4) != 0) {
+        std::cerr << "Not an iNES ROM" << std::endl;
+        return -1;
+    }
+    std::memcpy(&header, rom.data(), HEADER_SIZE);
+    size_t offset = HEADER_SIZE + ((header.flags6 & 0x4) ? TRAINER_SIZE : 0);
+    size_t prgSize = header.prgSize * 16384;
+    uint8_t mapper = (header.flags7 & 0xF0) | (header.flags6 >> 4);
+    if (mapper != 0 || (prgSize != 16384 && prgSize != 32768) || rom.size() < offset + prgSize) {
+        std::cerr << "Only complete NROM carts can be recompiled (mapper " << (int) mapper << ")" << std::endl;
+        return -1;
+    }
+    vector<uint8_t> prg(rom.begin() + offset, rom.begin() + offset + prgSize);
+
+    Recompiler recompiler(prg);
+    recompiler.discover();
+    if (recompiler.instructions() == 0) {
+        std::cerr << "No code found from the vectors" << std::endl;
+        return -1;
+    }
+    if (!recompiler.write(argv[2], argv[1])) {
+        std::cerr << "Couldn't write " << argv[2] << std::endl;
+        return -1;
+    }
+    std::cout << recompiler.instructions() << " instructions in " << recompiler.blocks() << " blocks, "
+              << recompiler.unresolved() << " indirect exits left to run time" << std::endl;
+    return 0;
+}